@@ -1552,6 +1552,7 @@ static BOOL set_privileges(LPCSTR privilege, BOOL set)
 static void test_reg_save_key(void)
 {
     DWORD ret;
+    HKEY subkey;
 
     if (!set_privileges(SE_BACKUP_NAME, TRUE) ||
         !set_privileges(SE_RESTORE_NAME, FALSE))
@@ -1560,6 +1561,16 @@ static void test_reg_save_key(void)
         return;
     }
 
+    /* a key name starting with a dash must not be taken for a deleted key */
+    ret = RegCreateKeyA(hkey_main, "-foo", &subkey);
+    ok(ret == ERROR_SUCCESS, "expected ERROR_SUCCESS, got %d\n", ret);
+    RegCloseKey(subkey);
+    ret = RegCreateKeyA(hkey_main, "deleted", &subkey);
+    ok(ret == ERROR_SUCCESS, "expected ERROR_SUCCESS, got %d\n", ret);
+    RegCloseKey(subkey);
+    ret = RegDeleteKeyA(hkey_main, "deleted");
+    ok(ret == ERROR_SUCCESS, "expected ERROR_SUCCESS, got %d\n", ret);
+
     ret = RegSaveKeyA(hkey_main, "saved_key", NULL);
     ok(ret == ERROR_SUCCESS, "expected ERROR_SUCCESS, got %d\n", ret);
 
@@ -1587,6 +1598,13 @@ static void test_reg_load_key(void)
     ok(ret == ERROR_SUCCESS, "expected ERROR_SUCCESS, got %d\n", ret);
 
     RegCloseKey(hkHandle);
+
+    ret = RegOpenKeyA(HKEY_LOCAL_MACHINE, "Test\\-foo", &hkHandle);
+    ok(ret == ERROR_SUCCESS, "expected ERROR_SUCCESS, got %d\n", ret);
+    RegCloseKey(hkHandle);
+
+    ret = RegOpenKeyA(HKEY_LOCAL_MACHINE, "Test\\deleted", &hkHandle);
+    ok(ret == ERROR_FILE_NOT_FOUND, "expected ERROR_FILE_NOT_FOUND, got %d\n", ret);
 }
 
 static void test_reg_unload_key(void)
@@ -3440,6 +3458,65 @@ static void test_delete_key_value(void)
     RegCloseKey(subkey);
 }
 
+#define MANY_SUBKEYS 5000
+
+static void test_many_subkeys(void)
+{
+    char name[32], buffer[32];
+    HKEY key, subkey;
+    DWORD start, size;
+    unsigned int i;
+    LONG ret;
+
+    ret = RegCreateKeyA(hkey_main, "ManySubkeys", &key);
+    ok(ret == ERROR_SUCCESS, "RegCreateKey failed %d\n", ret);
+
+    /* create them out of order so that every insertion doesn't land at the end */
+    start = GetTickCount();
+    for (i = 0; i < MANY_SUBKEYS; i++)
+    {
+        sprintf(name, "Key%05u", (i * 7919) % MANY_SUBKEYS);
+        ret = RegCreateKeyA(key, name, &subkey);
+        ok(ret == ERROR_SUCCESS, "RegCreateKey %s failed %d\n", name, ret);
+        RegCloseKey(subkey);
+    }
+    trace("%u creates: %u ms\n", MANY_SUBKEYS, GetTickCount() - start);
+
+    start = GetTickCount();
+    for (i = 0; i < MANY_SUBKEYS; i++)
+    {
+        sprintf(name, "kEY%05u", i);
+        ret = RegOpenKeyA(key, name, &subkey);
+        ok(ret == ERROR_SUCCESS, "RegOpenKey %s failed %d\n", name, ret);
+        RegCloseKey(subkey);
+        sprintf(name, "Key%05u_", i);
+        ret = RegOpenKeyA(key, name, &subkey);
+        ok(ret == ERROR_FILE_NOT_FOUND, "RegOpenKey %s returned %d\n", name, ret);
+    }
+    trace("%u opens: %u ms\n", 2 * MANY_SUBKEYS, GetTickCount() - start);
+
+    for (i = 0; i < MANY_SUBKEYS; i += 997)
+    {
+        size = sizeof(buffer);
+        ret = RegEnumKeyExA(key, i, buffer, &size, NULL, NULL, NULL, NULL);
+        ok(ret == ERROR_SUCCESS, "RegEnumKeyEx %u failed %d\n", i, ret);
+        sprintf(name, "Key%05u", i);
+        ok(!strcmp(buffer, name), "%u: got %s\n", i, buffer);
+    }
+
+    start = GetTickCount();
+    for (i = 0; i < MANY_SUBKEYS; i++)
+    {
+        sprintf(name, "Key%05u", (i * 7919) % MANY_SUBKEYS);
+        ret = RegDeleteKeyA(key, name);
+        ok(ret == ERROR_SUCCESS, "RegDeleteKey %s failed %d\n", name, ret);
+    }
+    trace("%u deletes: %u ms\n", MANY_SUBKEYS, GetTickCount() - start);
+
+    RegDeleteKeyA(key, "");
+    RegCloseKey(key);
+}
+
 static void test_RegOpenCurrentUser(void)
 {
     HKEY key;
@@ -3512,6 +3589,7 @@ START_TEST(registry)
     test_deleted_key();
     test_delete_value();
     test_delete_key_value();
+    test_many_subkeys();
     test_RegOpenCurrentUser();
     test_RegNotifyChangeKeyValue();
 
@@ -552,19 +552,127 @@ static void copy_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src,
     }
 }
 
+/* rectangles with fewer pixels than this are not worth splitting between threads */
+#define BAND_MIN_PIXELS  (256 * 256)
+#define BAND_MIN_HEIGHT  32
+#define BAND_MAX_COUNT   8
+
+struct band_job
+{
+    void  (*func)( const RECT *rect, void *context );
+    void   *context;
+    RECT    rect;       /* whole rectangle */
+    int     count;      /* number of bands */
+    LONG    next;       /* next band to process */
+};
+
+static void process_bands( struct band_job *job )
+{
+    int height = job->rect.bottom - job->rect.top;
+    RECT rect = job->rect;
+    LONG band;
+
+    while ((band = InterlockedIncrement( &job->next ) - 1) < job->count)
+    {
+        rect.top    = job->rect.top + height * band / job->count;
+        rect.bottom = job->rect.top + height * (band + 1) / job->count;
+        job->func( &rect, job->context );
+    }
+}
+
+static void CALLBACK band_callback( TP_CALLBACK_INSTANCE *instance, void *context, TP_WORK *work )
+{
+    process_bands( context );
+}
+
+static int get_max_bands(void)
+{
+    static int max_bands;
+
+    if (!max_bands)
+    {
+        SYSTEM_INFO info;
+
+        GetSystemInfo( &info );
+        max_bands = max( 1, min( info.dwNumberOfProcessors, BAND_MAX_COUNT ));
+    }
+    return max_bands;
+}
+
+/***********************************************************************
+ *           run_in_bands
+ *
+ * Call func on the rectangle, split in horizontal bands processed in parallel by the
+ * thread pool when it is large enough.  The bands don't overlap, so func must only
+ * touch the pixels of the rows it is given.  The calling thread processes bands too
+ * and only returns once all of them are done.
+ */
+void run_in_bands( const RECT *rect, void (*func)( const RECT *rect, void *context ), void *context )
+{
+    struct band_job job;
+    TP_WORK *work;
+    int i, width = rect->right - rect->left, height = rect->bottom - rect->top;
+
+    job.count = min( get_max_bands(), height / BAND_MIN_HEIGHT );
+    if (job.count <= 1 || width * height < BAND_MIN_PIXELS ||
+        !(work = CreateThreadpoolWork( band_callback, &job, NULL )))
+    {
+        func( rect, context );
+        return;
+    }
+
+    job.func    = func;
+    job.context = context;
+    job.rect    = *rect;
+    job.next    = 0;
+
+    for (i = 1; i < job.count; i++) SubmitThreadpoolWork( work );
+
+    /* bands that no worker picked up yet are processed here, the callbacks */
+    /* that didn't start by then have nothing left to do and are cancelled */
+    process_bands( &job );
+    WaitForThreadpoolWorkCallbacks( work, TRUE );
+    CloseThreadpoolWork( work );
+}
+
+struct blend_band
+{
+    dib_info            *dst;
+    const RECT          *dst_rect;
+    const dib_info      *src;
+    const RECT          *src_rect;
+    BLENDFUNCTION        blend;
+};
+
+static void blend_band( const RECT *rect, void *context )
+{
+    const struct blend_band *band = context;
+    POINT origin;
+
+    origin.x = band->src_rect->left + rect->left - band->dst_rect->left;
+    origin.y = band->src_rect->top  + rect->top  - band->dst_rect->top;
+    band->dst->funcs->blend_rect( band->dst, rect, band->src, &origin, band->blend );
+}
+
 static DWORD blend_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src, const RECT *src_rect,
                          HRGN clip, BLENDFUNCTION blend )
 {
-    POINT origin;
+    struct blend_band band;
     struct clipped_rects clipped_rects;
-    int i;
+    int i, overlap;
 
     if (!get_clipped_rects( dst, dst_rect, clip, &clipped_rects )) return ERROR_SUCCESS;
+    band.dst      = dst;
+    band.dst_rect = dst_rect;
+    band.src      = src;
+    band.src_rect = src_rect;
+    band.blend    = blend;
+    /* a band could read source rows that another band already blended */
+    overlap = get_overlap( dst, dst_rect, src, src_rect );
     for (i = 0; i < clipped_rects.count; i++)
     {
-        origin.x = src_rect->left + clipped_rects.rects[i].left - dst_rect->left;
-        origin.y = src_rect->top  + clipped_rects.rects[i].top  - dst_rect->top;
-        dst->funcs->blend_rect( dst, &clipped_rects.rects[i], src, &origin, blend );
+        if (overlap) blend_band( &clipped_rects.rects[i], &band );
+        else run_in_bands( &clipped_rects.rects[i], blend_band, &band );
     }
     free_clipped_rects( &clipped_rects );
     return ERROR_SUCCESS;
@@ -649,19 +757,36 @@ static void get_gradient_triangle_vertices( const GRADIENT_TRIANGLE *tri, const
     bounds->bottom = v[2].y;
 }
 
+struct gradient_band
+{
+    dib_info        *dib;
+    const TRIVERTEX *v;
+    int              mode;
+    BOOL             ret;
+};
+
+static void gradient_band( const RECT *rect, void *context )
+{
+    struct gradient_band *band = context;
+
+    if (!band->dib->funcs->gradient_rect( band->dib, rect, band->v, band->mode )) band->ret = FALSE;
+}
+
 static BOOL gradient_rect( dib_info *dib, TRIVERTEX *v, int mode, HRGN clip, const RECT *bounds )
 {
     int i;
     struct clipped_rects clipped_rects;
-    BOOL ret = TRUE;
+    struct gradient_band band;
 
     if (!get_clipped_rects( dib, bounds, clip, &clipped_rects )) return TRUE;
-    for (i = 0; i < clipped_rects.count; i++)
-    {
-        if (!(ret = dib->funcs->gradient_rect( dib, &clipped_rects.rects[i], v, mode ))) break;
-    }
+    band.dib  = dib;
+    band.v    = v;
+    band.mode = mode;
+    band.ret  = TRUE;
+    for (i = 0; i < clipped_rects.count && band.ret; i++)
+        run_in_bands( &clipped_rects.rects[i], gradient_band, &band );
     free_clipped_rects( &clipped_rects );
-    return ret;
+    return band.ret;
 }
 
 static DWORD copy_src_bits( dib_info *src, RECT *src_rect )
@@ -1751,6 +1751,19 @@ COLORREF dibdrv_SetDCPenColor( PHYSDEV dev, COLORREF color )
     return color;
 }
 
+struct solid_band
+{
+    dib_info *dib;
+    rop_mask  color;
+};
+
+static void solid_band( const RECT *rect, void *context )
+{
+    const struct solid_band *band = context;
+
+    band->dib->funcs->solid_rects( band->dib, 1, rect, band->color.and, band->color.xor );
+}
+
 /**********************************************************************
  *             solid_brush
  *
@@ -1759,11 +1772,13 @@ COLORREF dibdrv_SetDCPenColor( PHYSDEV dev, COLORREF color )
 static BOOL solid_brush(dibdrv_physdev *pdev, dib_brush *brush, dib_info *dib,
                         int num, const RECT *rects, INT rop)
 {
-    rop_mask brush_color;
+    struct solid_band band;
     DWORD color = get_pixel_color( pdev->dev.hdc, &pdev->dib, brush->colorref, TRUE );
+    int i;
 
-    calc_rop_masks( rop, color, &brush_color );
-    dib->funcs->solid_rects( dib, num, rects, brush_color.and, brush_color.xor );
+    band.dib = dib;
+    calc_rop_masks( rop, color, &band.color );
+    for (i = 0; i < num; i++) run_in_bands( &rects[i], solid_band, &band );
     return TRUE;
 }
 
@@ -1983,6 +1998,20 @@ static BOOL select_pattern_brush( dibdrv_physdev *pdev, dib_brush *brush, BOOL *
     return TRUE;
 }
 
+struct pattern_band
+{
+    dib_info         *dib;
+    const POINT      *origin;
+    const dib_brush  *brush;
+};
+
+static void pattern_band( const RECT *rect, void *context )
+{
+    const struct pattern_band *band = context;
+
+    band->dib->funcs->pattern_rects( band->dib, 1, rect, band->origin, &band->brush->dib, &band->brush->masks );
+}
+
 /**********************************************************************
  *             pattern_brush
  *
@@ -1992,8 +2021,10 @@ static BOOL select_pattern_brush( dibdrv_physdev *pdev, dib_brush *brush, BOOL *
 static BOOL pattern_brush(dibdrv_physdev *pdev, dib_brush *brush, dib_info *dib,
                           int num, const RECT *rects, INT rop)
 {
+    struct pattern_band band;
     POINT origin;
     BOOL needs_reselect = FALSE;
+    int i;
 
     if (rop != brush->rop)
     {
@@ -2030,7 +2061,10 @@ static BOOL pattern_brush(dibdrv_physdev *pdev, dib_brush *brush, dib_info *dib,
 
     GetBrushOrgEx(pdev->dev.hdc, &origin);
 
-    dib->funcs->pattern_rects( dib, num, rects, &origin, &brush->dib, &brush->masks );
+    band.dib    = dib;
+    band.origin = &origin;
+    band.brush  = brush;
+    for (i = 0; i < num; i++) run_in_bands( &rects[i], pattern_band, &band );
 
     if (needs_reselect) free_pattern_brush( brush );
     return TRUE;
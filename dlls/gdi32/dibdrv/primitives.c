@@ -19,14 +19,36 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
 
 #include "gdi_private.h"
 #include "dibdrv.h"
 
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#define HAVE_SSE2_PRIMITIVES
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#endif
+
 #include "wine/debug.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(dib);
 
+/* SIMD versions of some primitives, filled by init_dib_primitives() according to
+ * the CPU features; a NULL entry means the plain C code is used */
+static struct
+{
+    void (*blend_rect_8888)( const dib_info *dst, const RECT *rc, const dib_info *src,
+                             const POINT *origin, BLENDFUNCTION blend );
+    void (*convert_row_888_to_8888)( DWORD *dst, const BYTE *src, int width );
+    void (*draw_glyph_row_8888)( DWORD *dst, const BYTE *glyph, int width, DWORD text_pixel,
+                                 const struct intensity_range *ranges );
+} simd_funcs;
+
 /* Bayer matrices for dithering */
 
 static const BYTE bayer_4x4[4][4] =
@@ -1801,6 +1823,24 @@ static inline BOOL bit_fields_match(const dib_info *d1, const dib_info *d2)
            d1->blue_mask  == d2->blue_mask;
 }
 
+#ifdef HAVE_SSE2_PRIMITIVES
+
+/* convert a row of 24-bpp pixels to 32-bpp with one byte shuffle for every 4 pixels */
+static SSSE3_TARGET void convert_row_888_to_8888_ssse3( DWORD *dst, const BYTE *src, int width )
+{
+    const __m128i shuffle = _mm_setr_epi8( 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 );
+    int x;
+
+    /* each load reads 16 bytes, stop early enough to stay inside the row */
+    for (x = 0; x + 6 <= width; x += 4)
+        _mm_storeu_si128( (__m128i *)(dst + x),
+                          _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(src + 3 * x) ), shuffle ));
+
+    for ( ; x < width; x++) dst[x] = src[3 * x] | (src[3 * x + 1] << 8) | (src[3 * x + 2] << 16);
+}
+
+#endif  /* HAVE_SSE2_PRIMITIVES */
+
 static void convert_to_8888(dib_info *dst, const dib_info *src, const RECT *src_rect, BOOL dither)
 {
     DWORD *dst_start = get_pixel_ptr_32(dst, 0, 0), *dst_pixel, src_val;
@@ -1873,7 +1913,12 @@ static void convert_to_8888(dib_info *dst, const dib_info *src, const RECT *src_
         {
             dst_pixel = dst_start;
             src_pixel = src_start;
-            for(x = src_rect->left; x < src_rect->right; x++)
+            if (simd_funcs.convert_row_888_to_8888)
+            {
+                simd_funcs.convert_row_888_to_8888(dst_pixel, src_pixel, src_rect->right - src_rect->left);
+                dst_pixel += src_rect->right - src_rect->left;
+            }
+            else for(x = src_rect->left; x < src_rect->right; x++)
             {
                 RGBQUAD rgb;
                 rgb.rgbBlue  = *src_pixel++;
@@ -4182,6 +4227,86 @@ static inline DWORD blend_rgb( BYTE dst_r, BYTE dst_g, BYTE dst_b, DWORD src, BL
             blend_color( dst_r, src >> 16, blend.SourceConstantAlpha ) << 16);
 }
 
+#ifdef HAVE_SSE2_PRIMITIVES
+
+/* (x + 127) / 255 on each 16-bit lane, exact for x <= 255 * 255 */
+static inline SSE2_TARGET __m128i div255_sse2( __m128i x )
+{
+    x = _mm_add_epi16( x, _mm_set1_epi16( 127 ) );
+    return _mm_srli_epi16( _mm_add_epi16( _mm_add_epi16( x, _mm_set1_epi16( 1 ) ), _mm_srli_epi16( x, 8 ) ), 8 );
+}
+
+/* same as blend_argb() on two pixels unpacked to 16-bit lanes */
+static inline SSE2_TARGET __m128i blend_argb_sse2( __m128i dst, __m128i src )
+{
+    __m128i alpha = _mm_shufflehi_epi16( _mm_shufflelo_epi16( src, 0xff ), 0xff );
+    __m128i inv_alpha = _mm_sub_epi16( _mm_set1_epi16( 255 ), alpha );
+    return _mm_add_epi16( src, div255_sse2( _mm_mullo_epi16( dst, inv_alpha ) ) );
+}
+
+/* pack 16-bit lanes back to pixels; channels above 255 overflow into the next one, like in blend_argb() */
+static inline SSE2_TARGET __m128i pack_argb_sse2( __m128i lo, __m128i hi )
+{
+    const __m128i mask = _mm_set1_epi16( 0xff );
+    __m128i low = _mm_packus_epi16( _mm_and_si128( lo, mask ), _mm_and_si128( hi, mask ) );
+    __m128i carry = _mm_packus_epi16( _mm_srli_epi16( lo, 8 ), _mm_srli_epi16( hi, 8 ) );
+    return _mm_or_si128( low, _mm_slli_epi32( carry, 8 ) );
+}
+
+/* SSE2 version of blend_rect_8888, giving the exact same results */
+static SSE2_TARGET void blend_rect_8888_sse2( const dib_info *dst, const RECT *rc,
+                                              const dib_info *src, const POINT *origin, BLENDFUNCTION blend )
+{
+    DWORD *src_ptr = get_pixel_ptr_32( src, origin->x, origin->y );
+    DWORD *dst_ptr = get_pixel_ptr_32( dst, rc->left, rc->top );
+    DWORD src_mask = ((blend.AlphaFormat & AC_SRC_ALPHA) || src->compression == BI_RGB) ? 0 : 0xff000000;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi16( blend.SourceConstantAlpha );
+    const __m128i inv_alpha = _mm_set1_epi16( 255 - blend.SourceConstantAlpha );
+    const __m128i mask = _mm_set1_epi32( src_mask );
+    int x, y, width = rc->right - rc->left;
+
+    for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
+    {
+        for (x = 0; x + 4 <= width; x += 4)
+        {
+            __m128i s = _mm_or_si128( _mm_loadu_si128( (const __m128i *)(src_ptr + x) ), mask );
+            __m128i d = _mm_loadu_si128( (const __m128i *)(dst_ptr + x) );
+            __m128i s_lo = _mm_unpacklo_epi8( s, zero ), s_hi = _mm_unpackhi_epi8( s, zero );
+            __m128i d_lo = _mm_unpacklo_epi8( d, zero ), d_hi = _mm_unpackhi_epi8( d, zero );
+
+            if (blend.AlphaFormat & AC_SRC_ALPHA)
+            {
+                if (blend.SourceConstantAlpha != 255)
+                {
+                    s_lo = div255_sse2( _mm_mullo_epi16( s_lo, alpha ) );
+                    s_hi = div255_sse2( _mm_mullo_epi16( s_hi, alpha ) );
+                }
+                d = pack_argb_sse2( blend_argb_sse2( d_lo, s_lo ), blend_argb_sse2( d_hi, s_hi ) );
+            }
+            else
+            {
+                d_lo = div255_sse2( _mm_add_epi16( _mm_mullo_epi16( s_lo, alpha ), _mm_mullo_epi16( d_lo, inv_alpha ) ) );
+                d_hi = div255_sse2( _mm_add_epi16( _mm_mullo_epi16( s_hi, alpha ), _mm_mullo_epi16( d_hi, inv_alpha ) ) );
+                d = _mm_packus_epi16( d_lo, d_hi );
+            }
+            _mm_storeu_si128( (__m128i *)(dst_ptr + x), d );
+        }
+
+        for ( ; x < width; x++)
+        {
+            if (!(blend.AlphaFormat & AC_SRC_ALPHA))
+                dst_ptr[x] = blend_argb_constant_alpha( dst_ptr[x], src_ptr[x] | src_mask, blend.SourceConstantAlpha );
+            else if (blend.SourceConstantAlpha == 255)
+                dst_ptr[x] = blend_argb( dst_ptr[x], src_ptr[x] );
+            else
+                dst_ptr[x] = blend_argb_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
+        }
+    }
+}
+
+#endif  /* HAVE_SSE2_PRIMITIVES */
+
 static void blend_rect_8888(const dib_info *dst, const RECT *rc,
                             const dib_info *src, const POINT *origin, BLENDFUNCTION blend)
 {
@@ -4189,6 +4314,12 @@ static void blend_rect_8888(const dib_info *dst, const RECT *rc,
     DWORD *dst_ptr = get_pixel_ptr_32( dst, rc->left, rc->top );
     int x, y;
 
+    if (simd_funcs.blend_rect_8888)
+    {
+        simd_funcs.blend_rect_8888( dst, rc, src, origin, blend );
+        return;
+    }
+
     if (blend.AlphaFormat & AC_SRC_ALPHA)
     {
 	if (blend.SourceConstantAlpha == 255)
@@ -4941,21 +5072,66 @@ static inline DWORD aa_rgb( BYTE r_dst, BYTE g_dst, BYTE b_dst, DWORD text, cons
             aa_color( r_dst, text >> 16, range->r_min, range->r_max ) << 16);
 }
 
+static void draw_glyph_row_8888( DWORD *dst_ptr, const BYTE *glyph_ptr, int width, DWORD text_pixel,
+                                 const struct intensity_range *ranges )
+{
+    int x;
+
+    for (x = 0; x < width; x++)
+    {
+        if (glyph_ptr[x] <= 1) continue;
+        if (glyph_ptr[x] >= 16) { dst_ptr[x] = text_pixel; continue; }
+        dst_ptr[x] = aa_rgb( dst_ptr[x] >> 16, dst_ptr[x] >> 8, dst_ptr[x], text_pixel, ranges + glyph_ptr[x] );
+    }
+}
+
+#ifdef HAVE_SSE2_PRIMITIVES
+
+/* SSE2 version of draw_glyph_row_8888, skipping or filling 16 pixels at a time
+ * when they are all transparent or all opaque, which is the case for most of a glyph */
+static SSE2_TARGET void draw_glyph_row_8888_sse2( DWORD *dst_ptr, const BYTE *glyph_ptr, int width,
+                                                  DWORD text_pixel, const struct intensity_range *ranges )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8( 1 );
+    const __m128i sixteen = _mm_set1_epi8( 16 );
+    const __m128i text = _mm_set1_epi32( text_pixel );
+    int x;
+
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        __m128i g = _mm_loadu_si128( (const __m128i *)(glyph_ptr + x) );
+
+        /* unsigned comparisons, glyph_ptr[x] <= 1 and glyph_ptr[x] >= 16 */
+        if (_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_subs_epu8( g, one ), zero )) == 0xffff) continue;
+        if (_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_max_epu8( g, sixteen ), g )) == 0xffff)
+        {
+            _mm_storeu_si128( (__m128i *)(dst_ptr + x), text );
+            _mm_storeu_si128( (__m128i *)(dst_ptr + x + 4), text );
+            _mm_storeu_si128( (__m128i *)(dst_ptr + x + 8), text );
+            _mm_storeu_si128( (__m128i *)(dst_ptr + x + 12), text );
+            continue;
+        }
+        draw_glyph_row_8888( dst_ptr + x, glyph_ptr + x, 16, text_pixel, ranges );
+    }
+    draw_glyph_row_8888( dst_ptr + x, glyph_ptr + x, width - x, text_pixel, ranges );
+}
+
+#endif  /* HAVE_SSE2_PRIMITIVES */
+
 static void draw_glyph_8888( const dib_info *dib, const RECT *rect, const dib_info *glyph,
                              const POINT *origin, DWORD text_pixel, const struct intensity_range *ranges )
 {
     DWORD *dst_ptr = get_pixel_ptr_32( dib, rect->left, rect->top );
     const BYTE *glyph_ptr = get_pixel_ptr_8( glyph, origin->x, origin->y );
-    int x, y;
+    int y;
 
     for (y = rect->top; y < rect->bottom; y++)
     {
-        for (x = 0; x < rect->right - rect->left; x++)
-        {
-            if (glyph_ptr[x] <= 1) continue;
-            if (glyph_ptr[x] >= 16) { dst_ptr[x] = text_pixel; continue; }
-            dst_ptr[x] = aa_rgb( dst_ptr[x] >> 16, dst_ptr[x] >> 8, dst_ptr[x], text_pixel, ranges + glyph_ptr[x] );
-        }
+        if (simd_funcs.draw_glyph_row_8888)
+            simd_funcs.draw_glyph_row_8888( dst_ptr, glyph_ptr, rect->right - rect->left, text_pixel, ranges );
+        else
+            draw_glyph_row_8888( dst_ptr, glyph_ptr, rect->right - rect->left, text_pixel, ranges );
         dst_ptr += dib->stride / 4;
         glyph_ptr += glyph->stride;
     }
@@ -6404,3 +6580,30 @@ const primitive_funcs funcs_null =
     stretch_row_null,
     shrink_row_null
 };
+
+/***********************************************************************
+ *           init_dib_primitives
+ *
+ * Select the SIMD versions of the primitives supported by the CPU.
+ * Setting WINEDIBSIMD=0 in the environment keeps the plain C code.
+ */
+void init_dib_primitives(void)
+{
+#ifdef HAVE_SSE2_PRIMITIVES
+    const char *env = getenv( "WINEDIBSIMD" );
+    unsigned int eax, ebx, ecx, edx;
+
+    if (env && !atoi( env )) return;
+
+    if (IsProcessorFeaturePresent( PF_XMMI64_INSTRUCTIONS_AVAILABLE ))
+    {
+        simd_funcs.blend_rect_8888     = blend_rect_8888_sse2;
+        simd_funcs.draw_glyph_row_8888 = draw_glyph_row_8888_sse2;
+    }
+    if (__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) && (ecx & bit_SSSE3))
+        simd_funcs.convert_row_888_to_8888 = convert_row_888_to_8888_ssse3;
+
+    TRACE( "using SSE2 %u SSSE3 %u\n", simd_funcs.blend_rect_8888 != NULL,
+           simd_funcs.convert_row_888_to_8888 != NULL );
+#endif
+}
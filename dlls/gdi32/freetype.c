@@ -378,6 +378,7 @@ struct font_fileinfo {
 struct tagGdiFont {
     struct list entry;
     struct list unused_entry;
+    struct list hash_entry;
     unsigned int refcount;
     GM **gm;
     DWORD gmsize;
@@ -439,6 +440,9 @@ static struct list gdi_font_list = LIST_INIT(gdi_font_list);
 static struct list unused_gdi_font_list = LIST_INIT(unused_gdi_font_list);
 static unsigned int unused_font_count;
 #define UNUSED_CACHE_SIZE 10
+#define FONT_HASH_SIZE 256
+static struct list gdi_font_hash[FONT_HASH_SIZE];  /* fonts of gdi_font_list, by font_desc.hash */
+static unsigned int font_cache_hits, font_cache_misses;
 static struct list system_links = LIST_INIT(system_links);
 
 static struct list font_subst_list = LIST_INIT(font_subst_list);
@@ -578,6 +582,7 @@ static struct list mappings_list = LIST_INIT( mappings_list );
 
 static UINT default_aa_flags;
 static HKEY hkey_font_cache;
+static struct font_catalog_builder *font_catalog;  /* set during the initial font scan */
 static BOOL antialias_fakes = TRUE;
 
 static CRITICAL_SECTION freetype_cs;
@@ -1737,7 +1742,15 @@ static void load_font_list_from_cache(HKEY hkey_font_cache)
         if (!RegQueryValueExW(hkey_family, english_name_value, NULL, NULL, (BYTE *)buffer, &size))
             english_family = strdupW( buffer );
 
-        family = create_family(family_name, english_family);
+        if ((family = find_family_from_name(family_name)))
+        {
+            /* family already loaded from the font catalog */
+            family->refcount++;
+            HeapFree( GetProcessHeap(), 0, family_name );
+            HeapFree( GetProcessHeap(), 0, english_family );
+            english_family = NULL;
+        }
+        else family = create_family(family_name, english_family);
 
         if(english_family)
         {
@@ -1796,6 +1809,9 @@ static void add_face_to_cache(Face *face)
     HKEY hkey_family, hkey_face;
     WCHAR *face_key_name;
 
+    /* the faces of the initial scan are saved in the font catalog instead */
+    if (font_catalog) return;
+
     RegCreateKeyExW(hkey_font_cache, face->family->FamilyName, 0,
                     NULL, REG_OPTION_VOLATILE, KEY_ALL_ACCESS, NULL, &hkey_family, NULL);
     if(face->family->EnglishName)
@@ -1845,7 +1861,8 @@ static void remove_face_from_cache( Face *face )
 {
     HKEY hkey_family;
 
-    RegOpenKeyExW( hkey_font_cache, face->family->FamilyName, 0, KEY_ALL_ACCESS, &hkey_family );
+    /* faces loaded from the font catalog are not in the registry */
+    if (RegOpenKeyExW( hkey_font_cache, face->family->FamilyName, 0, KEY_ALL_ACCESS, &hkey_family )) return;
 
     if (face->scalable)
     {
@@ -1862,6 +1879,624 @@ static void remove_face_from_cache( Face *face )
     RegCloseKey(hkey_family);
 }
 
+/****************************************************************
+ *  Font catalog
+ *
+ * The faces found by the initial font scan are saved in a binary file of the
+ * prefix.  The first process of a session maps it and checks the time stamps of
+ * the font files and directories, and a digest of the font configuration,
+ * instead of scanning the fonts again; the other processes load it without
+ * checking, and only use the registry cache for the faces that were added
+ * after the scan.
+ */
+
+#define FONT_CATALOG_MAGIC    0x54414346  /* "FCAT" */
+#define FONT_CATALOG_VERSION  2
+#define FONT_CATALOG_NONE     (~0u)
+#define FONT_CATALOG_BUCKETS  1024
+
+struct font_catalog_header
+{
+    DWORD magic;
+    DWORD version;
+    DWORD size;          /* size of the whole file */
+    DWORD lcid;          /* locale of the localized names */
+    DWORD win9x;
+    DWORD config_hash;   /* digest of the font registry keys and fontconfig font list */
+    DWORD family_count;
+    DWORD face_count;
+    DWORD file_count;
+    DWORD families;      /* offset of the family array */
+    DWORD faces;         /* offset of the face array */
+    DWORD files;         /* offset of the file array */
+    DWORD strings;       /* offset of the string data */
+    DWORD strings_len;   /* length of the string data in WCHARs */
+};
+
+struct font_catalog_family
+{
+    DWORD name;          /* offsets in the string data */
+    DWORD english_name;
+    DWORD first_face;
+    DWORD face_count;
+};
+
+struct font_catalog_face
+{
+    DWORD         style_name;
+    DWORD         full_name;
+    DWORD         file;          /* index in the file array */
+    LONG          face_index;
+    FONTSIGNATURE fs;
+    DWORD         ntm_flags;
+    LONG          font_version;
+    DWORD         flags;
+    DWORD         scalable;
+    LONG          size;
+    LONG          x_ppem;
+    LONG          y_ppem;
+    SHORT         height;
+    SHORT         width;
+    SHORT         internal_leading;
+    SHORT         pad;
+};
+
+/* font files and scanned directories, checked before trusting the catalog */
+struct font_catalog_file
+{
+    ULONGLONG dev;
+    ULONGLONG ino;
+    ULONGLONG size;
+    ULONGLONG mtime;
+    DWORD     name;          /* unix path in the string data */
+    DWORD     flags;
+};
+
+#define FONT_CATALOG_FILE_MISSING  0x0001  /* path didn't exist at scan time */
+
+struct font_catalog_builder
+{
+    struct font_catalog_family *families;
+    DWORD                       family_count;
+    DWORD                       family_size;
+    struct font_catalog_face   *faces;
+    DWORD                       face_count;
+    DWORD                       face_size;
+    struct font_catalog_file   *files;
+    DWORD                       file_count;
+    DWORD                       file_size;
+    DWORD                      *file_next;  /* hash chains, in parallel with the files */
+    DWORD                       file_next_size;
+    DWORD                       buckets[FONT_CATALOG_BUCKETS];
+    WCHAR                      *strings;
+    DWORD                       strings_len;
+    DWORD                       strings_size;
+};
+
+static const WCHAR font_catalog_value[] = {'C','a','t','a','l','o','g',0};
+
+static void hash_fontconfig_fonts( DWORD *hash );
+
+static void hash_catalog_data( DWORD *hash, const void *data, DWORD size )
+{
+    const BYTE *ptr = data;
+
+    while (size--) *hash = (*hash ^ *ptr++) * 16777619;
+}
+
+/* digest of the font configuration that the scan depends on besides the font directories */
+static DWORD get_font_config_hash(void)
+{
+    static const WCHAR pathW[] = {'P','a','t','h',0};
+    DWORD hash = 2166136261u, i, type, vlen, dlen, valuelen, datalen;
+    HKEY hkey, external_key = 0;
+    WCHAR *value;
+    BYTE *data;
+
+    /* the entries of the Fonts key, except the external fonts that the scan adds itself */
+    if (!RegOpenKeyW( HKEY_LOCAL_MACHINE, is_win9x() ? win9x_font_reg_key : winnt_font_reg_key, &hkey ))
+    {
+        RegOpenKeyW( HKEY_CURRENT_USER, external_fonts_reg_key, &external_key );
+        if (!RegQueryInfoKeyW( hkey, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                               &valuelen, &datalen, NULL, NULL ))
+        {
+            valuelen++;
+            value = HeapAlloc( GetProcessHeap(), 0, valuelen * sizeof(WCHAR) );
+            data = HeapAlloc( GetProcessHeap(), 0, max( datalen, 1 ) );
+            for (i = 0; value && data; i++)
+            {
+                vlen = valuelen;
+                dlen = datalen;
+                if (RegEnumValueW( hkey, i, value, &vlen, NULL, &type, data, &dlen )) break;
+                if (external_key && !RegQueryValueExW( external_key, value, NULL, NULL, NULL, NULL )) continue;
+                hash_catalog_data( &hash, value, vlen * sizeof(WCHAR) );
+                hash_catalog_data( &hash, &type, sizeof(type) );
+                hash_catalog_data( &hash, data, dlen );
+            }
+            HeapFree( GetProcessHeap(), 0, data );
+            HeapFree( GetProcessHeap(), 0, value );
+        }
+        if (external_key) RegCloseKey( external_key );
+        RegCloseKey( hkey );
+    }
+
+    /* the font path of HKCU\Software\Wine\Fonts */
+    if (!RegOpenKeyA( HKEY_CURRENT_USER, "Software\\Wine\\Fonts", &hkey ))
+    {
+        if (!RegQueryValueExW( hkey, pathW, NULL, NULL, NULL, &dlen ) &&
+            (data = HeapAlloc( GetProcessHeap(), 0, dlen )))
+        {
+            if (!RegQueryValueExW( hkey, pathW, NULL, NULL, data, &dlen ))
+                hash_catalog_data( &hash, data, dlen );
+            HeapFree( GetProcessHeap(), 0, data );
+        }
+        RegCloseKey( hkey );
+    }
+
+    hash_fontconfig_fonts( &hash );
+    return hash;
+}
+
+static char *get_font_catalog_path( const char *suffix )
+{
+    const char *config_dir = wine_get_config_dir();
+    char *path;
+
+    if (!config_dir) return NULL;
+    if ((path = HeapAlloc( GetProcessHeap(), 0, strlen(config_dir) + sizeof("/fontcache.dat") + strlen(suffix) )))
+    {
+        strcpy( path, config_dir );
+        strcat( path, "/fontcache.dat" );
+        strcat( path, suffix );
+    }
+    return path;
+}
+
+static BOOL grow_catalog_array( void **array, DWORD *size, DWORD count, DWORD elem_size )
+{
+    DWORD new_size;
+    void *new_array;
+
+    if (count < *size) return TRUE;
+    new_size = max( 64, *size * 2 );
+    if (*array) new_array = HeapReAlloc( GetProcessHeap(), 0, *array, new_size * elem_size );
+    else new_array = HeapAlloc( GetProcessHeap(), 0, new_size * elem_size );
+    if (!new_array) return FALSE;
+    *array = new_array;
+    *size = new_size;
+    return TRUE;
+}
+
+static DWORD add_catalog_string( struct font_catalog_builder *builder, const WCHAR *str )
+{
+    DWORD len, pos = builder->strings_len;
+
+    if (!str) return FONT_CATALOG_NONE;
+    len = strlenW( str ) + 1;
+    while (builder->strings_size < pos + len)
+    {
+        if (!grow_catalog_array( (void **)&builder->strings, &builder->strings_size,
+                                 builder->strings_size, sizeof(WCHAR) ))
+            return FONT_CATALOG_NONE;
+    }
+    memcpy( builder->strings + pos, str, len * sizeof(WCHAR) );
+    builder->strings_len += len;
+    return pos;
+}
+
+/* add a file or directory to the catalog, return its index */
+static DWORD add_catalog_file( struct font_catalog_builder *builder, const WCHAR *name, BOOL allow_missing )
+{
+    struct font_catalog_file *file;
+    const WCHAR *p;
+    DWORD index, hash = 0;
+    struct stat st;
+    char *unix_name;
+    int len;
+
+    for (p = name; *p; p++) hash = hash * 31 + *p;
+    hash %= FONT_CATALOG_BUCKETS;
+
+    for (index = builder->buckets[hash]; index != FONT_CATALOG_NONE; index = builder->file_next[index])
+        if (!strcmpW( builder->strings + builder->files[index].name, name )) return index;
+
+    len = WideCharToMultiByte( CP_UNIXCP, 0, name, -1, NULL, 0, NULL, NULL );
+    if (!(unix_name = HeapAlloc( GetProcessHeap(), 0, len ))) return FONT_CATALOG_NONE;
+    WideCharToMultiByte( CP_UNIXCP, 0, name, -1, unix_name, len, NULL, NULL );
+    len = stat( unix_name, &st );
+    HeapFree( GetProcessHeap(), 0, unix_name );
+    if (len == -1)
+    {
+        if (!allow_missing) return FONT_CATALOG_NONE;
+        memset( &st, 0, sizeof(st) );
+    }
+
+    index = builder->file_count;
+    if (!grow_catalog_array( (void **)&builder->files, &builder->file_size, index, sizeof(*builder->files) ) ||
+        !grow_catalog_array( (void **)&builder->file_next, &builder->file_next_size, index, sizeof(DWORD) ))
+        return FONT_CATALOG_NONE;
+    file = &builder->files[index];
+    if ((file->name = add_catalog_string( builder, name )) == FONT_CATALOG_NONE) return FONT_CATALOG_NONE;
+    file->dev   = st.st_dev;
+    file->ino   = st.st_ino;
+    file->size  = st.st_size;
+    file->mtime = st.st_mtime;
+    file->flags = len == -1 ? FONT_CATALOG_FILE_MISSING : 0;
+    builder->file_next[index] = builder->buckets[hash];
+    builder->buckets[hash] = index;
+    builder->file_count++;
+    return index;
+}
+
+/* record a path scanned for fonts, even if it doesn't exist, so that changes are noticed */
+static void add_catalog_path( struct font_catalog_builder *builder, const char *path )
+{
+    WCHAR *name = towstr( CP_UNIXCP, path );
+
+    add_catalog_file( builder, name, TRUE );
+    HeapFree( GetProcessHeap(), 0, name );
+}
+
+static BOOL add_face_to_catalog( struct font_catalog_builder *builder, const Face *face )
+{
+    struct font_catalog_face *entry;
+    WCHAR *dir, *p;
+
+    if (!grow_catalog_array( (void **)&builder->faces, &builder->face_size, builder->face_count,
+                             sizeof(*builder->faces) ))
+        return FALSE;
+    entry = &builder->faces[builder->face_count];
+    memset( entry, 0, sizeof(*entry) );
+    if ((entry->file = add_catalog_file( builder, face->file, FALSE )) == FONT_CATALOG_NONE) return FALSE;
+    if ((entry->style_name = add_catalog_string( builder, face->StyleName )) == FONT_CATALOG_NONE) return FALSE;
+    entry->full_name        = add_catalog_string( builder, face->FullName );
+    entry->face_index       = face->face_index;
+    entry->fs               = face->fs;
+    entry->ntm_flags        = face->ntmFlags;
+    entry->font_version     = face->font_version;
+    entry->flags            = face->flags;
+    entry->scalable         = face->scalable;
+    entry->size             = face->size.size;
+    entry->x_ppem           = face->size.x_ppem;
+    entry->y_ppem           = face->size.y_ppem;
+    entry->height           = face->size.height;
+    entry->width            = face->size.width;
+    entry->internal_leading = face->size.internal_leading;
+
+    /* the directory time stamp changes when fonts are added next to this one */
+    if ((dir = strdupW( face->file )))
+    {
+        if ((p = strrchrW( dir, '/' )) && p != dir)
+        {
+            *p = 0;
+            add_catalog_file( builder, dir, FALSE );
+        }
+        HeapFree( GetProcessHeap(), 0, dir );
+    }
+    builder->face_count++;
+    return TRUE;
+}
+
+static inline BOOL is_catalog_face( const Face *face )
+{
+    return face->file && (face->flags & ADDFONT_ADD_TO_CACHE);
+}
+
+static int compare_catalog_families( const void *a, const void *b )
+{
+    const Family *family1 = *(const Family * const *)a, *family2 = *(const Family * const *)b;
+    return strcmpiW( family1->FamilyName, family2->FamilyName );
+}
+
+static BOOL build_font_catalog( struct font_catalog_builder *builder )
+{
+    struct font_catalog_family *cat_family;
+    Family *family, **families;
+    Face *face;
+    DWORD i, count = list_count( &font_list );
+    BOOL ret = FALSE;
+
+    if (!(families = HeapAlloc( GetProcessHeap(), 0, max( count, 1 ) * sizeof(*families) ))) return FALSE;
+    count = 0;
+    LIST_FOR_EACH_ENTRY( family, &font_list, Family, entry ) families[count++] = family;
+
+    /* store the families sorted by name, the same way the registry cache enumerates them */
+    qsort( families, count, sizeof(*families), compare_catalog_families );
+
+    for (i = 0; i < count; i++)
+    {
+        if (!grow_catalog_array( (void **)&builder->families, &builder->family_size, builder->family_count,
+                                 sizeof(*builder->families) ))
+            goto done;
+        cat_family = &builder->families[builder->family_count];
+        cat_family->first_face = builder->face_count;
+        LIST_FOR_EACH_ENTRY( face, &families[i]->faces, Face, entry )
+        {
+            if (is_catalog_face( face ) && !add_face_to_catalog( builder, face )) goto done;
+        }
+        if (!(cat_family->face_count = builder->face_count - cat_family->first_face)) continue;
+        if ((cat_family->name = add_catalog_string( builder, families[i]->FamilyName )) == FONT_CATALOG_NONE)
+            goto done;
+        cat_family->english_name = add_catalog_string( builder, families[i]->EnglishName );
+        builder->family_count++;
+    }
+    ret = TRUE;
+
+done:
+    HeapFree( GetProcessHeap(), 0, families );
+    return ret;
+}
+
+static BOOL write_font_catalog( const struct font_catalog_builder *builder )
+{
+    struct font_catalog_header header;
+    char *path, *tmp_path;
+    BOOL ret = FALSE;
+    char *data;
+    int fd;
+
+    header.magic        = FONT_CATALOG_MAGIC;
+    header.version      = FONT_CATALOG_VERSION;
+    header.lcid         = GetSystemDefaultLCID();
+    header.win9x        = is_win9x();
+    header.config_hash  = get_font_config_hash();
+    header.family_count = builder->family_count;
+    header.face_count   = builder->face_count;
+    header.file_count   = builder->file_count;
+    header.families     = sizeof(header);
+    header.faces        = header.families + builder->family_count * sizeof(*builder->families);
+    header.files        = header.faces + builder->face_count * sizeof(*builder->faces);
+    header.strings      = header.files + builder->file_count * sizeof(*builder->files);
+    header.strings_len  = builder->strings_len;
+    header.size         = header.strings + builder->strings_len * sizeof(WCHAR);
+
+    if (!(data = HeapAlloc( GetProcessHeap(), 0, header.size ))) return FALSE;
+    memcpy( data, &header, sizeof(header) );
+    memcpy( data + header.families, builder->families, builder->family_count * sizeof(*builder->families) );
+    memcpy( data + header.faces, builder->faces, builder->face_count * sizeof(*builder->faces) );
+    memcpy( data + header.files, builder->files, builder->file_count * sizeof(*builder->files) );
+    memcpy( data + header.strings, builder->strings, builder->strings_len * sizeof(WCHAR) );
+
+    path = get_font_catalog_path( "" );
+    tmp_path = get_font_catalog_path( ".tmp" );
+    if (path && tmp_path && (fd = open( tmp_path, O_CREAT | O_TRUNC | O_WRONLY, 0644 )) != -1)
+    {
+        ret = write( fd, data, header.size ) == header.size;
+        close( fd );
+        if (ret && rename( tmp_path, path ) == -1) ret = FALSE;
+        if (!ret) unlink( tmp_path );
+    }
+    if (!ret) WARN( "failed to write font catalog %s\n", debugstr_a(path) );
+    else TRACE( "saved %u families, %u faces and %u files to %s\n",
+                header.family_count, header.face_count, header.file_count, debugstr_a(path) );
+
+    HeapFree( GetProcessHeap(), 0, tmp_path );
+    HeapFree( GetProcessHeap(), 0, path );
+    HeapFree( GetProcessHeap(), 0, data );
+    return ret;
+}
+
+static struct font_catalog_builder *create_font_catalog_builder(void)
+{
+    struct font_catalog_builder *builder;
+
+    if (!(builder = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*builder) ))) return NULL;
+    memset( builder->buckets, 0xff, sizeof(builder->buckets) );
+    return builder;
+}
+
+static void free_font_catalog_builder( struct font_catalog_builder *builder )
+{
+    HeapFree( GetProcessHeap(), 0, builder->families );
+    HeapFree( GetProcessHeap(), 0, builder->faces );
+    HeapFree( GetProcessHeap(), 0, builder->files );
+    HeapFree( GetProcessHeap(), 0, builder->file_next );
+    HeapFree( GetProcessHeap(), 0, builder->strings );
+    HeapFree( GetProcessHeap(), 0, builder );
+}
+
+/* save the scanned font list, or fall back to the registry cache if that fails */
+static void save_font_catalog(void)
+{
+    struct font_catalog_builder *builder = font_catalog;
+    Family *family;
+    Face *face;
+    BOOL ret;
+
+    if (!builder) return;
+    ret = build_font_catalog( builder ) && write_font_catalog( builder );
+    free_font_catalog_builder( builder );
+    font_catalog = NULL;
+
+    if (ret)
+    {
+        reg_save_dword( hkey_font_cache, font_catalog_value, 1 );
+        return;
+    }
+    LIST_FOR_EACH_ENTRY( family, &font_list, Family, entry )
+        LIST_FOR_EACH_ENTRY( face, &family->faces, Face, entry )
+            if (face->flags & ADDFONT_ADD_TO_CACHE) add_face_to_cache( face );
+}
+
+static const WCHAR *get_catalog_string( const struct font_catalog_header *header, DWORD offset )
+{
+    if (offset >= header->strings_len) return NULL;
+    return (const WCHAR *)((const char *)header + header->strings) + offset;
+}
+
+static BOOL check_font_catalog( const struct font_catalog_header *header, size_t size, BOOL check_files )
+{
+    const struct font_catalog_file *files = (const void *)((const char *)header + header->files);
+    const WCHAR *strings = (const WCHAR *)((const char *)header + header->strings);
+    struct stat st;
+    char *unix_name;
+    DWORD i;
+    int len;
+
+    if (size < sizeof(*header) || header->magic != FONT_CATALOG_MAGIC ||
+        header->version != FONT_CATALOG_VERSION || header->size != size) return FALSE;
+    if (header->lcid != GetSystemDefaultLCID() || header->win9x != is_win9x()) return FALSE;
+    if (header->family_count > size / sizeof(struct font_catalog_family) ||
+        header->face_count > size / sizeof(struct font_catalog_face) ||
+        header->file_count > size / sizeof(struct font_catalog_file) ||
+        header->strings_len > size / sizeof(WCHAR)) return FALSE;
+    if (header->families != sizeof(*header) ||
+        header->faces != header->families + header->family_count * sizeof(struct font_catalog_family) ||
+        header->files != header->faces + header->face_count * sizeof(struct font_catalog_face) ||
+        header->strings != header->files + header->file_count * sizeof(struct font_catalog_file) ||
+        header->size != header->strings + header->strings_len * sizeof(WCHAR)) return FALSE;
+    if (header->strings_len && strings[header->strings_len - 1]) return FALSE;
+
+    if (!check_files) return TRUE;
+
+    if (header->config_hash != get_font_config_hash())
+    {
+        TRACE( "font configuration has changed\n" );
+        return FALSE;
+    }
+
+    for (i = 0; i < header->file_count; i++)
+    {
+        const WCHAR *name = get_catalog_string( header, files[i].name );
+
+        if (!name) return FALSE;
+        len = WideCharToMultiByte( CP_UNIXCP, 0, name, -1, NULL, 0, NULL, NULL );
+        if (!(unix_name = HeapAlloc( GetProcessHeap(), 0, len ))) return FALSE;
+        WideCharToMultiByte( CP_UNIXCP, 0, name, -1, unix_name, len, NULL, NULL );
+        len = stat( unix_name, &st );
+        HeapFree( GetProcessHeap(), 0, unix_name );
+        if (files[i].flags & FONT_CATALOG_FILE_MISSING)
+        {
+            if (len == -1) continue;
+            TRACE( "%s has appeared\n", debugstr_w(name) );
+            return FALSE;
+        }
+        if (len == -1 || st.st_dev != files[i].dev || st.st_ino != files[i].ino ||
+            (ULONGLONG)st.st_size != files[i].size || (ULONGLONG)st.st_mtime != files[i].mtime)
+        {
+            TRACE( "%s has changed\n", debugstr_w(name) );
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static void load_catalog_face( const struct font_catalog_header *header, const struct font_catalog_face *entry,
+                               Family *family )
+{
+    const struct font_catalog_file *file;
+    const WCHAR *style_name = get_catalog_string( header, entry->style_name );
+    const WCHAR *full_name = get_catalog_string( header, entry->full_name );
+    const WCHAR *file_name;
+    Face *face;
+
+    if (entry->file >= header->file_count || !style_name) return;
+    file = (const struct font_catalog_file *)((const char *)header + header->files) + entry->file;
+    if (!(file_name = get_catalog_string( header, file->name ))) return;
+
+    face = HeapAlloc( GetProcessHeap(), 0, sizeof(*face) );
+    face->refcount              = 1;
+    face->StyleName             = strdupW( style_name );
+    face->FullName              = full_name ? strdupW( full_name ) : NULL;
+    face->file                  = strdupW( file_name );
+    face->dev                   = file->dev;
+    face->ino                   = file->ino;
+    face->font_data_ptr         = NULL;
+    face->font_data_size        = 0;
+    face->face_index            = entry->face_index;
+    face->fs                    = entry->fs;
+    face->ntmFlags              = entry->ntm_flags;
+    face->font_version          = entry->font_version;
+    face->scalable              = entry->scalable;
+    face->size.height           = entry->height;
+    face->size.width            = entry->width;
+    face->size.size             = entry->size;
+    face->size.x_ppem           = entry->x_ppem;
+    face->size.y_ppem           = entry->y_ppem;
+    face->size.internal_leading = entry->internal_leading;
+    face->flags                 = entry->flags;
+    face->family                = NULL;
+    face->cached_enum_data      = NULL;
+
+    if (insert_face_in_family_list( face, family ))
+        TRACE("Added font %s %s\n", debugstr_w(family->FamilyName), debugstr_w(face->StyleName));
+    release_face( face );
+}
+
+/*************************************************************
+ *    load_font_catalog
+ *
+ * Load the font list from the catalog file.  The first process of the session
+ * checks that no font file or directory has changed since it was written.
+ */
+static BOOL load_font_catalog( BOOL check_files )
+{
+    const struct font_catalog_header *header;
+    const struct font_catalog_family *families;
+    const struct font_catalog_face *faces;
+    struct stat st;
+    char *path;
+    void *ptr;
+    DWORD i, j;
+    int fd;
+
+    if (!(path = get_font_catalog_path( "" ))) return FALSE;
+    fd = open( path, O_RDONLY );
+    HeapFree( GetProcessHeap(), 0, path );
+    if (fd == -1) return FALSE;
+    if (fstat( fd, &st ) == -1 || st.st_size < sizeof(*header) || st.st_size > 0x7fffffff)
+    {
+        close( fd );
+        return FALSE;
+    }
+    ptr = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if (ptr == MAP_FAILED) return FALSE;
+
+    header = ptr;
+    if (!check_font_catalog( header, st.st_size, check_files ))
+    {
+        TRACE( "font catalog is out of date\n" );
+        munmap( ptr, st.st_size );
+        return FALSE;
+    }
+
+    families = (const void *)((const char *)header + header->families);
+    faces = (const void *)((const char *)header + header->faces);
+    for (i = 0; i < header->family_count; i++)
+    {
+        const WCHAR *name = get_catalog_string( header, families[i].name );
+        const WCHAR *english_name = get_catalog_string( header, families[i].english_name );
+        Family *family;
+
+        if (!name || families[i].first_face > header->face_count ||
+            families[i].face_count > header->face_count - families[i].first_face) continue;
+
+        if ((family = find_family_from_name( name ))) family->refcount++;
+        else
+        {
+            family = create_family( strdupW( name ), english_name ? strdupW( english_name ) : NULL );
+            if (english_name)
+            {
+                FontSubst *subst = HeapAlloc( GetProcessHeap(), 0, sizeof(*subst) );
+                subst->from.name = strdupW( english_name );
+                subst->from.charset = -1;
+                subst->to.name = strdupW( name );
+                subst->to.charset = -1;
+                add_font_subst( &font_subst_list, subst, 0 );
+            }
+        }
+        for (j = 0; j < families[i].face_count; j++)
+            load_catalog_face( header, &faces[families[i].first_face + j], family );
+        release_family( family );
+    }
+    TRACE( "loaded %u families and %u faces\n", header->family_count, header->face_count );
+
+    munmap( ptr, st.st_size );
+    reorder_vertical_fonts();
+    return TRUE;
+}
+
 static WCHAR *prepend_at(WCHAR *family)
 {
     WCHAR *str;
@@ -2707,6 +3342,7 @@ static BOOL ReadFontDir(const char *dirname, BOOL external_fonts)
 
     TRACE("Loading fonts from %s\n", debugstr_a(dirname));
 
+    if (font_catalog) add_catalog_path( font_catalog, dirname );
     dir = opendir(dirname);
     if(!dir) {
         WARN("Can't open directory %s\n", debugstr_a(dirname));
@@ -2856,6 +3492,41 @@ static void load_fontconfig_fonts(void)
     pFcPatternDestroy(pat);
 }
 
+/* add the list of fontconfig font files to the font catalog digest */
+static void hash_fontconfig_fonts( DWORD *hash )
+{
+    FcPattern *pat;
+    FcObjectSet *os;
+    FcFontSet *fontset;
+    DWORD file_hash, sum = 0;
+    char *file;
+    int i;
+
+    if (!fontconfig_enabled) return;
+
+    pat = pFcPatternCreate();
+    os = pFcObjectSetCreate();
+    pFcObjectSetAdd(os, FC_FILE);
+    if ((fontset = pFcFontList(NULL, pat, os)))
+    {
+        /* the order of the list isn't meaningful, sum the hashes of the files */
+        for (i = 0; i < fontset->nfont; i++)
+        {
+            if (pFcPatternGetString(fontset->fonts[i], FC_FILE, 0, (FcChar8**)&file) != FcResultMatch)
+                continue;
+            file_hash = 2166136261u;
+            hash_catalog_data( &file_hash, file, strlen(file) );
+            sum += file_hash;
+        }
+        hash_catalog_data( hash, &fontset->nfont, sizeof(fontset->nfont) );
+        pFcFontSetDestroy(fontset);
+    }
+    hash_catalog_data( hash, &sum, sizeof(sum) );
+    hash_catalog_data( hash, &default_aa_flags, sizeof(default_aa_flags) );
+    pFcObjectSetDestroy(os);
+    pFcPatternDestroy(pat);
+}
+
 #elif defined(HAVE_CARBON_CARBON_H)
 
 static void load_mac_font_callback(const void *value, void *context)
@@ -2973,6 +3644,12 @@ static void load_mac_fonts(void)
 
 #endif
 
+#ifndef SONAME_LIBFONTCONFIG
+static void hash_fontconfig_fonts( DWORD *hash )
+{
+}
+#endif
+
 static char *get_font_dir(void)
 {
     const char *build_dir, *data_dir;
@@ -4205,6 +4882,7 @@ static void init_font_list(void)
                 {
                     if((unixname = wine_get_unix_file_name(data)))
                     {
+                        if (font_catalog) add_catalog_path( font_catalog, unixname );
                         AddFontToList(unixname, NULL, 0, ADDFONT_ALLOW_BITMAP | ADDFONT_ADD_TO_CACHE);
                         HeapFree(GetProcessHeap(), 0, unixname);
                     }
@@ -4327,9 +5005,11 @@ static void reorder_font_list(void)
 BOOL WineEngInit(void)
 {
     HKEY hkey;
-    DWORD disposition;
+    DWORD disposition, i;
     HANDLE font_mutex;
 
+    for (i = 0; i < FONT_HASH_SIZE; i++) list_init( &gdi_font_hash[i] );
+
     /* update locale dependent font info in registry */
     update_font_info();
 
@@ -4366,9 +5046,28 @@ BOOL WineEngInit(void)
     create_font_cache_key(&hkey_font_cache, &disposition);
 
     if(disposition == REG_CREATED_NEW_KEY)
-        init_font_list();
+    {
+        if (load_font_catalog( TRUE ))
+        {
+            delete_external_font_keys();
+            reg_save_dword( hkey_font_cache, font_catalog_value, 1 );
+        }
+        else
+        {
+            font_catalog = create_font_catalog_builder();
+            init_font_list();
+            save_font_catalog();
+        }
+    }
     else
+    {
+        DWORD catalog;
+
+        if (!reg_load_dword( hkey_font_cache, font_catalog_value, &catalog ) && catalog &&
+            !load_font_catalog( FALSE ))
+            ERR("Failed to load the font catalog\n");
         load_font_list_from_cache(hkey_font_cache);
+    }
 
     reorder_font_list();
 
@@ -4876,6 +5575,7 @@ static void release_font( GdiFont *font )
             font = LIST_ENTRY( list_tail( &unused_gdi_font_list ), struct tagGdiFont, unused_entry );
             TRACE( "freeing %p\n", font );
             list_remove( &font->entry );
+            list_remove( &font->hash_entry );
             list_remove( &font->unused_entry );
             free_font( font );
         }
@@ -4928,16 +5628,18 @@ static GdiFont *find_in_cache(HFONT hfont, const LOGFONTW *plf, const FMAT2 *pma
     fd.can_use_bitmap = can_use_bitmap;
     calc_hash(&fd);
 
-    /* try the in-use list */
-    LIST_FOR_EACH_ENTRY( ret, &gdi_font_list, struct tagGdiFont, entry )
+    LIST_FOR_EACH_ENTRY( ret, &gdi_font_hash[fd.hash % FONT_HASH_SIZE], struct tagGdiFont, hash_entry )
     {
         if(fontcmp(ret, &fd)) continue;
         if(!can_use_bitmap && !FT_IS_SCALABLE(ret->ft_face)) continue;
         list_remove( &ret->entry );
         list_add_head( &gdi_font_list, &ret->entry );
         grab_font( ret );
+        font_cache_hits++;
         return ret;
     }
+    font_cache_misses++;
+    TRACE("%u hits, %u misses\n", font_cache_hits, font_cache_misses);
     return NULL;
 }
 
@@ -4947,6 +5649,7 @@ static void add_to_cache(GdiFont *font)
 
     font->cache_num = cache_num++;
     list_add_head(&gdi_font_list, &font->entry);
+    list_add_head(&gdi_font_hash[font->font_desc.hash % FONT_HASH_SIZE], &font->hash_entry);
     TRACE( "font %p\n", font );
 }
 
@@ -6734,9 +7437,247 @@ static unsigned int get_bezier_glyph_outline(FT_Outline *outline, unsigned int b
 
 static const BYTE masks[8] = {0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
 
-static DWORD get_glyph_outline(GdiFont *incoming_font, UINT glyph, UINT format,
-                               LPGLYPHMETRICS lpgm, ABC *abc, DWORD buflen, LPVOID buf,
-                               const MAT2* lpmat)
+/*************************************************************
+ * Glyph cache
+ *
+ * Process-wide LRU cache of rendered glyphs.  The key holds the face and every
+ * font parameter that affects the rendering, so that the glyphs are shared by
+ * all the GdiFont instances created for the same face and size, and survive
+ * the destruction of unused instances.
+ */
+
+struct glyph_cache_key
+{
+    ULONGLONG dev;
+    ULONGLONG ino;
+    LONG      face_index;
+    LONG      height;
+    LONG      width;
+    LONG      escapement;
+    LONG      orientation;
+    LONG      weight;
+    LONG      ppem;
+    LONG      ave_width;
+    double    scale_y;
+    FMAT2     matrix;
+    INT       font_orientation;
+    BYTE      italic;
+    BYTE      charset;
+    BYTE      can_use_bitmap;
+    BYTE      fake_italic;
+    BYTE      fake_bold;
+    BYTE      pad[3];
+    UINT      glyph;
+    UINT      format;
+    WCHAR     name[LF_FACESIZE];
+};
+
+struct glyph_cache_entry
+{
+    struct list               entry;       /* entry in the LRU list */
+    struct glyph_cache_entry *next;        /* next entry in the hash bucket */
+    struct glyph_cache_key    key;
+    DWORD                     hash;
+    GLYPHMETRICS              gm;
+    ABC                       abc;
+    DWORD                     needed;      /* value returned by get_glyph_outline */
+    BYTE                     *data;        /* glyph bits, NULL until retrieved */
+};
+
+#define GLYPH_CACHE_HASH_SIZE  4096
+#define GLYPH_CACHE_MAX_SIZE   (4 * 1024 * 1024)
+
+static struct list glyph_cache_lru = LIST_INIT( glyph_cache_lru );
+static struct glyph_cache_entry *glyph_cache_hash[GLYPH_CACHE_HASH_SIZE];
+static SIZE_T glyph_cache_size;
+static unsigned int glyph_cache_count;
+static unsigned int glyph_cache_hits;
+static unsigned int glyph_cache_misses;
+
+static inline BOOL is_cached_glyph_format( UINT format )
+{
+    switch (format & ~(GGO_GLYPH_INDEX | GGO_UNHINTED))
+    {
+    case GGO_METRICS:
+    case GGO_BITMAP:
+    case GGO_GRAY2_BITMAP:
+    case GGO_GRAY4_BITMAP:
+    case GGO_GRAY8_BITMAP:
+    case WINE_GGO_GRAY16_BITMAP:
+    case WINE_GGO_HRGB_BITMAP:
+    case WINE_GGO_HBGR_BITMAP:
+    case WINE_GGO_VRGB_BITMAP:
+    case WINE_GGO_VBGR_BITMAP:
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static DWORD init_glyph_cache_key( struct glyph_cache_key *key, const GdiFont *font, UINT glyph, UINT format )
+{
+    const BYTE *ptr = (const BYTE *)key;
+    DWORD hash = 2166136261u;
+    unsigned int i;
+
+    memset( key, 0, sizeof(*key) );
+    key->dev              = font->mapping->dev;
+    key->ino              = font->mapping->ino;
+    key->face_index       = font->ft_face->face_index;
+    key->height           = font->font_desc.lf.lfHeight;
+    key->width            = font->font_desc.lf.lfWidth;
+    key->escapement       = font->font_desc.lf.lfEscapement;
+    key->orientation      = font->font_desc.lf.lfOrientation;
+    key->weight           = font->font_desc.lf.lfWeight;
+    key->ppem             = font->ppem;
+    key->ave_width        = font->aveWidth;
+    key->scale_y          = font->scale_y;
+    key->matrix           = font->font_desc.matrix;
+    key->font_orientation = font->orientation;
+    key->italic           = font->font_desc.lf.lfItalic;
+    key->charset          = font->font_desc.lf.lfCharSet;
+    key->can_use_bitmap   = font->font_desc.can_use_bitmap;
+    key->fake_italic      = font->fake_italic;
+    key->fake_bold        = font->fake_bold;
+    key->glyph            = glyph;
+    key->format           = format;
+    lstrcpynW( key->name, font->name, LF_FACESIZE );
+
+    for (i = 0; i < sizeof(*key); i++) hash = (hash ^ ptr[i]) * 16777619;
+    return hash;
+}
+
+static struct glyph_cache_entry *find_cached_glyph( const struct glyph_cache_key *key, DWORD hash )
+{
+    struct glyph_cache_entry *entry;
+
+    for (entry = glyph_cache_hash[hash % GLYPH_CACHE_HASH_SIZE]; entry; entry = entry->next)
+    {
+        if (entry->hash != hash || memcmp( &entry->key, key, sizeof(*key) )) continue;
+        list_remove( &entry->entry );
+        list_add_head( &glyph_cache_lru, &entry->entry );
+        return entry;
+    }
+    return NULL;
+}
+
+static void free_cached_glyph( struct glyph_cache_entry *entry )
+{
+    struct glyph_cache_entry **prev = &glyph_cache_hash[entry->hash % GLYPH_CACHE_HASH_SIZE];
+
+    while (*prev != entry) prev = &(*prev)->next;
+    *prev = entry->next;
+    list_remove( &entry->entry );
+    glyph_cache_size -= sizeof(*entry);
+    if (entry->data) glyph_cache_size -= entry->needed;
+    glyph_cache_count--;
+    HeapFree( GetProcessHeap(), 0, entry->data );
+    HeapFree( GetProcessHeap(), 0, entry );
+}
+
+static void shrink_glyph_cache(void)
+{
+    while (glyph_cache_size > GLYPH_CACHE_MAX_SIZE && !list_empty( &glyph_cache_lru ))
+        free_cached_glyph( LIST_ENTRY( list_tail( &glyph_cache_lru ), struct glyph_cache_entry, entry ));
+}
+
+static struct glyph_cache_entry *add_cached_glyph( const struct glyph_cache_key *key, DWORD hash,
+                                                   const GLYPHMETRICS *gm, const ABC *abc, DWORD needed )
+{
+    struct glyph_cache_entry *entry;
+
+    if (!(entry = HeapAlloc( GetProcessHeap(), 0, sizeof(*entry) ))) return NULL;
+    entry->key    = *key;
+    entry->hash   = hash;
+    entry->gm     = *gm;
+    entry->abc    = *abc;
+    entry->needed = needed;
+    entry->data   = NULL;
+    entry->next   = glyph_cache_hash[hash % GLYPH_CACHE_HASH_SIZE];
+    glyph_cache_hash[hash % GLYPH_CACHE_HASH_SIZE] = entry;
+    list_add_head( &glyph_cache_lru, &entry->entry );
+    glyph_cache_size += sizeof(*entry);
+    glyph_cache_count++;
+    shrink_glyph_cache();
+    return entry;
+}
+
+static void set_cached_glyph_data( struct glyph_cache_entry *entry, const void *data )
+{
+    if (!entry->needed || !(entry->data = HeapAlloc( GetProcessHeap(), 0, entry->needed ))) return;
+    memcpy( entry->data, data, entry->needed );
+    glyph_cache_size += entry->needed;
+    shrink_glyph_cache();
+}
+
+static void update_glyph_cache_stats( BOOL hit )
+{
+    if (hit) glyph_cache_hits++;
+    else glyph_cache_misses++;
+
+    if (!((glyph_cache_hits + glyph_cache_misses) % 4096))
+        TRACE( "%u hits, %u misses, %u glyphs, %lu bytes\n", glyph_cache_hits, glyph_cache_misses,
+               glyph_cache_count, glyph_cache_size );
+}
+
+static DWORD render_glyph_outline( GdiFont *font, UINT glyph, UINT format, LPGLYPHMETRICS lpgm, ABC *abc,
+                                   DWORD buflen, LPVOID buf, const MAT2 *lpmat );
+
+/*************************************************************
+ * get_glyph_outline
+ *
+ * Retrieve a glyph from the glyph cache, or render it with render_glyph_outline.
+ */
+static DWORD get_glyph_outline( GdiFont *font, UINT glyph, UINT format, LPGLYPHMETRICS lpgm, ABC *abc,
+                                DWORD buflen, LPVOID buf, const MAT2 *lpmat )
+{
+    struct glyph_cache_entry *entry;
+    struct glyph_cache_key key;
+    BOOL metrics = (format & ~(GGO_GLYPH_INDEX | GGO_UNHINTED)) == GGO_METRICS;
+    DWORD hash, ret;
+
+    /* memory fonts have no file to identify the face */
+    if (!is_identity_MAT2( lpmat ) || !is_cached_glyph_format( format ) || !font->mapping)
+        return render_glyph_outline( font, glyph, format, lpgm, abc, buflen, buf, lpmat );
+
+    hash = init_glyph_cache_key( &key, font, glyph, format );
+    if ((entry = find_cached_glyph( &key, hash )))
+    {
+        *abc = entry->abc;
+        if (metrics || !buf || !buflen)
+        {
+            update_glyph_cache_stats( TRUE );
+            *lpgm = entry->gm;
+            return metrics ? 1 : entry->needed;
+        }
+        /* empty glyphs go through the renderer so that a hit always
+         * returns the same thing as the uncached path */
+        if (entry->needed && entry->needed > buflen)
+        {
+            update_glyph_cache_stats( TRUE );
+            return GDI_ERROR;
+        }
+        if (entry->data)
+        {
+            update_glyph_cache_stats( TRUE );
+            memcpy( buf, entry->data, entry->needed );
+            *lpgm = entry->gm;
+            return entry->needed;
+        }
+    }
+
+    update_glyph_cache_stats( FALSE );
+    ret = render_glyph_outline( font, glyph, format, lpgm, abc, buflen, buf, lpmat );
+    if (ret == GDI_ERROR) return ret;
+
+    if (!entry) entry = add_cached_glyph( &key, hash, lpgm, abc, metrics ? 0 : ret );
+    if (entry && !metrics && !entry->data && buf && buflen && ret == entry->needed)
+        set_cached_glyph_data( entry, buf );
+    return ret;
+}
+
+static DWORD render_glyph_outline(GdiFont *incoming_font, UINT glyph, UINT format,
+                                  LPGLYPHMETRICS lpgm, ABC *abc, DWORD buflen, LPVOID buf,
+                                  const MAT2* lpmat)
 {
     static const FT_Matrix identityMat = {(1 << 16), 0, 0, (1 << 16)};
     GLYPHMETRICS gm;
@@ -3933,6 +3933,103 @@ static void test_GdiGradientFill(void)
     HeapFree(GetProcessHeap(), 0, bmi);
 }
 
+#define BAND_WIDTH   1024
+#define BAND_HEIGHT  512
+#define BAND_SIZE    (BAND_WIDTH * BAND_HEIGHT * 4)
+
+static void draw_large_rect( HDC hdc, HDC src_dc, int op )
+{
+    static const BLENDFUNCTION blend = { AC_SRC_OVER, 0, 200, AC_SRC_ALPHA };
+    TRIVERTEX vt[2] = { { 0, 0, 0xff00, 0x1000, 0x8000, 0x0000 },
+                        { BAND_WIDTH, BAND_HEIGHT, 0x0000, 0xff00, 0x2000, 0xff00 } };
+    GRADIENT_RECT rect = { 0, 1 };
+    HBRUSH brush, old_brush;
+
+    switch (op)
+    {
+    case 0:
+        pGdiGradientFill( hdc, vt, 2, &rect, 1, GRADIENT_FILL_RECT_V );
+        break;
+    case 1:
+        brush = CreateHatchBrush( HS_DIAGCROSS, RGB( 0x10, 0x80, 0xf0 ) );
+        old_brush = SelectObject( hdc, brush );
+        PatBlt( hdc, 3, 1, BAND_WIDTH - 5, BAND_HEIGHT - 2, PATINVERT );
+        SelectObject( hdc, old_brush );
+        DeleteObject( brush );
+        break;
+    case 2:
+        pGdiAlphaBlend( hdc, 0, 0, BAND_WIDTH, BAND_HEIGHT, src_dc, 0, 0, BAND_WIDTH, BAND_HEIGHT, blend );
+        break;
+    }
+}
+
+/* large operations are split in bands, compare with the same operations clipped in small strips */
+static void test_large_rects(void)
+{
+    static const char * const names[] = { "GradientFill", "PatBlt", "AlphaBlend" };
+    HDC hdc = CreateCompatibleDC( NULL ), src_dc = CreateCompatibleDC( NULL );
+    HBITMAP dib, strips_dib, src_dib;
+    BYTE *bits, *strips_bits, *src_bits;
+    BITMAPINFO bmi;
+    DWORD start, time;
+    HRGN rgn;
+    int op, i, y;
+
+    if (!pGdiGradientFill || !pGdiAlphaBlend)
+    {
+        win_skip( "GdiGradientFill or GdiAlphaBlend not available\n" );
+        return;
+    }
+
+    memset( &bmi, 0, sizeof(bmi) );
+    bmi.bmiHeader.biSize        = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth       = BAND_WIDTH;
+    bmi.bmiHeader.biHeight      = -BAND_HEIGHT;
+    bmi.bmiHeader.biPlanes      = 1;
+    bmi.bmiHeader.biBitCount    = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    dib = CreateDIBSection( 0, &bmi, DIB_RGB_COLORS, (void **)&bits, NULL, 0 );
+    strips_dib = CreateDIBSection( 0, &bmi, DIB_RGB_COLORS, (void **)&strips_bits, NULL, 0 );
+    src_dib = CreateDIBSection( 0, &bmi, DIB_RGB_COLORS, (void **)&src_bits, NULL, 0 );
+    ok( dib && strips_dib && src_dib, "CreateDIBSection failed\n" );
+    for (i = 0; i < BAND_SIZE; i++) src_bits[i] = (i * 2654435761u) >> 24;
+    SelectObject( src_dc, src_dib );
+
+    for (op = 0; op < 3; op++)
+    {
+        for (i = 0; i < BAND_SIZE; i++) bits[i] = strips_bits[i] = i * 7;
+
+        SelectObject( hdc, dib );
+        start = GetTickCount();
+        for (i = 0; i < 10; i++) draw_large_rect( hdc, src_dc, op );
+        GdiFlush();
+        time = GetTickCount() - start;
+
+        SelectObject( hdc, strips_dib );
+        for (i = 0; i < 10; i++)
+        {
+            for (y = 0; y < BAND_HEIGHT; y += 16)
+            {
+                rgn = CreateRectRgn( 0, y, BAND_WIDTH, y + 16 );
+                SelectClipRgn( hdc, rgn );
+                DeleteObject( rgn );
+                draw_large_rect( hdc, src_dc, op );
+            }
+        }
+        SelectClipRgn( hdc, NULL );
+        GdiFlush();
+
+        ok( !memcmp( bits, strips_bits, BAND_SIZE ), "%s: results differ\n", names[op] );
+        trace( "%s: %u Mpixels/s\n", names[op], time ? 10 * BAND_WIDTH * BAND_HEIGHT / 1000 / time : 0 );
+    }
+
+    DeleteDC( src_dc );
+    DeleteDC( hdc );
+    DeleteObject( src_dib );
+    DeleteObject( strips_dib );
+    DeleteObject( dib );
+}
+
 static void test_clipping(void)
 {
     HBITMAP bmpDst;
@@ -5925,6 +6022,7 @@ START_TEST(bitmap)
     test_StretchDIBits();
     test_GdiAlphaBlend();
     test_GdiGradientFill();
+    test_large_rects();
     test_32bit_ddb();
     test_bitmapinfoheadersize();
     test_get16dibits();
@@ -3327,16 +3327,263 @@ static void test_simple_graphics(void)
     DeleteDC(mem_dc);
 }
 
+#define SIMD_WIDTH   101
+#define SIMD_HEIGHT  48
+#define SIMD_SIZE    (SIMD_WIDTH * SIMD_HEIGHT * 4)
+#define SIMD_TESTS   6
+
+static const char * const simd_test_names[SIMD_TESTS] =
+{
+    "AlphaBlend", "AlphaBlend constant alpha", "AlphaBlend src alpha",
+    "AlphaBlend src and constant alpha", "24-bpp conversion", "anti-aliased text"
+};
+
+static unsigned int simd_seed;
+
+static BYTE simd_rand(void)
+{
+    simd_seed = simd_seed * 1103515245 + 12345;
+    return simd_seed >> 16;
+}
+
+static HBITMAP create_simd_dib( int bpp, BYTE **bits )
+{
+    BITMAPINFO bmi;
+    HBITMAP dib;
+    int i;
+
+    memset( &bmi, 0, sizeof(bmi) );
+    bmi.bmiHeader.biSize        = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth       = SIMD_WIDTH;
+    bmi.bmiHeader.biHeight      = -SIMD_HEIGHT;
+    bmi.bmiHeader.biPlanes      = 1;
+    bmi.bmiHeader.biBitCount    = bpp;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    dib = CreateDIBSection( 0, &bmi, DIB_RGB_COLORS, (void **)bits, NULL, 0 );
+    ok( dib != NULL, "CreateDIBSection failed\n" );
+    for (i = 0; i < SIMD_HEIGHT * ((SIMD_WIDTH * bpp / 8 + 3) & ~3); i++) (*bits)[i] = simd_rand();
+    return dib;
+}
+
+/* draw with the primitives that have SIMD versions on random data */
+static void draw_simd_primitives( BYTE *results )
+{
+    static const BLENDFUNCTION blends[4] =
+    {
+        { AC_SRC_OVER, 0, 255, 0 },
+        { AC_SRC_OVER, 0, 128, 0 },
+        { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA },
+        { AC_SRC_OVER, 0, 100, AC_SRC_ALPHA }
+    };
+    HDC dst_dc = CreateCompatibleDC( 0 ), src_dc = CreateCompatibleDC( 0 );
+    HBITMAP dst, src, old_dst, old_src;
+    BYTE *dst_bits, *src_bits;
+    HFONT font, old_font;
+    int i;
+
+    simd_seed = 1;
+    for (i = 0; i < 4; i++)
+    {
+        dst = create_simd_dib( 32, &dst_bits );
+        src = create_simd_dib( 32, &src_bits );
+        old_dst = SelectObject( dst_dc, dst );
+        old_src = SelectObject( src_dc, src );
+        if (pGdiAlphaBlend)
+            pGdiAlphaBlend( dst_dc, 0, 0, SIMD_WIDTH, SIMD_HEIGHT, src_dc, 0, 0, SIMD_WIDTH, SIMD_HEIGHT, blends[i] );
+        memcpy( results + i * SIMD_SIZE, dst_bits, SIMD_SIZE );
+        SelectObject( src_dc, old_src );
+        SelectObject( dst_dc, old_dst );
+        DeleteObject( src );
+        DeleteObject( dst );
+    }
+
+    dst = create_simd_dib( 32, &dst_bits );
+    src = create_simd_dib( 24, &src_bits );
+    old_dst = SelectObject( dst_dc, dst );
+    old_src = SelectObject( src_dc, src );
+    BitBlt( dst_dc, 0, 0, SIMD_WIDTH, SIMD_HEIGHT, src_dc, 0, 0, SRCCOPY );
+    memcpy( results + 4 * SIMD_SIZE, dst_bits, SIMD_SIZE );
+    SelectObject( src_dc, old_src );
+    DeleteObject( src );
+
+    for (i = 0; i < SIMD_SIZE; i++) dst_bits[i] = simd_rand();
+    font = CreateFontA( -40, 0, 0, 0, FW_BOLD, 0, 0, 0, ANSI_CHARSET, 0, 0, ANTIALIASED_QUALITY, 0, "Arial" );
+    old_font = SelectObject( dst_dc, font );
+    SetBkMode( dst_dc, TRANSPARENT );
+    SetTextColor( dst_dc, RGB( 0x20, 0x80, 0xc0 ) );
+    TextOutA( dst_dc, 1, 1, "Wine WMW", 8 );
+    GdiFlush();
+    memcpy( results + 5 * SIMD_SIZE, dst_bits, SIMD_SIZE );
+    SelectObject( dst_dc, old_font );
+    DeleteObject( font );
+    SelectObject( dst_dc, old_dst );
+    DeleteObject( dst );
+
+    DeleteDC( src_dc );
+    DeleteDC( dst_dc );
+}
+
+static void write_simd_results( const char *path )
+{
+    BYTE *results = HeapAlloc( GetProcessHeap(), 0, SIMD_TESTS * SIMD_SIZE );
+    HANDLE file;
+    DWORD size;
+
+    draw_simd_primitives( results );
+    file = CreateFileA( path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL );
+    ok( file != INVALID_HANDLE_VALUE, "CreateFile failed with %u\n", GetLastError() );
+    WriteFile( file, results, SIMD_TESTS * SIMD_SIZE, &size, NULL );
+    ok( size == SIMD_TESTS * SIMD_SIZE, "wrote %u bytes\n", size );
+    CloseHandle( file );
+    HeapFree( GetProcessHeap(), 0, results );
+}
+
+/* compare with the results of a child process that uses the plain C primitives on Wine */
+static void test_simd_primitives(void)
+{
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si = { sizeof(si) };
+    char path[MAX_PATH], cmdline[MAX_PATH * 2];
+    BYTE *results, *expect;
+    HANDLE file;
+    DWORD size;
+    char **argv;
+    int i, j;
+    BOOL ret;
+
+    GetTempPathA( MAX_PATH, path );
+    GetTempFileNameA( path, "dib", 0, path );
+    winetest_get_mainargs( &argv );
+    sprintf( cmdline, "\"%s\" dib simd \"%s\"", argv[0], path );
+    SetEnvironmentVariableA( "WINEDIBSIMD", "0" );
+    ret = CreateProcessA( argv[0], cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi );
+    ok( ret, "CreateProcess failed with %u\n", GetLastError() );
+    SetEnvironmentVariableA( "WINEDIBSIMD", NULL );
+    if (!ret) return;
+    winetest_wait_child_process( pi.hProcess );
+    CloseHandle( pi.hThread );
+    CloseHandle( pi.hProcess );
+
+    results = HeapAlloc( GetProcessHeap(), 0, SIMD_TESTS * SIMD_SIZE );
+    expect = HeapAlloc( GetProcessHeap(), 0, SIMD_TESTS * SIMD_SIZE );
+    file = CreateFileA( path, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL );
+    ok( file != INVALID_HANDLE_VALUE, "CreateFile failed with %u\n", GetLastError() );
+    ReadFile( file, expect, SIMD_TESTS * SIMD_SIZE, &size, NULL );
+    ok( size == SIMD_TESTS * SIMD_SIZE, "read %u bytes\n", size );
+    CloseHandle( file );
+    DeleteFileA( path );
+
+    draw_simd_primitives( results );
+    for (i = 0; i < SIMD_TESTS; i++)
+    {
+        const DWORD *res = (const DWORD *)(results + i * SIMD_SIZE), *exp = (const DWORD *)(expect + i * SIMD_SIZE);
+
+        for (j = 0; j < SIMD_SIZE / 4; j++) if (res[j] != exp[j]) break;
+        if (j < SIMD_SIZE / 4)
+            ok( 0, "%s: pixel %d,%d is %08x instead of %08x\n", simd_test_names[i],
+                j % SIMD_WIDTH, j / SIMD_WIDTH, res[j], exp[j] );
+    }
+    HeapFree( GetProcessHeap(), 0, expect );
+    HeapFree( GetProcessHeap(), 0, results );
+}
+
+#define TIME_WIDTH   1024
+#define TIME_HEIGHT  768
+
+/* time the primitives that have SIMD versions on a large bitmap */
+static void time_simd_primitives(void)
+{
+    static const BLENDFUNCTION blends[2] =
+    {
+        { AC_SRC_OVER, 0, 128, 0 },
+        { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA }
+    };
+    HDC dst_dc = CreateCompatibleDC( 0 ), src_dc = CreateCompatibleDC( 0 );
+    HBITMAP dst, src, src24, old_dst, old_src;
+    BITMAPINFO bmi;
+    HFONT font, old_font;
+    BYTE *dst_bits, *src_bits, *src24_bits;
+    DWORD start, time;
+    int i, j;
+
+    memset( &bmi, 0, sizeof(bmi) );
+    bmi.bmiHeader.biSize        = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth       = TIME_WIDTH;
+    bmi.bmiHeader.biHeight      = -TIME_HEIGHT;
+    bmi.bmiHeader.biPlanes      = 1;
+    bmi.bmiHeader.biBitCount    = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    dst = CreateDIBSection( 0, &bmi, DIB_RGB_COLORS, (void **)&dst_bits, NULL, 0 );
+    src = CreateDIBSection( 0, &bmi, DIB_RGB_COLORS, (void **)&src_bits, NULL, 0 );
+    bmi.bmiHeader.biBitCount    = 24;
+    src24 = CreateDIBSection( 0, &bmi, DIB_RGB_COLORS, (void **)&src24_bits, NULL, 0 );
+    simd_seed = 1;
+    for (i = 0; i < TIME_WIDTH * TIME_HEIGHT * 4; i++) src_bits[i] = simd_rand();
+    for (i = 0; i < TIME_WIDTH * TIME_HEIGHT * 3; i++) src24_bits[i] = simd_rand();
+    old_dst = SelectObject( dst_dc, dst );
+    old_src = SelectObject( src_dc, src );
+
+    for (i = 0; i < 2 && pGdiAlphaBlend; i++)
+    {
+        start = GetTickCount();
+        for (j = 0; j < 20; j++)
+            pGdiAlphaBlend( dst_dc, 0, 0, TIME_WIDTH, TIME_HEIGHT,
+                            src_dc, 0, 0, TIME_WIDTH, TIME_HEIGHT, blends[i] );
+        time = GetTickCount() - start;
+        trace( "%s: %u Mpixels/s\n", simd_test_names[i + 1],
+               time ? 20 * TIME_WIDTH * TIME_HEIGHT / 1000 / time : 0 );
+    }
+
+    SelectObject( src_dc, src24 );
+    start = GetTickCount();
+    for (j = 0; j < 20; j++)
+        BitBlt( dst_dc, 0, 0, TIME_WIDTH, TIME_HEIGHT, src_dc, 0, 0, SRCCOPY );
+    time = GetTickCount() - start;
+    trace( "%s: %u Mpixels/s\n", simd_test_names[4], time ? 20 * TIME_WIDTH * TIME_HEIGHT / 1000 / time : 0 );
+
+    font = CreateFontA( -40, 0, 0, 0, FW_BOLD, 0, 0, 0, ANSI_CHARSET, 0, 0, ANTIALIASED_QUALITY, 0, "Arial" );
+    old_font = SelectObject( dst_dc, font );
+    SetBkMode( dst_dc, TRANSPARENT );
+    start = GetTickCount();
+    for (j = 0; j < 1000; j++)
+        TextOutA( dst_dc, j % 512, (j * 7) % (TIME_HEIGHT - 40), "Wine WMW", 8 );
+    GdiFlush();
+    trace( "%s: 1000 strings in %u ms\n", simd_test_names[5], GetTickCount() - start );
+    SelectObject( dst_dc, old_font );
+    DeleteObject( font );
+
+    SelectObject( src_dc, old_src );
+    SelectObject( dst_dc, old_dst );
+    DeleteObject( src24 );
+    DeleteObject( src );
+    DeleteObject( dst );
+    DeleteDC( src_dc );
+    DeleteDC( dst_dc );
+}
+
 START_TEST(dib)
 {
     HMODULE mod = GetModuleHandleA("gdi32.dll");
+    char **argv;
+    int argc;
+
     pSetLayout = (void *)GetProcAddress( mod, "SetLayout" );
     pGdiAlphaBlend = (void *)GetProcAddress( mod, "GdiAlphaBlend" );
     pGdiGradientFill = (void *)GetProcAddress( mod, "GdiGradientFill" );
 
+    argc = winetest_get_mainargs( &argv );
+    if (argc >= 4 && !strcmp( argv[2], "simd" ))
+    {
+        write_simd_results( argv[3] );
+        time_simd_primitives();  /* for comparison with the SIMD timings */
+        return;
+    }
+
     CryptAcquireContextW(&crypt_prov, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT);
 
     test_simple_graphics();
+    test_simd_primitives();
+    time_simd_primitives();
 
     CryptReleaseContext(crypt_prov, 0);
 }
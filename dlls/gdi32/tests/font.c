@@ -4756,6 +4756,26 @@ static void test_GetGlyphOutline(void)
         }
     }
 
+    /* repeated calls on an empty glyph must not depend on earlier ones */
+    for (i = 0; i < sizeof(fmt) / sizeof(fmt[0]); ++i)
+    {
+        DWORD dummy, size;
+
+        if (fmt[i] == GGO_METRICS) continue;
+        SetLastError(0xdeadbeef);
+        for (size = 0; size <= sizeof(dummy); size += sizeof(dummy))
+        {
+            memset(&gm, 0xab, sizeof(gm));
+            ret = GetGlyphOutlineW(hdc, ' ', fmt[i], &gm, size, &dummy, &mat);
+            if (GetLastError() == ERROR_CALL_NOT_IMPLEMENTED) break;
+            memset(&gm2, 0xab, sizeof(gm2));
+            ret2 = GetGlyphOutlineW(hdc, ' ', fmt[i], &gm2, size, &dummy, &mat);
+            ok(ret == ret2, "%2d:%u: got %d then %d\n", fmt[i], size, ret, ret2);
+            ok(!memcmp(&gm, &gm2, sizeof(gm)), "%2d:%u: GLYPHMETRICS differ\n", fmt[i], size);
+            ok(ret == (size ? GDI_ERROR : 0), "%2d:%u: got %d\n", fmt[i], size, ret);
+        }
+    }
+
     SelectObject(hdc, old_hfont);
     DeleteObject(hfont);
 
@@ -6461,6 +6481,44 @@ static void test_fake_bold_font(void)
        "expected %d, got %d\n", data[0].gm.gmCellIncY, data[1].gm.gmCellIncY);
 }
 
+/* switch fonts rapidly while drawing on a window, the way reports and editors do */
+static void test_text_drawing_speed(void)
+{
+    static const char *faces[] = { "Arial", "Tahoma", "Times New Roman", "Courier New" };
+    static const char text[] = "The quick brown fox jumps over the lazy dog 0123456789";
+    HFONT fonts[32], old_font;
+    DWORD start;
+    HWND hwnd;
+    HDC hdc;
+    int i, j;
+
+    hwnd = CreateWindowExA(0, "static", "", WS_POPUP | WS_VISIBLE, 0, 0, 640, 480, 0, 0, 0, NULL);
+    hdc = GetDC( hwnd );
+
+    for (i = 0; i < 32; i++)
+        fonts[i] = CreateFontA( -(10 + 2 * (i / 4)), 0, 0, 0, (i & 16) ? FW_BOLD : FW_NORMAL, 0, 0, 0,
+                                ANSI_CHARSET, 0, 0, (i & 1) ? ANTIALIASED_QUALITY : NONANTIALIASED_QUALITY,
+                                0, faces[i % 4] );
+
+    old_font = SelectObject( hdc, fonts[0] );
+    start = GetTickCount();
+    for (i = 0; i < 100; i++)
+    {
+        for (j = 0; j < 32; j++)
+        {
+            SelectObject( hdc, fonts[(i + j * 7) % 32] );
+            ExtTextOutA( hdc, j % 8, (j * 15) % 460, 0, NULL, text, sizeof(text) - 1, NULL );
+        }
+    }
+    GdiFlush();
+    trace( "%u strings with %u fonts: %u ms\n", 100 * 32, 32, GetTickCount() - start );
+
+    SelectObject( hdc, old_font );
+    for (i = 0; i < 32; i++) DeleteObject( fonts[i] );
+    ReleaseDC( hwnd, hdc );
+    DestroyWindow( hwnd );
+}
+
 static void test_bitmap_font_glyph_index(void)
 {
     const WCHAR text[] = {'#','!','/','b','i','n','/','s','h',0};
@@ -6656,6 +6714,7 @@ START_TEST(font)
     test_GetCharWidth32();
     test_fake_bold_font();
     test_bitmap_font_glyph_index();
+    test_text_drawing_speed();
 
     /* These tests should be last test until RemoveFontResource
      * is properly implemented.
@@ -3380,6 +3380,177 @@ static void test_overlapped(void)
     ok( r == TRUE, "close handle failed\n");
 }
 
+#define QUEUE_DEPTH 64
+#define QUEUE_BLOCK 4096
+
+static void check_queued_block( const BYTE *buffer, unsigned int block )
+{
+    unsigned int i;
+
+    for (i = 0; i < QUEUE_BLOCK; i++) if (buffer[i] != (BYTE)(block * 7 + i)) break;
+    ok( i == QUEUE_BLOCK, "block %u: wrong data at %u\n", block, i );
+}
+
+static void test_overlapped_queue(void)
+{
+    static BYTE buffers[QUEUE_DEPTH][QUEUE_BLOCK];
+    char temp_path[MAX_PATH], name[MAX_PATH];
+    OVERLAPPED ov[QUEUE_DEPTH], *pov;
+    HANDLE file, port;
+    DWORD i, j, size, start, pending = 0;
+    ULONG_PTR key;
+    BOOL ret;
+
+    GetTempPathA( MAX_PATH, temp_path );
+    GetTempFileNameA( temp_path, "ovq", 0, name );
+    file = CreateFileA( name, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                        FILE_FLAG_OVERLAPPED | FILE_FLAG_DELETE_ON_CLOSE, NULL );
+    ok( file != INVALID_HANDLE_VALUE, "CreateFile failed %u\n", GetLastError() );
+
+    for (i = 0; i < QUEUE_DEPTH; i++)
+    {
+        for (j = 0; j < QUEUE_BLOCK; j++) buffers[i][j] = i * 7 + j;
+        memset( &ov[i], 0, sizeof(ov[i]) );
+        ov[i].Offset = i * QUEUE_BLOCK;
+        ov[i].hEvent = CreateEventA( NULL, TRUE, FALSE, NULL );
+        ret = WriteFile( file, buffers[i], QUEUE_BLOCK, NULL, &ov[i] );
+        ok( ret || GetLastError() == ERROR_IO_PENDING, "WriteFile failed %u\n", GetLastError() );
+    }
+    for (i = 0; i < QUEUE_DEPTH; i++)
+    {
+        ret = GetOverlappedResult( file, &ov[i], &size, TRUE );
+        ok( ret && size == QUEUE_BLOCK, "write %u: ret %d size %u\n", i, ret, size );
+    }
+
+    memset( buffers, 0, sizeof(buffers) );
+    start = GetTickCount();
+    for (i = 0; i < QUEUE_DEPTH; i++)
+    {
+        ret = ReadFile( file, buffers[i], QUEUE_BLOCK, NULL, &ov[i] );
+        if (!ret)
+        {
+            ok( GetLastError() == ERROR_IO_PENDING, "ReadFile failed %u\n", GetLastError() );
+            pending++;
+        }
+    }
+    for (i = 0; i < QUEUE_DEPTH; i++)
+    {
+        ret = GetOverlappedResult( file, &ov[i], &size, TRUE );
+        ok( ret && size == QUEUE_BLOCK, "read %u: ret %d size %u\n", i, ret, size );
+        check_queued_block( buffers[i], i );
+    }
+    trace( "%u reads, %u pending: %u ms\n", QUEUE_DEPTH, pending, GetTickCount() - start );
+
+    /* the event may be closed while the read is pending */
+    memset( buffers[0], 0, QUEUE_BLOCK );
+    ov[0].Offset = 5 * QUEUE_BLOCK;
+    ret = ReadFile( file, buffers[0], QUEUE_BLOCK, NULL, &ov[0] );
+    ok( ret || GetLastError() == ERROR_IO_PENDING, "ReadFile failed %u\n", GetLastError() );
+    CloseHandle( ov[0].hEvent );
+    for (i = 0; i < 500 && ov[0].Internal == STATUS_PENDING; i++) Sleep( 10 );
+    ok( ov[0].Internal == STATUS_SUCCESS, "got status %08lx\n", ov[0].Internal );
+    ok( ov[0].InternalHigh == QUEUE_BLOCK, "got size %lu\n", ov[0].InternalHigh );
+    check_queued_block( buffers[0], 5 );
+
+    /* reads past the end of file */
+    ov[1].Offset = QUEUE_DEPTH * QUEUE_BLOCK;
+    ret = ReadFile( file, buffers[1], QUEUE_BLOCK, NULL, &ov[1] );
+    if (!ret && GetLastError() == ERROR_IO_PENDING) ret = GetOverlappedResult( file, &ov[1], &size, TRUE );
+    ok( !ret && GetLastError() == ERROR_HANDLE_EOF, "got ret %d error %u\n", ret, GetLastError() );
+
+    /* completions are still posted once the file is bound to a port */
+    port = CreateIoCompletionPort( file, NULL, 0xdead, 0 );
+    ok( port != NULL, "CreateIoCompletionPort failed %u\n", GetLastError() );
+    ov[2].Offset = 3 * QUEUE_BLOCK;
+    ret = ReadFile( file, buffers[2], QUEUE_BLOCK, NULL, &ov[2] );
+    ok( ret || GetLastError() == ERROR_IO_PENDING, "ReadFile failed %u\n", GetLastError() );
+    ret = GetQueuedCompletionStatus( port, &size, &key, &pov, 5000 );
+    ok( ret, "GetQueuedCompletionStatus failed %u\n", GetLastError() );
+    ok( key == 0xdead && pov == &ov[2] && size == QUEUE_BLOCK, "got key %lx ov %p size %u\n", key, pov, size );
+    check_queued_block( buffers[2], 3 );
+    CloseHandle( port );
+
+    for (i = 1; i < QUEUE_DEPTH; i++) CloseHandle( ov[i].hEvent );
+    CloseHandle( file );
+}
+
+static void test_overlapped_queue_child(void)
+{
+    char cmdline[MAX_PATH], **argv;
+    PROCESS_INFORMATION info;
+    STARTUPINFOA startup;
+    BOOL ret;
+
+    winetest_get_mainargs( &argv );
+    sprintf( cmdline, "\"%s\" file overlapped", argv[0] );
+    memset( &startup, 0, sizeof(startup) );
+    startup.cb = sizeof(startup);
+    SetEnvironmentVariableA( "WINEIOURING", "1" );
+    SetEnvironmentVariableA( "WINEINPROCSYNC", "1" );
+    ret = CreateProcessA( NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &startup, &info );
+    SetEnvironmentVariableA( "WINEIOURING", NULL );
+    SetEnvironmentVariableA( "WINEINPROCSYNC", NULL );
+    ok( ret, "CreateProcess failed %u\n", GetLastError() );
+    winetest_wait_child_process( info.hProcess );
+    CloseHandle( info.hProcess );
+    CloseHandle( info.hThread );
+}
+
+#define MANY_FILES 1000
+
+static void test_case_insensitive_lookups(void)
+{
+    char temp_path[MAX_PATH], dir[MAX_PATH + 16], name[MAX_PATH + 32];
+    DWORD start, attr;
+    unsigned int i;
+    HANDLE file;
+    BOOL ret;
+
+    GetTempPathA( MAX_PATH, temp_path );
+    sprintf( dir, "%sManyFiles", temp_path );
+    ret = CreateDirectoryA( dir, NULL );
+    ok( ret, "CreateDirectory failed %u\n", GetLastError() );
+
+    for (i = 0; i < MANY_FILES; i++)
+    {
+        sprintf( name, "%s\\File%04u.Tmp", dir, i );
+        file = CreateFileA( name, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, 0 );
+        ok( file != INVALID_HANDLE_VALUE, "CreateFile %s failed %u\n", name, GetLastError() );
+        CloseHandle( file );
+    }
+
+    /* the names never match the exact case, so every lookup needs the directory contents */
+    start = GetTickCount();
+    for (i = 0; i < MANY_FILES; i++)
+    {
+        sprintf( name, "%s\\fILE%04u.tMP", dir, i );
+        attr = GetFileAttributesA( name );
+        ok( attr != INVALID_FILE_ATTRIBUTES, "%s not found %u\n", name, GetLastError() );
+        sprintf( name, "%s\\fILE%04u.tMP2", dir, i );
+        attr = GetFileAttributesA( name );
+        ok( attr == INVALID_FILE_ATTRIBUTES, "%s found\n", name );
+    }
+    trace( "%u lookups: %u ms\n", 2 * MANY_FILES, GetTickCount() - start );
+
+    /* changes are seen right away */
+    sprintf( name, "%s\\NewFile.Tmp", dir );
+    file = CreateFileA( name, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, 0 );
+    ok( file != INVALID_HANDLE_VALUE, "CreateFile %s failed %u\n", name, GetLastError() );
+    CloseHandle( file );
+    sprintf( name, "%s\\NEWFILE.TMP", dir );
+    ok( GetFileAttributesA( name ) != INVALID_FILE_ATTRIBUTES, "%s not found\n", name );
+    ok( DeleteFileA( name ), "DeleteFile %s failed %u\n", name, GetLastError() );
+    ok( GetFileAttributesA( name ) == INVALID_FILE_ATTRIBUTES, "%s still found\n", name );
+
+    for (i = 0; i < MANY_FILES; i++)
+    {
+        sprintf( name, "%s\\FILE%04u.TMP", dir, i );
+        ok( DeleteFileA( name ), "DeleteFile %s failed %u\n", name, GetLastError() );
+    }
+    ret = RemoveDirectoryA( dir );
+    ok( ret, "RemoveDirectory failed %u\n", GetLastError() );
+}
+
 static void test_RemoveDirectory(void)
 {
     int rc;
@@ -4720,8 +4891,18 @@ static void test_GetFileAttributesExW(void)
 
 START_TEST(file)
 {
+    char **argv;
+    int argc;
+
     InitFunctionPointers();
 
+    argc = winetest_get_mainargs( &argv );
+    if (argc >= 3 && !strcmp( argv[2], "overlapped" ))
+    {
+        test_overlapped_queue();
+        return;
+    }
+
     test__hread(  );
     test__hwrite(  );
     test__lclose(  );
@@ -4763,6 +4944,9 @@ START_TEST(file)
     test_read_write();
     test_OpenFile();
     test_overlapped();
+    test_overlapped_queue();
+    test_overlapped_queue_child();
+    test_case_insensitive_lookups();
     test_RemoveDirectory();
     test_ReplaceFileA();
     test_ReplaceFileW();
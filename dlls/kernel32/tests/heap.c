@@ -39,6 +39,7 @@
 #define HEAP_VALIDATE_PARAMS  0x40000000
 
 static BOOL (WINAPI *pHeapQueryInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T, PSIZE_T);
+static BOOL (WINAPI *pHeapSetInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T);
 static BOOL (WINAPI *pGetPhysicallyInstalledSystemMemory)(ULONGLONG *);
 static ULONG (WINAPI *pRtlGetNtGlobalFlags)(void);
 
@@ -854,6 +855,198 @@ static void test_HeapQueryInformation(void)
     ok(info == 0 || info == 1 || info == 2, "expected 0, 1 or 2, got %u\n", info);
 }
 
+static DWORD WINAPI lfh_thread( void *arg )
+{
+    HANDLE heap = arg;
+    BYTE *blocks[256];
+    SIZE_T size;
+    int i, j, iter;
+
+    for (iter = 0; iter < 50; iter++)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            size = (i * 7 + iter) % 1100;
+            blocks[i] = HeapAlloc( heap, (i & 1) ? HEAP_ZERO_MEMORY : 0, size );
+            ok( blocks[i] != NULL, "HeapAlloc failed for size %lu\n", size );
+            if (!blocks[i]) return 1;
+            if (i & 1)
+                for (j = 0; j < size; j++)
+                    if (blocks[i][j]) { ok( 0, "block %p not zeroed at %u\n", blocks[i], j ); break; }
+            memset( blocks[i], i, size );
+        }
+        for (i = 0; i < 256; i += 3)
+        {
+            size = (i * 7 + iter) % 1100;
+            ok( HeapSize( heap, 0, blocks[i] ) == size, "wrong size %lu / %lu\n",
+                HeapSize( heap, 0, blocks[i] ), size );
+            blocks[i] = HeapReAlloc( heap, 0, blocks[i], size + 100 );
+            ok( blocks[i] != NULL, "HeapReAlloc failed\n" );
+            if (!blocks[i]) return 1;
+            for (j = 0; j < size; j++)
+                if (blocks[i][j] != (BYTE)i) { ok( 0, "block %p corrupted at %u\n", blocks[i], j ); break; }
+        }
+        for (i = 0; i < 256; i++) ok( HeapFree( heap, 0, blocks[i] ), "HeapFree failed\n" );
+    }
+    return 0;
+}
+
+static DWORD WINAPI lfh_lock_thread( void *arg )
+{
+    HANDLE heap = arg;
+    void *ptr = HeapAlloc( heap, 0, 16 );
+
+    ok( ptr != NULL, "HeapAlloc failed\n" );
+    ok( HeapFree( heap, 0, ptr ), "HeapFree failed\n" );
+    return 0;
+}
+
+static DWORD run_lfh_threads( HANDLE heap )
+{
+    HANDLE threads[4];
+    DWORD start = GetTickCount();
+    int i;
+
+    for (i = 0; i < 4; i++) threads[i] = CreateThread( NULL, 0, lfh_thread, heap, 0, NULL );
+    WaitForMultipleObjects( 4, threads, TRUE, INFINITE );
+    for (i = 0; i < 4; i++) CloseHandle( threads[i] );
+    return GetTickCount() - start;
+}
+
+static void test_lfh_walk( HANDLE heap )
+{
+    PROCESS_HEAP_ENTRY entry;
+    void *ptrs[64];
+    BOOL found[64];
+    int i, busy = 0;
+
+    for (i = 0; i < 64; i++)
+    {
+        ptrs[i] = HeapAlloc( heap, 0, 8 + i * 16 );
+        ok( ptrs[i] != NULL, "HeapAlloc failed\n" );
+        found[i] = FALSE;
+    }
+    ok( HeapFree( heap, 0, ptrs[0] ), "HeapFree failed\n" );
+
+    ok( HeapLock( heap ), "HeapLock failed\n" );
+    memset( &entry, 0, sizeof(entry) );
+    while (HeapWalk( heap, &entry ))
+    {
+        if (!(entry.wFlags & PROCESS_HEAP_ENTRY_BUSY)) continue;
+        busy++;
+        for (i = 0; i < 64; i++)
+        {
+            if (entry.lpData != ptrs[i]) continue;
+            ok( !found[i], "block %p walked twice\n", ptrs[i] );
+            ok( entry.cbData >= 8 + i * 16, "%d: wrong size %u\n", i, entry.cbData );
+            found[i] = TRUE;
+        }
+    }
+    ok( GetLastError() == ERROR_NO_MORE_ITEMS, "HeapWalk error %u\n", GetLastError() );
+    ok( HeapUnlock( heap ), "HeapUnlock failed\n" );
+
+    ok( !found[0], "freed block %p walked as busy\n", ptrs[0] );
+    for (i = 1; i < 64; i++) ok( found[i], "%d: block %p not walked\n", i, ptrs[i] );
+    ok( busy >= 63, "only %d busy blocks\n", busy );
+    for (i = 1; i < 64; i++) HeapFree( heap, 0, ptrs[i] );
+}
+
+static void test_HeapSetInformation(void)
+{
+    HANDLE heap, thread;
+    ULONG info;
+    DWORD ret, time;
+    void *ptr, *ptr2;
+
+    pHeapSetInformation = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "HeapSetInformation");
+    if (!pHeapSetInformation || !pHeapQueryInformation)
+    {
+        win_skip("HeapSetInformation is not available\n");
+        return;
+    }
+
+    heap = HeapCreate( HEAP_NO_SERIALIZE, 0, 0 );
+    info = 2;
+    ret = pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( !ret, "enabling the LFH on an unserialized heap succeeded\n" );
+    HeapDestroy( heap );
+
+    heap = HeapCreate( 0, 0, 0 );
+    ok( heap != NULL, "HeapCreate failed\n" );
+    info = 2;
+    ret = pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    if (!ret && pRtlGetNtGlobalFlags && pRtlGetNtGlobalFlags())
+    {
+        skip( "LFH is disabled with heap debugging flags\n" );
+        HeapDestroy( heap );
+        return;
+    }
+    ok( ret, "HeapSetInformation error %u\n", GetLastError() );
+
+    info = 0xdeadbeef;
+    ret = pHeapQueryInformation( heap, HeapCompatibilityInformation, &info, sizeof(info), NULL );
+    ok( ret, "HeapQueryInformation error %u\n", GetLastError() );
+    ok( info == 2, "expected 2, got %u\n", info );
+
+    ptr = HeapAlloc( heap, 0, 24 );
+    ok( ptr != NULL, "HeapAlloc failed\n" );
+    ok( HeapValidate( heap, 0, ptr ), "HeapValidate failed\n" );
+    ok( HeapSize( heap, 0, ptr ) == 24, "wrong size %lu\n", HeapSize( heap, 0, ptr ) );
+    ptr = HeapReAlloc( heap, HEAP_REALLOC_IN_PLACE_ONLY, ptr, 8 );
+    ok( ptr != NULL, "HeapReAlloc failed\n" );
+    ok( HeapSize( heap, 0, ptr ) == 8, "wrong size %lu\n", HeapSize( heap, 0, ptr ) );
+    ok( HeapFree( heap, 0, ptr ), "HeapFree failed\n" );
+
+    ptr = HeapAlloc( heap, 0, 1024 );
+    ok( ptr != NULL, "HeapAlloc failed\n" );
+    memset( ptr, 0x55, 1024 );
+    ptr = HeapReAlloc( heap, 0, ptr, 16 );
+    ok( ptr != NULL, "HeapReAlloc failed\n" );
+    ok( HeapSize( heap, 0, ptr ) == 16, "wrong size %lu\n", HeapSize( heap, 0, ptr ) );
+    ok( ((BYTE *)ptr)[15] == 0x55, "wrong data %x\n", ((BYTE *)ptr)[15] );
+    ok( HeapValidate( heap, 0, ptr ), "HeapValidate failed\n" );
+    ok( HeapFree( heap, 0, ptr ), "HeapFree failed\n" );
+
+    /* shrinking in place works across size classes, like on the regular heap */
+    ptr = HeapAlloc( heap, 0, 1024 );
+    ok( ptr != NULL, "HeapAlloc failed\n" );
+    ptr2 = HeapReAlloc( heap, HEAP_REALLOC_IN_PLACE_ONLY, ptr, 700 );
+    ok( ptr2 == ptr, "HeapReAlloc returned %p instead of %p\n", ptr2, ptr );
+    ok( HeapSize( heap, 0, ptr ) == 700, "wrong size %lu\n", HeapSize( heap, 0, ptr ) );
+    ptr2 = HeapReAlloc( heap, HEAP_REALLOC_IN_PLACE_ONLY, ptr, 16 );
+    ok( ptr2 == ptr, "HeapReAlloc returned %p instead of %p\n", ptr2, ptr );
+    ok( HeapSize( heap, 0, ptr ) == 16, "wrong size %lu\n", HeapSize( heap, 0, ptr ) );
+    ptr2 = HeapReAlloc( heap, HEAP_REALLOC_IN_PLACE_ONLY | HEAP_ZERO_MEMORY, ptr, 1000 );
+    ok( ptr2 == ptr, "HeapReAlloc returned %p instead of %p\n", ptr2, ptr );
+    ok( HeapSize( heap, 0, ptr ) == 1000, "wrong size %lu\n", HeapSize( heap, 0, ptr ) );
+    ok( !((BYTE *)ptr)[999], "memory not zeroed\n" );
+    ok( HeapValidate( heap, 0, ptr ), "HeapValidate failed\n" );
+    ok( HeapFree( heap, 0, ptr ), "HeapFree failed\n" );
+
+    /* HeapLock keeps other threads out of the small blocks too */
+    ok( HeapLock( heap ), "HeapLock failed\n" );
+    thread = CreateThread( NULL, 0, lfh_lock_thread, heap, 0, NULL );
+    ret = WaitForSingleObject( thread, 200 );
+    ok( ret == WAIT_TIMEOUT, "thread wasn't blocked by HeapLock, ret %u\n", ret );
+    ptr = HeapAlloc( heap, 0, 16 );
+    ok( ptr != NULL, "HeapAlloc failed while holding the lock\n" );
+    ok( HeapFree( heap, 0, ptr ), "HeapFree failed while holding the lock\n" );
+    ok( HeapUnlock( heap ), "HeapUnlock failed\n" );
+    ret = WaitForSingleObject( thread, 5000 );
+    ok( ret == WAIT_OBJECT_0, "thread didn't finish, ret %u\n", ret );
+    CloseHandle( thread );
+
+    test_lfh_walk( heap );
+
+    time = run_lfh_threads( heap );
+    ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+    HeapDestroy( heap );
+
+    heap = HeapCreate( 0, 0, 0 );
+    trace( "small blocks in 4 threads: %u ms with the LFH, %u ms without\n", time, run_lfh_threads( heap ) );
+    HeapDestroy( heap );
+}
+
 static void test_heap_checks( DWORD flags )
 {
     BYTE old, *p, *p2;
@@ -1207,6 +1400,7 @@ START_TEST(heap)
     test_sized_HeapReAlloc((1 << 20), 1);
 
     test_HeapQueryInformation();
+    test_HeapSetInformation();
     test_GetPhysicallyInstalledSystemMemory();
 
     if (pRtlGetNtGlobalFlags)
@@ -233,6 +233,33 @@ static void testGetProcAddress_Wrong(void)
         "Expected ERROR_MOD_NOT_FOUND or ERROR_INVALID_HANDLE(win9x), got %d\n", GetLastError());
 }
 
+static void testGetProcAddress_speed(void)
+{
+    HMODULE module = GetModuleHandleA("kernel32.dll");
+    const IMAGE_NT_HEADERS *nt = (const IMAGE_NT_HEADERS *)((const char *)module + ((const IMAGE_DOS_HEADER *)module)->e_lfanew);
+    const IMAGE_DATA_DIRECTORY *dir = &nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+    const IMAGE_EXPORT_DIRECTORY *exports = (const IMAGE_EXPORT_DIRECTORY *)((const char *)module + dir->VirtualAddress);
+    const DWORD *names = (const DWORD *)((const char *)module + exports->AddressOfNames);
+    DWORD start, i, j, found = 0;
+    HMODULE hmod;
+
+    start = GetTickCount();
+    for (i = 0; i < 10; i++)
+        for (j = 0; j < exports->NumberOfNames; j++)
+            if (GetProcAddress(module, (const char *)module + names[j])) found++;
+    ok(found == 10 * exports->NumberOfNames, "found %u of %u exports\n", found, 10 * exports->NumberOfNames);
+    trace("%u lookups: %u ms\n", 10 * exports->NumberOfNames, GetTickCount() - start);
+
+    start = GetTickCount();
+    for (i = 0; i < 100000; i++)
+    {
+        hmod = GetModuleHandleA((i & 1) ? "KERNEL32.DLL" : "kernel32");
+        if (hmod != module) break;
+    }
+    ok(i == 100000, "%u: got %p instead of %p\n", i, hmod, module);
+    trace("%u module lookups: %u ms\n", i, GetTickCount() - start);
+}
+
 static void testLoadLibraryEx(void)
 {
     CHAR path[MAX_PATH];
@@ -765,6 +792,7 @@ START_TEST(module)
     testNestedLoadLibraryA();
     testLoadLibraryA_Wrong();
     testGetProcAddress_Wrong();
+    testGetProcAddress_speed();
     testLoadLibraryEx();
     testGetModuleHandleEx();
     testK32GetModuleInformation();
@@ -654,6 +654,59 @@ static void test_waitable_timer(void)
     CloseHandle( handle );
 }
 
+#define MANY_TIMERS 10000
+
+static void test_many_timers(void)
+{
+    static HANDLE timers[MANY_TIMERS];
+    LARGE_INTEGER due;
+    HANDLE timer;
+    DWORD start, ret;
+    unsigned int i;
+
+    if (!pCreateWaitableTimerA)
+    {
+        win_skip("CreateWaitableTimerA() is not available\n");
+        return;
+    }
+
+    for (i = 0; i < MANY_TIMERS; i++)
+    {
+        timers[i] = pCreateWaitableTimerA(NULL, TRUE, NULL);
+        ok(timers[i] != NULL, "CreateWaitableTimer failed with error %u\n", GetLastError());
+    }
+
+    /* pending timeouts between one and four hours away, set in no particular order */
+    start = GetTickCount();
+    for (i = 0; i < MANY_TIMERS; i++)
+    {
+        due.QuadPart = -(LONGLONG)(3600 + (i * 7919) % MANY_TIMERS) * 10000000;
+        ret = SetWaitableTimer(timers[i], &due, 0, NULL, NULL, FALSE);
+        ok(ret, "SetWaitableTimer failed with error %u\n", GetLastError());
+    }
+    trace("%u timers set: %u ms\n", MANY_TIMERS, GetTickCount() - start);
+
+    /* a short timeout must still expire first */
+    timer = pCreateWaitableTimerA(NULL, TRUE, NULL);
+    due.QuadPart = -100 * 10000;
+    SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE);
+    ret = WaitForSingleObject(timer, 5000);
+    ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret);
+    ret = WaitForMultipleObjects(MAXIMUM_WAIT_OBJECTS, timers, FALSE, 0);
+    ok(ret == WAIT_TIMEOUT, "WaitForMultipleObjects returned %u\n", ret);
+    CloseHandle(timer);
+
+    /* cancel every other one, then close them all with the rest still pending */
+    start = GetTickCount();
+    for (i = 0; i < MANY_TIMERS; i += 2)
+    {
+        ret = CancelWaitableTimer(timers[i]);
+        ok(ret, "CancelWaitableTimer failed with error %u\n", GetLastError());
+    }
+    for (i = 0; i < MANY_TIMERS; i++) CloseHandle(timers[i]);
+    trace("%u timers canceled and closed: %u ms\n", MANY_TIMERS, GetTickCount() - start);
+}
+
 static HANDLE sem = 0;
 
 static void CALLBACK iocp_callback(DWORD dwErrorCode, DWORD dwNumberOfBytesTransferred, LPOVERLAPPED lpOverlapped)
@@ -2648,6 +2701,115 @@ static void test_apc_deadlock(void)
     CloseHandle(pi.hProcess);
 }
 
+static DWORD WINAPI abandon_mutex_thread(void *arg)
+{
+    HANDLE *mutexes = arg;
+    DWORD ret;
+
+    ret = WaitForSingleObject(mutexes[0], 0);
+    ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret);
+    ret = WaitForSingleObject(mutexes[0], 0);
+    ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret);
+    SetEvent(mutexes[1]);
+    WaitForSingleObject(mutexes[2], INFINITE);
+    return 0;
+}
+
+static void test_mutex_child(void)
+{
+    HANDLE mutex, thread, handles[3];
+    DWORD ret;
+    int i;
+
+    mutex = CreateMutexA(NULL, TRUE, NULL);
+    ok(mutex != NULL, "CreateMutex failed with error %u\n", GetLastError());
+
+    /* recursive acquire and release */
+    for (i = 0; i < 4; i++)
+    {
+        ret = WaitForSingleObject(mutex, 0);
+        ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret);
+    }
+    for (i = 0; i < 5; i++)
+    {
+        ret = ReleaseMutex(mutex);
+        ok(ret, "ReleaseMutex failed with error %u\n", GetLastError());
+    }
+    SetLastError(0xdeadbeef);
+    ret = ReleaseMutex(mutex);
+    ok(!ret, "ReleaseMutex succeeded\n");
+    ok(GetLastError() == ERROR_NOT_OWNER, "wrong error %u\n", GetLastError());
+
+    /* abandoned by a thread exiting while nobody waits */
+    handles[0] = mutex;
+    handles[1] = CreateEventA(NULL, FALSE, FALSE, NULL);
+    handles[2] = CreateEventA(NULL, FALSE, TRUE, NULL);
+    thread = CreateThread(NULL, 0, abandon_mutex_thread, handles, 0, NULL);
+    ret = WaitForSingleObject(thread, 1000);
+    ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret);
+    CloseHandle(thread);
+    ret = WaitForSingleObject(handles[1], 0);
+    ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret);
+
+    ret = WaitForSingleObject(mutex, 0);
+    ok(ret == WAIT_ABANDONED, "WaitForSingleObject returned %u\n", ret);
+    ret = WaitForSingleObject(mutex, 0);
+    ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret);
+    ret = ReleaseMutex(mutex);
+    ok(ret, "ReleaseMutex failed with error %u\n", GetLastError());
+    ret = ReleaseMutex(mutex);
+    ok(ret, "ReleaseMutex failed with error %u\n", GetLastError());
+    ret = ReleaseMutex(mutex);
+    ok(!ret, "ReleaseMutex succeeded\n");
+
+    /* abandoned by a thread exiting while another thread is waiting */
+    thread = CreateThread(NULL, 0, abandon_mutex_thread, handles, 0, NULL);
+    ret = WaitForSingleObject(handles[1], 1000);
+    ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret);
+    ret = WaitForSingleObject(mutex, 0);
+    ok(ret == WAIT_TIMEOUT, "WaitForSingleObject returned %u\n", ret);
+    SetEvent(handles[2]);
+    ret = WaitForSingleObject(mutex, 1000);
+    ok(ret == WAIT_ABANDONED, "WaitForSingleObject returned %u\n", ret);
+    ret = ReleaseMutex(mutex);
+    ok(ret, "ReleaseMutex failed with error %u\n", GetLastError());
+    ret = WaitForSingleObject(thread, 1000);
+    ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret);
+    CloseHandle(thread);
+
+    /* the abandoned state is only reported once */
+    ret = WaitForSingleObject(mutex, 0);
+    ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret);
+    ret = ReleaseMutex(mutex);
+    ok(ret, "ReleaseMutex failed with error %u\n", GetLastError());
+
+    CloseHandle(handles[1]);
+    CloseHandle(handles[2]);
+    CloseHandle(mutex);
+}
+
+/* run the mutex tests in a child process, with the in-process synchronization enabled on Wine */
+static void test_inproc_mutex(void)
+{
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si = { sizeof(si) };
+    char cmdline[MAX_PATH];
+    char **argv;
+    BOOL ret;
+
+    winetest_get_mainargs(&argv);
+    sprintf(cmdline, "\"%s\" sync mutex", argv[0]);
+    SetEnvironmentVariableA("WINEINPROCSYNC", "1");
+    ret = CreateProcessA(argv[0], cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi);
+    ok(ret, "CreateProcess failed with %u\n", GetLastError());
+    SetEnvironmentVariableA("WINEINPROCSYNC", NULL);
+    if (!ret) return;
+
+    winetest_wait_child_process(pi.hProcess);
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+}
+
 START_TEST(sync)
 {
     char **argv;
@@ -2694,16 +2856,20 @@ START_TEST(sync)
         {
             for (;;) SleepEx(INFINITE, TRUE);
         }
+        if (!strcmp(argv[2], "mutex")) test_mutex_child();
         return;
     }
 
     init_fastcall_thunk();
     test_signalandwait();
     test_mutex();
+    test_mutex_child();
+    test_inproc_mutex();
     test_slist();
     test_event();
     test_semaphore();
     test_waitable_timer();
+    test_many_timers();
     test_iocp_callback();
     test_timer_queue();
     test_WaitForSingleObject();
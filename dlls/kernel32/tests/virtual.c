@@ -234,6 +234,56 @@ static void test_VirtualAllocEx(void)
     CloseHandle(hProcess);
 }
 
+static void test_process_memory_bandwidth(void)
+{
+    const SIZE_T alloc_size = 1 << 20;
+    SIZE_T bytes, i;
+    char *src, *dst;
+    HANDLE hProcess;
+    void *addr;
+    DWORD start;
+    BOOL b;
+
+    if (!pVirtualAllocEx || !pVirtualFreeEx)
+    {
+        win_skip("Virtual{Alloc,Free}Ex not available\n");
+        return;
+    }
+
+    hProcess = create_target_process("sleep");
+    ok(hProcess != NULL, "Can't start process\n");
+    addr = pVirtualAllocEx(hProcess, NULL, alloc_size, MEM_COMMIT, PAGE_READWRITE);
+    ok(addr != NULL, "VirtualAllocEx error %u\n", GetLastError());
+
+    src = VirtualAlloc( NULL, alloc_size, MEM_COMMIT, PAGE_READWRITE );
+    dst = VirtualAlloc( NULL, alloc_size, MEM_COMMIT, PAGE_READWRITE );
+    for (i = 0; i < alloc_size; i++)
+        src[i] = (i * 7) >> 3;
+
+    start = GetTickCount();
+    for (i = 0; i < 4; i++)
+    {
+        b = WriteProcessMemory(hProcess, addr, src, alloc_size, &bytes);
+        ok(b && bytes == alloc_size, "%lu bytes written\n", bytes);
+    }
+    trace("%lu MB written: %u ms\n", (4 * alloc_size) >> 20, GetTickCount() - start);
+
+    start = GetTickCount();
+    for (i = 0; i < 4; i++)
+    {
+        b = ReadProcessMemory(hProcess, addr, dst, alloc_size, &bytes);
+        ok(b && bytes == alloc_size, "%lu bytes read\n", bytes);
+    }
+    trace("%lu MB read: %u ms\n", (4 * alloc_size) >> 20, GetTickCount() - start);
+    ok(!memcmp(src, dst, alloc_size), "Data from remote process differs\n");
+
+    VirtualFree( src, 0, MEM_RELEASE );
+    VirtualFree( dst, 0, MEM_RELEASE );
+    pVirtualFreeEx(hProcess, addr, 0, MEM_RELEASE);
+    TerminateProcess(hProcess, 0);
+    CloseHandle(hProcess);
+}
+
 static void test_VirtualAlloc(void)
 {
     void *addr1, *addr2;
@@ -423,6 +473,59 @@ static void test_VirtualAlloc(void)
     ok(VirtualFree(addr1, 0, MEM_RELEASE), "VirtualFree failed\n");
 }
 
+#define MANY_VIEWS 4096
+
+static void test_many_views(void)
+{
+    static void *views[MANY_VIEWS];
+    MEMORY_BASIC_INFORMATION info;
+    DWORD start, old_prot;
+    unsigned int i, count;
+    BOOL ret;
+
+    start = GetTickCount();
+    for (count = 0; count < MANY_VIEWS; count++)
+        if (!(views[count] = VirtualAlloc( NULL, 0x10000, MEM_RESERVE, PAGE_NOACCESS ))) break;
+    ok( count == MANY_VIEWS, "only %u views allocated, error %u\n", count, GetLastError() );
+    trace( "%u allocs: %u ms\n", count, GetTickCount() - start );
+
+    start = GetTickCount();
+    for (i = 0; i < count; i++)
+    {
+        ok( VirtualAlloc( (char *)views[i] + 0x1000, 0x1000, MEM_COMMIT, PAGE_READWRITE ) != NULL,
+            "%u: commit failed %u\n", i, GetLastError() );
+        ret = VirtualProtect( (char *)views[i] + 0x1000, 0x1000, PAGE_READONLY, &old_prot );
+        ok( ret && old_prot == PAGE_READWRITE, "%u: VirtualProtect failed %u\n", i, GetLastError() );
+    }
+    trace( "%u commits and protects: %u ms\n", count, GetTickCount() - start );
+
+    start = GetTickCount();
+    for (i = 0; i < count; i++)
+    {
+        ok( VirtualQuery( (char *)views[i] + 0x1800, &info, sizeof(info) ) == sizeof(info),
+            "%u: VirtualQuery failed\n", i );
+        ok( info.AllocationBase == views[i], "%u: got base %p for %p\n", i, info.AllocationBase, views[i] );
+        ok( info.BaseAddress == (char *)views[i] + 0x1000, "%u: got %p\n", i, info.BaseAddress );
+        ok( info.State == MEM_COMMIT && info.Protect == PAGE_READONLY,
+            "%u: got state %x prot %x\n", i, info.State, info.Protect );
+    }
+    trace( "%u queries: %u ms\n", count, GetTickCount() - start );
+
+    /* free every other view and reallocate the holes at their address */
+    start = GetTickCount();
+    for (i = 0; i < count; i += 2)
+        ok( VirtualFree( views[i], 0, MEM_RELEASE ), "%u: VirtualFree failed %u\n", i, GetLastError() );
+    for (i = 0; i < count; i += 2)
+        ok( VirtualAlloc( views[i], 0x10000, MEM_RESERVE, PAGE_NOACCESS ) == views[i],
+            "%u: realloc at %p failed %u\n", i, views[i], GetLastError() );
+    trace( "%u frees and reallocs: %u ms\n", (count + 1) / 2, GetTickCount() - start );
+
+    start = GetTickCount();
+    for (i = 0; i < count; i++)
+        ok( VirtualFree( views[i], 0, MEM_RELEASE ), "%u: VirtualFree failed %u\n", i, GetLastError() );
+    trace( "%u frees: %u ms\n", count, GetTickCount() - start );
+}
+
 static void test_MapViewOfFile(void)
 {
     static const char testfile[] = "testfile.xxx";
@@ -1645,16 +1748,17 @@ static void test_write_watch(void)
 
     num_bytes = 0;
     success = GetOverlappedResult( readpipe, &overlapped, &num_bytes, TRUE );
-    todo_wine ok( success, "GetOverlappedResult failed %u\n", GetLastError() );
-    todo_wine ok( num_bytes == sizeof(testdata), "wrong number of bytes read\n" );
-    todo_wine ok( !memcmp( base, testdata, sizeof(testdata)), "didn't receive expected data\n" );
+    /* the server can only write to watched pages when the host kernel tracks the writes */
+    todo_wine_if (!success) ok( success, "GetOverlappedResult failed %u\n", GetLastError() );
+    todo_wine_if (!success) ok( num_bytes == sizeof(testdata), "wrong number of bytes read\n" );
+    todo_wine_if (!success) ok( !memcmp( base, testdata, sizeof(testdata)), "didn't receive expected data\n" );
 
     count = 64;
     memset( results, 0, sizeof(results) );
     ret = pGetWriteWatch( WRITE_WATCH_FLAG_RESET, base, size, results, &count, &pagesize );
     ok( !ret, "GetWriteWatch failed %u\n", GetLastError() );
-    todo_wine ok( count == 1, "wrong count %lu\n", count );
-    todo_wine ok( results[0] == base, "wrong result %p\n", results[0] );
+    todo_wine_if (!success) ok( count == 1, "wrong count %lu\n", count );
+    todo_wine_if (!success) ok( results[0] == base, "wrong result %p\n", results[0] );
 
     CloseHandle( readpipe );
     CloseHandle( writepipe );
@@ -3833,7 +3937,9 @@ START_TEST(virtual)
     test_VirtualAlloc_protection();
     test_VirtualProtect();
     test_VirtualAllocEx();
+    test_process_memory_bandwidth();
     test_VirtualAlloc();
+    test_many_views();
     test_MapViewOfFile();
     test_NtMapViewOfSection();
     test_NtAreMappedFilesTheSame();
@@ -44,6 +44,9 @@
 #ifdef HAVE_SYS_SYSCALL_H
 # include <sys/syscall.h>
 #endif
+#ifdef HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
 #ifdef HAVE_SYS_ATTR_H
 #include <sys/attr.h>
 #endif
@@ -186,15 +189,30 @@ struct dir_data
     struct file_identity    id;      /* directory file identity */
     struct dir_data_names  *names;   /* directory file names */
     struct dir_data_buffer *buffer;  /* head of data buffers list */
+    struct dir_listing     *listing; /* shared listing holding the names, if any */
+};
+
+/* full sorted contents of a directory, shared by all the handles that enumerate it */
+struct dir_listing
+{
+    struct list             entry;      /* entry in the list of cached listings */
+    unsigned int            refcount;   /* references from the cache and the dir data */
+    time_t                  mtime;      /* directory modification time when it was read */
+    unsigned long           mtime_nsec;
+    struct dir_data        *data;       /* directory contents, without mask */
 };
 
 static const unsigned int dir_data_buffer_initial_size = 4096;
 static const unsigned int dir_data_cache_initial_size  = 256;
 static const unsigned int dir_data_names_initial_size  = 64;
+static const unsigned int dir_listing_max_count        = 32;
 
 static struct dir_data **dir_data_cache;
 static unsigned int dir_data_cache_size;
 
+static struct list dir_listings = LIST_INIT( dir_listings );  /* most recently used first */
+static unsigned int dir_listing_count;
+
 static BOOL show_dot_files;
 static RTL_RUN_ONCE init_once = RTL_RUN_ONCE_INIT;
 
@@ -365,6 +383,8 @@ static BOOL add_dir_data_names( struct dir_data *data, const WCHAR *long_name,
     return TRUE;
 }
 
+static void release_dir_listing( struct dir_listing *listing );
+
 /* free the complete directory data structure */
 static void free_dir_data( struct dir_data *data )
 {
@@ -372,6 +392,7 @@ static void free_dir_data( struct dir_data *data )
 
     if (!data) return;
 
+    if (data->listing) release_dir_listing( data->listing );
     for (buffer = data->buffer; buffer; buffer = next)
     {
         next = buffer->next;
@@ -1864,6 +1885,147 @@ static int name_compare( const void *a, const void *b )
 }
 
 
+/* sort file names, but not "." and ".." */
+static void sort_dir_data( struct dir_data *data )
+{
+    unsigned int i = 0;
+
+    if (i < data->count && !strcmp( data->names[i].unix_name, "." )) i++;
+    if (i < data->count && !strcmp( data->names[i].unix_name, ".." )) i++;
+    if (i < data->count) qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
+}
+
+
+/* get the modification time of a directory, with the best available precision */
+static void get_dir_mtime( const struct stat *st, time_t *mtime, unsigned long *nsec )
+{
+    *mtime = st->st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    *nsec = st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    *nsec = st->st_mtimespec.tv_nsec;
+#else
+    *nsec = 0;
+#endif
+}
+
+
+static void release_dir_listing( struct dir_listing *listing )
+{
+    if (--listing->refcount) return;
+    free_dir_data( listing->data );
+    RtlFreeHeap( GetProcessHeap(), 0, listing );
+}
+
+
+/* remove a listing from the cache; it stays alive as long as some dir data uses it */
+static void remove_dir_listing( struct dir_listing *listing )
+{
+    list_remove( &listing->entry );
+    dir_listing_count--;
+    release_dir_listing( listing );
+}
+
+
+/***********************************************************************
+ *           get_dir_listing
+ *
+ * Get the full sorted listing of a directory, from the cache if it hasn't
+ * been modified since it was read. dir_section must be held by caller.
+ */
+static struct dir_listing *get_dir_listing( int fd, const struct stat *st )
+{
+    struct dir_listing *listing;
+    struct dir_data *data;
+    unsigned long mtime_nsec;
+    time_t mtime;
+
+    get_dir_mtime( st, &mtime, &mtime_nsec );
+
+    LIST_FOR_EACH_ENTRY( listing, &dir_listings, struct dir_listing, entry )
+    {
+        if (listing->data->id.dev != st->st_dev || listing->data->id.ino != st->st_ino) continue;
+        if (listing->mtime == mtime && listing->mtime_nsec == mtime_nsec)
+        {
+            list_remove( &listing->entry );
+            list_add_head( &dir_listings, &listing->entry );
+            listing->refcount++;
+            TRACE( "using cached listing of %u files\n", listing->data->count );
+            return listing;
+        }
+        remove_dir_listing( listing );  /* directory has been modified */
+        break;
+    }
+
+    if (!(data = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*data) ))) return NULL;
+    if (!(listing = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*listing) )))
+    {
+        free_dir_data( data );
+        return NULL;
+    }
+    if (read_directory_data( data, fd, NULL ))
+    {
+        free_dir_data( data );
+        RtlFreeHeap( GetProcessHeap(), 0, listing );
+        return NULL;
+    }
+    sort_dir_data( data );
+    data->id.dev = st->st_dev;
+    data->id.ino = st->st_ino;
+    listing->refcount   = 1;
+    listing->mtime      = mtime;
+    listing->mtime_nsec = mtime_nsec;
+    listing->data       = data;
+
+    /* a change within the same clock tick as the last one wouldn't be noticed,
+     * so don't keep the listing if the directory has been modified too recently */
+    if (time( NULL ) - mtime > 1)
+    {
+        listing->refcount++;
+        list_add_head( &dir_listings, &listing->entry );
+        if (++dir_listing_count > dir_listing_max_count)
+            remove_dir_listing( LIST_ENTRY( list_tail( &dir_listings ), struct dir_listing, entry ));
+    }
+    return listing;
+}
+
+
+/***********************************************************************
+ *           filter_dir_listing
+ *
+ * Fill the directory data with the names from the listing that match the mask.
+ */
+static BOOL filter_dir_listing( struct dir_data *data, struct dir_listing *listing,
+                                const UNICODE_STRING *mask )
+{
+    const struct dir_data_names *names = listing->data->names;
+    unsigned int i, count = listing->data->count;
+    UNICODE_STRING str;
+
+    data->listing = listing;
+    if (!count) return TRUE;
+    if (!(data->names = RtlAllocateHeap( GetProcessHeap(), 0, count * sizeof(*data->names) )))
+        return FALSE;
+    data->size = count;
+
+    for (i = 0; i < count; i++)
+    {
+        if (mask)
+        {
+            RtlInitUnicodeString( &str, names[i].long_name );
+            if (!match_filename( &str, mask ))
+            {
+                if (!names[i].short_name[0]) continue;  /* no short name to match */
+                RtlInitUnicodeString( &str, names[i].short_name );
+                if (!match_filename( &str, mask )) continue;
+            }
+        }
+        data->names[data->count++] = names[i];
+    }
+    return TRUE;
+}
+
+
 /***********************************************************************
  *           init_cached_dir_data
  *
@@ -1872,6 +2034,7 @@ static int name_compare( const void *a, const void *b )
 static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const UNICODE_STRING *mask )
 {
     struct dir_data *data;
+    struct dir_listing *listing;
     struct stat st;
     NTSTATUS status;
     unsigned int i;
@@ -1879,17 +2042,24 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
     if (!(data = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*data) )))
         return STATUS_NO_MEMORY;
 
-    if ((status = read_directory_data( data, fd, mask )))
+    /* wildcard searches need the full directory contents, which are shared between calls */
+    if (has_wildcard( mask ) && !fstat( fd, &st ) && (listing = get_dir_listing( fd, &st )))
     {
-        free_dir_data( data );
-        return status;
+        if (!filter_dir_listing( data, listing, mask ))
+        {
+            free_dir_data( data );
+            return STATUS_NO_MEMORY;
+        }
+    }
+    else
+    {
+        if ((status = read_directory_data( data, fd, mask )))
+        {
+            free_dir_data( data );
+            return status;
+        }
+        sort_dir_data( data );
     }
-
-    /* sort filenames, but not "." and ".." */
-    i = 0;
-    if (i < data->count && !strcmp( data->names[i].unix_name, "." )) i++;
-    if (i < data->count && !strcmp( data->names[i].unix_name, ".." )) i++;
-    if (i < data->count) qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
 
     if (data->count)
     {
@@ -2069,6 +2239,284 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
 }
 
 
+#ifdef HAVE_SYS_INOTIFY_H
+
+/* cache of the directory contents used for case-insensitive lookups */
+/* the cached directories are watched with inotify to detect changes */
+
+#define DIR_CACHE_MAX_DIRS    256      /* max. number of cached directories */
+#define DIR_CACHE_MAX_ENTRIES 0x10000  /* max. number of entries in a cached directory */
+
+struct dir_cache_entry
+{
+    struct dir_cache_entry *next;       /* next entry in the hash chain */
+    unsigned int            hash;       /* hash of the lower-case name */
+    int                     len;        /* length of the Unicode name */
+    char                   *unix_name;  /* Unix name, stored after the Unicode name */
+    WCHAR                   name[1];    /* Unicode name */
+};
+
+struct dir_cache
+{
+    struct list              entry;      /* entry in the list of cached directories */
+    dev_t                    dev;        /* device of the directory */
+    ino_t                    ino;        /* inode of the directory */
+    int                      wd;         /* inotify watch descriptor */
+    unsigned int             count;      /* number of entries */
+    unsigned int             hash_size;  /* size of the hash table */
+    struct dir_cache_entry **hash;       /* hash table of the entries */
+};
+
+static struct list dir_caches = LIST_INIT( dir_caches );  /* most recently used first */
+static unsigned int dir_cache_count;
+static unsigned int dir_cache_hits, dir_cache_misses;
+static int dir_cache_fd = -1;  /* inotify fd, -2 if inotify is not available */
+
+static RTL_CRITICAL_SECTION dir_cache_section;
+static RTL_CRITICAL_SECTION_DEBUG dir_cache_critsect_debug =
+{
+    0, 0, &dir_cache_section,
+    { &dir_cache_critsect_debug.ProcessLocksList, &dir_cache_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": dir_cache_section") }
+};
+static RTL_CRITICAL_SECTION dir_cache_section = { &dir_cache_critsect_debug, -1, 0, 0, 0, 0 };
+
+static inline unsigned int get_dir_cache_hash( const WCHAR *name, int len )
+{
+    unsigned int hash = 0;
+    while (len--) hash = hash * 31 + tolowerW( *name++ );
+    return hash;
+}
+
+static void free_dir_cache( struct dir_cache *cache, BOOL remove_watch )
+{
+    struct dir_cache_entry *entry, *next;
+    unsigned int i;
+
+    for (i = 0; i < cache->hash_size; i++)
+    {
+        for (entry = cache->hash[i]; entry; entry = next)
+        {
+            next = entry->next;
+            RtlFreeHeap( GetProcessHeap(), 0, entry );
+        }
+    }
+    if (remove_watch) inotify_rm_watch( dir_cache_fd, cache->wd );
+    list_remove( &cache->entry );
+    dir_cache_count--;
+    RtlFreeHeap( GetProcessHeap(), 0, cache->hash );
+    RtlFreeHeap( GetProcessHeap(), 0, cache );
+}
+
+/* process the pending inotify events and discard the directories that changed */
+static void process_dir_cache_events(void)
+{
+    union
+    {
+        struct inotify_event event;
+        char buffer[4096];
+    } data;
+    struct dir_cache *cache, *next;
+    const struct inotify_event *event;
+    ssize_t size;
+    char *ptr;
+
+    while ((size = read( dir_cache_fd, &data, sizeof(data) )) > 0)
+    {
+        for (ptr = data.buffer; ptr < data.buffer + size; ptr += sizeof(*event) + event->len)
+        {
+            event = (const struct inotify_event *)ptr;
+            LIST_FOR_EACH_ENTRY_SAFE( cache, next, &dir_caches, struct dir_cache, entry )
+            {
+                if (event->mask & IN_Q_OVERFLOW)
+                    free_dir_cache( cache, TRUE );
+                else if (cache->wd == event->wd)
+                {
+                    /* the watch is already gone if the directory was removed */
+                    free_dir_cache( cache, !(event->mask & IN_IGNORED) );
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/* grow the hash table of a directory cache; failure is not fatal */
+static void grow_dir_cache( struct dir_cache *cache )
+{
+    unsigned int i, new_size = cache->hash_size * 4 + 1;
+    struct dir_cache_entry **hash, *entry, *next;
+
+    if (!(hash = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, new_size * sizeof(*hash) ))) return;
+    for (i = 0; i < cache->hash_size; i++)
+    {
+        for (entry = cache->hash[i]; entry; entry = next)
+        {
+            next = entry->next;
+            entry->next = hash[entry->hash % new_size];
+            hash[entry->hash % new_size] = entry;
+        }
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, cache->hash );
+    cache->hash = hash;
+    cache->hash_size = new_size;
+}
+
+/* add an entry to a directory cache, unless there is already one with the same name */
+static void add_dir_cache_entry( struct dir_cache *cache, const char *unix_name, const WCHAR *name, int len )
+{
+    unsigned int hash = get_dir_cache_hash( name, len );
+    struct dir_cache_entry *entry, **bucket = &cache->hash[hash % cache->hash_size];
+    size_t unix_len = strlen( unix_name ) + 1;
+
+    /* the first one found by readdir wins, as in find_file_in_dir */
+    for (entry = *bucket; entry; entry = entry->next)
+        if (entry->hash == hash && entry->len == len && !memicmpW( entry->name, name, len )) return;
+
+    if (!(entry = RtlAllocateHeap( GetProcessHeap(), 0,
+                                   FIELD_OFFSET( struct dir_cache_entry, name[len] ) + unix_len )))
+        return;
+    entry->hash = hash;
+    entry->len  = len;
+    entry->unix_name = (char *)&entry->name[len];
+    memcpy( entry->name, name, len * sizeof(WCHAR) );
+    memcpy( entry->unix_name, unix_name, unix_len );
+    entry->next = *bucket;
+    *bucket = entry;
+    if (++cache->count > cache->hash_size * 2) grow_dir_cache( cache );
+}
+
+/* read the contents of a directory into a new cache */
+static struct dir_cache *create_dir_cache( const char *unix_dir, const struct stat *st )
+{
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    struct dir_cache *cache;
+    struct dirent *de;
+    struct stat dir_st;
+    unsigned int count = 0;
+    DIR *dir;
+    int wd, ret;
+
+    if (dir_cache_count >= DIR_CACHE_MAX_DIRS)
+        free_dir_cache( LIST_ENTRY( list_tail( &dir_caches ), struct dir_cache, entry ), TRUE );
+
+    /* add the watch first so that changes made while reading the directory are not missed */
+    if ((wd = inotify_add_watch( dir_cache_fd, unix_dir, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                 IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR )) == -1)
+        return NULL;
+    if (!(dir = opendir( unix_dir ))) goto failed;
+
+    /* make sure that this is still the directory we are looking for */
+    if (fstat( dirfd( dir ), &dir_st ) == -1 || dir_st.st_dev != st->st_dev || dir_st.st_ino != st->st_ino)
+        goto failed;
+
+    if (!(cache = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*cache) ))) goto failed;
+    cache->dev = st->st_dev;
+    cache->ino = st->st_ino;
+    cache->wd  = wd;
+    cache->count = 0;
+    cache->hash_size = 61;
+    if (!(cache->hash = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                         cache->hash_size * sizeof(*cache->hash) )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, cache );
+        goto failed;
+    }
+    list_add_head( &dir_caches, &cache->entry );
+    dir_cache_count++;
+
+    while ((de = readdir( dir )))
+    {
+        if (++count > DIR_CACHE_MAX_ENTRIES)
+        {
+            free_dir_cache( cache, FALSE );
+            goto failed;
+        }
+        ret = ntdll_umbstowcs( 0, de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
+        if (ret > 0) add_dir_cache_entry( cache, de->d_name, buffer, ret );
+    }
+    closedir( dir );
+    TRACE( "cached %u entries for %s, %u hits %u misses\n", count, debugstr_a(unix_dir),
+           dir_cache_hits, dir_cache_misses );
+    return cache;
+
+failed:
+    if (dir) closedir( dir );
+    inotify_rm_watch( dir_cache_fd, wd );
+    return NULL;
+}
+
+/***********************************************************************
+ *           lookup_dir_cache
+ *
+ * Look for a file in the cached contents of a directory.
+ * Returns 1 if found, with the Unix name copied to unix_name, 0 if not
+ * found, and -1 if the directory could not be cached.
+ */
+static int lookup_dir_cache( const char *unix_dir, const WCHAR *name, int length, char *unix_name )
+{
+    struct dir_cache *cache;
+    struct dir_cache_entry *entry;
+    unsigned int hash;
+    struct stat st;
+    int ret = 0;
+
+    if (dir_cache_fd == -2) return -1;
+    if (stat( unix_dir, &st ) == -1 || !S_ISDIR( st.st_mode )) return -1;
+
+    RtlEnterCriticalSection( &dir_cache_section );
+
+    if (dir_cache_fd == -1)
+    {
+        if ((dir_cache_fd = inotify_init()) == -1)
+        {
+            dir_cache_fd = -2;
+            RtlLeaveCriticalSection( &dir_cache_section );
+            return -1;
+        }
+        fcntl( dir_cache_fd, F_SETFL, O_NONBLOCK );
+        fcntl( dir_cache_fd, F_SETFD, FD_CLOEXEC );
+    }
+    process_dir_cache_events();
+
+    LIST_FOR_EACH_ENTRY( cache, &dir_caches, struct dir_cache, entry )
+    {
+        if (cache->dev != st.st_dev || cache->ino != st.st_ino) continue;
+        list_remove( &cache->entry );
+        list_add_head( &dir_caches, &cache->entry );
+        dir_cache_hits++;
+        goto found;
+    }
+    dir_cache_misses++;
+    if (!(cache = create_dir_cache( unix_dir, &st )))
+    {
+        RtlLeaveCriticalSection( &dir_cache_section );
+        return -1;
+    }
+
+found:
+    hash = get_dir_cache_hash( name, length );
+    for (entry = cache->hash[hash % cache->hash_size]; entry; entry = entry->next)
+    {
+        if (entry->hash != hash || entry->len != length || memicmpW( entry->name, name, length )) continue;
+        strcpy( unix_name, entry->unix_name );
+        ret = 1;
+        break;
+    }
+    RtlLeaveCriticalSection( &dir_cache_section );
+    return ret;
+}
+
+#else  /* HAVE_SYS_INOTIFY_H */
+
+static int lookup_dir_cache( const char *unix_dir, const WCHAR *name, int length, char *unix_name )
+{
+    return -1;
+}
+
+#endif  /* HAVE_SYS_INOTIFY_H */
+
+
 /***********************************************************************
  *           find_file_in_dir
  *
@@ -2120,6 +2568,18 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
 
     if (!is_name_8_dot_3 && !get_dir_case_sensitivity( unix_name )) goto not_found;
 
+    /* check the cached directory contents; short names still need a full search */
+
+    switch (lookup_dir_cache( unix_name, name, length, unix_name + pos ))
+    {
+    case 1:
+        unix_name[pos - 1] = '/';
+        goto success;
+    case 0:
+        if (!is_name_8_dot_3) goto not_found;
+        break;
+    }
+
     /* now look for it through the directory */
 
 #ifdef VFAT_IOCTL_READDIR_BOTH
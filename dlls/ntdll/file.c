@@ -30,12 +30,18 @@
 #ifdef HAVE_LINUX_MAJOR_H
 # include <linux/major.h>
 #endif
+#ifdef HAVE_LINUX_IO_URING_H
+# include <linux/io_uring.h>
+#endif
 #ifdef HAVE_SYS_STATVFS_H
 # include <sys/statvfs.h>
 #endif
 #ifdef HAVE_SYS_PARAM_H
 # include <sys/param.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 #ifdef HAVE_SYS_SYSCALL_H
 # include <sys/syscall.h>
 #endif
@@ -57,6 +63,9 @@
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
 #ifdef MAJOR_IN_MKDEV
 # include <sys/mkdev.h>
 #elif defined(MAJOR_IN_SYSMACROS)
@@ -102,6 +111,7 @@
 #include "wine/unicode.h"
 #include "wine/debug.h"
 #include "wine/server.h"
+#include "wine/list.h"
 #include "ntdll_misc.h"
 
 #include "winternl.h"
@@ -775,6 +785,430 @@ static NTSTATUS get_io_avail_mode( HANDLE handle, enum server_fd_type type, BOOL
 }
 
 
+#if defined(__linux__) && defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+
+/* Overlapped I/O on regular files submitted to the kernel through io_uring,
+ * enabled with WINEIOURING. Only requests signaling an event whose state is
+ * shared with the process are handled, so that the completion thread can
+ * report them without a server round trip; the server only sees the cancel
+ * requests and the events it has its own waiters on. Requests on files bound
+ * to a completion port go through the normal path.
+ */
+
+#define URING_ENTRIES 256
+#define URING_PORT_CACHE_SIZE 256
+
+struct uring_io
+{
+    struct list          entry;    /* entry in pending list */
+    HANDLE               handle;   /* file handle passed by the caller */
+    struct inproc_sync  *event;    /* reference to the state of the event to signal on completion */
+    IO_STATUS_BLOCK     *iosb;     /* status block of the request */
+    ULONG                tid;      /* thread that started the I/O */
+    ULONG                length;   /* total length of the buffers */
+    BOOL                 read;     /* read or write? */
+    int                  fd;       /* private copy of the unix fd */
+    unsigned int         count;    /* number of buffers */
+    struct iovec         iov[1];   /* buffers */
+};
+
+static struct
+{
+    int                  fd;
+    unsigned int        *sq_head;
+    unsigned int        *sq_tail;
+    unsigned int        *sq_mask;
+    unsigned int        *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned int        *cq_head;
+    unsigned int        *cq_tail;
+    unsigned int        *cq_mask;
+    struct io_uring_cqe *cqes;
+} uring = { -1 };
+
+static struct list uring_pending = LIST_INIT( uring_pending );
+static unsigned int uring_inflight;
+
+/* handles known not to be bound to a completion port, as generation << 32 | handle */
+static LONG64 uring_no_port[URING_PORT_CACHE_SIZE];
+static LONG uring_port_gen = 1;
+
+static RTL_CRITICAL_SECTION uring_section;
+static RTL_CRITICAL_SECTION_DEBUG uring_critsect_debug =
+{
+    0, 0, &uring_section,
+    { &uring_critsect_debug.ProcessLocksList, &uring_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": uring_section") }
+};
+static RTL_CRITICAL_SECTION uring_section = { &uring_critsect_debug, -1, 0, 0, 0, 0 };
+
+static inline int uring_enter( unsigned int to_submit, unsigned int min_complete, unsigned int flags )
+{
+    return syscall( __NR_io_uring_enter, uring.fd, to_submit, min_complete, flags, NULL, 0 );
+}
+
+static inline LONG64 *uring_port_cache_entry( HANDLE handle )
+{
+    return &uring_no_port[(wine_server_obj_handle( handle ) >> 2) % URING_PORT_CACHE_SIZE];
+}
+
+/* check whether completions must be posted for the file, the server is only asked once per handle */
+static BOOL uring_has_port( HANDLE handle )
+{
+    LONG64 *entry = uring_port_cache_entry( handle );
+    LONG64 value = ((LONG64)uring_port_gen << 32) | wine_server_obj_handle( handle );
+    LONG64 old = interlocked_cmpxchg64( entry, 0, 0 );
+    BOOL bound = TRUE;
+
+    if (old == value) return FALSE;
+
+    SERVER_START_REQ( get_fd_completion )
+    {
+        req->handle = wine_server_obj_handle( handle );
+        if (!wine_server_call( req )) bound = reply->bound;
+    }
+    SERVER_END_REQ;
+    if (!bound) interlocked_cmpxchg64( entry, value, old );
+    return bound;
+}
+
+/***********************************************************************
+ *           uring_remove_from_cache
+ */
+void uring_remove_from_cache( HANDLE handle )
+{
+    LONG64 *entry = uring_port_cache_entry( handle );
+    LONG64 value = interlocked_cmpxchg64( entry, 0, 0 );
+
+    if ((DWORD)value == wine_server_obj_handle( handle )) interlocked_cmpxchg64( entry, 0, value );
+}
+
+/* a file has been bound to a completion port, forget what we know about all of them */
+static inline void uring_port_changed(void)
+{
+    interlocked_xchg_add( &uring_port_gen, 1 );
+}
+
+/* report the result of a finished I/O */
+static void complete_uring_io( struct uring_io *io, int res )
+{
+    NTSTATUS status;
+    ULONG info = 0;
+
+    RtlEnterCriticalSection( &uring_section );
+    list_remove( &io->entry );
+    uring_inflight--;
+    RtlLeaveCriticalSection( &uring_section );
+
+    if (res >= 0)
+    {
+        info = res;
+        status = (info || !io->read) ? STATUS_SUCCESS : STATUS_END_OF_FILE;
+    }
+    else if (res == -ECANCELED) status = STATUS_CANCELLED;
+    else
+    {
+        errno = -res;
+        status = FILE_GetNtStatus();
+    }
+    TRACE( "%p %p = 0x%08x (%u)\n", io->handle, io->iosb, status, info );
+
+    close( io->fd );
+    io->iosb->Information = info;
+    interlocked_xchg( (int *)&io->iosb->u.Status, status );
+    release_inproc_event( io->event, TRUE );
+    RtlFreeHeap( GetProcessHeap(), 0, io );
+}
+
+static void WINAPI uring_completion_thread( void *arg )
+{
+    struct io_uring_cqe *cqe;
+    unsigned int head;
+    ULONG_PTR user_data;
+    int res;
+
+    for (;;)
+    {
+        head = *uring.cq_head;
+        __sync_synchronize();
+        if (head == *(volatile unsigned int *)uring.cq_tail)
+        {
+            uring_enter( 0, 1, IORING_ENTER_GETEVENTS );
+            continue;
+        }
+        cqe = &uring.cqes[head & *uring.cq_mask];
+        user_data = cqe->user_data;
+        res = cqe->res;
+        __sync_synchronize();
+        *uring.cq_head = head + 1;
+
+        /* cancel requests don't have an I/O attached */
+        if (user_data) complete_uring_io( (struct uring_io *)user_data, res );
+    }
+}
+
+/* set up the ring and the completion thread; called with uring_section held */
+static BOOL init_uring(void)
+{
+    static BOOL init_done;
+    struct io_uring_params params;
+    size_t sq_size, cq_size;
+    char *sq_ptr, *cq_ptr;
+    const char *env;
+    HANDLE thread;
+    int fd;
+
+    if (init_done) return uring.fd != -1;
+    init_done = TRUE;
+
+    if (!(env = getenv( "WINEIOURING" )) || !atoi( env )) return FALSE;
+
+    memset( &params, 0, sizeof(params) );
+    if ((fd = syscall( __NR_io_uring_setup, URING_ENTRIES, &params )) == -1)
+    {
+        WARN( "io_uring not available, errno %d\n", errno );
+        return FALSE;
+    }
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) sq_size = cq_size = max( sq_size, cq_size );
+
+    sq_ptr = mmap( NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+    if (sq_ptr == MAP_FAILED) goto failed;
+    if (params.features & IORING_FEAT_SINGLE_MMAP) cq_ptr = sq_ptr;
+    else
+    {
+        cq_ptr = mmap( NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING );
+        if (cq_ptr == MAP_FAILED) goto failed;
+    }
+    uring.sqes = mmap( NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+    if (uring.sqes == MAP_FAILED) goto failed;
+
+    uring.sq_head  = (unsigned int *)(sq_ptr + params.sq_off.head);
+    uring.sq_tail  = (unsigned int *)(sq_ptr + params.sq_off.tail);
+    uring.sq_mask  = (unsigned int *)(sq_ptr + params.sq_off.ring_mask);
+    uring.sq_array = (unsigned int *)(sq_ptr + params.sq_off.array);
+    uring.cq_head  = (unsigned int *)(cq_ptr + params.cq_off.head);
+    uring.cq_tail  = (unsigned int *)(cq_ptr + params.cq_off.tail);
+    uring.cq_mask  = (unsigned int *)(cq_ptr + params.cq_off.ring_mask);
+    uring.cqes     = (struct io_uring_cqe *)(cq_ptr + params.cq_off.cqes);
+    uring.fd       = fd;
+
+    if (RtlCreateUserThread( NtCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                             uring_completion_thread, NULL, &thread, NULL ))
+    {
+        ERR( "failed to create io_uring completion thread\n" );
+        uring.fd = -1;
+        goto failed;
+    }
+    NtClose( thread );
+    TRACE( "using io_uring for overlapped file I/O\n" );
+    return TRUE;
+
+failed:
+    /* the mappings go away with the last reference to the ring */
+    close( fd );
+    return FALSE;
+}
+
+static struct uring_io *alloc_uring_io( unsigned int count )
+{
+    return RtlAllocateHeap( GetProcessHeap(), 0, FIELD_OFFSET( struct uring_io, iov[count] ));
+}
+
+/***********************************************************************
+ *           submit_uring_io
+ *
+ * Start an overlapped read or write through io_uring. Returns FALSE if the
+ * caller has to perform the I/O itself; io is freed in all cases.
+ */
+static BOOL submit_uring_io( struct uring_io *io, BOOL read, HANDLE handle, int unix_fd, HANDLE event,
+                             IO_STATUS_BLOCK *iosb, ULONG_PTR cvalue, ULONGLONG offset )
+{
+    struct io_uring_sqe *sqe;
+    unsigned int i, tail, idx;
+    BOOL ready;
+    int ret;
+
+    io->handle = handle;
+    io->event  = NULL;
+    io->iosb   = iosb;
+    io->tid    = HandleToULong( NtCurrentTeb()->ClientId.UniqueThread );
+    io->read   = read;
+    for (i = io->length = 0; i < io->count; i++) io->length += io->iov[i].iov_len;
+
+    RtlEnterCriticalSection( &uring_section );
+    ready = init_uring() && uring_inflight < URING_ENTRIES;
+    RtlLeaveCriticalSection( &uring_section );
+
+    /* the file signaled state and the completion port are only known to the server */
+    if (!ready || !event || (cvalue && uring_has_port( handle )) || !(io->event = grab_inproc_event( event )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, io );
+        return FALSE;
+    }
+    if ((io->fd = dup( unix_fd )) == -1)
+    {
+        release_inproc_event( io->event, FALSE );
+        RtlFreeHeap( GetProcessHeap(), 0, io );
+        return FALSE;
+    }
+
+    /* the state is shared, this doesn't need the server either */
+    NtResetEvent( event, NULL );
+    iosb->u.Status = STATUS_PENDING;
+    iosb->Information = 0;
+
+    RtlEnterCriticalSection( &uring_section );
+
+    if (uring_inflight >= URING_ENTRIES) goto failed;
+
+    tail = *uring.sq_tail;
+    idx = tail & *uring.sq_mask;
+    sqe = &uring.sqes[idx];
+    memset( sqe, 0, sizeof(*sqe) );
+    sqe->opcode    = read ? IORING_OP_READV : IORING_OP_WRITEV;
+    sqe->fd        = io->fd;
+    sqe->off       = offset;
+    sqe->addr      = (ULONG_PTR)io->iov;
+    sqe->len       = io->count;
+    sqe->user_data = (ULONG_PTR)io;
+    uring.sq_array[idx] = idx;
+    __sync_synchronize();
+    *uring.sq_tail = tail + 1;
+
+    list_add_tail( &uring_pending, &io->entry );
+    uring_inflight++;
+
+    while ((ret = uring_enter( 1, 0, 0 )) == -1 && errno == EINTR);
+    if (ret != 1)
+    {
+        /* the kernel didn't consume the entry, take it back */
+        WARN( "failed to submit I/O, errno %d\n", errno );
+        *uring.sq_tail = tail;
+        list_remove( &io->entry );
+        uring_inflight--;
+        goto failed;
+    }
+
+    TRACE( "%p %p %s %u bytes at 0x%s\n", handle, iosb, read ? "read" : "write",
+           io->length, wine_dbgstr_longlong( offset ));
+    RtlLeaveCriticalSection( &uring_section );
+    return TRUE;
+
+failed:
+    RtlLeaveCriticalSection( &uring_section );
+    /* the event stays reset, the caller will signal it when doing the I/O itself */
+    release_inproc_event( io->event, FALSE );
+    close( io->fd );
+    RtlFreeHeap( GetProcessHeap(), 0, io );
+    return FALSE;
+}
+
+static BOOL submit_uring_rw( BOOL read, HANDLE handle, int unix_fd, HANDLE event, IO_STATUS_BLOCK *iosb,
+                             ULONG_PTR cvalue, void *buffer, ULONG length, ULONGLONG offset )
+{
+    struct uring_io *io;
+
+    if (!(io = alloc_uring_io( 1 ))) return FALSE;
+    io->count = 1;
+    io->iov[0].iov_base = buffer;
+    io->iov[0].iov_len  = length;
+    return submit_uring_io( io, read, handle, unix_fd, event, iosb, cvalue, offset );
+}
+
+static BOOL submit_uring_segments( BOOL read, HANDLE handle, int unix_fd, HANDLE event, IO_STATUS_BLOCK *iosb,
+                                   ULONG_PTR cvalue, FILE_SEGMENT_ELEMENT *segments, ULONG length,
+                                   ULONGLONG offset )
+{
+    struct uring_io *io;
+    unsigned int i;
+
+    if (!(io = alloc_uring_io( length / page_size ))) return FALSE;
+    io->count = length / page_size;
+    for (i = 0; i < io->count; i++)
+    {
+        io->iov[i].iov_base = segments[i].Buffer;
+        io->iov[i].iov_len  = page_size;
+    }
+    return submit_uring_io( io, read, handle, unix_fd, event, iosb, cvalue, offset );
+}
+
+/* request cancellation of the pending I/Os matching the parameters */
+static BOOL cancel_uring_io( HANDLE handle, IO_STATUS_BLOCK *iosb, BOOL only_thread )
+{
+    ULONG tid = HandleToULong( NtCurrentTeb()->ClientId.UniqueThread );
+    struct io_uring_sqe *sqe;
+    struct uring_io *io;
+    unsigned int count = 0, tail;
+
+    if (uring.fd == -1) return FALSE;
+
+    RtlEnterCriticalSection( &uring_section );
+    tail = *uring.sq_tail;
+    LIST_FOR_EACH_ENTRY( io, &uring_pending, struct uring_io, entry )
+    {
+        if (io->handle != handle) continue;
+        if (iosb && io->iosb != iosb) continue;
+        if (only_thread && io->tid != tid) continue;
+        if (count == URING_ENTRIES) break;
+
+        sqe = &uring.sqes[(tail + count) & *uring.sq_mask];
+        memset( sqe, 0, sizeof(*sqe) );
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr   = (ULONG_PTR)io;
+        uring.sq_array[(tail + count) & *uring.sq_mask] = (tail + count) & *uring.sq_mask;
+        count++;
+    }
+    if (count)
+    {
+        int ret;
+
+        __sync_synchronize();
+        *uring.sq_tail = tail + count;
+        while ((ret = uring_enter( count, 0, 0 )) == -1 && errno == EINTR);
+        if (ret != count)
+        {
+            WARN( "failed to submit cancel requests, errno %d\n", errno );
+            *uring.sq_tail = tail + max( ret, 0 );
+        }
+    }
+    RtlLeaveCriticalSection( &uring_section );
+    return count != 0;
+}
+
+#else  /* __linux__ */
+
+static inline BOOL submit_uring_rw( BOOL read, HANDLE handle, int unix_fd, HANDLE event, IO_STATUS_BLOCK *iosb,
+                                    ULONG_PTR cvalue, void *buffer, ULONG length, ULONGLONG offset )
+{
+    return FALSE;
+}
+
+static inline BOOL submit_uring_segments( BOOL read, HANDLE handle, int unix_fd, HANDLE event,
+                                          IO_STATUS_BLOCK *iosb, ULONG_PTR cvalue,
+                                          FILE_SEGMENT_ELEMENT *segments, ULONG length, ULONGLONG offset )
+{
+    return FALSE;
+}
+
+static inline BOOL cancel_uring_io( HANDLE handle, IO_STATUS_BLOCK *iosb, BOOL only_thread )
+{
+    return FALSE;
+}
+
+void uring_remove_from_cache( HANDLE handle )
+{
+}
+
+static inline void uring_port_changed(void)
+{
+}
+
+#endif  /* __linux__ */
+
+
 /******************************************************************************
  *  NtReadFile					[NTDLL.@]
  *  ZwReadFile					[NTDLL.@]
@@ -841,6 +1275,14 @@ NTSTATUS WINAPI NtReadFile(HANDLE hFile, HANDLE hEvent,
 
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
         {
+            if (async_read && !apc && length &&
+                submit_uring_rw( TRUE, hFile, unix_handle, hEvent, io_status, cvalue,
+                                 buffer, length, offset->QuadPart ))
+            {
+                status = STATUS_PENDING;
+                goto err;
+            }
+
             /* async I/O doesn't make sense on regular files */
             while ((result = pread( unix_handle, buffer, length, offset->QuadPart )) == -1)
             {
@@ -1043,6 +1485,14 @@ NTSTATUS WINAPI NtReadFileScatter( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
         goto error;
     }
 
+    if (offset && offset->QuadPart >= 0 && !apc && length &&
+        submit_uring_segments( TRUE, file, unix_handle, event, io_status, cvalue,
+                               segments, length, offset->QuadPart ))
+    {
+        status = STATUS_PENDING;
+        goto error;
+    }
+
     while (length)
     {
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
@@ -1262,6 +1712,13 @@ NTSTATUS WINAPI NtWriteFile(HANDLE hFile, HANDLE hEvent,
                 status = STATUS_INVALID_PARAMETER;
                 goto done;
             }
+            else if (async_write && !apc && length &&
+                     submit_uring_rw( FALSE, hFile, unix_handle, hEvent, io_status, cvalue,
+                                      (void *)buffer, length, off ))
+            {
+                status = STATUS_PENDING;
+                goto err;
+            }
 
             /* async I/O doesn't make sense on regular files */
             while ((result = pwrite( unix_handle, buffer, length, off )) == -1)
@@ -1449,6 +1906,14 @@ NTSTATUS WINAPI NtWriteFileGather( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
         goto error;
     }
 
+    if (offset && offset->QuadPart >= 0 && !apc && length &&
+        submit_uring_segments( FALSE, file, unix_handle, event, io_status, cvalue,
+                               segments, length, offset->QuadPart ))
+    {
+        status = STATUS_PENDING;
+        goto error;
+    }
+
     while (length)
     {
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
@@ -2760,6 +3225,7 @@ NTSTATUS WINAPI NtSetInformationFile(HANDLE handle, PIO_STATUS_BLOCK io,
                 io->u.Status  = wine_server_call( req );
             }
             SERVER_END_REQ;
+            if (!io->u.Status) uring_port_changed();
         } else
             io->u.Status = STATUS_INVALID_PARAMETER_3;
         break;
@@ -3602,6 +4068,8 @@ NTSTATUS WINAPI NtCancelIoFileEx( HANDLE hFile, PIO_STATUS_BLOCK iosb, PIO_STATU
         io_status->u.Status = wine_server_call( req );
     }
     SERVER_END_REQ;
+    if (cancel_uring_io( hFile, iosb, FALSE ) && io_status->u.Status == STATUS_NOT_FOUND)
+        io_status->u.Status = STATUS_SUCCESS;
 
     return io_status->u.Status;
 }
@@ -3623,6 +4091,8 @@ NTSTATUS WINAPI NtCancelIoFile( HANDLE hFile, PIO_STATUS_BLOCK io_status )
         io_status->u.Status = wine_server_call( req );
     }
     SERVER_END_REQ;
+    if (cancel_uring_io( hFile, NULL, TRUE ) && io_status->u.Status == STATUS_NOT_FOUND)
+        io_status->u.Status = STATUS_SUCCESS;
 
     return io_status->u.Status;
 }
@@ -42,6 +42,7 @@
 #include "ntdll_misc.h"
 #include "wine/list.h"
 #include "wine/debug.h"
+#include "wine/exception.h"
 #include "wine/server.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(heap);
@@ -85,6 +86,8 @@ typedef struct
 #define ARENA_PENDING_MAGIC    0xbedead
 #define ARENA_FREE_MAGIC       0x45455246
 #define ARENA_LARGE_MAGIC      0x6752614c
+#define ARENA_LFH_MAGIC        0x48464c    /* in-use block of the low fragmentation heap */
+#define ARENA_LFH_FREE_MAGIC   0x68666c    /* free block of the low fragmentation heap */
 
 #define ARENA_INUSE_FILLER     0x55
 #define ARENA_TAIL_FILLER      0xab
@@ -128,6 +131,43 @@ typedef union
 
 struct tagHEAP;
 
+/* The low fragmentation heap serves small blocks from groups of same-sized
+ * blocks, carved out of regular heap blocks.  Free blocks are kept on one
+ * lock-free list per size class, so that allocating and freeing them doesn't
+ * need the heap critical section; LFH operations only hold the LFH lock in
+ * shared mode, RtlLockHeap and RtlWalkHeap take it exclusively to keep them
+ * out.  In-use blocks have an ARENA_INUSE header with ARENA_LFH_MAGIC, whose
+ * size field holds the offset of the block from the start of its group in the
+ * low 16 bits and the number of unused bytes in the high 16 bits.  Groups are
+ * never released before the heap is destroyed, which makes it safe to read
+ * the list links of blocks popped concurrently. */
+
+#define LFH_GRANULARITY      16
+#define LFH_MAX_BLOCK_SIZE   0x400   /* largest block served by the LFH */
+#define LFH_NB_BINS          (LFH_MAX_BLOCK_SIZE / LFH_GRANULARITY)
+#define LFH_GROUP_SIZE       0x10000 /* size of the heap blocks used as groups */
+#define LFH_OFFSET_MASK      0xffff
+#define LFH_UNUSED_SHIFT     16
+
+typedef struct tagLFH_GROUP
+{
+    struct tagHEAP     *heap;       /* heap the group belongs to */
+    DWORD               block_size; /* usable size of the group blocks */
+    DWORD               bin;        /* size class of the blocks */
+    DWORD               magic;      /* Magic number */
+} LFH_GROUP;
+
+#define LFH_GROUP_MAGIC  ((DWORD)('L' | ('F'<<8) | ('H'<<16) | ('G'<<24)))
+#define LFH_GROUP_HEADER_SIZE  ((sizeof(LFH_GROUP) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
+typedef struct
+{
+    SLIST_HEADER        bins[LFH_NB_BINS];  /* free blocks of each size class */
+    RTL_SRWLOCK         lock;       /* shared by LFH operations, exclusive while the heap is locked */
+    DWORD               lock_owner; /* thread holding the lock exclusively */
+    DWORD               lock_count; /* recursion count of the exclusive owner */
+} LFH_HEAP;
+
 typedef struct tagSUBHEAP
 {
     void               *base;       /* Base address of the sub-heap memory block */
@@ -158,6 +198,7 @@ typedef struct tagHEAP
     ARENA_INUSE    **pending_free;  /* Ring buffer for pending free requests */
     RTL_CRITICAL_SECTION critSection; /* Critical section for serialization */
     FREE_LIST_ENTRY *freeList;      /* Free lists */
+    LFH_HEAP        *lfh;           /* Low fragmentation heap front-end, if enabled */
 } HEAP;
 
 #define HEAP_MAGIC       ((DWORD)('H' | ('E'<<8) | ('A'<<16) | ('P'<<24)))
@@ -175,6 +216,7 @@ typedef struct tagHEAP
 static HEAP *processHeap;  /* main process heap */
 
 static BOOL HEAP_IsRealArena( HEAP *heapPtr, DWORD flags, LPCVOID block, BOOL quiet );
+static BOOL lfh_validate_block( const HEAP *heap, const ARENA_INUSE *arena );
 
 /* mark a block of memory as free for debugging purposes */
 static inline void mark_block_free( void *ptr, SIZE_T size, DWORD flags )
@@ -915,6 +957,7 @@ static SUBHEAP *HEAP_CreateSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         heap->flags         = flags;
         heap->magic         = HEAP_MAGIC;
         heap->grow_size     = max( HEAP_DEF_SIZE, totalSize );
+        heap->lfh           = NULL;
         list_init( &heap->subheap_list );
         list_init( &heap->large_list );
 
@@ -1348,7 +1391,10 @@ static BOOL HEAP_IsRealArena( HEAP *heapPtr,   /* [in] ptr to the heap */
             }
             else
                 ret = validate_large_arena( heapPtr, large_arena, quiet );
-        } else
+        }
+        else if (heapPtr->lfh && arena->magic == ARENA_LFH_MAGIC)
+            ret = lfh_validate_block( heapPtr, arena );
+        else
             ret = HEAP_ValidateInUseArena( subheap, arena, quiet );
 
         if (!(flags & HEAP_NO_SERIALIZE))
@@ -1389,6 +1435,279 @@ static BOOL HEAP_IsRealArena( HEAP *heapPtr,   /* [in] ptr to the heap */
 }
 
 
+/***********************************************************************
+ *           lfh_get_group
+ */
+static inline LFH_GROUP *lfh_get_group( const ARENA_INUSE *arena )
+{
+    return (LFH_GROUP *)((char *)arena - (arena->size & LFH_OFFSET_MASK));
+}
+
+
+/***********************************************************************
+ *           lfh_get_unused
+ */
+static inline SIZE_T lfh_get_unused( const ARENA_INUSE *arena )
+{
+    return arena->size >> LFH_UNUSED_SHIFT;
+}
+
+
+/***********************************************************************
+ *           lfh_set_unused
+ */
+static inline void lfh_set_unused( ARENA_INUSE *arena, SIZE_T unused )
+{
+    arena->size = (arena->size & LFH_OFFSET_MASK) | (unused << LFH_UNUSED_SHIFT);
+}
+
+
+/***********************************************************************
+ *           lfh_enter
+ *
+ * Hold the LFH lock in shared mode, unless the heap is locked by the current thread.
+ */
+static inline BOOL lfh_enter( HEAP *heap )
+{
+    if (heap->lfh->lock_owner == GetCurrentThreadId()) return FALSE;
+    RtlAcquireSRWLockShared( &heap->lfh->lock );
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           lfh_leave
+ */
+static inline void lfh_leave( HEAP *heap, BOOL locked )
+{
+    if (locked) RtlReleaseSRWLockShared( &heap->lfh->lock );
+}
+
+
+/***********************************************************************
+ *           lfh_validate_block
+ *
+ * Check that a block with the LFH magic really belongs to a group of the heap.
+ */
+static BOOL lfh_validate_block( const HEAP *heap, const ARENA_INUSE *arena )
+{
+    const LFH_GROUP *group;
+    SIZE_T offset = arena->size & LFH_OFFSET_MASK;
+
+    if (offset < LFH_GROUP_HEADER_SIZE) goto error;
+    group = lfh_get_group( arena );
+    if (group->magic != LFH_GROUP_MAGIC || group->heap != heap) goto error;
+    if ((offset - LFH_GROUP_HEADER_SIZE - ARENA_OFFSET) % (group->block_size + ALIGNMENT)) goto error;
+    if (lfh_get_unused( arena ) > group->block_size) goto error;
+    return TRUE;
+
+error:
+    WARN( "Heap %p: invalid LFH block %p\n", heap, arena + 1 );
+    return FALSE;
+}
+
+
+/***********************************************************************
+ *           is_lfh_block
+ *
+ * Check if a pointer passed to a heap function is an in-use LFH block.  The
+ * heap lock isn't held, so the pointer can't be checked against the sub-heaps
+ * before reading its header; a bad pointer is caught by the exception handler
+ * and then rejected by the regular heap checks.
+ */
+static BOOL is_lfh_block( const HEAP *heap, const void *ptr )
+{
+    const ARENA_INUSE *arena = (const ARENA_INUSE *)ptr - 1;
+    BOOL ret;
+
+    if (!heap->lfh || ((ULONG_PTR)ptr % ALIGNMENT)) return FALSE;
+    __TRY
+    {
+        ret = arena->magic == ARENA_LFH_MAGIC && lfh_validate_block( heap, arena );
+    }
+    __EXCEPT_PAGE_FAULT
+    {
+        ret = FALSE;
+    }
+    __ENDTRY
+    return ret;
+}
+
+
+/***********************************************************************
+ *           lfh_find_group
+ *
+ * Return the LFH group stored in an in-use block of the regular heap, if any.
+ */
+static LFH_GROUP *lfh_find_group( const HEAP *heap, ARENA_INUSE *arena )
+{
+    LFH_GROUP *group = (LFH_GROUP *)(arena + 1);
+
+    if (!heap->lfh || arena->magic != ARENA_INUSE_MAGIC) return NULL;
+    if ((arena->size & ARENA_SIZE_MASK) < LFH_GROUP_SIZE) return NULL;
+    if (group->magic != LFH_GROUP_MAGIC || group->heap != heap) return NULL;
+    return group;
+}
+
+
+/***********************************************************************
+ *           lfh_grow
+ *
+ * Allocate a new group of blocks for a size class; return one of its blocks
+ * and put the others on the free list.
+ */
+static ARENA_INUSE *lfh_grow( HEAP *heap, unsigned int bin )
+{
+    SIZE_T offset, block_size = (bin + 1) * LFH_GRANULARITY;
+    ARENA_INUSE *arena, *ret = NULL;
+    LFH_GROUP *group;
+
+    if (!(group = RtlAllocateHeap( heap, 0, LFH_GROUP_SIZE ))) return NULL;
+    group->heap       = heap;
+    group->block_size = block_size;
+    group->bin        = bin;
+    group->magic      = LFH_GROUP_MAGIC;
+
+    for (offset = LFH_GROUP_HEADER_SIZE;
+         offset + block_size + ALIGNMENT <= LFH_GROUP_SIZE;
+         offset += block_size + ALIGNMENT)
+    {
+        arena = (ARENA_INUSE *)((char *)group + offset + ARENA_OFFSET);
+        arena->size         = (char *)arena - (char *)group;
+        arena->magic        = ARENA_LFH_FREE_MAGIC;
+        arena->unused_bytes = 0;
+        if (!ret) ret = arena;
+        else RtlInterlockedPushEntrySList( &heap->lfh->bins[bin], (SLIST_ENTRY *)(arena + 1) );
+    }
+    return ret;
+}
+
+
+/***********************************************************************
+ *           lfh_allocate
+ *
+ * Allocate a small block from the LFH. Return NULL to fall back to the main heap.
+ */
+static void *lfh_allocate( HEAP *heap, DWORD flags, SIZE_T size )
+{
+    unsigned int bin = size ? (size - 1) / LFH_GRANULARITY : 0;
+    SLIST_ENTRY *entry;
+    ARENA_INUSE *arena;
+    BOOL locked = lfh_enter( heap );
+
+    if ((entry = RtlInterlockedPopEntrySList( &heap->lfh->bins[bin] ))) arena = (ARENA_INUSE *)entry - 1;
+    else if (!(arena = lfh_grow( heap, bin )))
+    {
+        lfh_leave( heap, locked );
+        return NULL;
+    }
+
+    arena->magic = ARENA_LFH_MAGIC;
+    lfh_set_unused( arena, (bin + 1) * LFH_GRANULARITY - size );
+    lfh_leave( heap, locked );
+    if (flags & HEAP_ZERO_MEMORY) memset( arena + 1, 0, size );
+    return arena + 1;
+}
+
+
+/***********************************************************************
+ *           lfh_free
+ */
+static void lfh_free( HEAP *heap, ARENA_INUSE *arena )
+{
+    BOOL locked = lfh_enter( heap );
+
+    arena->magic = ARENA_LFH_FREE_MAGIC;
+    RtlInterlockedPushEntrySList( &heap->lfh->bins[lfh_get_group( arena )->bin], (SLIST_ENTRY *)(arena + 1) );
+    lfh_leave( heap, locked );
+}
+
+
+/***********************************************************************
+ *           lfh_walk_entry
+ *
+ * Fill a heap walk entry for an LFH block.
+ */
+static void lfh_walk_entry( const LFH_GROUP *group, ARENA_INUSE *arena, PROCESS_HEAP_ENTRY *entry )
+{
+    entry->lpData = arena + 1;
+    entry->cbData = group->block_size;
+    entry->cbOverhead = sizeof(ARENA_INUSE);
+    entry->wFlags = (arena->magic == ARENA_LFH_MAGIC) ?
+                    PROCESS_HEAP_ENTRY_BUSY : PROCESS_HEAP_UNCOMMITTED_RANGE;
+}
+
+
+/***********************************************************************
+ *           lock_heap
+ *
+ * Lock the heap for the current thread, including the LFH blocks.
+ */
+static void lock_heap( HEAP *heap )
+{
+    LFH_HEAP *lfh = heap->lfh;
+
+    if (lfh)
+    {
+        if (lfh->lock_owner == GetCurrentThreadId()) lfh->lock_count++;
+        else
+        {
+            RtlAcquireSRWLockExclusive( &lfh->lock );
+            lfh->lock_owner = GetCurrentThreadId();
+            lfh->lock_count = 1;
+        }
+    }
+    RtlEnterCriticalSection( &heap->critSection );
+}
+
+
+/***********************************************************************
+ *           unlock_heap
+ */
+static void unlock_heap( HEAP *heap )
+{
+    LFH_HEAP *lfh = heap->lfh;
+
+    RtlLeaveCriticalSection( &heap->critSection );
+    /* the LFH may have been enabled while the heap was locked */
+    if (lfh && lfh->lock_owner == GetCurrentThreadId() && !--lfh->lock_count)
+    {
+        lfh->lock_owner = 0;
+        RtlReleaseSRWLockExclusive( &lfh->lock );
+    }
+}
+
+
+/***********************************************************************
+ *           heap_enable_lfh
+ */
+static NTSTATUS heap_enable_lfh( HEAP *heap )
+{
+    SIZE_T size = sizeof(LFH_HEAP);
+    LFH_HEAP *lfh = NULL;
+    unsigned int i;
+
+    if (heap->lfh) return STATUS_SUCCESS;
+
+    /* the LFH doesn't support unserialized heaps and skips the debugging checks */
+    if ((heap->flags & (HEAP_NO_SERIALIZE | HEAP_SHARED | HEAP_PAGE_ALLOCS | HEAP_VALIDATE |
+                        HEAP_TAIL_CHECKING_ENABLED | HEAP_FREE_CHECKING_ENABLED)) || RUNNING_ON_VALGRIND)
+        return STATUS_UNSUCCESSFUL;
+
+    if (NtAllocateVirtualMemory( NtCurrentProcess(), (void **)&lfh, 0, &size, MEM_COMMIT, PAGE_READWRITE ))
+        return STATUS_NO_MEMORY;
+    for (i = 0; i < LFH_NB_BINS; i++) RtlInitializeSListHead( &lfh->bins[i] );
+
+    if (interlocked_cmpxchg_ptr( (void **)&heap->lfh, lfh, NULL ))
+    {
+        size = 0;
+        NtFreeVirtualMemory( NtCurrentProcess(), (void **)&lfh, &size, MEM_RELEASE );
+    }
+    TRACE( "enabled LFH for heap %p\n", heap );
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           validate_block_pointer
  *
@@ -1622,6 +1941,12 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
         NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
     }
     subheap_notify_free_all(&heapPtr->subheap);
+    if (heapPtr->lfh)
+    {
+        size = 0;
+        addr = heapPtr->lfh;
+        NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
+    }
     if (heapPtr->pending_free)
     {
         size = 0;
@@ -1673,6 +1998,16 @@ PVOID WINAPI RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
     }
     if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
 
+    if (heapPtr->lfh && size <= LFH_MAX_BLOCK_SIZE)
+    {
+        void *ret = lfh_allocate( heapPtr, flags, size );
+        if (ret)
+        {
+            TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, ret );
+            return ret;
+        }
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     if (rounded_size >= HEAP_MIN_LARGE_BLOCK_SIZE && (flags & HEAP_GROWABLE))
@@ -1754,6 +2089,13 @@ BOOLEAN WINAPI RtlFreeHeap( HANDLE heap, ULONG flags, PVOID ptr )
         return FALSE;
     }
 
+    if (is_lfh_block( heapPtr, ptr ))
+    {
+        lfh_free( heapPtr, (ARENA_INUSE *)ptr - 1 );
+        TRACE("(%p,%08x,%p): returning TRUE\n", heap, flags, ptr );
+        return TRUE;
+    }
+
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
@@ -1782,6 +2124,52 @@ error:
 }
 
 
+/***********************************************************************
+ *           lfh_realloc
+ *
+ * Resize an LFH block.  It stays in place unless it grows beyond its size class
+ * or shrinks to less than half of it.
+ */
+static void *lfh_realloc( HEAP *heap, DWORD flags, void *ptr, SIZE_T size )
+{
+    ARENA_INUSE *arena = (ARENA_INUSE *)ptr - 1;
+    SIZE_T block_size = lfh_get_group( arena )->block_size, old_size;
+    BOOL locked;
+    void *ret;
+
+    if (size > block_size || (size <= block_size / 2 && !(flags & HEAP_REALLOC_IN_PLACE_ONLY)))
+    {
+        if (!(flags & HEAP_REALLOC_IN_PLACE_ONLY) &&
+            (ret = RtlAllocateHeap( heap, flags & (HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE), size )))
+        {
+            old_size = block_size - lfh_get_unused( arena );
+            if (size < old_size) memcpy( ret, ptr, size );
+            else
+            {
+                memcpy( ret, ptr, old_size );
+                if (flags & HEAP_ZERO_MEMORY) memset( (char *)ret + old_size, 0, size - old_size );
+            }
+            lfh_free( heap, arena );
+            return ret;
+        }
+        if (size > block_size)
+        {
+            if (flags & HEAP_GENERATE_EXCEPTIONS) RtlRaiseStatus( STATUS_NO_MEMORY );
+            RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_NO_MEMORY );
+            return NULL;
+        }
+    }
+
+    /* the block stays in place, like regular blocks that shrink */
+    locked = lfh_enter( heap );
+    old_size = block_size - lfh_get_unused( arena );
+    lfh_set_unused( arena, block_size - size );
+    lfh_leave( heap, locked );
+    if (size > old_size && (flags & HEAP_ZERO_MEMORY)) memset( (char *)ptr + old_size, 0, size - old_size );
+    return ptr;
+}
+
+
 /***********************************************************************
  *           RtlReAllocateHeap   (NTDLL.@)
  *
@@ -1817,6 +2205,9 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
     flags &= HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE | HEAP_ZERO_MEMORY |
              HEAP_REALLOC_IN_PLACE_ONLY;
     flags |= heapPtr->flags;
+
+    if (is_lfh_block( heapPtr, ptr )) return lfh_realloc( heapPtr, flags, ptr, size );
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     rounded_size = ROUND_SIZE(size) + HEAP_TAIL_EXTRA_SIZE(flags);
@@ -1969,7 +2360,7 @@ BOOLEAN WINAPI RtlLockHeap( HANDLE heap )
 {
     HEAP *heapPtr = HEAP_GetPtr( heap );
     if (!heapPtr) return FALSE;
-    RtlEnterCriticalSection( &heapPtr->critSection );
+    lock_heap( heapPtr );
     return TRUE;
 }
 
@@ -1990,7 +2381,7 @@ BOOLEAN WINAPI RtlUnlockHeap( HANDLE heap )
 {
     HEAP *heapPtr = HEAP_GetPtr( heap );
     if (!heapPtr) return FALSE;
-    RtlLeaveCriticalSection( &heapPtr->critSection );
+    unlock_heap( heapPtr );
     return TRUE;
 }
 
@@ -2024,6 +2415,16 @@ SIZE_T WINAPI RtlSizeHeap( HANDLE heap, ULONG flags, const void *ptr )
         RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_HANDLE );
         return ~0UL;
     }
+    if (is_lfh_block( heapPtr, ptr ))
+    {
+        BOOL locked = lfh_enter( heapPtr );
+        pArena = (const ARENA_INUSE *)ptr - 1;
+        ret = lfh_get_group( pArena )->block_size - lfh_get_unused( pArena );
+        lfh_leave( heapPtr, locked );
+        TRACE("(%p,%08x,%p): returning %08lx\n", heap, flags, ptr, ret );
+        return ret;
+    }
+
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
@@ -2084,13 +2485,14 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
     LPPROCESS_HEAP_ENTRY entry = entry_ptr; /* FIXME */
     HEAP *heapPtr = HEAP_GetPtr(heap);
     SUBHEAP *sub, *currentheap = NULL;
+    LFH_GROUP *group;
     NTSTATUS ret;
     char *ptr;
     int region_index = 0;
 
     if (!heapPtr || !entry) return STATUS_INVALID_PARAMETER;
 
-    if (!(heapPtr->flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
+    if (!(heapPtr->flags & HEAP_NO_SERIALIZE)) lock_heap( heapPtr );
 
     /* FIXME: enumerate large blocks too */
 
@@ -2099,7 +2501,8 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
     if (!entry->lpData) /* first call (init) ? */
     {
         TRACE("begin walking of heap %p.\n", heap);
-        currentheap = &heapPtr->subheap;
+        /* sub-heaps are added at the head of the list, start from there */
+        currentheap = LIST_ENTRY( list_head( &heapPtr->subheap_list ), SUBHEAP, entry );
         ptr = (char*)currentheap->base + currentheap->headerSize;
     }
     else
@@ -2122,8 +2525,23 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
             goto HW_end;
         }
 
-        if (((ARENA_INUSE *)ptr - 1)->magic == ARENA_INUSE_MAGIC ||
-            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_PENDING_MAGIC)
+        if (((ARENA_INUSE *)ptr - 1)->magic == ARENA_LFH_MAGIC ||
+            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_LFH_FREE_MAGIC)
+        {
+            /* LFH blocks are walked one by one, then the walk resumes after their group */
+            group = lfh_get_group( (ARENA_INUSE *)ptr - 1 );
+            ptr += group->block_size + ALIGNMENT;
+            if (ptr + group->block_size - (char *)group <= LFH_GROUP_SIZE)
+            {
+                lfh_walk_entry( group, (ARENA_INUSE *)ptr - 1, entry );
+                entry->iRegionIndex = region_index;
+                ret = STATUS_SUCCESS;
+                goto HW_end;
+            }
+            ptr = (char *)group + (((ARENA_INUSE *)group - 1)->size & ARENA_SIZE_MASK);
+        }
+        else if (((ARENA_INUSE *)ptr - 1)->magic == ARENA_INUSE_MAGIC ||
+                 ((ARENA_INUSE *)ptr - 1)->magic == ARENA_PENDING_MAGIC)
         {
             ARENA_INUSE *pArena = (ARENA_INUSE *)ptr - 1;
             ptr += pArena->size & ARENA_SIZE_MASK;
@@ -2162,6 +2580,10 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
         entry->cbOverhead = sizeof(ARENA_FREE);
         entry->wFlags = PROCESS_HEAP_UNCOMMITTED_RANGE;
     }
+    else if ((group = lfh_find_group( heapPtr, (ARENA_INUSE *)ptr )))
+    {
+        lfh_walk_entry( group, (ARENA_INUSE *)((char *)group + LFH_GROUP_HEADER_SIZE + ARENA_OFFSET), entry );
+    }
     else
     {
         ARENA_INUSE *pArena = (ARENA_INUSE *)ptr;
@@ -2195,7 +2617,7 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
     if (TRACE_ON(heap)) HEAP_DumpEntry(entry);
 
 HW_end:
-    if (!(heapPtr->flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
+    if (!(heapPtr->flags & HEAP_NO_SERIALIZE)) unlock_heap( heapPtr );
     return ret;
 }
 
@@ -2236,6 +2658,8 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
 NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
                                          PVOID info, SIZE_T size_in, PSIZE_T size_out)
 {
+    HEAP *heapPtr;
+
     switch (info_class)
     {
     case HeapCompatibilityInformation:
@@ -2244,7 +2668,8 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
         if (size_in < sizeof(ULONG))
             return STATUS_BUFFER_TOO_SMALL;
 
-        *(ULONG *)info = 0; /* standard heap */
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+        *(ULONG *)info = heapPtr->lfh ? 2 : 0; /* low fragmentation or standard heap */
         return STATUS_SUCCESS;
 
     default:
@@ -2258,6 +2683,27 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
  */
 NTSTATUS WINAPI RtlSetHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class, PVOID info, SIZE_T size)
 {
-    FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
-    return STATUS_SUCCESS;
+    HEAP *heapPtr;
+
+    switch (info_class)
+    {
+    case HeapCompatibilityInformation:
+        if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+
+        switch (*(ULONG *)info)
+        {
+        case 0:  /* the LFH can't be disabled once enabled */
+            return heapPtr->lfh ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS;
+        case 2:
+            return heap_enable_lfh( heapPtr );
+        default:
+            FIXME( "%p: unsupported heap compatibility %u\n", heap, *(ULONG *)info );
+            return STATUS_UNSUCCESSFUL;
+        }
+
+    default:
+        FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
+        return STATUS_SUCCESS;
+    }
 }
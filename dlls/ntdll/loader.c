@@ -78,14 +78,31 @@ static const char * const reason_names[] =
 
 static const WCHAR dllW[] = {'.','d','l','l',0};
 
+/* hash table of the exported names of a module */
+struct export_hash
+{
+    const IMAGE_EXPORT_DIRECTORY *exports;  /* export directory the table was built for */
+    unsigned int                  mask;     /* size of the table minus one */
+    int                           index[1]; /* indices in the names array, -1 if free */
+};
+
 /* internal representation of 32bit modules. per process. */
 typedef struct _wine_modref
 {
     LDR_MODULE            ldr;
     int                   nDeps;
     struct _wine_modref **deps;
+    LIST_ENTRY            basename_hash;  /* entry in the base name hash table */
+    LIST_ENTRY            fullname_hash;  /* entry in the full name hash table */
+    struct export_hash   *export_hash;    /* hash table of the exports, built on first use */
 } WINE_MODREF;
 
+#define MODULE_HASH_SIZE  64  /* number of buckets of the module name hash tables */
+#define EXPORT_HASH_MIN   32  /* min. number of exported names to use a hash table */
+
+static LIST_ENTRY basename_hash_table[MODULE_HASH_SIZE];
+static LIST_ENTRY fullname_hash_table[MODULE_HASH_SIZE];
+
 /* info about the current builtin dll load */
 /* used to keep track of things across the register_dll constructor call */
 struct builtin_load_info
@@ -121,7 +138,7 @@ static NTSTATUS load_dll( LPCWSTR load_path, LPCWSTR libname, DWORD flags, WINE_
 static NTSTATUS process_attach( WINE_MODREF *wm, LPVOID lpReserved );
 static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
                                     DWORD exp_size, DWORD ordinal, LPCWSTR load_path );
-static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
+static FARPROC find_named_export( HMODULE module, WINE_MODREF *wm, const IMAGE_EXPORT_DIRECTORY *exports,
                                   DWORD exp_size, const char *name, int hint, LPCWSTR load_path );
 
 /* convert PE image VirtualAddress to Real Address */
@@ -361,6 +378,54 @@ static WINE_MODREF *get_modref( HMODULE hmod )
 }
 
 
+/* case-insensitive hash of a module name */
+static unsigned int hash_module_name( const WCHAR *name )
+{
+    unsigned int hash = 0;
+
+    while (*name) hash = hash * 31 + tolowerW( *name++ );
+    return hash % MODULE_HASH_SIZE;
+}
+
+
+/**********************************************************************
+ *	    insert_module_hash
+ *
+ * Add a module to the name hash tables.
+ * The loader_section must be locked while calling this function
+ */
+static void insert_module_hash( WINE_MODREF *wm )
+{
+    unsigned int i;
+
+    if (!basename_hash_table[0].Flink)
+    {
+        for (i = 0; i < MODULE_HASH_SIZE; i++)
+        {
+            InitializeListHead( &basename_hash_table[i] );
+            InitializeListHead( &fullname_hash_table[i] );
+        }
+    }
+    InsertTailList( &basename_hash_table[hash_module_name( wm->ldr.BaseDllName.Buffer )],
+                    &wm->basename_hash );
+    InsertTailList( &fullname_hash_table[hash_module_name( wm->ldr.FullDllName.Buffer )],
+                    &wm->fullname_hash );
+}
+
+
+/**********************************************************************
+ *	    remove_module_hash
+ *
+ * Remove a module from the name hash tables.
+ * The loader_section must be locked while calling this function
+ */
+static void remove_module_hash( WINE_MODREF *wm )
+{
+    RemoveEntryList( &wm->basename_hash );
+    RemoveEntryList( &wm->fullname_hash );
+}
+
+
 /**********************************************************************
  *	    find_basename_module
  *
@@ -374,13 +439,14 @@ static WINE_MODREF *find_basename_module( LPCWSTR name )
     if (cached_modref && !strcmpiW( name, cached_modref->ldr.BaseDllName.Buffer ))
         return cached_modref;
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
+    if (!basename_hash_table[0].Flink) return NULL;
+    mark = &basename_hash_table[hash_module_name( name )];
     for (entry = mark->Flink; entry != mark; entry = entry->Flink)
     {
-        LDR_MODULE *mod = CONTAINING_RECORD(entry, LDR_MODULE, InLoadOrderModuleList);
-        if (!strcmpiW( name, mod->BaseDllName.Buffer ))
+        WINE_MODREF *wm = CONTAINING_RECORD(entry, WINE_MODREF, basename_hash);
+        if (!strcmpiW( name, wm->ldr.BaseDllName.Buffer ))
         {
-            cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
+            cached_modref = wm;
             return cached_modref;
         }
     }
@@ -401,13 +467,14 @@ static WINE_MODREF *find_fullname_module( LPCWSTR name )
     if (cached_modref && !strcmpiW( name, cached_modref->ldr.FullDllName.Buffer ))
         return cached_modref;
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
+    if (!fullname_hash_table[0].Flink) return NULL;
+    mark = &fullname_hash_table[hash_module_name( name )];
     for (entry = mark->Flink; entry != mark; entry = entry->Flink)
     {
-        LDR_MODULE *mod = CONTAINING_RECORD(entry, LDR_MODULE, InLoadOrderModuleList);
-        if (!strcmpiW( name, mod->FullDllName.Buffer ))
+        WINE_MODREF *wm = CONTAINING_RECORD(entry, WINE_MODREF, fullname_hash);
+        if (!strcmpiW( name, wm->ldr.FullDllName.Buffer ))
         {
-            cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
+            cached_modref = wm;
             return cached_modref;
         }
     }
@@ -467,7 +534,7 @@ static FARPROC find_forwarded_export( HMODULE module, const char *forward, LPCWS
         if (*name == '#')  /* ordinal */
             proc = find_ordinal_export( wm->ldr.BaseAddress, exports, exp_size, atoi(name+1), load_path );
         else
-            proc = find_named_export( wm->ldr.BaseAddress, exports, exp_size, name, -1, load_path );
+            proc = find_named_export( wm->ldr.BaseAddress, wm, exports, exp_size, name, -1, load_path );
     }
 
     if (!proc)
@@ -522,18 +589,65 @@ static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY
 }
 
 
+/* hash of an exported name */
+static inline unsigned int hash_export_name( const char *name )
+{
+    unsigned int hash = 2166136261u;
+
+    while (*name) hash = (hash ^ (unsigned char)*name++) * 16777619;
+    return hash;
+}
+
+
+/*************************************************************************
+ *		get_export_hash
+ *
+ * Get the hash table of the exported names of a module, building it if needed.
+ * The table is cached in the modref, wm can be NULL if there isn't one yet.
+ * The loader_section must be locked while calling this function.
+ */
+static struct export_hash *get_export_hash( HMODULE module, WINE_MODREF *wm,
+                                            const IMAGE_EXPORT_DIRECTORY *exports )
+{
+    const DWORD *names = get_rva( module, exports->AddressOfNames );
+    struct export_hash *table;
+    unsigned int i, pos, size;
+
+    if (!wm || exports->NumberOfNames < EXPORT_HASH_MIN) return NULL;
+    if (wm->export_hash) return wm->export_hash->exports == exports ? wm->export_hash : NULL;
+
+    for (size = 64; size < exports->NumberOfNames * 2; size *= 2) ;
+    if (!(table = RtlAllocateHeap( GetProcessHeap(), 0, offsetof( struct export_hash, index[size] ))))
+        return NULL;
+    table->exports = exports;
+    table->mask = size - 1;
+    memset( table->index, 0xff, size * sizeof(table->index[0]) );
+
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        pos = hash_export_name( get_rva( module, names[i] )) & table->mask;
+        while (table->index[pos] != -1) pos = (pos + 1) & table->mask;
+        table->index[pos] = i;
+    }
+    TRACE( "built hash table of %u exports for %s\n", exports->NumberOfNames,
+           debugstr_w(wm->ldr.BaseDllName.Buffer) );
+    return wm->export_hash = table;
+}
+
+
 /*************************************************************************
  *		find_named_export
  *
  * Find an exported function by name.
  * The loader_section must be locked while calling this function.
  */
-static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
+static FARPROC find_named_export( HMODULE module, WINE_MODREF *wm, const IMAGE_EXPORT_DIRECTORY *exports,
                                   DWORD exp_size, const char *name, int hint, LPCWSTR load_path )
 {
     const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
     const DWORD *names = get_rva( module, exports->AddressOfNames );
     int min = 0, max = exports->NumberOfNames - 1;
+    struct export_hash *table;
 
     /* first check the hint */
     if (hint >= 0 && hint <= max)
@@ -543,7 +657,21 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
             return find_ordinal_export( module, exports, exp_size, ordinals[hint], load_path );
     }
 
-    /* then do a binary search */
+    /* then look it up in the hash table */
+    if ((table = get_export_hash( module, wm, exports )))
+    {
+        unsigned int pos = hash_export_name( name ) & table->mask;
+
+        for ( ; table->index[pos] != -1; pos = (pos + 1) & table->mask)
+        {
+            int idx = table->index[pos];
+            if (!strcmp( get_rva( module, names[idx] ), name ))
+                return find_ordinal_export( module, exports, exp_size, ordinals[idx], load_path );
+        }
+        return NULL;
+    }
+
+    /* or do a binary search */
     while (min <= max)
     {
         int res, pos = (min + max) / 2;
@@ -680,7 +808,7 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
         {
             IMAGE_IMPORT_BY_NAME *pe_name;
             pe_name = get_rva( module, (DWORD)import_list->u1.AddressOfData );
-            thunk_list->u1.Function = (ULONG_PTR)find_named_export( imp_mod, exports, exp_size,
+            thunk_list->u1.Function = (ULONG_PTR)find_named_export( imp_mod, wmImp, exports, exp_size,
                                                                     (const char*)pe_name->Name,
                                                                     pe_name->Hint, load_path );
             if (!thunk_list->u1.Function)
@@ -936,8 +1064,9 @@ static WINE_MODREF *alloc_module( HMODULE hModule, LPCWSTR filename )
 
     if (!(wm = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*wm) ))) return NULL;
 
-    wm->nDeps    = 0;
-    wm->deps     = NULL;
+    wm->nDeps       = 0;
+    wm->deps        = NULL;
+    wm->export_hash = NULL;
 
     wm->ldr.BaseAddress   = hModule;
     wm->ldr.EntryPoint    = NULL;
@@ -965,6 +1094,7 @@ static WINE_MODREF *alloc_module( HMODULE hModule, LPCWSTR filename )
 
     InsertTailList(&NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList,
                    &wm->ldr.InLoadOrderModuleList);
+    insert_module_hash( wm );
 
     /* insert module in MemoryList, sorted in increasing base addresses */
     mark = &NtCurrentTeb()->Peb->LdrData->InMemoryOrderModuleList;
@@ -1447,18 +1577,19 @@ NTSTATUS WINAPI LdrGetProcedureAddress(HMODULE module, const ANSI_STRING *name,
                                        ULONG ord, PVOID *address)
 {
     IMAGE_EXPORT_DIRECTORY *exports;
+    WINE_MODREF *wm;
     DWORD exp_size;
     NTSTATUS ret = STATUS_PROCEDURE_NOT_FOUND;
 
     RtlEnterCriticalSection( &loader_section );
 
     /* check if the module itself is invalid to return the proper error */
-    if (!get_modref( module )) ret = STATUS_DLL_NOT_FOUND;
+    if (!(wm = get_modref( module ))) ret = STATUS_DLL_NOT_FOUND;
     else if ((exports = RtlImageDirectoryEntryToData( module, TRUE,
                                                       IMAGE_DIRECTORY_ENTRY_EXPORT, &exp_size )))
     {
         LPCWSTR load_path = NtCurrentTeb()->Peb->ProcessParameters->DllPath.Buffer;
-        void *proc = name ? find_named_export( module, exports, exp_size, name->Buffer, -1, load_path )
+        void *proc = name ? find_named_export( module, wm, exports, exp_size, name->Buffer, -1, load_path )
                           : find_ordinal_export( module, exports, exp_size, ord - exports->Base, load_path );
         if (proc)
         {
@@ -1549,7 +1680,7 @@ static BOOL is_16bit_builtin( HMODULE module )
                                                   IMAGE_DIRECTORY_ENTRY_EXPORT, &exp_size )))
         return FALSE;
 
-    return find_named_export( module, exports, exp_size, "__wine_spec_dos_header", -1, NULL ) != NULL;
+    return find_named_export( module, NULL, exports, exp_size, "__wine_spec_dos_header", -1, NULL ) != NULL;
 }
 
 
@@ -1613,6 +1744,7 @@ static void load_builtin_callback( void *module, const char *filename )
             /* the module has only be inserted in the load & memory order lists */
             RemoveEntryList(&wm->ldr.InLoadOrderModuleList);
             RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
+            remove_module_hash( wm );
             /* FIXME: free the modref */
             builtin_load_info->status = STATUS_DLL_NOT_FOUND;
             return;
@@ -1703,7 +1835,8 @@ static NTSTATUS perform_relocations( void *module, SIZE_T len )
     nt = RtlImageNtHeader( module );
     base = (char *)nt->OptionalHeader.ImageBase;
 
-    assert( module != base );
+    /* the image may have been mapped from a copy already relocated by the server */
+    if (module == base) return STATUS_SUCCESS;
 
     /* no relocations are performed on non page-aligned binaries */
     if (nt->OptionalHeader.SectionAlignment < page_size)
@@ -1827,6 +1960,7 @@ static NTSTATUS load_native_dll( LPCWSTR load_path, LPCWSTR name, HANDLE file,
             /* the module has only be inserted in the load & memory order lists */
             RemoveEntryList(&wm->ldr.InLoadOrderModuleList);
             RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
+            remove_module_hash( wm );
 
             /* FIXME: there are several more dangling references
              * left. Including dlls loaded by this dll before the
@@ -2805,6 +2939,7 @@ static void free_modref( WINE_MODREF *wm )
 {
     RemoveEntryList(&wm->ldr.InLoadOrderModuleList);
     RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
+    remove_module_hash( wm );
     if (wm->ldr.InInitializationOrderModuleList.Flink)
         RemoveEntryList(&wm->ldr.InInitializationOrderModuleList);
 
@@ -2827,6 +2962,7 @@ static void free_modref( WINE_MODREF *wm )
     NtUnmapViewOfSection( NtCurrentProcess(), wm->ldr.BaseAddress );
     if (cached_modref == wm) cached_modref = NULL;
     RtlFreeUnicodeString( &wm->ldr.FullDllName );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->export_hash );
     RtlFreeHeap( GetProcessHeap(), 0, wm->deps );
     RtlFreeHeap( GetProcessHeap(), 0, wm );
 }
@@ -3059,10 +3195,12 @@ void WINAPI LdrInitializeThunk( void *kernel_start, ULONG_PTR unknown2,
                                 ULONG_PTR unknown3, ULONG_PTR unknown4 )
 {
     static const WCHAR globalflagW[] = {'G','l','o','b','a','l','F','l','a','g',0};
+    static const WCHAR frontendheapW[] = {'F','r','o','n','t','E','n','d','H','e','a','p',0};
     NTSTATUS status;
     WINE_MODREF *wm;
     LPCWSTR load_path;
     PEB *peb = NtCurrentTeb()->Peb;
+    ULONG heap_type;
 
     if (main_exe_file) NtClose( main_exe_file );  /* at this point the main module is created */
 
@@ -3097,6 +3235,11 @@ void WINAPI LdrInitializeThunk( void *kernel_start, ULONG_PTR unknown2,
     if ((status = fixup_imports( wm, load_path )) != STATUS_SUCCESS) goto error;
     heap_set_debug_flags( GetProcessHeap() );
 
+    /* the process heap front-end can be selected per application, 2 is the LFH */
+    if (!LdrQueryImageFileExecutionOptions( &peb->ProcessParameters->ImagePathName, frontendheapW,
+                                            REG_DWORD, &heap_type, sizeof(heap_type), NULL ))
+        RtlSetHeapInformation( GetProcessHeap(), HeapCompatibilityInformation, &heap_type, sizeof(heap_type) );
+
     status = wine_call_on_stack( attach_process_dlls, wm, NtCurrentTeb()->Tib.StackBase );
     if (status != STATUS_SUCCESS) goto error;
 
@@ -3257,6 +3400,7 @@ void CDECL __wine_init_windows_dir( const WCHAR *windir, const WCHAR *sysdir )
     for (entry = mark->Flink; entry != mark; entry = entry->Flink)
     {
         LDR_MODULE *mod = CONTAINING_RECORD( entry, LDR_MODULE, InLoadOrderModuleList );
+        WINE_MODREF *wm = CONTAINING_RECORD( mod, WINE_MODREF, ldr );
 
         assert( mod->Flags & LDR_WINE_INTERNAL );
 
@@ -3267,8 +3411,11 @@ void CDECL __wine_init_windows_dir( const WCHAR *windir, const WCHAR *sysdir )
         p = buffer + strlenW( buffer );
         if (p > buffer && p[-1] != '\\') *p++ = '\\';
         strcpyW( p, mod->FullDllName.Buffer );
+        /* the names are changing, move the module to the right buckets */
+        remove_module_hash( wm );
         RtlInitUnicodeString( &mod->FullDllName, buffer );
         RtlInitUnicodeString( &mod->BaseDllName, p );
+        insert_module_hash( wm );
     }
 }
 
@@ -97,6 +97,11 @@ extern int server_remove_fd_from_cache( HANDLE handle ) DECLSPEC_HIDDEN;
 extern int server_get_unix_fd( HANDLE handle, unsigned int access, int *unix_fd,
                                int *needs_close, enum server_fd_type *type, unsigned int *options ) DECLSPEC_HIDDEN;
 extern int server_pipe( int fd[2] ) DECLSPEC_HIDDEN;
+extern unsigned int server_call_receive_fd( void *req_ptr, int *fd, obj_handle_t *cookie ) DECLSPEC_HIDDEN;
+extern void init_inproc_sync(void) DECLSPEC_HIDDEN;
+extern void inproc_sync_remove_from_cache( HANDLE handle ) DECLSPEC_HIDDEN;
+extern struct inproc_sync *grab_inproc_event( HANDLE handle ) DECLSPEC_HIDDEN;
+extern void release_inproc_event( struct inproc_sync *sync, BOOL signal ) DECLSPEC_HIDDEN;
 extern NTSTATUS alloc_object_attributes( const OBJECT_ATTRIBUTES *attr, struct object_attributes **ret,
                                          data_size_t *ret_len ) DECLSPEC_HIDDEN;
 extern NTSTATUS validate_open_object_attributes( const OBJECT_ATTRIBUTES *attr ) DECLSPEC_HIDDEN;
@@ -151,6 +156,7 @@ extern int get_file_info( const char *path, struct stat *st, ULONG *attr ) DECLS
 extern NTSTATUS fill_file_info( const struct stat *st, ULONG attr, void *ptr,
                                 FILE_INFORMATION_CLASS class ) DECLSPEC_HIDDEN;
 extern NTSTATUS server_get_unix_name( HANDLE handle, ANSI_STRING *unix_name ) DECLSPEC_HIDDEN;
+extern void uring_remove_from_cache( HANDLE handle ) DECLSPEC_HIDDEN;
 extern void DIR_init_windows_dir( const WCHAR *windir, const WCHAR *sysdir ) DECLSPEC_HIDDEN;
 extern BOOL DIR_is_hidden_file( const UNICODE_STRING *name ) DECLSPEC_HIDDEN;
 extern NTSTATUS DIR_unmount_device( HANDLE handle ) DECLSPEC_HIDDEN;
@@ -238,6 +244,9 @@ struct ntdll_thread_data
     WINE_VM86_TEB_INFO vm86;          /* 1fc vm86 private data */
     void              *exit_frame;    /* 204 exit frame pointer */
 #endif
+    struct request_shm *request_shm;  /* 208/318 buffer shared with the server for requests */
+    void              *threadpool_worker; /* 20c/320 thread pool worker running on this thread */
+    int                doorbell_fd;   /* 210/328 eventfd signaling requests in the shared buffer */
 };
 
 static inline struct ntdll_thread_data *ntdll_get_thread_data(void)
@@ -51,6 +51,9 @@
 #ifdef HAVE_SYS_MMAN_H
 #include <sys/mman.h>
 #endif
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
 #ifdef HAVE_SYS_PRCTL_H
 # include <sys/prctl.h>
 #endif
@@ -80,6 +83,7 @@
 #include "wine/library.h"
 #include "wine/server.h"
 #include "wine/debug.h"
+#include "wine/exception.h"
 #include "ntdll_misc.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(server);
@@ -198,6 +202,30 @@ static DECLSPEC_NORETURN void server_protocol_perror( const char *err )
 }
 
 
+#ifdef __linux__
+static inline int futex_wait( int *addr, int val, struct timespec *timeout )
+{
+    return syscall( __NR_futex, addr, 0 /* FUTEX_WAIT */, val, timeout, 0, 0 );
+}
+#else
+static inline int futex_wait( int *addr, int val, struct timespec *timeout )
+{
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
+/* return the shared buffer if the request and its reply fit in it */
+static inline struct request_shm *get_request_shm( const struct __server_request_info *req )
+{
+    struct request_shm *shm = ntdll_get_thread_data()->request_shm;
+
+    if (shm && req->u.req.request_header.request_size <= REQUEST_SHM_DATA_SIZE &&
+        req->u.req.request_header.reply_size <= REQUEST_SHM_DATA_SIZE) return shm;
+    return NULL;
+}
+
+
 /***********************************************************************
  *           send_request
  *
@@ -205,10 +233,36 @@ static DECLSPEC_NORETURN void server_protocol_perror( const char *err )
  */
 static unsigned int send_request( const struct __server_request_info *req )
 {
+    struct request_shm *shm = get_request_shm( req );
     unsigned int i;
     int ret;
 
-    if (!req->u.req.request_header.request_size)
+    if (shm)
+    {
+        static const ULONG64 one = 1;
+        char *ptr = (char *)(shm + 1);
+
+        __TRY
+        {
+            for (i = 0; i < req->data_count; i++)
+            {
+                memcpy( ptr, req->data[i].ptr, req->data[i].size );
+                ptr += req->data[i].size;
+            }
+        }
+        __EXCEPT_PAGE_FAULT
+        {
+            return STATUS_ACCESS_VIOLATION;
+        }
+        __ENDTRY
+
+        memcpy( &shm->header, &req->u.req, sizeof(req->u.req) );
+        interlocked_xchg( &shm->state, REQUEST_SHM_REQUEST );
+        /* ring the doorbell, the server polls the eventfd like the request pipe */
+        if ((ret = write( ntdll_get_thread_data()->doorbell_fd, &one, sizeof(one) )) == sizeof(one))
+            return STATUS_SUCCESS;
+    }
+    else if (!req->u.req.request_header.request_size)
     {
         if ((ret = write( ntdll_get_thread_data()->request_fd, &req->u.req,
                           sizeof(req->u.req) )) == sizeof(req->u.req)) return STATUS_SUCCESS;
@@ -263,6 +317,39 @@ static void read_reply_data( void *buffer, size_t size )
 }
 
 
+/***********************************************************************
+ *           wait_shm_reply
+ *
+ * Wait for the server to write the reply in the shared buffer; helper for wait_reply.
+ */
+static unsigned int wait_shm_reply( struct request_shm *shm, struct __server_request_info *req )
+{
+    struct timespec timeout = { 1, 0 };
+    struct pollfd pfd;
+    int state;
+
+    while ((state = shm->state) == REQUEST_SHM_REQUEST)
+    {
+        if (futex_wait( &shm->state, state, &timeout ) == -1 && errno == ETIMEDOUT)
+        {
+            /* the server can't wake us if it's gone, check the reply pipe */
+            pfd.fd = ntdll_get_thread_data()->reply_fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            if (poll( &pfd, 1, 0 ) == 1 && (pfd.revents & (POLLHUP | POLLERR))) abort_thread(0);
+        }
+    }
+    /* the server killed the thread */
+    if (state != REQUEST_SHM_REPLY) abort_thread(0);
+
+    memcpy( &req->u.reply, &shm->header, sizeof(req->u.reply) );
+    if (req->u.reply.reply_header.reply_size)
+        memcpy( req->reply_data, shm + 1, req->u.reply.reply_header.reply_size );
+    shm->state = REQUEST_SHM_IDLE;
+    return req->u.reply.reply_header.error;
+}
+
+
 /***********************************************************************
  *           wait_reply
  *
@@ -270,6 +357,10 @@ static void read_reply_data( void *buffer, size_t size )
  */
 static inline unsigned int wait_reply( struct __server_request_info *req )
 {
+    struct request_shm *shm = get_request_shm( req );
+
+    if (shm) return wait_shm_reply( shm, req );
+
     read_reply_data( &req->u.reply, sizeof(req->u.reply) );
     if (req->u.reply.reply_header.reply_size)
         read_reply_data( req->reply_data, req->u.reply.reply_header.reply_size );
@@ -1454,6 +1545,68 @@ NTSTATUS server_init_process_done(void)
 }
 
 
+/***********************************************************************
+ *           server_call_receive_fd
+ *
+ * Perform a server call for a request that sends back a file descriptor on the socket.
+ */
+unsigned int server_call_receive_fd( void *req_ptr, int *fd, obj_handle_t *cookie )
+{
+    unsigned int ret;
+    sigset_t sigset;
+
+    *fd = -1;
+    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+    if (!(ret = wine_server_call( req_ptr ))) *fd = receive_fd( cookie );
+    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+    return ret;
+}
+
+
+/***********************************************************************
+ *           init_request_shm
+ *
+ * Map the buffer shared with the server for requests, if enabled with WINESERVERSHM.
+ */
+static void init_request_shm(void)
+{
+    static int enabled = -1;
+    obj_handle_t fd_handle;
+    sigset_t sigset;
+    void *ptr;
+    int fd = -1, doorbell = -1;
+
+    if (enabled == -1)
+    {
+        const char *env = getenv( "WINESERVERSHM" );
+        enabled = env && atoi( env );
+    }
+    if (!enabled) return;
+
+    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+    SERVER_START_REQ( init_request_shm )
+    {
+        if (!wine_server_call( req ))
+        {
+            fd = receive_fd( &fd_handle );
+            assert( fd_handle == GetCurrentThreadId() );
+            doorbell = receive_fd( &fd_handle );
+            assert( fd_handle == GetCurrentThreadId() );
+        }
+    }
+    SERVER_END_REQ;
+    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+
+    if (fd == -1) return;
+    ptr = mmap( NULL, REQUEST_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if (ptr == MAP_FAILED) server_protocol_perror( "mmap" );
+    close( fd );
+    /* the server is already listening on the doorbell */
+    ntdll_get_thread_data()->doorbell_fd = doorbell;
+    ntdll_get_thread_data()->request_shm = ptr;
+}
+
+
 /***********************************************************************
  *           server_init_thread
  *
@@ -1518,6 +1671,7 @@ size_t server_init_thread( void *entry_point )
                 fatal_error( "WINEARCH set to win64 but '%s' is a 32-bit installation.\n",
                              wine_get_config_dir() );
         }
+        init_request_shm();
         return info_size;
     case STATUS_INVALID_IMAGE_WIN_64:
         fatal_error( "'%s' is a 32-bit installation, it cannot support 64-bit applications.\n",
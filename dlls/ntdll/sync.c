@@ -26,6 +26,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
 #ifdef HAVE_SYS_TIME_H
 # include <sys/time.h>
@@ -42,6 +43,12 @@
 #ifdef HAVE_SCHED_H
 # include <sched.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -53,6 +60,7 @@
 #define NONAMELESSUNION
 #include "windef.h"
 #include "winternl.h"
+#include "wine/library.h"
 #include "wine/server.h"
 #include "wine/debug.h"
 #include "ntdll_misc.h"
@@ -72,6 +80,319 @@ static inline int interlocked_dec_if_nonzero( int *dest )
     return val;
 }
 
+
+/*
+ *	In-process synchronization
+ *
+ * The state of the events, semaphores and mutexes created by this process
+ * is kept in memory shared with the server, so that uncontended waits and
+ * signals can be done with atomic operations and futexes.  The server sets
+ * INPROC_SYNC_SERVER_WAIT in the state while it has waiters of its own, in
+ * which case anything but the trivial cases is sent to the server.
+ */
+
+static struct inproc_sync *inproc_sync_area;
+
+#define TICKSPERSEC 10000000
+
+#define INPROC_ACCESS_WAIT    1  /* SYNCHRONIZE */
+#define INPROC_ACCESS_MODIFY  2  /* EVENT_MODIFY_STATE / SEMAPHORE_MODIFY_STATE */
+
+#define INPROC_SYNC_EVENT_PULSE_MASK (~(INPROC_SYNC_SERVER_WAIT | INPROC_SYNC_EVENT_SIGNALED))
+
+union inproc_sync_cache_entry
+{
+    LONG data;
+    struct
+    {
+        unsigned int valid  : 1;   /* the server has been queried for this handle */
+        unsigned int type   : 3;   /* INPROC_SYNC_* type, INPROC_SYNC_NONE if not shared */
+        unsigned int access : 2;   /* INPROC_ACCESS_* rights of the handle */
+        unsigned int index  : 26;  /* index of the state in the shared area */
+    } s;
+};
+
+C_ASSERT( sizeof(union inproc_sync_cache_entry) == sizeof(LONG) );
+
+#define INPROC_SYNC_CACHE_BLOCK_SIZE  (65536 / sizeof(union inproc_sync_cache_entry))
+#define INPROC_SYNC_CACHE_ENTRIES     128
+
+static union inproc_sync_cache_entry *inproc_sync_cache[INPROC_SYNC_CACHE_ENTRIES];
+
+#ifdef __linux__
+
+/* the futexes live in memory shared with the server, so they can't use FUTEX_PRIVATE_FLAG */
+static inline int futex_wait( int *addr, int val, struct timespec *timeout )
+{
+    return syscall( __NR_futex, addr, 0 /* FUTEX_WAIT */, val, timeout, 0, 0 );
+}
+
+static inline int futex_wake( int *addr, int val )
+{
+    return syscall( __NR_futex, addr, 1 /* FUTEX_WAKE */, val, NULL, 0, 0 );
+}
+
+/* SRW locks and condition variables are private to the process */
+static int futex_private = 128;  /* FUTEX_PRIVATE_FLAG */
+
+static inline int futex_wait_private( int *addr, int val, struct timespec *timeout )
+{
+    return syscall( __NR_futex, addr, 0 /* FUTEX_WAIT */ | futex_private, val, timeout, 0, 0 );
+}
+
+static inline int futex_wake_private( int *addr, int val )
+{
+    return syscall( __NR_futex, addr, 1 /* FUTEX_WAKE */ | futex_private, val, NULL, 0, 0 );
+}
+
+static inline int futex_wait_bitset( int *addr, int val, struct timespec *timeout, int mask )
+{
+    return syscall( __NR_futex, addr, 9 /* FUTEX_WAIT_BITSET */ | futex_private, val, timeout, 0, mask );
+}
+
+static inline int futex_wake_bitset( int *addr, int val, int mask )
+{
+    return syscall( __NR_futex, addr, 10 /* FUTEX_WAKE_BITSET */ | futex_private, val, NULL, 0, mask );
+}
+
+/* check once whether the kernel supports the futex operations we need */
+static inline BOOL use_futexes(void)
+{
+    static int supported = -1;
+
+    if (supported == -1)
+    {
+        futex_wait_bitset( &supported, 10, NULL, ~0 );
+        if (errno == ENOSYS)
+        {
+            futex_private = 0;
+            futex_wait_bitset( &supported, 10, NULL, ~0 );
+        }
+        supported = (errno != ENOSYS);
+    }
+    return supported;
+}
+
+#else
+
+static inline int futex_wait( int *addr, int val, struct timespec *timeout )
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static inline int futex_wake( int *addr, int val )
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static inline BOOL use_futexes(void)
+{
+    return FALSE;
+}
+
+#endif
+
+/***********************************************************************
+ *           init_inproc_sync
+ *
+ * Map the area shared with the server, if enabled with WINEINPROCSYNC.
+ */
+void init_inproc_sync(void)
+{
+    const char *env = getenv( "WINEINPROCSYNC" );
+    obj_handle_t cookie;
+    void *ptr;
+    int fd = -1;
+
+    if (!env || !atoi( env )) return;
+
+    SERVER_START_REQ( init_inproc_sync )
+    {
+        server_call_receive_fd( req, &fd, &cookie );
+    }
+    SERVER_END_REQ;
+
+    if (fd == -1) return;
+    ptr = mmap( NULL, INPROC_SYNC_AREA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if (ptr != MAP_FAILED) inproc_sync_area = ptr;
+    else WARN( "failed to map in-process synchronization area\n" );
+    close( fd );
+}
+
+static inline unsigned int inproc_sync_handle_to_index( HANDLE handle, unsigned int *entry )
+{
+    unsigned int idx = (wine_server_obj_handle(handle) >> 2) - 1;
+    *entry = idx / INPROC_SYNC_CACHE_BLOCK_SIZE;
+    return idx % INPROC_SYNC_CACHE_BLOCK_SIZE;
+}
+
+static void add_inproc_sync_to_cache( HANDLE handle, union inproc_sync_cache_entry cache )
+{
+    unsigned int entry, idx = inproc_sync_handle_to_index( handle, &entry );
+    void *ptr;
+
+    if (entry >= INPROC_SYNC_CACHE_ENTRIES) return;
+
+    if (!inproc_sync_cache[entry])  /* do we need to allocate a new block of entries? */
+    {
+        ptr = wine_anon_mmap( NULL, INPROC_SYNC_CACHE_BLOCK_SIZE * sizeof(union inproc_sync_cache_entry),
+                              PROT_READ | PROT_WRITE, 0 );
+        if (ptr == MAP_FAILED) return;
+        if (interlocked_cmpxchg_ptr( (void **)&inproc_sync_cache[entry], ptr, NULL ))
+            munmap( ptr, INPROC_SYNC_CACHE_BLOCK_SIZE * sizeof(union inproc_sync_cache_entry) );
+    }
+    interlocked_xchg( &inproc_sync_cache[entry][idx].data, cache.data );
+}
+
+/***********************************************************************
+ *           inproc_sync_remove_from_cache
+ */
+void inproc_sync_remove_from_cache( HANDLE handle )
+{
+    unsigned int entry, idx = inproc_sync_handle_to_index( handle, &entry );
+
+    if (entry < INPROC_SYNC_CACHE_ENTRIES && inproc_sync_cache[entry])
+        interlocked_xchg( &inproc_sync_cache[entry][idx].data, 0 );
+}
+
+/* retrieve the shared state of an object, if the handle has the requested access */
+static struct inproc_sync *get_inproc_sync( HANDLE handle, unsigned int access,
+                                            enum inproc_sync_type *type )
+{
+    union inproc_sync_cache_entry cache;
+    unsigned int entry, idx;
+
+    if (!inproc_sync_area) return NULL;
+
+    idx = inproc_sync_handle_to_index( handle, &entry );
+    if (entry >= INPROC_SYNC_CACHE_ENTRIES) return NULL;  /* also catches pseudo-handles */
+
+    cache.data = inproc_sync_cache[entry] ? inproc_sync_cache[entry][idx].data : 0;
+    if (!cache.s.valid)
+    {
+        SERVER_START_REQ( get_inproc_sync )
+        {
+            req->handle = wine_server_obj_handle( handle );
+            if (wine_server_call( req )) cache.data = 0;
+            else
+            {
+                cache.s.valid  = 1;
+                cache.s.type   = reply->type;
+                cache.s.index  = reply->index;
+                cache.s.access = ((reply->access & SYNCHRONIZE) ? INPROC_ACCESS_WAIT : 0) |
+                                 ((reply->access & EVENT_MODIFY_STATE) ? INPROC_ACCESS_MODIFY : 0);
+            }
+        }
+        SERVER_END_REQ;
+        if (!cache.s.valid) return NULL;
+        add_inproc_sync_to_cache( handle, cache );
+    }
+
+    if (cache.s.type == INPROC_SYNC_NONE || (cache.s.access & access) != access) return NULL;
+    *type = cache.s.type;
+    return &inproc_sync_area[cache.s.index];
+}
+
+/* compute the time left until an absolute timeout, return FALSE if it has expired */
+static BOOL get_timeout_left( const LARGE_INTEGER *end, struct timespec *timespec )
+{
+    LARGE_INTEGER now;
+
+    NtQuerySystemTime( &now );
+    if (now.QuadPart >= end->QuadPart) return FALSE;
+    timespec->tv_sec  = (end->QuadPart - now.QuadPart) / TICKSPERSEC;
+    timespec->tv_nsec = ((end->QuadPart - now.QuadPart) % TICKSPERSEC) * 100;
+    return TRUE;
+}
+
+/***********************************************************************
+ *           inproc_wait
+ *
+ * Wait on a single object without going through the server.
+ * Returns STATUS_NOT_IMPLEMENTED if the wait must be done by the server, in
+ * which case a relative timeout has been converted to an absolute one in end.
+ */
+static NTSTATUS inproc_wait( HANDLE handle, const LARGE_INTEGER **timeout, LARGE_INTEGER *end )
+{
+    DWORD tid = GetCurrentThreadId();
+    enum inproc_sync_type type;
+    struct inproc_sync *sync;
+    struct timespec timespec;
+    int state, start, woken = 0;
+
+    if (!(sync = get_inproc_sync( handle, INPROC_ACCESS_WAIT, &type ))) return STATUS_NOT_IMPLEMENTED;
+
+    start = sync->state;
+    for (;;)
+    {
+        state = sync->state;
+        switch (type)
+        {
+        case INPROC_SYNC_MANUAL_EVENT:
+            if (state & INPROC_SYNC_EVENT_SIGNALED) return STATUS_WAIT_0;
+            if ((state ^ start) & INPROC_SYNC_EVENT_PULSE_MASK) return STATUS_WAIT_0;
+            break;
+        case INPROC_SYNC_AUTO_EVENT:
+            if (state & INPROC_SYNC_SERVER_WAIT) return STATUS_NOT_IMPLEMENTED;
+            if (state & INPROC_SYNC_EVENT_SIGNALED)
+            {
+                if (interlocked_cmpxchg( &sync->state, state & ~INPROC_SYNC_EVENT_SIGNALED, state ) == state)
+                    return STATUS_WAIT_0;
+                continue;
+            }
+            /* a pulse only releases the thread that was woken up */
+            if (woken && ((state ^ start) & INPROC_SYNC_EVENT_PULSE_MASK)) return STATUS_WAIT_0;
+            break;
+        case INPROC_SYNC_SEMAPHORE:
+            if (state & INPROC_SYNC_SERVER_WAIT) return STATUS_NOT_IMPLEMENTED;
+            if (state)
+            {
+                if (interlocked_cmpxchg( &sync->state, state - 1, state ) == state) return STATUS_WAIT_0;
+                continue;
+            }
+            break;
+        case INPROC_SYNC_MUTEX:
+            if ((state & ~INPROC_SYNC_SERVER_WAIT) == tid)
+            {
+                if (sync->count == INPROC_SYNC_MUTEX_MAX_COUNT) return STATUS_MUTANT_LIMIT_EXCEEDED;
+                sync->count++;
+                return STATUS_WAIT_0;
+            }
+            if (state & INPROC_SYNC_SERVER_WAIT) return STATUS_NOT_IMPLEMENTED;
+            if (!state)
+            {
+                if (interlocked_cmpxchg( &sync->state, tid, 0 )) continue;
+                sync->count = 1;
+                if (!sync->abandoned) return STATUS_WAIT_0;
+                sync->abandoned = 0;
+                return STATUS_ABANDONED_WAIT_0;
+            }
+            break;
+        default:
+            return STATUS_NOT_IMPLEMENTED;
+        }
+
+        if (*timeout && *timeout != end)
+        {
+            if (!(*timeout)->QuadPart) return STATUS_TIMEOUT;
+            /* convert to absolute time, in case we have to fall back to the server */
+            if ((*timeout)->QuadPart < 0)
+            {
+                NtQuerySystemTime( end );
+                end->QuadPart -= (*timeout)->QuadPart;
+            }
+            else *end = **timeout;
+            *timeout = end;
+        }
+        if (*timeout && !get_timeout_left( end, &timespec )) return STATUS_TIMEOUT;
+
+        woken = !futex_wait( &sync->state, state, *timeout ? &timespec : NULL );
+        if (!woken && errno == ENOSYS) return STATUS_NOT_IMPLEMENTED;
+    }
+}
+
 /* creates a struct security_descriptor and contained information in one contiguous piece of memory */
 NTSTATUS alloc_object_attributes( const OBJECT_ATTRIBUTES *attr, struct object_attributes **ret,
                                   data_size_t *ret_len )
@@ -265,7 +586,24 @@ NTSTATUS WINAPI NtQuerySemaphore( HANDLE handle, SEMAPHORE_INFORMATION_CLASS cla
  */
 NTSTATUS WINAPI NtReleaseSemaphore( HANDLE handle, ULONG count, PULONG previous )
 {
+    enum inproc_sync_type type;
+    struct inproc_sync *sync;
     NTSTATUS ret;
+    int state;
+
+    if ((sync = get_inproc_sync( handle, INPROC_ACCESS_MODIFY, &type )) && type == INPROC_SYNC_SEMAPHORE)
+    {
+        while (!((state = sync->state) & INPROC_SYNC_SERVER_WAIT))
+        {
+            if ((unsigned int)state + count < (unsigned int)state || state + count > sync->count)
+                return STATUS_SEMAPHORE_LIMIT_EXCEEDED;
+            if (interlocked_cmpxchg( &sync->state, state + count, state ) != state) continue;
+            if (previous) *previous = state;
+            if (count) futex_wake( &sync->state, count );
+            return STATUS_SUCCESS;
+        }
+    }
+
     SERVER_START_REQ( release_semaphore )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -336,16 +674,80 @@ NTSTATUS WINAPI NtOpenEvent( HANDLE *handle, ACCESS_MASK access, const OBJECT_AT
 }
 
 
+/* set an event in the shared state; fails if the server has to do it */
+static BOOL set_inproc_event( struct inproc_sync *sync, enum inproc_sync_type type )
+{
+    int state;
+
+    while (!((state = sync->state) & INPROC_SYNC_SERVER_WAIT))
+    {
+        if (state & INPROC_SYNC_EVENT_SIGNALED) return TRUE;
+        if (interlocked_cmpxchg( &sync->state, state | INPROC_SYNC_EVENT_SIGNALED, state ) != state)
+            continue;
+        futex_wake( &sync->state, type == INPROC_SYNC_MANUAL_EVENT ? INT_MAX : 1 );
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/***********************************************************************
+ *           grab_inproc_event
+ *
+ * Get a reference to the shared state of an event, to signal it after the
+ * handle may have been closed. Returns NULL if the state isn't shared.
+ */
+struct inproc_sync *grab_inproc_event( HANDLE handle )
+{
+    enum inproc_sync_type type;
+    struct inproc_sync *sync;
+
+    if (!(sync = get_inproc_sync( handle, INPROC_ACCESS_MODIFY, &type ))) return NULL;
+    if (type != INPROC_SYNC_AUTO_EVENT && type != INPROC_SYNC_MANUAL_EVENT) return NULL;
+    /* the server keeps the entry allocated while the count is non-zero */
+    interlocked_xchg_add( (int *)&sync->count, 1 );
+    return sync;
+}
+
+/***********************************************************************
+ *           release_inproc_event
+ *
+ * Release a reference taken with grab_inproc_event, signaling the event first if requested.
+ */
+void release_inproc_event( struct inproc_sync *sync, BOOL signal )
+{
+    enum inproc_sync_type type = sync->type;
+
+    /* the type is cleared when the event is destroyed, nobody can wait on it then */
+    if (signal && (type == INPROC_SYNC_AUTO_EVENT || type == INPROC_SYNC_MANUAL_EVENT) &&
+        !set_inproc_event( sync, type ))
+    {
+        SERVER_START_REQ( set_inproc_event )
+        {
+            req->index = sync - inproc_sync_area;
+            wine_server_call( req );
+        }
+        SERVER_END_REQ;
+    }
+    interlocked_xchg_add( (int *)&sync->count, -1 );
+}
+
 /******************************************************************************
  *  NtSetEvent (NTDLL.@)
  *  ZwSetEvent (NTDLL.@)
  */
 NTSTATUS WINAPI NtSetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
 {
+    enum inproc_sync_type type;
+    struct inproc_sync *sync;
     NTSTATUS ret;
 
     /* FIXME: set NumberOfThreadsReleased */
 
+    if ((sync = get_inproc_sync( handle, INPROC_ACCESS_MODIFY, &type )) &&
+        (type == INPROC_SYNC_AUTO_EVENT || type == INPROC_SYNC_MANUAL_EVENT) &&
+        set_inproc_event( sync, type ))
+        return STATUS_SUCCESS;
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -361,11 +763,22 @@ NTSTATUS WINAPI NtSetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
  */
 NTSTATUS WINAPI NtResetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
 {
+    enum inproc_sync_type type;
+    struct inproc_sync *sync;
     NTSTATUS ret;
+    int state;
 
     /* resetting an event can't release any thread... */
     if (NumberOfThreadsReleased) *NumberOfThreadsReleased = 0;
 
+    if ((sync = get_inproc_sync( handle, INPROC_ACCESS_MODIFY, &type )) &&
+        (type == INPROC_SYNC_AUTO_EVENT || type == INPROC_SYNC_MANUAL_EVENT))
+    {
+        do state = sync->state;
+        while (interlocked_cmpxchg( &sync->state, state & ~INPROC_SYNC_EVENT_SIGNALED, state ) != state);
+        return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -508,7 +921,25 @@ NTSTATUS WINAPI NtOpenMutant( HANDLE *handle, ACCESS_MASK access, const OBJECT_A
  */
 NTSTATUS WINAPI NtReleaseMutant( IN HANDLE handle, OUT PLONG prev_count OPTIONAL)
 {
+    enum inproc_sync_type type;
+    struct inproc_sync *sync;
     NTSTATUS    status;
+    int state;
+
+    if ((sync = get_inproc_sync( handle, 0, &type )) && type == INPROC_SYNC_MUTEX)
+    {
+        if ((sync->state & ~INPROC_SYNC_SERVER_WAIT) != GetCurrentThreadId()) return STATUS_MUTANT_NOT_OWNED;
+        if (prev_count) *prev_count = 1 - sync->count;
+        if (--sync->count) return STATUS_SUCCESS;
+        while (!((state = sync->state) & INPROC_SYNC_SERVER_WAIT))
+        {
+            if (interlocked_cmpxchg( &sync->state, 0, state ) != state) continue;
+            futex_wake( &sync->state, 1 );
+            return STATUS_SUCCESS;
+        }
+        /* let the server hand the mutex over to its waiters */
+        sync->count = 1;
+    }
 
     SERVER_START_REQ( release_mutex )
     {
@@ -998,9 +1429,15 @@ static NTSTATUS wait_objects( DWORD count, const HANDLE *handles,
 {
     select_op_t select_op;
     UINT i, flags = SELECT_INTERRUPTIBLE;
+    LARGE_INTEGER end;
+    NTSTATUS ret;
 
     if (!count || count > MAXIMUM_WAIT_OBJECTS) return STATUS_INVALID_PARAMETER_1;
 
+    if (count == 1 && !alertable &&
+        (ret = inproc_wait( handles[0], &timeout, &end )) != STATUS_NOT_IMPLEMENTED)
+        return ret;
+
     if (alertable) flags |= SELECT_ALERTABLE;
     select_op.wait.op = wait_any ? SELECT_WAIT : SELECT_WAIT_ALL;
     for (i = 0; i < count; i++) select_op.wait.handles[i] = wine_server_obj_handle( handles[i] );
@@ -1645,15 +2082,265 @@ static inline void srwlock_leave_shared( RTL_SRWLOCK *lock, unsigned int val )
         NtReleaseKeyedEvent( keyed_event, srwlock_key_exclusive(lock), FALSE, NULL );
 }
 
+#ifdef __linux__
+
+/* Futex-based SRW locks and condition variables
+ *
+ * When futexes are available, threads wait directly on the lock value and
+ * the lock doesn't need to count the waiters for the keyed event, so a
+ * different layout is used:
+ *
+ *    31 - set if the lock is owned exclusively
+ * 30-16 - number of threads waiting for exclusive access
+ *    15 - set if there are threads waiting for shared access
+ *  14-0 - number of shared owners (waiting threads are not included)
+ *
+ * Exclusive and shared waiters use different futex bitsets, so that they
+ * can be woken separately. Condition variables are a sequence number that
+ * is incremented on every wake.
+ */
+
+#define SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT      0x80000000
+#define SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK  0x7fff0000
+#define SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_INC   0x00010000
+#define SRWLOCK_FUTEX_SHARED_WAITERS_BIT      0x00008000
+#define SRWLOCK_FUTEX_SHARED_OWNERS_MASK      0x00007fff
+#define SRWLOCK_FUTEX_SHARED_OWNERS_INC       0x00000001
+
+#define SRWLOCK_FUTEX_BITSET_EXCLUSIVE  1
+#define SRWLOCK_FUTEX_BITSET_SHARED     2
+
+static NTSTATUS fast_try_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *(int *)&lock->Ptr;
+        if (old & (SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT | SRWLOCK_FUTEX_SHARED_OWNERS_MASK))
+            return STATUS_TIMEOUT;
+        new = old | SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT;
+    } while (interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) != old);
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    int old, new;
+    BOOL wait;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    /* register as an exclusive waiter first, so that new shared owners stay out */
+    do
+    {
+        old = *(int *)&lock->Ptr;
+        new = old + SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_INC;
+        if (!(new & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK)) RtlRaiseStatus( STATUS_RESOURCE_NOT_OWNED );
+    } while (interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) != old);
+
+    for (;;)
+    {
+        do
+        {
+            old = *(int *)&lock->Ptr;
+            if (!(old & (SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT | SRWLOCK_FUTEX_SHARED_OWNERS_MASK)))
+            {
+                new = (old | SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) - SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_INC;
+                wait = FALSE;
+            }
+            else
+            {
+                new = old;
+                wait = TRUE;
+            }
+        } while (interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) != old);
+
+        if (!wait) return STATUS_SUCCESS;
+        futex_wait_bitset( (int *)&lock->Ptr, new, NULL, SRWLOCK_FUTEX_BITSET_EXCLUSIVE );
+    }
+}
+
+static NTSTATUS fast_try_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *(int *)&lock->Ptr;
+        if (old & (SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT | SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK))
+            return STATUS_TIMEOUT;
+        new = old + SRWLOCK_FUTEX_SHARED_OWNERS_INC;
+        if (!(new & SRWLOCK_FUTEX_SHARED_OWNERS_MASK)) RtlRaiseStatus( STATUS_RESOURCE_NOT_OWNED );
+    } while (interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) != old);
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    int old, new;
+    BOOL wait;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    for (;;)
+    {
+        do
+        {
+            old = *(int *)&lock->Ptr;
+            /* exclusive waiters have priority over new shared owners */
+            if (!(old & (SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT | SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK)))
+            {
+                new = old + SRWLOCK_FUTEX_SHARED_OWNERS_INC;
+                if (!(new & SRWLOCK_FUTEX_SHARED_OWNERS_MASK)) RtlRaiseStatus( STATUS_RESOURCE_NOT_OWNED );
+                wait = FALSE;
+            }
+            else
+            {
+                new = old | SRWLOCK_FUTEX_SHARED_WAITERS_BIT;
+                wait = TRUE;
+            }
+        } while (interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) != old);
+
+        if (!wait) return STATUS_SUCCESS;
+        futex_wait_bitset( (int *)&lock->Ptr, new, NULL, SRWLOCK_FUTEX_BITSET_SHARED );
+    }
+}
+
+static NTSTATUS fast_release_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *(int *)&lock->Ptr;
+        if (!(old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT)) RtlRaiseStatus( STATUS_RESOURCE_NOT_OWNED );
+        new = old & ~SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT;
+        /* shared waiters are all woken when there are no exclusive waiters left */
+        if (!(new & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK)) new &= ~SRWLOCK_FUTEX_SHARED_WAITERS_BIT;
+    } while (interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) != old);
+
+    if (new & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK)
+        futex_wake_bitset( (int *)&lock->Ptr, 1, SRWLOCK_FUTEX_BITSET_EXCLUSIVE );
+    else if (old & SRWLOCK_FUTEX_SHARED_WAITERS_BIT)
+        futex_wake_bitset( (int *)&lock->Ptr, INT_MAX, SRWLOCK_FUTEX_BITSET_SHARED );
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_release_srw_shared( RTL_SRWLOCK *lock )
+{
+    int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *(int *)&lock->Ptr;
+        if ((old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) || !(old & SRWLOCK_FUTEX_SHARED_OWNERS_MASK))
+            RtlRaiseStatus( STATUS_RESOURCE_NOT_OWNED );
+        new = old - SRWLOCK_FUTEX_SHARED_OWNERS_INC;
+    } while (interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) != old);
+
+    /* the last shared owner wakes an exclusive waiter */
+    if (!(new & SRWLOCK_FUTEX_SHARED_OWNERS_MASK) && (new & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK))
+        futex_wake_bitset( (int *)&lock->Ptr, 1, SRWLOCK_FUTEX_BITSET_EXCLUSIVE );
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_wait_cv( RTL_CONDITION_VARIABLE *variable, int val, const LARGE_INTEGER *timeout )
+{
+    struct timespec timespec;
+    LARGE_INTEGER end;
+    int ret;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    if (timeout)
+    {
+        if (timeout->QuadPart < 0)
+        {
+            NtQuerySystemTime( &end );
+            end.QuadPart -= timeout->QuadPart;
+        }
+        else end = *timeout;
+        if (!get_timeout_left( &end, &timespec )) return STATUS_TIMEOUT;
+        ret = futex_wait_private( (int *)&variable->Ptr, val, &timespec );
+    }
+    else ret = futex_wait_private( (int *)&variable->Ptr, val, NULL );
+
+    if (ret == -1 && errno == ETIMEDOUT) return STATUS_TIMEOUT;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_wake_cv( RTL_CONDITION_VARIABLE *variable, int count )
+{
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    interlocked_xchg_add( (int *)&variable->Ptr, 1 );
+    futex_wake_private( (int *)&variable->Ptr, count );
+    return STATUS_SUCCESS;
+}
+
+#else
+
+static NTSTATUS fast_try_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_try_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_release_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_release_srw_shared( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_wait_cv( RTL_CONDITION_VARIABLE *variable, int val, const LARGE_INTEGER *timeout )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_wake_cv( RTL_CONDITION_VARIABLE *variable, int count )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+#endif
+
 /***********************************************************************
  *              RtlInitializeSRWLock (NTDLL.@)
  *
  * NOTES
  *  Please note that SRWLocks do not keep track of the owner of a lock.
  *  It doesn't make any difference which thread for example unlocks an
- *  SRWLock (see corresponding tests). This implementation uses two
- *  keyed events (one for the exclusive waiters and one for the shared
- *  waiters) and is limited to 2^15-1 waiting threads.
+ *  SRWLock (see corresponding tests). On Linux waiting threads block
+ *  on futexes, elsewhere this implementation uses two keyed events (one
+ *  for the exclusive waiters and one for the shared waiters); both are
+ *  limited to 2^15-1 waiting threads.
  */
 void WINAPI RtlInitializeSRWLock( RTL_SRWLOCK *lock )
 {
@@ -1670,6 +2357,9 @@ void WINAPI RtlInitializeSRWLock( RTL_SRWLOCK *lock )
  */
 void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 {
+    if (fast_acquire_srw_exclusive( lock ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     if (srwlock_lock_exclusive( (unsigned int *)&lock->Ptr, SRWLOCK_RES_EXCLUSIVE ))
         NtWaitForKeyedEvent( keyed_event, srwlock_key_exclusive(lock), FALSE, NULL );
 }
@@ -1684,6 +2374,10 @@ void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
 {
     unsigned int val, tmp;
+
+    if (fast_acquire_srw_shared( lock ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     /* Acquires a shared lock. If it's currently not possible to add elements to
      * the shared queue, then request exclusive access instead. */
     for (val = *(unsigned int *)&lock->Ptr;; val = tmp)
@@ -1714,6 +2408,9 @@ void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
  */
 void WINAPI RtlReleaseSRWLockExclusive( RTL_SRWLOCK *lock )
 {
+    if (fast_release_srw_exclusive( lock ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     srwlock_leave_exclusive( lock, srwlock_unlock_exclusive( (unsigned int *)&lock->Ptr,
                              - SRWLOCK_RES_EXCLUSIVE ) - SRWLOCK_RES_EXCLUSIVE );
 }
@@ -1723,6 +2420,9 @@ void WINAPI RtlReleaseSRWLockExclusive( RTL_SRWLOCK *lock )
  */
 void WINAPI RtlReleaseSRWLockShared( RTL_SRWLOCK *lock )
 {
+    if (fast_release_srw_shared( lock ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     srwlock_leave_shared( lock, srwlock_lock_exclusive( (unsigned int *)&lock->Ptr,
                           - SRWLOCK_RES_SHARED ) - SRWLOCK_RES_SHARED );
 }
@@ -1736,6 +2436,11 @@ void WINAPI RtlReleaseSRWLockShared( RTL_SRWLOCK *lock )
  */
 BOOLEAN WINAPI RtlTryAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 {
+    NTSTATUS ret;
+
+    if ((ret = fast_try_acquire_srw_exclusive( lock )) != STATUS_NOT_IMPLEMENTED)
+        return (ret == STATUS_SUCCESS);
+
     return interlocked_cmpxchg( (int *)&lock->Ptr, SRWLOCK_MASK_IN_EXCLUSIVE |
                                 SRWLOCK_RES_EXCLUSIVE, 0 ) == 0;
 }
@@ -1746,6 +2451,11 @@ BOOLEAN WINAPI RtlTryAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 BOOLEAN WINAPI RtlTryAcquireSRWLockShared( RTL_SRWLOCK *lock )
 {
     unsigned int val, tmp;
+    NTSTATUS ret;
+
+    if ((ret = fast_try_acquire_srw_shared( lock )) != STATUS_NOT_IMPLEMENTED)
+        return (ret == STATUS_SUCCESS);
+
     for (val = *(unsigned int *)&lock->Ptr;; val = tmp)
     {
         if (val & SRWLOCK_MASK_EXCLUSIVE_QUEUE)
@@ -1789,6 +2499,9 @@ void WINAPI RtlInitializeConditionVariable( RTL_CONDITION_VARIABLE *variable )
  */
 void WINAPI RtlWakeConditionVariable( RTL_CONDITION_VARIABLE *variable )
 {
+    if (fast_wake_cv( variable, 1 ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     if (interlocked_dec_if_nonzero( (int *)&variable->Ptr ))
         NtReleaseKeyedEvent( keyed_event, &variable->Ptr, FALSE, NULL );
 }
@@ -1800,7 +2513,12 @@ void WINAPI RtlWakeConditionVariable( RTL_CONDITION_VARIABLE *variable )
  */
 void WINAPI RtlWakeAllConditionVariable( RTL_CONDITION_VARIABLE *variable )
 {
-    int val = interlocked_xchg( (int *)&variable->Ptr, 0 );
+    int val;
+
+    if (fast_wake_cv( variable, INT_MAX ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
+    val = interlocked_xchg( (int *)&variable->Ptr, 0 );
     while (val-- > 0)
         NtReleaseKeyedEvent( keyed_event, &variable->Ptr, FALSE, NULL );
 }
@@ -1824,6 +2542,17 @@ NTSTATUS WINAPI RtlSleepConditionVariableCS( RTL_CONDITION_VARIABLE *variable, R
                                              const LARGE_INTEGER *timeout )
 {
     NTSTATUS status;
+    int val;
+
+    if (use_futexes())
+    {
+        val = *(int *)&variable->Ptr;
+        RtlLeaveCriticalSection( crit );
+        status = fast_wait_cv( variable, val, timeout );
+        RtlEnterCriticalSection( crit );
+        return status;
+    }
+
     interlocked_xchg_add( (int *)&variable->Ptr, 1 );
     RtlLeaveCriticalSection( crit );
 
@@ -1861,6 +2590,26 @@ NTSTATUS WINAPI RtlSleepConditionVariableSRW( RTL_CONDITION_VARIABLE *variable,
                                               const LARGE_INTEGER *timeout, ULONG flags )
 {
     NTSTATUS status;
+    int val;
+
+    if (use_futexes())
+    {
+        val = *(int *)&variable->Ptr;
+
+        if (flags & RTL_CONDITION_VARIABLE_LOCKMODE_SHARED)
+            RtlReleaseSRWLockShared( lock );
+        else
+            RtlReleaseSRWLockExclusive( lock );
+
+        status = fast_wait_cv( variable, val, timeout );
+
+        if (flags & RTL_CONDITION_VARIABLE_LOCKMODE_SHARED)
+            RtlAcquireSRWLockShared( lock );
+        else
+            RtlAcquireSRWLockExclusive( lock );
+        return status;
+    }
+
     interlocked_xchg_add( (int *)&variable->Ptr, 1 );
 
     if (flags & RTL_CONDITION_VARIABLE_LOCKMODE_SHARED)
@@ -0,0 +1,336 @@
+/*
+ * Unit tests for SRW locks and condition variables
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "ntdll_test.h"
+
+static void     (WINAPI *pRtlAcquireSRWLockExclusive)(RTL_SRWLOCK *);
+static void     (WINAPI *pRtlAcquireSRWLockShared)(RTL_SRWLOCK *);
+static void     (WINAPI *pRtlInitializeConditionVariable)(RTL_CONDITION_VARIABLE *);
+static void     (WINAPI *pRtlInitializeSRWLock)(RTL_SRWLOCK *);
+static void     (WINAPI *pRtlReleaseSRWLockExclusive)(RTL_SRWLOCK *);
+static void     (WINAPI *pRtlReleaseSRWLockShared)(RTL_SRWLOCK *);
+static NTSTATUS (WINAPI *pRtlSleepConditionVariableCS)(RTL_CONDITION_VARIABLE *,RTL_CRITICAL_SECTION *,const LARGE_INTEGER *);
+static NTSTATUS (WINAPI *pRtlSleepConditionVariableSRW)(RTL_CONDITION_VARIABLE *,RTL_SRWLOCK *,const LARGE_INTEGER *,ULONG);
+static void     (WINAPI *pRtlWakeAllConditionVariable)(RTL_CONDITION_VARIABLE *);
+static void     (WINAPI *pRtlWakeConditionVariable)(RTL_CONDITION_VARIABLE *);
+
+#define NTDLL_GET_PROC(func) \
+    do \
+    { \
+        p ## func = (void *)GetProcAddress(hntdll, #func); \
+        if (!p ## func) trace("Failed to get address for %s\n", #func); \
+    } \
+    while (0)
+
+#define STRESS_THREADS    4
+#define SRW_ITERATIONS    50000
+#define CV_ITEMS          20000
+#define CV_BUFFER_SIZE    4
+#define CV_ROUNDS         2000
+
+/* a lost wakeup makes a waiter time out instead of hanging the test */
+#define WAIT_TIMEOUT_MS   5000
+
+static BOOL init_sync(void)
+{
+    HMODULE hntdll = GetModuleHandleA("ntdll");
+
+    NTDLL_GET_PROC(RtlAcquireSRWLockExclusive);
+    NTDLL_GET_PROC(RtlAcquireSRWLockShared);
+    NTDLL_GET_PROC(RtlInitializeConditionVariable);
+    NTDLL_GET_PROC(RtlInitializeSRWLock);
+    NTDLL_GET_PROC(RtlReleaseSRWLockExclusive);
+    NTDLL_GET_PROC(RtlReleaseSRWLockShared);
+    NTDLL_GET_PROC(RtlSleepConditionVariableCS);
+    NTDLL_GET_PROC(RtlSleepConditionVariableSRW);
+    NTDLL_GET_PROC(RtlWakeAllConditionVariable);
+    NTDLL_GET_PROC(RtlWakeConditionVariable);
+
+    if (!pRtlInitializeSRWLock || !pRtlInitializeConditionVariable)
+    {
+        win_skip("SRW locks or condition variables not supported\n");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void run_threads( LPTHREAD_START_ROUTINE func, HANDLE *threads, int count )
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        threads[i] = CreateThread( NULL, 0, func, ULongToPtr(i + 1), 0, NULL );
+        ok( threads[i] != NULL, "CreateThread failed with %u\n", GetLastError() );
+    }
+}
+
+static void wait_threads( HANDLE *threads, int count )
+{
+    DWORD ret;
+    int i;
+
+    ret = WaitForMultipleObjects( count, threads, TRUE, 60000 );
+    ok( ret == WAIT_OBJECT_0, "threads didn't finish, ret %u\n", ret );
+    for (i = 0; i < count; i++) CloseHandle( threads[i] );
+}
+
+static struct
+{
+    RTL_SRWLOCK lock;
+    LONG        exclusive;   /* threads inside the lock in exclusive mode */
+    LONG        shared;      /* threads inside the lock in shared mode */
+    LONG        max_shared;  /* highest number of simultaneous shared owners */
+    LONG        errors;
+    LONG        acquired;    /* number of exclusive acquisitions */
+    unsigned int counter;    /* only modified in exclusive mode, without atomics */
+} srw;
+
+static DWORD WINAPI srwlock_stress_thread( void *arg )
+{
+    unsigned int i, seed = PtrToUlong(arg);
+    LONG count, max;
+
+    for (i = 0; i < SRW_ITERATIONS; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        if (!((seed >> 16) & 3))
+        {
+            pRtlAcquireSRWLockExclusive( &srw.lock );
+            if (InterlockedIncrement( &srw.exclusive ) != 1 || srw.shared)
+                InterlockedIncrement( &srw.errors );
+            srw.counter++;
+            InterlockedIncrement( &srw.acquired );
+            if (!(i % 256)) Sleep(0);
+            InterlockedDecrement( &srw.exclusive );
+            pRtlReleaseSRWLockExclusive( &srw.lock );
+        }
+        else
+        {
+            pRtlAcquireSRWLockShared( &srw.lock );
+            count = InterlockedIncrement( &srw.shared );
+            if (srw.exclusive) InterlockedIncrement( &srw.errors );
+            while (count > (max = srw.max_shared) &&
+                   InterlockedCompareExchange( &srw.max_shared, count, max ) != max);
+            if (!(i % 256)) Sleep(0);
+            InterlockedDecrement( &srw.shared );
+            pRtlReleaseSRWLockShared( &srw.lock );
+        }
+    }
+    return 0;
+}
+
+static void test_srwlock_stress(void)
+{
+    HANDLE threads[STRESS_THREADS];
+    DWORD start;
+
+    memset( &srw, 0, sizeof(srw) );
+    pRtlInitializeSRWLock( &srw.lock );
+
+    start = GetTickCount();
+    run_threads( srwlock_stress_thread, threads, STRESS_THREADS );
+    wait_threads( threads, STRESS_THREADS );
+    trace( "%u SRW lock acquisitions in %u threads took %u ms\n",
+           SRW_ITERATIONS * STRESS_THREADS, STRESS_THREADS, GetTickCount() - start );
+
+    ok( !srw.errors, "%d mutual exclusion violations\n", srw.errors );
+    ok( srw.counter == srw.acquired, "counter is %u, expected %u\n", srw.counter, srw.acquired );
+    ok( !srw.exclusive && !srw.shared, "lock still held: %d exclusive, %d shared\n",
+        srw.exclusive, srw.shared );
+    trace( "up to %d simultaneous shared owners\n", srw.max_shared );
+}
+
+/* bounded buffer, the producers and consumers only wake one waiter at a time */
+static struct
+{
+    RTL_SRWLOCK            lock;
+    RTL_CRITICAL_SECTION   cs;
+    BOOL                   use_cs;
+    RTL_CONDITION_VARIABLE not_empty;
+    RTL_CONDITION_VARIABLE not_full;
+    unsigned int           count;
+    unsigned int           produced;
+    unsigned int           consumed;
+    BOOL                   done;
+    LONG                   timeouts;
+} buffer;
+
+static void buffer_lock(void)
+{
+    if (buffer.use_cs) RtlEnterCriticalSection( &buffer.cs );
+    else pRtlAcquireSRWLockExclusive( &buffer.lock );
+}
+
+static void buffer_unlock(void)
+{
+    if (buffer.use_cs) RtlLeaveCriticalSection( &buffer.cs );
+    else pRtlReleaseSRWLockExclusive( &buffer.lock );
+}
+
+static void buffer_wait( RTL_CONDITION_VARIABLE *cv )
+{
+    LARGE_INTEGER timeout;
+    NTSTATUS status;
+
+    timeout.QuadPart = -(LONGLONG)WAIT_TIMEOUT_MS * 10000;
+    if (buffer.use_cs) status = pRtlSleepConditionVariableCS( cv, &buffer.cs, &timeout );
+    else status = pRtlSleepConditionVariableSRW( cv, &buffer.lock, &timeout, 0 );
+    if (status == STATUS_TIMEOUT) InterlockedIncrement( &buffer.timeouts );
+    else ok( status == STATUS_SUCCESS, "got status %08x\n", status );
+}
+
+static DWORD WINAPI producer_thread( void *arg )
+{
+    unsigned int i;
+
+    for (i = 0; i < CV_ITEMS / (STRESS_THREADS / 2); i++)
+    {
+        buffer_lock();
+        while (buffer.count == CV_BUFFER_SIZE) buffer_wait( &buffer.not_full );
+        buffer.count++;
+        buffer.produced++;
+        buffer_unlock();
+        pRtlWakeConditionVariable( &buffer.not_empty );
+    }
+    return 0;
+}
+
+static DWORD WINAPI consumer_thread( void *arg )
+{
+    buffer_lock();
+    for (;;)
+    {
+        while (!buffer.count && !buffer.done) buffer_wait( &buffer.not_empty );
+        if (!buffer.count) break;
+        buffer.count--;
+        buffer.consumed++;
+        buffer_unlock();
+        pRtlWakeConditionVariable( &buffer.not_full );
+        buffer_lock();
+    }
+    buffer_unlock();
+    return 0;
+}
+
+static void test_condvar_buffer( BOOL use_cs )
+{
+    HANDLE producers[STRESS_THREADS / 2], consumers[STRESS_THREADS / 2];
+    DWORD start;
+
+    memset( &buffer, 0, sizeof(buffer) );
+    buffer.use_cs = use_cs;
+    pRtlInitializeSRWLock( &buffer.lock );
+    RtlInitializeCriticalSection( &buffer.cs );
+    pRtlInitializeConditionVariable( &buffer.not_empty );
+    pRtlInitializeConditionVariable( &buffer.not_full );
+
+    start = GetTickCount();
+    run_threads( consumer_thread, consumers, STRESS_THREADS / 2 );
+    run_threads( producer_thread, producers, STRESS_THREADS / 2 );
+    wait_threads( producers, STRESS_THREADS / 2 );
+
+    buffer_lock();
+    buffer.done = TRUE;
+    buffer_unlock();
+    pRtlWakeAllConditionVariable( &buffer.not_empty );
+    wait_threads( consumers, STRESS_THREADS / 2 );
+    trace( "%u items through a %u entry buffer with %s took %u ms\n", CV_ITEMS, CV_BUFFER_SIZE,
+           use_cs ? "a critical section" : "an SRW lock", GetTickCount() - start );
+
+    ok( !buffer.timeouts, "%d waits timed out\n", buffer.timeouts );
+    ok( buffer.produced == CV_ITEMS, "produced %u items\n", buffer.produced );
+    ok( buffer.consumed == CV_ITEMS, "consumed %u items\n", buffer.consumed );
+    ok( !buffer.count, "%u items left\n", buffer.count );
+    RtlDeleteCriticalSection( &buffer.cs );
+}
+
+/* all the waiters sleep in shared mode and must be woken by every WakeAll */
+static struct
+{
+    RTL_SRWLOCK            lock;
+    RTL_CONDITION_VARIABLE cv;
+    LONG                   generation;  /* only modified in exclusive mode */
+    LONG                   woken;
+    LONG                   timeouts;
+    LONG                   errors;
+} broadcast;
+
+static DWORD WINAPI broadcast_thread( void *arg )
+{
+    LARGE_INTEGER timeout;
+    NTSTATUS status;
+    LONG round;
+
+    timeout.QuadPart = -(LONGLONG)WAIT_TIMEOUT_MS * 10000;
+    pRtlAcquireSRWLockShared( &broadcast.lock );
+    for (round = 1; round <= CV_ROUNDS; round++)
+    {
+        while (broadcast.generation < round)
+        {
+            status = pRtlSleepConditionVariableSRW( &broadcast.cv, &broadcast.lock, &timeout,
+                                                    CONDITION_VARIABLE_LOCKMODE_SHARED );
+            if (status == STATUS_TIMEOUT) InterlockedIncrement( &broadcast.timeouts );
+            else if (status) InterlockedIncrement( &broadcast.errors );
+        }
+        InterlockedIncrement( &broadcast.woken );
+    }
+    pRtlReleaseSRWLockShared( &broadcast.lock );
+    return 0;
+}
+
+static void test_condvar_broadcast(void)
+{
+    HANDLE threads[STRESS_THREADS];
+    DWORD start;
+    LONG round;
+
+    memset( &broadcast, 0, sizeof(broadcast) );
+    pRtlInitializeSRWLock( &broadcast.lock );
+    pRtlInitializeConditionVariable( &broadcast.cv );
+
+    start = GetTickCount();
+    run_threads( broadcast_thread, threads, STRESS_THREADS );
+    for (round = 1; round <= CV_ROUNDS; round++)
+    {
+        pRtlAcquireSRWLockExclusive( &broadcast.lock );
+        broadcast.generation = round;
+        pRtlReleaseSRWLockExclusive( &broadcast.lock );
+        pRtlWakeAllConditionVariable( &broadcast.cv );
+        /* let the waiters go back to sleep before the next round */
+        while (broadcast.woken < round * STRESS_THREADS && !broadcast.timeouts) Sleep(0);
+    }
+    wait_threads( threads, STRESS_THREADS );
+    trace( "%u broadcasts to %u shared waiters took %u ms\n", CV_ROUNDS, STRESS_THREADS,
+           GetTickCount() - start );
+
+    ok( !broadcast.timeouts, "%d waits timed out\n", broadcast.timeouts );
+    ok( !broadcast.errors, "%d waits failed\n", broadcast.errors );
+    ok( broadcast.woken == CV_ROUNDS * STRESS_THREADS, "%d wakeups, expected %d\n",
+        broadcast.woken, CV_ROUNDS * STRESS_THREADS );
+}
+
+START_TEST(sync)
+{
+    if (!init_sync()) return;
+
+    test_srwlock_stress();
+    test_condvar_buffer( FALSE );
+    test_condvar_buffer( TRUE );
+    test_condvar_broadcast();
+}
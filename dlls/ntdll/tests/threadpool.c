@@ -706,6 +706,69 @@ static void test_tp_work_scheduler(void)
     pTpReleasePool(pool);
 }
 
+#define MANY_WORK_ITEMS 100000
+
+static void CALLBACK tiny_work_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WORK *work)
+{
+    InterlockedIncrement((LONG *)userdata);
+}
+
+static void CALLBACK spawn_work_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WORK *work)
+{
+    TP_WORK *tiny_work = userdata;
+    int i;
+
+    /* work posted from a worker thread */
+    for (i = 0; i < 1000; i++)
+        pTpPostWork(tiny_work);
+}
+
+static void test_tp_work_throughput(void)
+{
+    TP_CALLBACK_ENVIRON environment;
+    TP_WORK *work, *spawn_work;
+    TP_POOL *pool;
+    NTSTATUS status;
+    LONG userdata;
+    DWORD start;
+    int i;
+
+    pool = NULL;
+    status = pTpAllocPool(&pool, NULL);
+    ok(!status, "TpAllocPool failed with status %x\n", status);
+
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = pool;
+    work = NULL;
+    status = pTpAllocWork(&work, tiny_work_cb, &userdata, &environment);
+    ok(!status, "TpAllocWork failed with status %x\n", status);
+    spawn_work = NULL;
+    status = pTpAllocWork(&spawn_work, spawn_work_cb, work, &environment);
+    ok(!status, "TpAllocWork failed with status %x\n", status);
+
+    userdata = 0;
+    start = GetTickCount();
+    for (i = 0; i < MANY_WORK_ITEMS; i++)
+        pTpPostWork(work);
+    pTpWaitForWork(work, FALSE);
+    ok(userdata == MANY_WORK_ITEMS, "expected userdata = %u, got %u\n", MANY_WORK_ITEMS, userdata);
+    trace("%u work items posted from one thread: %u ms\n", MANY_WORK_ITEMS, GetTickCount() - start);
+
+    userdata = 0;
+    start = GetTickCount();
+    for (i = 0; i < MANY_WORK_ITEMS / 1000; i++)
+        pTpPostWork(spawn_work);
+    pTpWaitForWork(spawn_work, FALSE);
+    pTpWaitForWork(work, FALSE);
+    ok(userdata == MANY_WORK_ITEMS, "expected userdata = %u, got %u\n", MANY_WORK_ITEMS, userdata);
+    trace("%u work items posted from workers: %u ms\n", MANY_WORK_ITEMS, GetTickCount() - start);
+
+    pTpReleaseWork(spawn_work);
+    pTpReleaseWork(work);
+    pTpReleasePool(pool);
+}
+
 static DWORD group_cancel_tid;
 
 static void CALLBACK group_cancel_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
@@ -1677,6 +1740,7 @@ START_TEST(threadpool)
     test_tp_simple();
     test_tp_work();
     test_tp_work_scheduler();
+    test_tp_work_throughput();
     test_tp_group_cancel();
     test_tp_instance();
     test_tp_disassociate();
@@ -303,6 +303,8 @@ HANDLE thread_init(void)
     thread_data->reply_fd   = -1;
     thread_data->wait_fd[0] = -1;
     thread_data->wait_fd[1] = -1;
+    thread_data->request_shm = NULL;
+    thread_data->doorbell_fd = -1;
     thread_data->debug_info = &debug_info;
     InsertHeadList( &tls_links, &teb->TlsLinks );
 
@@ -353,6 +355,7 @@ HANDLE thread_init(void)
     fill_cpu_info();
 
     NtCreateKeyedEvent( &keyed_event, GENERIC_READ | GENERIC_WRITE, NULL, 0 );
+    init_inproc_sync();
 
     return exe_file;
 }
@@ -370,6 +373,11 @@ void terminate_thread( int status )
     close( ntdll_get_thread_data()->wait_fd[1] );
     close( ntdll_get_thread_data()->reply_fd );
     close( ntdll_get_thread_data()->request_fd );
+    if (ntdll_get_thread_data()->request_shm)
+    {
+        munmap( ntdll_get_thread_data()->request_shm, REQUEST_SHM_SIZE );
+        close( ntdll_get_thread_data()->doorbell_fd );
+    }
     pthread_exit( UIntToPtr(status) );
 }
 
@@ -419,6 +427,11 @@ void exit_thread( int status )
     close( ntdll_get_thread_data()->wait_fd[1] );
     close( ntdll_get_thread_data()->reply_fd );
     close( ntdll_get_thread_data()->request_fd );
+    if (ntdll_get_thread_data()->request_shm)
+    {
+        munmap( ntdll_get_thread_data()->request_shm, REQUEST_SHM_SIZE );
+        close( ntdll_get_thread_data()->doorbell_fd );
+    }
     pthread_exit( UIntToPtr(status) );
 }
 
@@ -556,6 +569,8 @@ NTSTATUS WINAPI RtlCreateUserThread( HANDLE process, const SECURITY_DESCRIPTOR *
     thread_data->reply_fd    = -1;
     thread_data->wait_fd[0]  = -1;
     thread_data->wait_fd[1]  = -1;
+    thread_data->request_shm = NULL;
+    thread_data->doorbell_fd = -1;
 
     if ((status = virtual_alloc_thread_stack( teb, stack_reserve, stack_commit ))) goto error;
 
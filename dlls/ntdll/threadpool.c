@@ -116,6 +116,13 @@ struct timer_queue
 #define THREADPOOL_WORKER_TIMEOUT 5000
 #define MAXIMUM_WAITQUEUE_OBJECTS (MAXIMUM_WAIT_OBJECTS - 1)
 
+/* queue of objects with pending callbacks */
+struct threadpool_queue
+{
+    RTL_SRWLOCK             lock;
+    struct list             objects;
+};
+
 /* internal threadpool representation */
 struct threadpool
 {
@@ -123,14 +130,26 @@ struct threadpool
     LONG                    objcount;
     BOOL                    shutdown;
     CRITICAL_SECTION        cs;
-    /* pool of work items, locked via .cs */
-    struct list             pool;
+    /* work submitted from threads not belonging to the pool */
+    struct threadpool_queue queue;
+    LONG                    num_queued;         /* objects in all the queues of the pool */
+    LONG                    num_searching;      /* workers looking for work */
     RTL_CONDITION_VARIABLE  update_event;
     /* information about worker threads, locked via .cs */
+    struct list             workers;
     int                     max_workers;
     int                     min_workers;
     int                     num_workers;
-    int                     num_busy_workers;
+    int                     num_idle_workers;   /* workers sleeping on update_event */
+    int                     num_wakeups;        /* idle workers woken up to search for work */
+};
+
+/* worker thread of a threadpool */
+struct threadpool_worker
+{
+    struct list             entry;      /* entry in the pool workers list, locked via pool->cs */
+    struct threadpool      *pool;
+    struct threadpool_queue queue;      /* work submitted from this thread, can be stolen */
 };
 
 enum threadpool_objtype
@@ -158,7 +177,10 @@ struct threadpool_object
     /* information about the group, locked via .group->cs */
     struct list             group_entry;
     BOOL                    is_group_member;
-    /* information about the pool, locked via .pool->cs */
+    /* information about pending callbacks, locked via .lock */
+    RTL_SRWLOCK             lock;
+    BOOL                    queued;         /* in a queue, or being dequeued by a worker */
+    struct threadpool_queue *queue;         /* queue containing the object, locked via .queue->lock */
     struct list             pool_entry;
     RTL_CONDITION_VARIABLE  finished_event;
     RTL_CONDITION_VARIABLE  group_finished_event;
@@ -1601,6 +1623,155 @@ static void tp_waitqueue_unlock( struct threadpool_object *wait )
     RtlLeaveCriticalSection( &waitqueue.cs );
 }
 
+/***********************************************************************
+ *           tp_new_worker_thread    (internal)
+ *
+ * Starts a new worker thread, which begins by looking for work.
+ * Has to be called with pool->cs held.
+ */
+static NTSTATUS tp_new_worker_thread( struct threadpool *pool )
+{
+    HANDLE thread;
+    NTSTATUS status;
+
+    status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                  threadpool_worker_proc, pool, &thread, NULL );
+    if (status == STATUS_SUCCESS)
+    {
+        interlocked_inc( &pool->refcount );
+        interlocked_inc( &pool->num_searching );
+        pool->num_workers++;
+        NtClose( thread );
+    }
+    return status;
+}
+
+/***********************************************************************
+ *           tp_threadpool_wake    (internal)
+ *
+ * Makes sure that a worker thread is looking for each queued object, waking
+ * up an idle worker or starting a new one if required. Workers passing the
+ * search on only start threads up to the number of CPUs, so that the many
+ * callbacks of a single object don't get a thread each.
+ */
+static void tp_threadpool_wake( struct threadpool *pool, BOOL from_worker )
+{
+    RtlEnterCriticalSection( &pool->cs );
+    if (pool->num_searching < pool->num_queued)
+    {
+        if (pool->num_idle_workers > pool->num_wakeups)
+        {
+            pool->num_wakeups++;
+            interlocked_inc( &pool->num_searching );
+            RtlWakeConditionVariable( &pool->update_event );
+        }
+        else if (pool->num_workers < pool->max_workers &&
+                 (!from_worker || pool->num_workers < NtCurrentTeb()->Peb->NumberOfProcessors))
+            tp_new_worker_thread( pool );
+    }
+    RtlLeaveCriticalSection( &pool->cs );
+}
+
+/***********************************************************************
+ *           tp_queue_push    (internal)
+ *
+ * Adds an object to the tail of a queue. Has to be called with object->lock held.
+ */
+static void tp_queue_push( struct threadpool_queue *queue, struct threadpool_object *object )
+{
+    RtlAcquireSRWLockExclusive( &queue->lock );
+    list_add_tail( &queue->objects, &object->pool_entry );
+    object->queue = queue;
+    interlocked_inc( &object->pool->num_queued );
+    RtlReleaseSRWLockExclusive( &queue->lock );
+}
+
+/***********************************************************************
+ *           tp_queue_pop    (internal)
+ *
+ * Removes the object at the head of a queue. The object stays marked as
+ * queued until the caller has updated its pending callbacks.
+ */
+static struct threadpool_object *tp_queue_pop( struct threadpool *pool, struct threadpool_queue *queue )
+{
+    struct threadpool_object *object = NULL;
+    struct list *ptr;
+
+    if (list_empty( &queue->objects )) return NULL;
+
+    RtlAcquireSRWLockExclusive( &queue->lock );
+    if ((ptr = list_head( &queue->objects )))
+    {
+        object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
+        list_remove( &object->pool_entry );
+        object->queue = NULL;
+        interlocked_dec( &pool->num_queued );
+    }
+    RtlReleaseSRWLockExclusive( &queue->lock );
+    return object;
+}
+
+/***********************************************************************
+ *           tp_queue_remove    (internal)
+ *
+ * Removes an object from the queue containing it, if any. Has to be called
+ * with object->lock held, which prevents the object from being queued again.
+ * pool->cs keeps the queue of a worker thread valid until we have locked it.
+ */
+static BOOL tp_queue_remove( struct threadpool_object *object )
+{
+    struct threadpool *pool = object->pool;
+    struct threadpool_queue *queue;
+    BOOL ret = FALSE;
+
+    RtlEnterCriticalSection( &pool->cs );
+    if ((queue = object->queue))
+    {
+        RtlAcquireSRWLockExclusive( &queue->lock );
+        if (object->queue == queue)
+        {
+            list_remove( &object->pool_entry );
+            object->queue = NULL;
+            interlocked_dec( &pool->num_queued );
+            ret = TRUE;
+        }
+        RtlReleaseSRWLockExclusive( &queue->lock );
+    }
+    RtlLeaveCriticalSection( &pool->cs );
+    return ret;
+}
+
+/***********************************************************************
+ *           tp_threadpool_get_object    (internal)
+ *
+ * Finds an object with pending callbacks for a worker thread, looking at
+ * its own queue first, then at work submitted from outside the pool, and
+ * finally stealing from the other workers.
+ */
+static struct threadpool_object *tp_threadpool_get_object( struct threadpool *pool,
+                                                           struct threadpool_worker *worker )
+{
+    struct threadpool_object *object;
+    struct threadpool_worker *other;
+    struct list *ptr;
+
+    if ((object = tp_queue_pop( pool, &worker->queue ))) return object;
+    if ((object = tp_queue_pop( pool, &pool->queue ))) return object;
+    if (!pool->num_queued) return NULL;
+
+    /* start with the next worker, to spread the thieves over the other queues */
+    RtlEnterCriticalSection( &pool->cs );
+    for (ptr = list_next( &pool->workers, &worker->entry ); !object; ptr = list_next( &pool->workers, ptr ))
+    {
+        if (!ptr) ptr = list_head( &pool->workers );
+        other = LIST_ENTRY( ptr, struct threadpool_worker, entry );
+        if (other == worker) break;
+        object = tp_queue_pop( pool, &other->queue );
+    }
+    RtlLeaveCriticalSection( &pool->cs );
+    return object;
+}
+
 /***********************************************************************
  *           tp_threadpool_alloc    (internal)
  *
@@ -1621,13 +1792,18 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
     RtlInitializeCriticalSection( &pool->cs );
     pool->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool.cs");
 
-    list_init( &pool->pool );
+    RtlInitializeSRWLock( &pool->queue.lock );
+    list_init( &pool->queue.objects );
+    pool->num_queued            = 0;
+    pool->num_searching         = 0;
     RtlInitializeConditionVariable( &pool->update_event );
 
+    list_init( &pool->workers );
     pool->max_workers           = 500;
     pool->min_workers           = 0;
     pool->num_workers           = 0;
-    pool->num_busy_workers      = 0;
+    pool->num_idle_workers      = 0;
+    pool->num_wakeups           = 0;
 
     TRACE( "allocated threadpool %p\n", pool );
 
@@ -1664,7 +1840,8 @@ static BOOL tp_threadpool_release( struct threadpool *pool )
 
     assert( pool->shutdown );
     assert( !pool->objcount );
-    assert( list_empty( &pool->pool ) );
+    assert( !pool->num_queued );
+    assert( list_empty( &pool->queue.objects ) );
 
     pool->cs.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &pool->cs );
@@ -1710,18 +1887,7 @@ static NTSTATUS tp_threadpool_lock( struct threadpool **out, TP_CALLBACK_ENVIRON
 
     /* Make sure that the threadpool has at least one thread. */
     if (!pool->num_workers)
-    {
-        HANDLE thread;
-        status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
-                                      threadpool_worker_proc, pool, &thread, NULL );
-        if (status == STATUS_SUCCESS)
-        {
-            interlocked_inc( &pool->refcount );
-            pool->num_workers++;
-            pool->num_busy_workers++;
-            NtClose( thread );
-        }
-    }
+        status = tp_new_worker_thread( pool );
 
     /* Keep a reference, and increment objcount to ensure that the
      * last thread doesn't terminate. */
@@ -1836,6 +2002,9 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
     memset( &object->group_entry, 0, sizeof(object->group_entry) );
     object->is_group_member         = FALSE;
 
+    RtlInitializeSRWLock( &object->lock );
+    object->queued                  = FALSE;
+    object->queue                   = NULL;
     memset( &object->pool_entry, 0, sizeof(object->pool_entry) );
     RtlInitializeConditionVariable( &object->finished_event );
     RtlInitializeConditionVariable( &object->group_finished_event );
@@ -1900,46 +2069,34 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
 static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
 {
     struct threadpool *pool = object->pool;
-    NTSTATUS status = STATUS_UNSUCCESSFUL;
+    struct threadpool_worker *worker = ntdll_get_thread_data()->threadpool_worker;
 
     assert( !object->shutdown );
     assert( !pool->shutdown );
 
-    RtlEnterCriticalSection( &pool->cs );
+    /* Increment refcount for the new pending callback. */
+    interlocked_inc( &object->refcount );
 
-    /* Start new worker threads if required. */
-    if (pool->num_busy_workers >= pool->num_workers &&
-        pool->num_workers < pool->max_workers)
+    RtlAcquireSRWLockExclusive( &object->lock );
+
+    /* Queue the object if it isn't already, preferably on the queue of the
+     * current worker thread. The queue holds an additional reference. */
+    if (!object->num_pending_callbacks++ && !object->queued)
     {
-        HANDLE thread;
-        status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
-                                      threadpool_worker_proc, pool, &thread, NULL );
-        if (status == STATUS_SUCCESS)
-        {
-            interlocked_inc( &pool->refcount );
-            pool->num_workers++;
-            pool->num_busy_workers++;
-            NtClose( thread );
-        }
+        object->queued = TRUE;
+        interlocked_inc( &object->refcount );
+        tp_queue_push( (worker && worker->pool == pool) ? &worker->queue : &pool->queue, object );
     }
 
-    /* Queue work item and increment refcount. */
-    interlocked_inc( &object->refcount );
-    if (!object->num_pending_callbacks++)
-        list_add_tail( &pool->pool, &object->pool_entry );
-
     /* Count how often the object was signaled. */
     if (object->type == TP_OBJECT_TYPE_WAIT && signaled)
         object->u.wait.signaled++;
 
-    /* No new thread started - wake up one existing thread. */
-    if (status != STATUS_SUCCESS)
-    {
-        assert( pool->num_workers > 0 );
-        RtlWakeConditionVariable( &pool->update_event );
-    }
+    RtlReleaseSRWLockExclusive( &object->lock );
 
-    RtlLeaveCriticalSection( &pool->cs );
+    /* Make sure that some thread will pick it up. */
+    if (pool->num_searching < pool->num_queued)
+        tp_threadpool_wake( pool, FALSE );
 }
 
 /***********************************************************************
@@ -1949,20 +2106,26 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
  */
 static void tp_object_cancel( struct threadpool_object *object, BOOL group_cancel, PVOID userdata )
 {
-    struct threadpool *pool = object->pool;
     LONG pending_callbacks = 0;
+    BOOL dequeued = FALSE;
 
-    RtlEnterCriticalSection( &pool->cs );
+    RtlAcquireSRWLockExclusive( &object->lock );
     if (object->num_pending_callbacks)
     {
         pending_callbacks = object->num_pending_callbacks;
         object->num_pending_callbacks = 0;
-        list_remove( &object->pool_entry );
+
+        /* If a worker is already dequeuing the object, it takes care of it. */
+        if ((dequeued = tp_queue_remove( object )))
+            object->queued = FALSE;
 
         if (object->type == TP_OBJECT_TYPE_WAIT)
             object->u.wait.signaled = 0;
     }
-    RtlLeaveCriticalSection( &pool->cs );
+    RtlReleaseSRWLockExclusive( &object->lock );
+
+    if (dequeued)
+        tp_object_release( object );
 
     /* Execute group cancellation callback if defined, and if this was actually a group cancel. */
     if (pending_callbacks && group_cancel && object->group_cancel_callback)
@@ -1984,20 +2147,18 @@ static void tp_object_cancel( struct threadpool_object *object, BOOL group_cance
  */
 static void tp_object_wait( struct threadpool_object *object, BOOL group_wait )
 {
-    struct threadpool *pool = object->pool;
-
-    RtlEnterCriticalSection( &pool->cs );
+    RtlAcquireSRWLockExclusive( &object->lock );
     if (group_wait)
     {
         while (object->num_pending_callbacks || object->num_running_callbacks)
-            RtlSleepConditionVariableCS( &object->group_finished_event, &pool->cs, NULL );
+            RtlSleepConditionVariableSRW( &object->group_finished_event, &object->lock, NULL, 0 );
     }
     else
     {
         while (object->num_pending_callbacks || object->num_associated_callbacks)
-            RtlSleepConditionVariableCS( &object->finished_event, &pool->cs, NULL );
+            RtlSleepConditionVariableSRW( &object->finished_event, &object->lock, NULL, 0 );
     }
-    RtlLeaveCriticalSection( &pool->cs );
+    RtlReleaseSRWLockExclusive( &object->lock );
 }
 
 /***********************************************************************
@@ -2029,6 +2190,7 @@ static BOOL tp_object_release( struct threadpool_object *object )
     TRACE( "destroying object %p of type %u\n", object, object->type );
 
     assert( object->shutdown );
+    assert( !object->queued );
     assert( !object->num_pending_callbacks );
     assert( !object->num_running_callbacks );
     assert( !object->num_associated_callbacks );
@@ -2065,28 +2227,52 @@ static void CALLBACK threadpool_worker_proc( void *param )
 {
     TP_CALLBACK_INSTANCE *callback_instance;
     struct threadpool_instance instance;
+    struct threadpool_worker worker;
+    struct threadpool_object *object;
     struct threadpool *pool = param;
     TP_WAIT_RESULT wait_result = 0;
     LARGE_INTEGER timeout;
-    struct list *ptr;
     NTSTATUS status;
 
     TRACE( "starting worker thread for pool %p\n", pool );
 
+    worker.pool = pool;
+    RtlInitializeSRWLock( &worker.queue.lock );
+    list_init( &worker.queue.objects );
+    ntdll_get_thread_data()->threadpool_worker = &worker;
+
     RtlEnterCriticalSection( &pool->cs );
-    pool->num_busy_workers--;
+    list_add_tail( &pool->workers, &worker.entry );
+    RtlLeaveCriticalSection( &pool->cs );
+
     for (;;)
     {
-        while ((ptr = list_head( &pool->pool )))
+        while ((object = tp_threadpool_get_object( pool, &worker )))
         {
-            struct threadpool_object *object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
-            assert( object->num_pending_callbacks > 0 );
+            BOOL dequeued = FALSE;
+
+            RtlAcquireSRWLockExclusive( &object->lock );
+            assert( object->queued );
+
+            /* The pending callbacks may have been canceled in the meantime. */
+            if (!object->num_pending_callbacks)
+            {
+                object->queued = FALSE;
+                RtlReleaseSRWLockExclusive( &object->lock );
+                tp_object_release( object );
+                continue;
+            }
 
             /* If further pending callbacks are queued, move the work item to
-             * the end of the pool list. Otherwise remove it from the pool. */
-            list_remove( &object->pool_entry );
+             * the end of the pool queue, so that the other objects get their
+             * turn. Otherwise drop the queue reference. */
             if (--object->num_pending_callbacks)
-                list_add_tail( &pool->pool, &object->pool_entry );
+                tp_queue_push( &pool->queue, object );
+            else
+            {
+                object->queued = FALSE;
+                dequeued = TRUE;
+            }
 
             /* For wait objects check if they were signaled or have timed out. */
             if (object->type == TP_OBJECT_TYPE_WAIT)
@@ -2095,11 +2281,17 @@ static void CALLBACK threadpool_worker_proc( void *param )
                 if (wait_result == WAIT_OBJECT_0) object->u.wait.signaled--;
             }
 
-            /* Leave critical section and do the actual callback. */
+            /* Release the lock and do the actual callback. */
             object->num_associated_callbacks++;
             object->num_running_callbacks++;
-            pool->num_busy_workers++;
-            RtlLeaveCriticalSection( &pool->cs );
+            RtlReleaseSRWLockExclusive( &object->lock );
+
+            /* The pending callback still holds a reference. */
+            if (dequeued) tp_object_release( object );
+
+            /* Make sure that another thread looks at the remaining work. */
+            if (interlocked_dec( &pool->num_searching ) < pool->num_queued)
+                tp_threadpool_wake( pool, TRUE );
 
             /* Initialize threadpool instance struct. */
             callback_instance = (TP_CALLBACK_INSTANCE *)&instance;
@@ -2192,8 +2384,7 @@ static void CALLBACK threadpool_worker_proc( void *param )
             }
 
         skip_cleanup:
-            RtlEnterCriticalSection( &pool->cs );
-            pool->num_busy_workers--;
+            RtlAcquireSRWLockExclusive( &object->lock );
 
             object->num_running_callbacks--;
             if (!object->num_pending_callbacks && !object->num_running_callbacks)
@@ -2206,7 +2397,21 @@ static void CALLBACK threadpool_worker_proc( void *param )
                     RtlWakeAllConditionVariable( &object->finished_event );
             }
 
+            RtlReleaseSRWLockExclusive( &object->lock );
+
             tp_object_release( object );
+            interlocked_inc( &pool->num_searching );
+        }
+
+        /* Check again for work queued after we stopped searching, with the
+         * lock held so that tp_threadpool_wake() can't miss us. */
+        RtlEnterCriticalSection( &pool->cs );
+        interlocked_dec( &pool->num_searching );
+        if (pool->num_queued)
+        {
+            interlocked_inc( &pool->num_searching );
+            RtlLeaveCriticalSection( &pool->cs );
+            continue;
         }
 
         /* Shutdown worker thread if requested. */
@@ -2219,16 +2424,28 @@ static void CALLBACK threadpool_worker_proc( void *param )
          * min_workers == 0, then objcount is used to detect if the last thread
          * can be terminated. */
         timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
-        if (RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout ) == STATUS_TIMEOUT &&
-            !list_head( &pool->pool ) && (pool->num_workers > max( pool->min_workers, 1 ) ||
-            (!pool->min_workers && !pool->objcount)))
-        {
+        pool->num_idle_workers++;
+        status = RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout );
+        pool->num_idle_workers--;
+
+        /* tp_threadpool_wake() already counted one woken thread as searching. */
+        if (pool->num_wakeups)
+            pool->num_wakeups--;
+        else if (status == STATUS_TIMEOUT && !pool->num_queued &&
+                 (pool->num_workers > max( pool->min_workers, 1 ) ||
+                 (!pool->min_workers && !pool->objcount)))
             break;
-        }
+        else
+            interlocked_inc( &pool->num_searching );
+
+        RtlLeaveCriticalSection( &pool->cs );
     }
+    list_remove( &worker.entry );
     pool->num_workers--;
     RtlLeaveCriticalSection( &pool->cs );
 
+    ntdll_get_thread_data()->threadpool_worker = NULL;
+
     TRACE( "terminating worker thread for pool %p\n", pool );
     tp_threadpool_release( pool );
     RtlExitUserThread( 0 );
@@ -2405,26 +2622,13 @@ NTSTATUS WINAPI TpCallbackMayRunLong( TP_CALLBACK_INSTANCE *instance )
     pool = object->pool;
     RtlEnterCriticalSection( &pool->cs );
 
-    /* Start new worker threads if required. */
-    if (pool->num_busy_workers >= pool->num_workers)
+    /* Start new worker threads if no other worker is available. */
+    if (!pool->num_searching && pool->num_idle_workers <= pool->num_wakeups)
     {
         if (pool->num_workers < pool->max_workers)
-        {
-            HANDLE thread;
-            status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
-                                          threadpool_worker_proc, pool, &thread, NULL );
-            if (status == STATUS_SUCCESS)
-            {
-                interlocked_inc( &pool->refcount );
-                pool->num_workers++;
-                pool->num_busy_workers++;
-                NtClose( thread );
-            }
-        }
+            status = tp_new_worker_thread( pool );
         else
-        {
             status = STATUS_TOO_MANY_THREADS;
-        }
     }
 
     RtlLeaveCriticalSection( &pool->cs );
@@ -2494,7 +2698,6 @@ VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
 {
     struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
     struct threadpool_object *object = this->object;
-    struct threadpool *pool;
 
     TRACE( "%p\n", instance );
 
@@ -2507,14 +2710,13 @@ VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
     if (!this->associated)
         return;
 
-    pool = object->pool;
-    RtlEnterCriticalSection( &pool->cs );
+    RtlAcquireSRWLockExclusive( &object->lock );
 
     object->num_associated_callbacks--;
     if (!object->num_pending_callbacks && !object->num_associated_callbacks)
         RtlWakeAllConditionVariable( &object->finished_event );
 
-    RtlLeaveCriticalSection( &pool->cs );
+    RtlReleaseSRWLockExclusive( &object->lock );
     this->associated = FALSE;
 }
 
@@ -2697,16 +2899,9 @@ BOOL WINAPI TpSetPoolMinThreads( TP_POOL *pool, DWORD minimum )
 
     while (this->num_workers < minimum)
     {
-        HANDLE thread;
-        status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
-                                      threadpool_worker_proc, this, &thread, NULL );
+        status = tp_new_worker_thread( this );
         if (status != STATUS_SUCCESS)
             break;
-
-        interlocked_inc( &this->refcount );
-        this->num_workers++;
-        this->num_busy_workers++;
-        NtClose( thread );
     }
 
     if (status == STATUS_SUCCESS)
@@ -38,6 +38,18 @@
 #ifdef HAVE_SYS_MMAN_H
 # include <sys/mman.h>
 #endif
+#ifdef HAVE_SYS_IOCTL_H
+# include <sys/ioctl.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
+#ifdef HAVE_SYS_UIO_H
+# include <sys/uio.h>
+#endif
+#ifdef HAVE_LINUX_USERFAULTFD_H
+# include <linux/userfaultfd.h>
+#endif
 #ifdef HAVE_VALGRIND_VALGRIND_H
 # include <valgrind/valgrind.h>
 #endif
@@ -51,6 +63,7 @@
 #include "wine/server.h"
 #include "wine/exception.h"
 #include "wine/list.h"
+#include "wine/rbtree.h"
 #include "wine/debug.h"
 #include "ntdll_misc.h"
 
@@ -65,6 +78,7 @@ WINE_DECLARE_DEBUG_CHANNEL(module);
 struct file_view
 {
     struct list   entry;       /* Entry in global view list */
+    struct wine_rb_entry tree_entry; /* Entry in global view tree */
     void         *base;        /* Base address */
     size_t        size;        /* Size in bytes */
     HANDLE        mapping;     /* Handle to the file mapping */
@@ -95,7 +109,8 @@ static const BYTE VIRTUAL_Win32Flags[16] =
     PAGE_EXECUTE_WRITECOPY      /* READ | WRITE | EXEC | WRITECOPY */
 };
 
-static struct list views_list = LIST_INIT(views_list);
+static struct list views_list = LIST_INIT(views_list);  /* views sorted by address */
+static struct wine_rb_tree views_tree;                   /* same views indexed for lookups */
 
 static RTL_CRITICAL_SECTION csVirtual;
 static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
@@ -148,6 +163,7 @@ static void *preload_reserve_start;
 static void *preload_reserve_end;
 static BOOL use_locks;
 static BOOL force_exec_prot;  /* whether to force PROT_EXEC on all PROT_READ mmaps */
+static BOOL kernel_write_watch;  /* whether write watches are tracked by the kernel */
 
 
 /***********************************************************************
@@ -180,7 +196,7 @@ static int VIRTUAL_GetUnixProt( BYTE vprot )
         if (vprot & VPROT_WRITE) prot |= PROT_WRITE | PROT_READ;
         if (vprot & VPROT_WRITECOPY) prot |= PROT_WRITE | PROT_READ;
         if (vprot & VPROT_EXEC) prot |= PROT_EXEC | PROT_READ;
-        if (vprot & VPROT_WRITEWATCH) prot &= ~PROT_WRITE;
+        if ((vprot & VPROT_WRITEWATCH) && !kernel_write_watch) prot &= ~PROT_WRITE;
     }
     if (!prot) prot = PROT_NONE;
     return prot;
@@ -241,6 +257,44 @@ static void VIRTUAL_Dump(void)
 #endif
 
 
+/***********************************************************************
+ *           compare_view
+ *
+ * Compare an address to a view; since views don't overlap, this also orders the views.
+ */
+static int compare_view( const void *addr, const struct wine_rb_entry *entry )
+{
+    const struct file_view *view = WINE_RB_ENTRY_VALUE( entry, const struct file_view, tree_entry );
+
+    if ((const char *)addr < (const char *)view->base) return -1;
+    if ((const char *)addr >= (const char *)view->base + view->size) return 1;
+    return 0;
+}
+
+static void *views_tree_alloc( size_t size )
+{
+    return RtlAllocateHeap( virtual_heap, 0, size );
+}
+
+static void *views_tree_realloc( void *ptr, size_t size )
+{
+    return RtlReAllocateHeap( virtual_heap, 0, ptr, size );
+}
+
+static void views_tree_free( void *ptr )
+{
+    RtlFreeHeap( virtual_heap, 0, ptr );
+}
+
+static const struct wine_rb_functions views_tree_functions =
+{
+    views_tree_alloc,
+    views_tree_realloc,
+    views_tree_free,
+    compare_view,
+};
+
+
 /***********************************************************************
  *           VIRTUAL_FindView
  *
@@ -255,17 +309,65 @@ static void VIRTUAL_Dump(void)
  */
 static struct file_view *VIRTUAL_FindView( const void *addr, size_t size )
 {
+    struct wine_rb_entry *ptr = wine_rb_get( &views_tree, addr );
     struct file_view *view;
 
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
+    if (!ptr) return NULL;
+    view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, tree_entry );
+    if ((const char *)view->base + view->size < (const char *)addr + size) return NULL;  /* size too large */
+    if ((const char *)addr + size < (const char *)addr) return NULL; /* overflow */
+    return view;
+}
+
+
+/***********************************************************************
+ *           find_view_after
+ *
+ * Find the first view that ends after the given address, i.e. the view
+ * containing it or the first one following it.
+ * The csVirtual section must be held by caller.
+ */
+static struct file_view *find_view_after( const void *addr )
+{
+    struct wine_rb_entry *ptr = views_tree.root;
+    struct file_view *view, *ret = NULL;
+
+    while (ptr)
     {
-        if (view->base > addr) break;  /* no matching view */
-        if ((const char *)view->base + view->size <= (const char *)addr) continue;
-        if ((const char *)view->base + view->size < (const char *)addr + size) break;  /* size too large */
-        if ((const char *)addr + size < (const char *)addr) break; /* overflow */
-        return view;
+        view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, tree_entry );
+        if ((const char *)view->base + view->size > (const char *)addr)
+        {
+            ret = view;
+            ptr = ptr->left;
+        }
+        else ptr = ptr->right;
     }
-    return NULL;
+    return ret;
+}
+
+
+/***********************************************************************
+ *           find_view_before
+ *
+ * Find the last view that starts before the given address.
+ * The csVirtual section must be held by caller.
+ */
+static struct file_view *find_view_before( const void *addr )
+{
+    struct wine_rb_entry *ptr = views_tree.root;
+    struct file_view *view, *ret = NULL;
+
+    while (ptr)
+    {
+        view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, tree_entry );
+        if ((const char *)view->base < (const char *)addr)
+        {
+            ret = view;
+            ptr = ptr->right;
+        }
+        else ptr = ptr->left;
+    }
+    return ret;
 }
 
 
@@ -288,13 +390,9 @@ static inline UINT_PTR get_mask( ULONG zero_bits )
  */
 static struct file_view *find_view_range( const void *addr, size_t size )
 {
-    struct file_view *view;
+    struct file_view *view = find_view_after( addr );
 
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
-    {
-        if ((const char *)view->base >= (const char *)addr + size) break;
-        if ((const char *)view->base + view->size > (const char *)addr) return view;
-    }
+    if (view && (const char *)view->base < (const char *)addr + size) return view;
     return NULL;
 }
 
@@ -307,6 +405,7 @@ static struct file_view *find_view_range( const void *addr, size_t size )
  */
 static void *find_free_area( void *base, void *end, size_t size, size_t mask, int top_down )
 {
+    struct file_view *first;
     struct list *ptr;
     void *start;
 
@@ -315,7 +414,8 @@ static void *find_free_area( void *base, void *end, size_t size, size_t mask, in
         start = ROUND_ADDR( (char *)end - size, mask );
         if (start >= end || start < base) return NULL;
 
-        for (ptr = views_list.prev; ptr != &views_list; ptr = ptr->prev)
+        first = find_view_before( (char *)start + size );
+        for (ptr = first ? &first->entry : NULL; ptr; ptr = list_prev( &views_list, ptr ))
         {
             struct file_view *view = LIST_ENTRY( ptr, struct file_view, entry );
 
@@ -331,7 +431,8 @@ static void *find_free_area( void *base, void *end, size_t size, size_t mask, in
         start = ROUND_ADDR( (char *)base + mask, mask );
         if (start >= end || (char *)end - (char *)start < size) return NULL;
 
-        for (ptr = views_list.next; ptr != &views_list; ptr = ptr->next)
+        first = find_view_after( start );
+        for (ptr = first ? &first->entry : NULL; ptr; ptr = list_next( &views_list, ptr ))
         {
             struct file_view *view = LIST_ENTRY( ptr, struct file_view, entry );
 
@@ -379,19 +480,21 @@ static void add_reserved_area( void *addr, size_t size )
 static void remove_reserved_area( void *addr, size_t size )
 {
     struct file_view *view;
+    struct list *ptr;
 
     TRACE( "removing %p-%p\n", addr, (char *)addr + size );
     wine_mmap_remove_reserved_area( addr, size, 0 );
 
     /* unmap areas not covered by an existing view */
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
+    view = find_view_after( addr );
+    for (ptr = view ? &view->entry : NULL; ptr; ptr = list_next( &views_list, ptr ))
     {
+        view = LIST_ENTRY( ptr, struct file_view, entry );
         if ((char *)view->base >= (char *)addr + size)
         {
             munmap( addr, size );
             break;
         }
-        if ((char *)view->base + view->size <= (char *)addr) continue;
         if (view->base > addr) munmap( addr, (char *)view->base - (char *)addr );
         if ((char *)view->base + view->size > (char *)addr + size) break;
         size = (char *)addr + size - ((char *)view->base + view->size);
@@ -436,6 +539,7 @@ static inline void unmap_area( void *addr, size_t size )
 static void delete_view( struct file_view *view ) /* [in] View */
 {
     if (!(view->protect & VPROT_SYSTEM)) unmap_area( view->base, view->size );
+    wine_rb_remove( &views_tree, view->base );
     list_remove( &view->entry );
     if (view->mapping) close_handle( view->mapping );
     RtlFreeHeap( virtual_heap, 0, view );
@@ -449,8 +553,7 @@ static void delete_view( struct file_view *view ) /* [in] View */
  */
 static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t size, unsigned int vprot )
 {
-    struct file_view *view;
-    struct list *ptr;
+    struct file_view *view, *prev;
     int unix_prot = VIRTUAL_GetUnixProt( vprot );
 
     assert( !((UINT_PTR)base & page_mask) );
@@ -471,43 +574,29 @@ static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t siz
     view->protect = vprot;
     memset( view->prot, vprot, size >> page_shift );
 
-    /* Insert it in the linked list */
-
-    LIST_FOR_EACH( ptr, &views_list )
-    {
-        struct file_view *next = LIST_ENTRY( ptr, struct file_view, entry );
-        if (next->base > base) break;
-    }
-    list_add_before( ptr, &view->entry );
-
     /* Check for overlapping views. This can happen if the previous view
      * was a system view that got unmapped behind our back. In that case
      * we recover by simply deleting it. */
 
-    if ((ptr = list_prev( &views_list, &view->entry )) != NULL)
+    while ((prev = find_view_range( base, size )))
     {
-        struct file_view *prev = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)prev->base + prev->size > (char *)base)
-        {
-            TRACE( "overlapping prev view %p-%p for %p-%p\n",
-                   prev->base, (char *)prev->base + prev->size,
-                   base, (char *)base + view->size );
-            assert( prev->protect & VPROT_SYSTEM );
-            delete_view( prev );
-        }
+        TRACE( "overlapping view %p-%p for %p-%p\n",
+               prev->base, (char *)prev->base + prev->size,
+               base, (char *)base + view->size );
+        assert( prev->protect & VPROT_SYSTEM );
+        delete_view( prev );
     }
-    if ((ptr = list_next( &views_list, &view->entry )) != NULL)
+
+    /* Insert it in the tree and the sorted list */
+
+    if (wine_rb_put( &views_tree, base, &view->tree_entry ) == -1)
     {
-        struct file_view *next = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)base + view->size > (char *)next->base)
-        {
-            TRACE( "overlapping next view %p-%p for %p-%p\n",
-                   next->base, (char *)next->base + next->size,
-                   base, (char *)base + view->size );
-            assert( next->protect & VPROT_SYSTEM );
-            delete_view( next );
-        }
+        FIXME( "out of memory in virtual heap for %p-%p\n", base, (char *)base + size );
+        RtlFreeHeap( virtual_heap, 0, view );
+        return STATUS_NO_MEMORY;
     }
+    prev = find_view_before( base );
+    list_add_after( prev ? &prev->entry : &views_list, &view->entry );
 
     *view_ret = view;
     VIRTUAL_DEBUG_DUMP_VIEW( view );
@@ -673,6 +762,281 @@ static BOOL VIRTUAL_SetProt( struct file_view *view, /* [in] Pointer to view */
 }
 
 
+#if defined(__linux__) && defined(HAVE_LINUX_USERFAULTFD_H) && defined(__NR_userfaultfd)
+
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED (1 << 13)
+#endif
+#ifndef UFFD_FEATURE_WP_ASYNC
+#define UFFD_FEATURE_WP_ASYNC (1 << 15)
+#endif
+
+#ifndef PAGEMAP_SCAN
+#define PM_SCAN_WP_MATCHING   (1 << 0)
+#define PM_SCAN_CHECK_WPASYNC (1 << 1)
+#define PAGE_IS_WRITTEN       (1 << 1)
+
+struct page_region
+{
+    __u64 start;
+    __u64 end;
+    __u64 categories;
+};
+
+struct pm_scan_arg
+{
+    __u64 size;
+    __u64 flags;
+    __u64 start;
+    __u64 end;
+    __u64 walk_end;
+    __u64 vec;
+    __u64 vec_len;
+    __u64 max_pages;
+    __u64 category_inverted;
+    __u64 category_mask;
+    __u64 category_anyof_mask;
+    __u64 return_mask;
+};
+
+#define PAGEMAP_SCAN _IOWR('f', 16, struct pm_scan_arg)
+#endif
+
+static int uffd_fd = -1;     /* userfaultfd used to write-protect the watched pages */
+static int pagemap_fd = -1;  /* /proc/self/pagemap, used to query written pages */
+
+/***********************************************************************
+ *           init_kernel_write_watch
+ *
+ * Check whether the kernel can track writes to watched pages by itself,
+ * using asynchronous userfaultfd write protection. In that case watched
+ * pages stay writable and no page fault is taken on the first write.
+ */
+static void init_kernel_write_watch(void)
+{
+    static BOOL init_done;
+    struct uffdio_api api;
+    struct pm_scan_arg arg;
+    int fd;
+
+    if (init_done) return;
+    init_done = TRUE;
+
+    if ((fd = syscall( __NR_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY )) == -1 &&
+        (fd = syscall( __NR_userfaultfd, O_CLOEXEC | O_NONBLOCK )) == -1)
+    {
+        TRACE( "userfaultfd not available (errno %d), using page faults for write watches\n", errno );
+        return;
+    }
+
+    memset( &api, 0, sizeof(api) );
+    api.api = UFFD_API;
+    api.features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+    if (ioctl( fd, UFFDIO_API, &api ) == -1 ||
+        (api.features & (UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED)) !=
+        (UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED))
+    {
+        TRACE( "asynchronous write protection not supported, using page faults for write watches\n" );
+        close( fd );
+        return;
+    }
+
+    /* an empty scan is enough to check that the ioctl is supported */
+    memset( &arg, 0, sizeof(arg) );
+    arg.size = sizeof(arg);
+    if ((pagemap_fd = open( "/proc/self/pagemap", O_RDONLY | O_CLOEXEC )) == -1 ||
+        ioctl( pagemap_fd, PAGEMAP_SCAN, &arg ) == -1)
+    {
+        TRACE( "PAGEMAP_SCAN not supported, using page faults for write watches\n" );
+        if (pagemap_fd != -1) close( pagemap_fd );
+        pagemap_fd = -1;
+        close( fd );
+        return;
+    }
+
+    TRACE( "using kernel write tracking for write watches\n" );
+    uffd_fd = fd;
+    kernel_write_watch = TRUE;
+}
+
+
+/***********************************************************************
+ *           kernel_reset_write_watches
+ *
+ * Write-protect a range so that the next write to each page gets recorded.
+ */
+static void kernel_reset_write_watches( void *base, SIZE_T size )
+{
+    struct uffdio_writeprotect wp;
+
+    wp.range.start = (UINT_PTR)base;
+    wp.range.len   = size;
+    wp.mode        = UFFDIO_WRITEPROTECT_MODE_WP;
+    if (ioctl( uffd_fd, UFFDIO_WRITEPROTECT, &wp ) == -1)
+        ERR( "failed to reset write watches for %p-%p, errno %d\n", base, (char *)base + size, errno );
+}
+
+
+/***********************************************************************
+ *           kernel_register_write_watches
+ *
+ * Start tracking writes to a newly mapped range of a write watch view.
+ */
+static NTSTATUS kernel_register_write_watches( void *base, SIZE_T size )
+{
+    struct uffdio_register reg;
+
+    reg.range.start = (UINT_PTR)base;
+    reg.range.len   = size;
+    reg.mode        = UFFDIO_REGISTER_MODE_WP;
+    if (ioctl( uffd_fd, UFFDIO_REGISTER, &reg ) == -1)
+    {
+        ERR( "failed to register %p-%p for write watches, errno %d\n", base, (char *)base + size, errno );
+        return FILE_GetNtStatus();
+    }
+    kernel_reset_write_watches( base, size );
+    return STATUS_SUCCESS;
+}
+
+
+/***********************************************************************
+ *           kernel_init_scan
+ */
+static void kernel_init_scan( struct pm_scan_arg *arg, struct page_region *regions, unsigned int count,
+                              void *base, SIZE_T size, BOOL reset )
+{
+    memset( arg, 0, sizeof(*arg) );
+    arg->size          = sizeof(*arg);
+    arg->flags         = PM_SCAN_CHECK_WPASYNC | (reset ? PM_SCAN_WP_MATCHING : 0);
+    arg->start         = (UINT_PTR)base;
+    arg->end           = (UINT_PTR)base + size;
+    arg->vec           = (UINT_PTR)regions;
+    arg->vec_len       = count;
+    arg->category_mask = PAGE_IS_WRITTEN;
+    arg->return_mask   = PAGE_IS_WRITTEN;
+}
+
+
+/***********************************************************************
+ *           kernel_save_write_watches
+ *
+ * Record the written pages of a range in the view protection before its
+ * mapping gets replaced, since the kernel state is lost with the mapping.
+ */
+static void kernel_save_write_watches( struct file_view *view, void *base, SIZE_T size )
+{
+    struct page_region regions[64];
+    struct pm_scan_arg arg;
+    char *addr, *end;
+    int i, ret;
+
+    kernel_init_scan( &arg, regions, sizeof(regions) / sizeof(regions[0]), base, size, FALSE );
+    while (arg.start < arg.end)
+    {
+        if ((ret = ioctl( pagemap_fd, PAGEMAP_SCAN, &arg )) == -1)
+        {
+            ERR( "failed to scan %p-%p, errno %d\n", base, (char *)base + size, errno );
+            break;
+        }
+        for (i = 0; i < ret; i++)
+        {
+            end = (char *)(UINT_PTR)regions[i].end;
+            for (addr = (char *)(UINT_PTR)regions[i].start; addr < end; addr += page_size)
+                view->prot[(addr - (char *)view->base) >> page_shift] &= ~VPROT_WRITEWATCH;
+        }
+        arg.start = arg.walk_end;
+    }
+}
+
+
+/***********************************************************************
+ *           kernel_get_saved_write_watches
+ *
+ * Add the pages recorded by kernel_save_write_watches up to a given address.
+ */
+static char *kernel_get_saved_write_watches( struct file_view *view, char *addr, char *end,
+                                             PVOID *addresses, ULONG_PTR *pos, ULONG_PTR count )
+{
+    for ( ; addr < end && *pos < count; addr += page_size)
+        if (!(view->prot[(addr - (char *)view->base) >> page_shift] & VPROT_WRITEWATCH))
+            addresses[(*pos)++] = addr;
+    return addr;
+}
+
+
+/***********************************************************************
+ *           kernel_get_write_watches
+ *
+ * Retrieve the pages written to in a range, optionally resetting them.
+ */
+static ULONG_PTR kernel_get_write_watches( struct file_view *view, void *base, SIZE_T size,
+                                           PVOID *addresses, ULONG_PTR count, BOOL reset )
+{
+    struct page_region regions[64];
+    struct pm_scan_arg arg;
+    ULONG_PTR pos = 0;
+    char *addr = base, *end = addr + size, *region_end;
+    BOOL saved = FALSE;
+    int i, ret;
+
+    /* pages written before a decommit have to be merged in, and then the
+     * range can't be reset atomically by the scan */
+    for ( ; addr < end; addr += page_size)
+        if ((saved = !(view->prot[(addr - (char *)view->base) >> page_shift] & VPROT_WRITEWATCH))) break;
+
+    addr = base;
+    kernel_init_scan( &arg, regions, sizeof(regions) / sizeof(regions[0]), base, size, reset && !saved );
+    while (pos < count && arg.start < arg.end)
+    {
+        arg.max_pages = count - pos;
+        if ((ret = ioctl( pagemap_fd, PAGEMAP_SCAN, &arg )) == -1)
+        {
+            ERR( "failed to scan %p-%p, errno %d\n", base, (char *)base + size, errno );
+            break;
+        }
+        for (i = 0; i < ret; i++)
+        {
+            addr = kernel_get_saved_write_watches( view, addr, (char *)(UINT_PTR)regions[i].start,
+                                                   addresses, &pos, count );
+            region_end = (char *)(UINT_PTR)regions[i].end;
+            for ( ; addr < region_end && pos < count; addr += page_size) addresses[pos++] = addr;
+        }
+        arg.start = arg.walk_end;
+    }
+    if (!saved) return pos;
+
+    if (pos < count) addr = kernel_get_saved_write_watches( view, addr, end, addresses, &pos, count );
+    if (reset)
+    {
+        BYTE *p = view->prot + (((char *)base - (char *)view->base) >> page_shift);
+
+        for (i = 0; i < (addr - (char *)base) >> page_shift; i++) p[i] |= VPROT_WRITEWATCH;
+        kernel_reset_write_watches( base, addr - (char *)base );
+    }
+    return pos;
+}
+
+#else  /* __linux__ */
+
+static inline void init_kernel_write_watch(void) { }
+static inline void kernel_reset_write_watches( void *base, SIZE_T size ) { }
+static inline NTSTATUS kernel_register_write_watches( void *base, SIZE_T size )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+static inline void kernel_save_write_watches( struct file_view *view, void *base, SIZE_T size ) { }
+static inline ULONG_PTR kernel_get_write_watches( struct file_view *view, void *base, SIZE_T size,
+                                                  PVOID *addresses, ULONG_PTR count, BOOL reset )
+{
+    return 0;
+}
+
+#endif  /* __linux__ */
+
+
 /***********************************************************************
  *           reset_write_watches
  *
@@ -685,6 +1049,13 @@ static void reset_write_watches( struct file_view *view, void *base, SIZE_T size
     char *addr = base;
     BYTE *p = view->prot + ((addr - (char *)view->base) >> page_shift);
 
+    if (kernel_write_watch)
+    {
+        for (i = 0; i < size >> page_shift; i++) p[i] |= VPROT_WRITEWATCH;
+        kernel_reset_write_watches( base, size );
+        return;
+    }
+
     p[0] |= VPROT_WRITEWATCH;
     unix_prot = VIRTUAL_GetUnixProt( p[0] );
     for (count = i = 1; i < size >> page_shift; i++, count++)
@@ -959,11 +1330,17 @@ static SIZE_T get_committed_size( struct file_view *view, void *base, BYTE *vpro
  */
 static NTSTATUS decommit_pages( struct file_view *view, size_t start, size_t size )
 {
+    if (kernel_write_watch && (view->protect & VPROT_WRITEWATCH))
+        kernel_save_write_watches( view, (char *)view->base + start, size );
     if (wine_anon_mmap( (char *)view->base + start, size, PROT_NONE, MAP_FIXED ) != (void *)-1)
     {
         BYTE *p = view->prot + (start >> page_shift);
-        size >>= page_shift;
-        while (size--) *p++ &= ~VPROT_COMMITTED;
+        SIZE_T i;
+
+        for (i = 0; i < size >> page_shift; i++) p[i] &= ~VPROT_COMMITTED;
+        /* the new mapping is no longer registered for write tracking */
+        if (kernel_write_watch && (view->protect & VPROT_WRITEWATCH))
+            kernel_register_write_watches( (char *)view->base + start, size );
         return STATUS_SUCCESS;
     }
     return FILE_GetNtStatus();
@@ -1053,13 +1430,40 @@ static NTSTATUS stat_mapping_file( struct file_view *view, struct stat *st )
     return status;
 }
 
+/***********************************************************************
+ *           get_reloc_file
+ *
+ * Get the file holding the copy of an image relocated to the given address, if any.
+ * Returns -1 if the image has to be relocated by the loader.
+ */
+static int get_reloc_file( HANDLE hmapping, void *addr )
+{
+    HANDLE handle = 0;
+    int fd = -1, needs_close;
+
+    SERVER_START_REQ( get_mapping_reloc_file )
+    {
+        req->handle = wine_server_obj_handle( hmapping );
+        req->base   = wine_server_client_ptr( addr );
+        if (!wine_server_call( req )) handle = wine_server_ptr_handle( reply->handle );
+    }
+    SERVER_END_REQ;
+
+    if (!handle) return -1;
+    if (!server_get_unix_fd( handle, FILE_READ_DATA, &fd, &needs_close, NULL, NULL ) && !needs_close)
+        fd = dup( fd );
+    close_handle( handle );
+    return fd;
+}
+
 /***********************************************************************
  *           map_image
  *
  * Map an executable (PE format) image into memory.
  */
-static NTSTATUS map_image( HANDLE hmapping, int fd, char *base, SIZE_T total_size, SIZE_T mask,
-                           SIZE_T header_size, int shared_fd, HANDLE dup_mapping, unsigned int map_vprot, PVOID *addr_ptr )
+static NTSTATUS map_image( HANDLE hmapping, int fd, char *base, char *reloc_base, SIZE_T total_size,
+                           SIZE_T mask, SIZE_T header_size, int shared_fd, HANDLE dup_mapping,
+                           unsigned int map_vprot, PVOID *addr_ptr )
 {
     IMAGE_DOS_HEADER *dos;
     IMAGE_NT_HEADERS *nt;
@@ -1067,7 +1471,7 @@ static NTSTATUS map_image( HANDLE hmapping, int fd, char *base, SIZE_T total_siz
     IMAGE_SECTION_HEADER *sec;
     IMAGE_DATA_DIRECTORY *imports;
     NTSTATUS status = STATUS_CONFLICTING_ADDRESSES;
-    int i;
+    int i, reloc_fd = -1;
     off_t pos;
     sigset_t sigset;
     struct stat st;
@@ -1082,6 +1486,11 @@ static NTSTATUS map_image( HANDLE hmapping, int fd, char *base, SIZE_T total_siz
         status = map_view( &view, base, total_size, mask, FALSE,
                            VPROT_COMMITTED | VPROT_READ | VPROT_EXEC | VPROT_WRITECOPY | VPROT_IMAGE );
 
+    /* try the address other processes relocated the image to, so that we can share it */
+    if (status != STATUS_SUCCESS && reloc_base >= (char *)address_space_start)
+        status = map_view( &view, reloc_base, total_size, mask, FALSE,
+                           VPROT_COMMITTED | VPROT_READ | VPROT_EXEC | VPROT_WRITECOPY | VPROT_IMAGE );
+
     if (status != STATUS_SUCCESS)
         status = map_view( &view, NULL, total_size, mask, FALSE,
                            VPROT_COMMITTED | VPROT_READ | VPROT_EXEC | VPROT_WRITECOPY | VPROT_IMAGE );
@@ -1091,6 +1500,8 @@ static NTSTATUS map_image( HANDLE hmapping, int fd, char *base, SIZE_T total_siz
     ptr = view->base;
     TRACE_(module)( "mapped PE file at %p-%p\n", ptr, ptr + total_size );
 
+    if (ptr != base && shared_fd == -1) reloc_fd = get_reloc_file( hmapping, ptr );
+
     /* map the header */
 
     if (fstat( fd, &st ) == -1)
@@ -1145,6 +1556,19 @@ static NTSTATUS map_image( HANDLE hmapping, int fd, char *base, SIZE_T total_siz
         goto done;
     }
 
+    /* map the copy of the image relocated by the server, the loader will find it at its base */
+
+    if (reloc_fd != -1)
+    {
+        if (map_file_into_view( view, reloc_fd, 0, total_size, 0, VPROT_COMMITTED | VPROT_READ | VPROT_WRITECOPY,
+                                FALSE ) == STATUS_SUCCESS)
+        {
+            TRACE_(module)( "mapped relocated copy at %p-%p\n", ptr, ptr + total_size );
+            goto set_protections;
+        }
+        WARN_(module)( "failed to map relocated copy, relocating privately\n" );
+    }
+
 
     /* map all the sections */
 
@@ -1237,6 +1661,7 @@ static NTSTATUS map_image( HANDLE hmapping, int fd, char *base, SIZE_T total_siz
 
     /* set the image protections */
 
+ set_protections:
     VIRTUAL_SetProt( view, ptr, ROUND_SIZE( 0, header_size ), VPROT_COMMITTED | VPROT_READ );
 
     sec = sections;
@@ -1268,6 +1693,7 @@ static NTSTATUS map_image( HANDLE hmapping, int fd, char *base, SIZE_T total_siz
     view->mapping = dup_mapping;
     view->map_protect = map_vprot;
     server_leave_uninterrupted_section( &csVirtual, &sigset );
+    if (reloc_fd != -1) close( reloc_fd );
 
     *addr_ptr = ptr;
 #ifdef VALGRIND_LOAD_PDB_DEBUGINFO
@@ -1280,6 +1706,7 @@ static NTSTATUS map_image( HANDLE hmapping, int fd, char *base, SIZE_T total_siz
     if (view) delete_view( view );
     server_leave_uninterrupted_section( &csVirtual, &sigset );
     if (dup_mapping) close_handle( dup_mapping );
+    if (reloc_fd != -1) close( reloc_fd );
     return status;
 }
 
@@ -1333,6 +1760,11 @@ void virtual_init(void)
     assert( heap_base != (void *)-1 );
     virtual_heap = RtlCreateHeap( HEAP_NO_SERIALIZE, heap_base, VIRTUAL_HEAP_SIZE,
                                   VIRTUAL_HEAP_SIZE, NULL, NULL );
+    if (wine_rb_init( &views_tree, &views_tree_functions ) == -1)
+    {
+        ERR( "failed to initialize the view tree\n" );
+        exit(1);
+    }
     create_view( &heap_view, heap_base, VIRTUAL_HEAP_SIZE, VPROT_COMMITTED | VPROT_READ | VPROT_WRITE );
 
     /* make the DOS area accessible (except the low 64K) to hide bugs in broken apps like Excel 2003 */
@@ -1954,9 +2386,19 @@ NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG zero_
 
     if ((type & MEM_RESERVE) || !base)
     {
-        if (type & MEM_WRITE_WATCH) vprot |= VPROT_WRITEWATCH;
+        if (type & MEM_WRITE_WATCH)
+        {
+            vprot |= VPROT_WRITEWATCH;
+            init_kernel_write_watch();
+        }
         status = map_view( &view, base, size, mask, type & MEM_TOP_DOWN, vprot );
-        if (status == STATUS_SUCCESS) base = view->base;
+        if (status == STATUS_SUCCESS)
+        {
+            base = view->base;
+            if (kernel_write_watch && (vprot & VPROT_WRITEWATCH) &&
+                (status = kernel_register_write_watches( view->base, view->size )))
+                delete_view( view );
+        }
     }
     else if (type & MEM_RESET)
     {
@@ -2297,30 +2739,22 @@ NTSTATUS WINAPI NtQueryVirtualMemory( HANDLE process, LPCVOID addr,
     /* Find the view containing the address */
 
     server_enter_uninterrupted_section( &csVirtual, &sigset );
-    ptr = list_head( &views_list );
-    for (;;)
+    if ((view = find_view_after( base )) && (char *)view->base <= base)
     {
-        if (!ptr)
-        {
-            size = (char *)working_set_limit - alloc_base;
-            view = NULL;
-            break;
-        }
-        view = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)view->base > base)
-        {
-            size = (char *)view->base - alloc_base;
-            view = NULL;
-            break;
-        }
-        if ((char *)view->base + view->size > base)
+        alloc_base = view->base;
+        size = view->size;
+    }
+    else
+    {
+        /* free area, it starts at the end of the previous view */
+        ptr = view ? list_prev( &views_list, &view->entry ) : list_tail( &views_list );
+        if (ptr)
         {
-            alloc_base = view->base;
-            size = view->size;
-            break;
+            struct file_view *prev = LIST_ENTRY( ptr, struct file_view, entry );
+            alloc_base = (char *)prev->base + prev->size;
         }
-        alloc_base = (char *)view->base + view->size;
-        ptr = list_next( &views_list, ptr );
+        size = (view ? (char *)view->base : (char *)working_set_limit) - alloc_base;
+        view = NULL;
     }
 
     /* Fill the info structure */
@@ -2530,7 +2964,7 @@ NTSTATUS WINAPI NtMapViewOfSection( HANDLE handle, HANDLE process, PVOID *addr_p
     SIZE_T size, mask = get_mask( zero_bits );
     int unix_handle = -1, needs_close;
     unsigned int map_vprot, vprot;
-    void *base;
+    void *base, *reloc_base;
     struct file_view *view;
     DWORD header_size;
     HANDLE dup_mapping, shared_file;
@@ -2611,11 +3045,13 @@ NTSTATUS WINAPI NtMapViewOfSection( HANDLE handle, HANDLE process, PVOID *addr_p
         res = wine_server_call( req );
         map_vprot   = reply->protect;
         base        = wine_server_get_ptr( reply->base );
+        reloc_base  = wine_server_get_ptr( reply->reloc_base );
         full_size   = reply->size;
         header_size = reply->header_size;
         dup_mapping = wine_server_ptr_handle( reply->mapping );
         shared_file = wine_server_ptr_handle( reply->shared_file );
         if ((ULONG_PTR)base != reply->base) base = NULL;
+        if ((ULONG_PTR)reloc_base != reply->reloc_base) reloc_base = NULL;
     }
     SERVER_END_REQ;
     if (res) return res;
@@ -2637,14 +3073,14 @@ NTSTATUS WINAPI NtMapViewOfSection( HANDLE handle, HANDLE process, PVOID *addr_p
 
             if ((res = server_get_unix_fd( shared_file, FILE_READ_DATA|FILE_WRITE_DATA,
                                            &shared_fd, &shared_needs_close, NULL, NULL ))) goto done;
-            res = map_image( handle, unix_handle, base, size, mask, header_size,
+            res = map_image( handle, unix_handle, base, reloc_base, size, mask, header_size,
                              shared_fd, dup_mapping, map_vprot, addr_ptr );
             if (shared_needs_close) close( shared_fd );
             close_handle( shared_file );
         }
         else
         {
-            res = map_image( handle, unix_handle, base, size, mask, header_size,
+            res = map_image( handle, unix_handle, base, reloc_base, size, mask, header_size,
                              -1, dup_mapping, map_vprot, addr_ptr );
         }
         if (needs_close) close( unix_handle );
@@ -2829,13 +3265,19 @@ NTSTATUS WINAPI NtGetWriteWatch( HANDLE process, ULONG flags, PVOID base, SIZE_T
         char *addr = base;
         char *end = addr + size;
 
-        while (pos < *count && addr < end)
+        if (kernel_write_watch)
+            pos = kernel_get_write_watches( view, base, size, addresses, *count,
+                                            flags & WRITE_WATCH_FLAG_RESET );
+        else
         {
-            BYTE prot = view->prot[(addr - (char *)view->base) >> page_shift];
-            if (!(prot & VPROT_WRITEWATCH)) addresses[pos++] = addr;
-            addr += page_size;
+            while (pos < *count && addr < end)
+            {
+                BYTE prot = view->prot[(addr - (char *)view->base) >> page_shift];
+                if (!(prot & VPROT_WRITEWATCH)) addresses[pos++] = addr;
+                addr += page_size;
+            }
+            if (flags & WRITE_WATCH_FLAG_RESET) reset_write_watches( view, base, addr - (char *)base );
         }
-        if (flags & WRITE_WATCH_FLAG_RESET) reset_write_watches( view, base, addr - (char *)base );
         *count = pos;
         *granularity = page_size;
     }
@@ -2875,6 +3317,107 @@ NTSTATUS WINAPI NtResetWriteWatch( HANDLE process, PVOID base, SIZE_T size )
 }
 
 
+#if defined(__linux__) && defined(HAVE_SYS_UIO_H) && defined(__NR_process_vm_readv) && defined(__NR_process_vm_writev)
+
+/***********************************************************************
+ *           process_vm_denied
+ *
+ * Check if the kernel policy doesn't let us access the process memory.
+ * Yama ptrace_scope 1 only allows access to descendants, so denied
+ * processes are remembered by handle; a stale entry only means going
+ * through the server again. Scope 2 and 3 deny everything.
+ */
+static int vm_copy_unsupported;
+static int vm_ptrace_scope = -1;
+static HANDLE vm_denied_handles[16];
+static unsigned int vm_denied_pos;
+
+static BOOL process_vm_denied( HANDLE process )
+{
+    unsigned int i;
+
+    if (vm_ptrace_scope == -1)
+    {
+        char buffer[4] = "0";
+        int fd = open( "/proc/sys/kernel/yama/ptrace_scope", O_RDONLY );
+
+        if (fd != -1)
+        {
+            if (read( fd, buffer, sizeof(buffer) - 1 ) <= 0) buffer[0] = '0';
+            close( fd );
+        }
+        vm_ptrace_scope = buffer[0] - '0';
+    }
+    if (vm_ptrace_scope >= 2) return TRUE;
+    for (i = 0; i < sizeof(vm_denied_handles) / sizeof(vm_denied_handles[0]); i++)
+        if (vm_denied_handles[i] == process) return TRUE;
+    return FALSE;
+}
+
+/***********************************************************************
+ *           process_vm_copy
+ *
+ * Copy memory from or to another process directly with process_vm_readv/writev.
+ * The server only checks the handle access and returns the Unix pid.
+ * Returns FALSE if the whole range couldn't be copied, the caller then
+ * goes through the server, which can also access protected pages.
+ *
+ * The process may exit and its pid be reused between the server call and
+ * the copy. The kernel then applies its ptrace access checks to the new
+ * process, so this can only reach another process of the same user that
+ * we could already attach to; the server has the same window between
+ * looking up the pid and attaching with ptrace.
+ */
+static BOOL process_vm_copy( HANDLE process, ULONG access, void *addr, void *buffer, SIZE_T size )
+{
+    struct iovec local, remote;
+    int unix_pid = -1;
+    ssize_t ret;
+
+    if (!size || vm_copy_unsupported) return FALSE;
+
+    if (process == NtCurrentProcess()) unix_pid = getpid();
+    else
+    {
+        if (process_vm_denied( process )) return FALSE;
+
+        SERVER_START_REQ( get_process_vm_pid )
+        {
+            req->handle = wine_server_obj_handle( process );
+            req->access = access;
+            if (!wine_server_call( req )) unix_pid = reply->unix_pid;
+        }
+        SERVER_END_REQ;
+        if (unix_pid == -1) return FALSE;
+    }
+
+    local.iov_base  = buffer;
+    local.iov_len   = size;
+    remote.iov_base = addr;
+    remote.iov_len  = size;
+    if (access == PROCESS_VM_READ)
+        ret = syscall( __NR_process_vm_readv, unix_pid, &local, 1, &remote, 1, 0 );
+    else
+        ret = syscall( __NR_process_vm_writev, unix_pid, &local, 1, &remote, 1, 0 );
+
+    if (ret == -1)
+    {
+        if (errno == ENOSYS) vm_copy_unsupported = 1;
+        else if (errno == EPERM && process != NtCurrentProcess())
+            vm_denied_handles[vm_denied_pos++ % (sizeof(vm_denied_handles) / sizeof(vm_denied_handles[0]))] = process;
+    }
+    return ret == size;
+}
+
+#else
+
+static inline BOOL process_vm_copy( HANDLE process, ULONG access, void *addr, void *buffer, SIZE_T size )
+{
+    return FALSE;
+}
+
+#endif
+
 /***********************************************************************
  *             NtReadVirtualMemory   (NTDLL.@)
  *             ZwReadVirtualMemory   (NTDLL.@)
@@ -2886,6 +3429,11 @@ NTSTATUS WINAPI NtReadVirtualMemory( HANDLE process, const void *addr, void *buf
 
     if (virtual_check_buffer_for_write( buffer, size ))
     {
+        if (process_vm_copy( process, PROCESS_VM_READ, (void *)addr, buffer, size ))
+        {
+            if (bytes_read) *bytes_read = size;
+            return STATUS_SUCCESS;
+        }
         SERVER_START_REQ( read_process_memory )
         {
             req->handle = wine_server_obj_handle( process );
@@ -2916,6 +3464,11 @@ NTSTATUS WINAPI NtWriteVirtualMemory( HANDLE process, void *addr, const void *bu
 
     if (virtual_check_buffer_for_read( buffer, size ))
     {
+        if (process_vm_copy( process, PROCESS_VM_WRITE, addr, (void *)buffer, size ))
+        {
+            if (bytes_written) *bytes_written = size;
+            return STATUS_SUCCESS;
+        }
         SERVER_START_REQ( write_process_memory )
         {
             req->handle     = wine_server_obj_handle( process );
@@ -2772,6 +2772,7 @@ static BOOL peek_message( MSG *msg, HWND hwnd, UINT first, UINT last, UINT flags
                 info.msg.pt.y    = reply->y;
                 hw_id            = 0;
                 thread_info->active_hooks = reply->active_hooks;
+                thread_info->queue_idle = FALSE;
             }
             else buffer_size = reply->total;
         }
@@ -2784,6 +2785,8 @@ static BOOL peek_message( MSG *msg, HWND hwnd, UINT first, UINT last, UINT flags
             {
                 thread_info->wake_mask = changed_mask & (QS_SENDMESSAGE | QS_SMRESULT);
                 thread_info->changed_mask = changed_mask;
+                thread_info->queue_idle = TRUE;
+                thread_info->idle_time = GetTickCount();
             }
             if (res != STATUS_BUFFER_OVERFLOW) return FALSE;
             if (!(buffer = HeapAlloc( GetProcessHeap(), 0, buffer_size ))) return FALSE;
@@ -2975,6 +2978,51 @@ static inline void process_sent_messages(void)
 }
 
 
+/***********************************************************************
+ *           init_queue_shm
+ *
+ * Map the queue state shared with the server, if enabled with WINEQUEUESHM.
+ */
+static void init_queue_shm( struct user_thread_info *thread_info )
+{
+    static const struct queue_shm *area;
+    static int enabled = -1;
+    HANDLE mapping = 0;
+    unsigned int index = 0;
+    NTSTATUS status;
+
+    if (enabled == -1)
+    {
+        char buffer[16];
+        enabled = GetEnvironmentVariableA( "WINEQUEUESHM", buffer, sizeof(buffer) ) &&
+                  atoi( buffer );
+    }
+    if (!enabled) return;
+
+    SERVER_START_REQ( get_queue_shm )
+    {
+        req->map = !area;
+        if (!(status = wine_server_call( req )))
+        {
+            mapping = wine_server_ptr_handle( reply->handle );
+            index   = reply->index;
+        }
+    }
+    SERVER_END_REQ;
+    if (status) return;
+
+    if (mapping)
+    {
+        void *ptr = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+
+        if (ptr && InterlockedCompareExchangePointer( (void **)&area, ptr, NULL ))
+            UnmapViewOfFile( ptr );
+        CloseHandle( mapping );
+    }
+    if (area) thread_info->queue_shm = &area[index];
+}
+
+
 /***********************************************************************
  *           get_server_queue_handle
  *
@@ -2995,11 +3043,31 @@ static HANDLE get_server_queue_handle(void)
         SERVER_END_REQ;
         thread_info->server_queue = ret;
         if (!ret) ERR( "Cannot get server thread queue\n" );
+        else init_queue_shm( thread_info );
     }
     return ret;
 }
 
 
+/***********************************************************************
+ *           is_queue_idle
+ *
+ * Check in the queue state shared with the server that a get_message call
+ * would not find anything, so that polling an empty queue doesn't need a server call.
+ */
+static BOOL is_queue_idle(void)
+{
+    struct user_thread_info *thread_info = get_user_thread_info();
+
+    if (!thread_info->queue_idle) return FALSE;
+    get_server_queue_handle();
+    if (!thread_info->queue_shm) return FALSE;
+    /* the server uses get_message calls to detect hung threads, so still call it from time to time */
+    if (GetTickCount() - thread_info->idle_time > 1000) return FALSE;
+    return !thread_info->queue_shm->wake_bits;
+}
+
+
 /***********************************************************************
  *           wait_message_reply
  *
@@ -3048,12 +3116,20 @@ static DWORD wait_objects( DWORD count, const HANDLE *handles, DWORD timeout,
                            DWORD wake_mask, DWORD changed_mask, DWORD flags )
 {
     struct user_thread_info *thread_info = get_user_thread_info();
+    const volatile struct queue_shm *shm = thread_info->queue_shm;
     DWORD ret;
 
     assert( count );  /* we must have at least the server queue */
 
     flush_window_surfaces( TRUE );
 
+    /* polling only the queue, check its shared state before asking the server */
+    if (shm && count == 1 && !timeout && !(flags & MWMO_ALERTABLE) &&
+        thread_info->wake_mask == wake_mask && thread_info->changed_mask == changed_mask &&
+        !(shm->wake_bits & wake_mask) && !(shm->changed_bits & changed_mask) &&
+        wow_handlers.wait_message( 0, NULL, 0, changed_mask, flags ) == WAIT_TIMEOUT)
+        return WAIT_TIMEOUT;
+
     if (thread_info->wake_mask != wake_mask || thread_info->changed_mask != changed_mask)
     {
         SERVER_START_REQ( set_queue_mask )
@@ -3767,7 +3843,7 @@ BOOL WINAPI DECLSPEC_HOTPATCH PeekMessageW( MSG *msg_out, HWND hwnd, UINT first,
     USER_CheckNotLock();
     check_for_driver_events( 0 );
 
-    if (!peek_message( &msg, hwnd, first, last, flags, 0 ))
+    if (is_queue_idle() || !peek_message( &msg, hwnd, first, last, flags, 0 ))
     {
         DWORD ret;
 
@@ -791,6 +791,139 @@ ULONG WIN_SetStyle( HWND hwnd, ULONG set_bits, ULONG clear_bits )
 }
 
 
+/***********************************************************************
+ *           get_window_shm_table
+ *
+ * Map the window states shared by the server, if enabled with WINEWINDOWSHM.
+ */
+static const volatile struct window_shm *get_window_shm_table(void)
+{
+    static const struct window_shm *table;
+    static int enabled = -1;
+    HANDLE mapping = 0;
+    void *ptr;
+
+    if (table) return table;
+    if (enabled == -1)
+    {
+        char buffer[16];
+        enabled = GetEnvironmentVariableA( "WINEWINDOWSHM", buffer, sizeof(buffer) ) &&
+                  atoi( buffer );
+    }
+    if (!enabled) return NULL;
+
+    SERVER_START_REQ( get_window_shm )
+    {
+        if (!wine_server_call( req )) mapping = wine_server_ptr_handle( reply->handle );
+    }
+    SERVER_END_REQ;
+
+    if (mapping)
+    {
+        if ((ptr = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 )) &&
+            InterlockedCompareExchangePointer( (void **)&table, ptr, NULL ))
+            UnmapViewOfFile( ptr );
+        CloseHandle( mapping );
+    }
+    if (!table) enabled = 0;
+    return table;
+}
+
+
+/***********************************************************************
+ *           get_shared_window
+ *
+ * Get a consistent copy of the window state shared by the server.
+ * Return FALSE if it's not available; info->handle is 0 if hwnd is not a window.
+ */
+static BOOL get_shared_window( HWND hwnd, struct window_shm *info )
+{
+    const volatile struct window_shm *table, *shm;
+    WORD generation = HIWORD(hwnd);
+    unsigned int seq;
+
+    if (LOWORD(hwnd) < FIRST_USER_HANDLE || LOWORD(hwnd) > LAST_USER_HANDLE) return FALSE;
+    if (!(table = get_window_shm_table())) return FALSE;
+
+    shm = &table[(LOWORD(hwnd) - FIRST_USER_HANDLE) >> 1];
+    do
+    {
+        while ((seq = shm->seq) & 1) SwitchToThread();  /* being updated by the server */
+        __sync_synchronize();
+        *info = *(const struct window_shm *)shm;
+        __sync_synchronize();
+    } while (shm->seq != seq);
+
+    /* same check as the server, generations 0 and 0xffff match any window */
+    if (generation && generation != 0xffff && HIWORD(info->handle) != generation) info->handle = 0;
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           get_shared_window_rects
+ *
+ * Get the rectangles of a window from the window states shared by the server.
+ */
+static BOOL get_shared_window_rects( HWND hwnd, enum coords_relative relative,
+                                     RECT *rectWindow, RECT *rectClient )
+{
+    struct window_shm info;
+    RECT window_rect, client_rect, rect;
+    int depth = 0;
+
+    if (!get_shared_window( hwnd, &info ) || !info.handle) return FALSE;
+
+    SetRect( &window_rect, info.window_rect.left, info.window_rect.top,
+             info.window_rect.right, info.window_rect.bottom );
+    SetRect( &client_rect, info.client_rect.left, info.client_rect.top,
+             info.client_rect.right, info.client_rect.bottom );
+
+    switch (relative)
+    {
+    case COORDS_CLIENT:
+        rect = client_rect;
+        OffsetRect( &window_rect, -rect.left, -rect.top );
+        OffsetRect( &client_rect, -rect.left, -rect.top );
+        if (info.ex_style & WS_EX_LAYOUTRTL) mirror_rect( &rect, &window_rect );
+        break;
+    case COORDS_WINDOW:
+        rect = window_rect;
+        OffsetRect( &window_rect, -rect.left, -rect.top );
+        OffsetRect( &client_rect, -rect.left, -rect.top );
+        if (info.ex_style & WS_EX_LAYOUTRTL) mirror_rect( &rect, &client_rect );
+        break;
+    case COORDS_PARENT:
+        if (!info.parent) break;
+        if (!get_shared_window( wine_server_ptr_handle( info.parent ), &info ) || !info.handle) return FALSE;
+        if (info.ex_style & WS_EX_LAYOUTRTL)
+        {
+            SetRect( &rect, info.client_rect.left, info.client_rect.top,
+                     info.client_rect.right, info.client_rect.bottom );
+            mirror_rect( &rect, &window_rect );
+            mirror_rect( &rect, &client_rect );
+        }
+        break;
+    case COORDS_SCREEN:
+        while (info.parent)
+        {
+            /* give up on very deep trees, they may be changing while we walk them */
+            if (++depth > 64) return FALSE;
+            if (!get_shared_window( wine_server_ptr_handle( info.parent ), &info ) || !info.handle) return FALSE;
+            if (!info.parent) break;  /* desktop window */
+            OffsetRect( &window_rect, info.client_rect.left, info.client_rect.top );
+            OffsetRect( &client_rect, info.client_rect.left, info.client_rect.top );
+        }
+        break;
+    default:
+        return FALSE;
+    }
+    if (rectWindow) *rectWindow = window_rect;
+    if (rectClient) *rectClient = client_rect;
+    return TRUE;
+}
+
+
 /***********************************************************************
  *           WIN_GetRectangles
  *
@@ -898,6 +1031,8 @@ BOOL WIN_GetRectangles( HWND hwnd, enum coords_relative relative, RECT *rectWind
     }
 
 other_process:
+    if (get_shared_window_rects( hwnd, relative, rectWindow, rectClient )) return TRUE;
+
     SERVER_START_REQ( get_window_rectangles )
     {
         req->handle = wine_server_user_handle( hwnd );
@@ -2223,11 +2358,24 @@ static LONG_PTR WIN_GetWindowLong( HWND hwnd, INT offset, UINT size, BOOL unicod
 
     if (wndPtr == WND_OTHER_PROCESS || wndPtr == WND_DESKTOP)
     {
+        struct window_shm info;
+
         if (offset == GWLP_WNDPROC)
         {
             SetLastError( ERROR_ACCESS_DENIED );
             return 0;
         }
+        if (offset < 0 && get_shared_window( hwnd, &info ) && info.handle)
+        {
+            switch(offset)
+            {
+            case GWL_STYLE:      return info.style;
+            case GWL_EXSTYLE:    return info.ex_style;
+            case GWLP_ID:        return info.id;
+            case GWLP_HINSTANCE: return (ULONG_PTR)wine_server_get_ptr( info.instance );
+            case GWLP_USERDATA:  return info.user_data;
+            }
+        }
         SERVER_START_REQ( set_window_info )
         {
             req->handle = wine_server_user_handle( hwnd );
@@ -2812,6 +2960,7 @@ INT WINAPI GetWindowTextLengthW( HWND hwnd )
  */
 BOOL WINAPI IsWindow( HWND hwnd )
 {
+    struct window_shm info;
     WND *ptr;
     BOOL ret;
 
@@ -2825,6 +2974,13 @@ BOOL WINAPI IsWindow( HWND hwnd )
     }
 
     /* check other processes */
+    if (get_shared_window( hwnd, &info ))
+    {
+        if (info.handle) return TRUE;
+        SetLastError( ERROR_INVALID_WINDOW_HANDLE );
+        return FALSE;
+    }
+
     SERVER_START_REQ( get_window_info )
     {
         req->handle = wine_server_user_handle( hwnd );
@@ -2840,6 +2996,7 @@ BOOL WINAPI IsWindow( HWND hwnd )
  */
 DWORD WINAPI GetWindowThreadProcessId( HWND hwnd, LPDWORD process )
 {
+    struct window_shm info;
     WND *ptr;
     DWORD tid = 0;
 
@@ -2859,6 +3016,12 @@ DWORD WINAPI GetWindowThreadProcessId( HWND hwnd, LPDWORD process )
     }
 
     /* check other processes */
+    if (get_shared_window( hwnd, &info ) && info.handle)
+    {
+        if (process) *process = info.pid;
+        return info.tid;
+    }
+
     SERVER_START_REQ( get_window_info )
     {
         req->handle = wine_server_user_handle( hwnd );
@@ -2878,6 +3041,7 @@ DWORD WINAPI GetWindowThreadProcessId( HWND hwnd, LPDWORD process )
  */
 HWND WINAPI GetParent( HWND hwnd )
 {
+    struct window_shm info;
     WND *wndPtr;
     HWND retvalue = 0;
 
@@ -2887,7 +3051,12 @@ HWND WINAPI GetParent( HWND hwnd )
         return 0;
     }
     if (wndPtr == WND_DESKTOP) return 0;
-    if (wndPtr == WND_OTHER_PROCESS)
+    if (wndPtr == WND_OTHER_PROCESS && get_shared_window( hwnd, &info ) && info.handle)
+    {
+        if (info.style & WS_POPUP) retvalue = wine_server_ptr_handle( info.owner );
+        else if (info.style & WS_CHILD) retvalue = wine_server_ptr_handle( info.parent );
+    }
+    else if (wndPtr == WND_OTHER_PROCESS)
     {
         LONG style = GetWindowLongW( hwnd, GWL_STYLE );
         if (style & (WS_POPUP | WS_CHILD))
@@ -133,7 +133,10 @@ typedef struct
     LFANDSIZE lfsz;
     gsCacheEntryFormat *format[GLYPH_NBTYPES][AA_MAXVALUE];
     INT count;
-    INT next;
+    INT next;          /* next entry in the free list */
+    INT hash_next;     /* next entry in the hash bucket */
+    DWORD last_use;    /* value of glyphset_clock when last looked up */
+    DWORD size;        /* bytes of glyph data uploaded to the server */
 } gsCacheEntry;
 
 struct xrender_physdev
@@ -160,9 +163,33 @@ static const struct gdi_dc_funcs xrender_funcs;
 static gsCacheEntry *glyphsetCache = NULL;
 static DWORD glyphsetCacheSize = 0;
 static INT lastfree = -1;
-static INT mru = -1;
 
 #define INIT_CACHE_SIZE 10
+#define GLYPHSET_HASH_SIZE 64
+#define GLYPHSET_CACHE_MAX_SIZE (16 * 1024 * 1024)  /* glyph data kept in unused glyphsets */
+
+static INT glyphset_hash[GLYPHSET_HASH_SIZE];
+static DWORD glyphset_clock;
+static DWORD glyphset_cache_bytes;
+
+/* usage statistics, reported on the xrender channel */
+static unsigned int glyphset_hits, glyphset_misses, glyphset_evictions;
+static unsigned int glyph_uploads, glyph_upload_batches;
+
+/* glyphs waiting to be sent with a single XRenderAddGlyphs call */
+#define GLYPH_BATCH_COUNT 64
+#define GLYPH_BATCH_SIZE  (64 * 1024)
+
+struct glyph_batch
+{
+    gsCacheEntryFormat *format;
+    unsigned int        count;
+    unsigned int        size;        /* bytes of glyph data */
+    unsigned int        alloc_size;  /* allocated size of the data buffer */
+    char               *data;
+    Glyph               gids[GLYPH_BATCH_COUNT];
+    XGlyphInfo          gis[GLYPH_BATCH_COUNT];
+};
 
 static void *xrender_handle;
 
@@ -371,6 +398,7 @@ const struct gdi_dc_funcs *X11DRV_XRender_Init(void)
         glyphsetCache[i].count = -1;
     }
     glyphsetCache[i-1].next = -1;
+    for (i = 0; i < GLYPHSET_HASH_SIZE; i++) glyphset_hash[i] = -1;
 
     return &xrender_funcs;
 }
@@ -588,31 +616,25 @@ static BOOL fontcmp(LFANDSIZE *p1, LFANDSIZE *p2)
 
 static int LookupEntry(LFANDSIZE *plfsz)
 {
-  int i, prev_i = -1;
-
-  for(i = mru; i >= 0; i = glyphsetCache[i].next) {
-    TRACE("%d\n", i);
-    if(glyphsetCache[i].count == -1) break; /* reached free list so stop */
+  int i;
 
+  for(i = glyphset_hash[plfsz->hash % GLYPHSET_HASH_SIZE]; i >= 0; i = glyphsetCache[i].hash_next) {
     if(!fontcmp(&glyphsetCache[i].lfsz, plfsz)) {
       glyphsetCache[i].count++;
-      if(prev_i >= 0) {
-	glyphsetCache[prev_i].next = glyphsetCache[i].next;
-	glyphsetCache[i].next = mru;
-	mru = i;
-      }
+      glyphsetCache[i].last_use = ++glyphset_clock;
+      glyphset_hits++;
       TRACE("found font in cache %d\n", i);
       return i;
     }
-    prev_i = i;
   }
+  glyphset_misses++;
   TRACE("font not in cache\n");
   return -1;
 }
 
 static void FreeEntry(int entry)
 {
-    int type, format;
+    int type, format, *ptr;
 
     for (type = 0; type < GLYPH_NBTYPES; type++)
     {
@@ -640,45 +662,63 @@ static void FreeEntry(int entry)
             glyphsetCache[entry].format[type][format] = NULL;
         }
     }
+
+    /* remove it from its hash bucket */
+    ptr = &glyphset_hash[glyphsetCache[entry].lfsz.hash % GLYPHSET_HASH_SIZE];
+    while (*ptr != entry) ptr = &glyphsetCache[*ptr].hash_next;
+    *ptr = glyphsetCache[entry].hash_next;
+
+    glyphset_cache_bytes -= glyphsetCache[entry].size;
+    glyphsetCache[entry].size = 0;
+}
+
+/* find the least recently used glyphset that no DC is using */
+static int find_unused_entry(void)
+{
+  int i, best = -1;
+
+  for(i = 0; i < glyphsetCacheSize; i++) {
+    if(glyphsetCache[i].count != 0) continue;
+    if(best == -1 || (int)(glyphsetCache[i].last_use - glyphsetCache[best].last_use) < 0) best = i;
+  }
+  return best;
+}
+
+/* free unused glyphsets until the glyph data fits in the cache limit */
+static void shrink_cache(void)
+{
+  int i;
+
+  while(glyphset_cache_bytes > GLYPHSET_CACHE_MAX_SIZE && (i = find_unused_entry()) >= 0) {
+    TRACE("evicting unused glyphset %d, %u bytes\n", i, glyphsetCache[i].size);
+    FreeEntry(i);
+    glyphsetCache[i].count = -1;
+    glyphsetCache[i].next = lastfree;
+    lastfree = i;
+    glyphset_evictions++;
+  }
 }
 
 static int AllocEntry(void)
 {
-  int best = -1, prev_best = -1, i, prev_i = -1;
+  int best, i;
 
   if(lastfree >= 0) {
     assert(glyphsetCache[lastfree].count == -1);
     glyphsetCache[lastfree].count = 1;
     best = lastfree;
     lastfree = glyphsetCache[lastfree].next;
-    assert(best != mru);
-    glyphsetCache[best].next = mru;
-    mru = best;
-
-    TRACE("empty space at %d, next lastfree = %d\n", mru, lastfree);
-    return mru;
-  }
 
-  for(i = mru; i >= 0; i = glyphsetCache[i].next) {
-    if(glyphsetCache[i].count == 0) {
-      best = i;
-      prev_best = prev_i;
-    }
-    prev_i = i;
+    TRACE("empty space at %d, next lastfree = %d\n", best, lastfree);
+    return best;
   }
 
-  if(best >= 0) {
+  if((best = find_unused_entry()) >= 0) {
     TRACE("freeing unused glyphset at cache %d\n", best);
     FreeEntry(best);
     glyphsetCache[best].count = 1;
-    if(prev_best >= 0) {
-      glyphsetCache[prev_best].next = glyphsetCache[best].next;
-      glyphsetCache[best].next = mru;
-      mru = best;
-    } else {
-      assert(mru == best);
-    }
-    return mru;
+    glyphset_evictions++;
+    return best;
   }
 
   TRACE("Growing cache\n");
@@ -703,10 +743,8 @@ static int AllocEntry(void)
 
   lastfree = glyphsetCache[best].next;
   glyphsetCache[best].count = 1;
-  glyphsetCache[best].next = mru;
-  mru = best;
-  TRACE("new free cache slot at %d\n", mru);
-  return mru;
+  TRACE("new free cache slot at %d\n", best);
+  return best;
 }
 
 static int GetCacheEntry( LFANDSIZE *plfsz )
@@ -719,6 +757,13 @@ static int GetCacheEntry( LFANDSIZE *plfsz )
     ret = AllocEntry();
     entry = glyphsetCache + ret;
     entry->lfsz = *plfsz;
+    entry->last_use = ++glyphset_clock;
+    entry->hash_next = glyphset_hash[plfsz->hash % GLYPHSET_HASH_SIZE];
+    glyphset_hash[plfsz->hash % GLYPHSET_HASH_SIZE] = ret;
+
+    TRACE("glyphsets: %u hits, %u misses, %u evictions, %u bytes; glyphs: %u uploads in %u batches\n",
+          glyphset_hits, glyphset_misses, glyphset_evictions, glyphset_cache_bytes,
+          glyph_uploads, glyph_upload_batches);
     return ret;
 }
 
@@ -727,7 +772,7 @@ static void dec_ref_cache(int index)
     assert(index >= 0);
     TRACE("dec'ing entry %d to %d\n", index, glyphsetCache[index].count - 1);
     assert(glyphsetCache[index].count > 0);
-    glyphsetCache[index].count--;
+    if (!--glyphsetCache[index].count) shrink_cache();
 }
 
 static void lfsz_calc_hash(LFANDSIZE *plfsz)
@@ -996,12 +1041,66 @@ static void xrenderdrv_SetDeviceClipping( PHYSDEV dev, HRGN rgn )
 }
 
 
+/************************************************************************
+ *   flush_glyph_batch
+ *
+ * Send the pending glyphs to the server.  Must be called inside xrender_cs
+ */
+static void flush_glyph_batch( struct glyph_batch *batch )
+{
+    if (!batch->count) return;
+    pXRenderAddGlyphs( gdi_display, batch->format->glyphset, batch->gids, batch->gis, batch->count,
+                       batch->data, batch->size );
+    glyph_upload_batches++;
+    batch->count = 0;
+    batch->size = 0;
+}
+
+/************************************************************************
+ *   add_glyph_to_batch
+ *
+ * Queue a glyph image for upload.  Must be called inside xrender_cs
+ */
+static void add_glyph_to_batch( struct glyph_batch *batch, gsCacheEntryFormat *formatEntry, Glyph gid,
+                                const XGlyphInfo *gi, const char *data, unsigned int size )
+{
+    if (batch->format != formatEntry || batch->count == GLYPH_BATCH_COUNT ||
+        (batch->count && batch->size + size > GLYPH_BATCH_SIZE))
+        flush_glyph_batch( batch );
+
+    batch->format = formatEntry;
+    if (batch->size + size > batch->alloc_size)
+    {
+        unsigned int new_size = max( batch->size + size, GLYPH_BATCH_SIZE );
+        char *new_data;
+
+        if (batch->data) new_data = HeapReAlloc( GetProcessHeap(), 0, batch->data, new_size );
+        else new_data = HeapAlloc( GetProcessHeap(), 0, new_size );
+        if (!new_data)
+        {
+            /* send it on its own */
+            flush_glyph_batch( batch );
+            pXRenderAddGlyphs( gdi_display, formatEntry->glyphset, &gid, gi, 1, data, size );
+            glyph_upload_batches++;
+            return;
+        }
+        batch->data = new_data;
+        batch->alloc_size = new_size;
+    }
+    memcpy( batch->data + batch->size, data, size );
+    batch->gids[batch->count] = gid;
+    batch->gis[batch->count] = *gi;
+    batch->count++;
+    batch->size += size;
+}
+
 /************************************************************************
  *   UploadGlyph
  *
  * Helper to ExtTextOut.  Must be called inside xrender_cs
  */
-static void UploadGlyph(struct xrender_physdev *physDev, UINT glyph, enum glyph_type type)
+static void UploadGlyph(struct xrender_physdev *physDev, UINT glyph, enum glyph_type type,
+                        struct glyph_batch *batch)
 {
     unsigned int buflen;
     char *buf;
@@ -1186,8 +1285,10 @@ static void UploadGlyph(struct xrender_physdev *physDev, UINT glyph, enum glyph_
         if(buflen == 0)
             gi.width = gi.height = 1;
 
-	pXRenderAddGlyphs(gdi_display, formatEntry->glyphset, &gid, &gi, 1,
-                          buflen ? buf : zero, buflen ? buflen : sizeof(zero));
+        add_glyph_to_batch( batch, formatEntry, gid, &gi, buflen ? buf : zero, buflen ? buflen : sizeof(zero) );
+        entry->size += buflen ? buflen : sizeof(zero);
+        glyphset_cache_bytes += buflen ? buflen : sizeof(zero);
+        glyph_uploads++;
     }
 
     HeapFree(GetProcessHeap(), 0, buf);
@@ -1287,6 +1388,7 @@ static BOOL xrenderdrv_ExtTextOut( PHYSDEV dev, INT x, INT y, UINT flags,
     struct xrender_physdev *physdev = get_xrender_dev( dev );
     gsCacheEntry *entry;
     gsCacheEntryFormat *formatEntry;
+    struct glyph_batch batch;
     unsigned int idx;
     Picture pict, tile_pict = 0;
     XGlyphElt16 *elts;
@@ -1325,15 +1427,22 @@ static BOOL xrenderdrv_ExtTextOut( PHYSDEV dev, INT x, INT y, UINT flags,
     entry = glyphsetCache + physdev->cache_index;
     formatEntry = entry->format[type][aa_type_from_flags( physdev->aa_flags )];
 
+    batch.format = NULL;
+    batch.count = batch.size = batch.alloc_size = 0;
+    batch.data = NULL;
     for(idx = 0; idx < count; idx++) {
         if( !formatEntry ) {
-	    UploadGlyph(physdev, wstr[idx], type);
+	    UploadGlyph(physdev, wstr[idx], type, &batch);
             /* re-evaluate format entry since aa_flags may have changed */
             formatEntry = entry->format[type][aa_type_from_flags( physdev->aa_flags )];
         } else if( wstr[idx] >= formatEntry->nrealized || formatEntry->realized[wstr[idx]] == FALSE) {
-	    UploadGlyph(physdev, wstr[idx], type);
+	    UploadGlyph(physdev, wstr[idx], type, &batch);
 	}
     }
+    flush_glyph_batch( &batch );
+    HeapFree( GetProcessHeap(), 0, batch.data );
+    shrink_cache();
+
     if (!formatEntry)
     {
         WARN("could not upload requested glyphs\n");
@@ -50,6 +50,24 @@ struct request_max_size
     int pad[16];
 };
 
+
+#define REQUEST_SHM_SIZE 0x10000
+
+
+struct request_shm
+{
+    int                     state;
+    int                     pad[15];
+    struct request_max_size header;
+};
+
+#define REQUEST_SHM_IDLE    0
+#define REQUEST_SHM_REQUEST 1
+#define REQUEST_SHM_REPLY   2
+#define REQUEST_SHM_DEAD    3
+
+#define REQUEST_SHM_DATA_SIZE (REQUEST_SHM_SIZE - sizeof(struct request_shm))
+
 #define FIRST_USER_HANDLE 0x0020
 #define LAST_USER_HANDLE  0xffef
 
@@ -346,6 +364,61 @@ typedef struct
 } char_info_t;
 
 
+struct inproc_sync
+{
+    int          state;
+    unsigned int type;
+    unsigned int count;
+
+    int          abandoned;
+};
+
+enum inproc_sync_type
+{
+    INPROC_SYNC_NONE,
+    INPROC_SYNC_AUTO_EVENT,
+    INPROC_SYNC_MANUAL_EVENT,
+    INPROC_SYNC_SEMAPHORE,
+    INPROC_SYNC_MUTEX
+};
+
+
+
+#define INPROC_SYNC_SERVER_WAIT  ((int)0x80000000)
+#define INPROC_SYNC_EVENT_SIGNALED 0x00000001
+#define INPROC_SYNC_EVENT_PULSE    0x00000002
+#define INPROC_SYNC_AREA_SIZE      0x100000
+#define INPROC_SYNC_MUTEX_MAX_COUNT 0x80000001
+
+
+struct queue_shm
+{
+    unsigned int wake_bits;
+    unsigned int changed_bits;
+};
+#define QUEUE_SHM_AREA_SIZE        0x10000
+
+
+struct window_shm
+{
+    mod_handle_t   instance;
+    lparam_t       user_data;
+    rectangle_t    window_rect;
+    rectangle_t    client_rect;
+    unsigned int   seq;
+    user_handle_t  handle;
+    user_handle_t  parent;
+    user_handle_t  owner;
+    thread_id_t    tid;
+    process_id_t   pid;
+    unsigned int   style;
+    unsigned int   ex_style;
+    unsigned int   id;
+    int            __pad;
+};
+#define WINDOW_SHM_COUNT ((LAST_USER_HANDLE - FIRST_USER_HANDLE + 1) >> 1)
+
+
 struct filesystem_event
 {
     int         action;
@@ -809,6 +882,19 @@ struct init_thread_reply
 
 
 
+
+struct init_request_shm_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct init_request_shm_reply
+{
+    struct reply_header __header;
+};
+
+
+
 struct terminate_process_request
 {
     struct request_header __header;
@@ -1369,6 +1455,47 @@ struct open_semaphore_reply
 
 
 
+
+struct init_inproc_sync_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct init_inproc_sync_reply
+{
+    struct reply_header __header;
+};
+
+
+
+struct get_inproc_sync_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+};
+struct get_inproc_sync_reply
+{
+    struct reply_header __header;
+    unsigned int type;
+    unsigned int index;
+    unsigned int access;
+    char __pad_20[4];
+};
+
+
+
+struct set_inproc_event_request
+{
+    struct request_header __header;
+    unsigned int index;
+};
+struct set_inproc_event_reply
+{
+    struct reply_header __header;
+};
+
+
+
 struct create_file_request
 {
     struct request_header __header;
@@ -2190,12 +2317,29 @@ struct get_mapping_info_reply
     int          protect;
     int          header_size;
     client_ptr_t base;
+    client_ptr_t reloc_base;
     obj_handle_t mapping;
     obj_handle_t shared_file;
 };
 
 
 
+struct get_mapping_reloc_file_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+    client_ptr_t base;
+};
+struct get_mapping_reloc_file_reply
+{
+    struct reply_header __header;
+    client_ptr_t reloc_base;
+    obj_handle_t handle;
+    char __pad_20[4];
+};
+
+
+
 struct get_mapping_committed_range_request
 {
     struct request_header __header;
@@ -2421,6 +2565,22 @@ struct write_process_memory_reply
 
 
 
+struct get_process_vm_pid_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+    unsigned int access;
+    char __pad_20[4];
+};
+struct get_process_vm_pid_reply
+{
+    struct reply_header __header;
+    int          unix_pid;
+    char __pad_12[4];
+};
+
+
+
 struct create_key_request
 {
     struct request_header __header;
@@ -2874,6 +3034,20 @@ struct get_msg_queue_reply
 
 
 
+struct get_queue_shm_request
+{
+    struct request_header __header;
+    int          map;
+};
+struct get_queue_shm_reply
+{
+    struct reply_header __header;
+    obj_handle_t handle;
+    unsigned int index;
+};
+
+
+
 struct set_queue_fd_request
 {
     struct request_header __header;
@@ -3457,6 +3631,20 @@ struct set_window_info_reply
 
 
 
+struct get_window_shm_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_window_shm_reply
+{
+    struct reply_header __header;
+    obj_handle_t   handle;
+    char __pad_12[4];
+};
+
+
+
 struct set_parent_request
 {
     struct request_header __header;
@@ -5125,6 +5313,20 @@ struct add_fd_completion_reply
 
 
 
+struct get_fd_completion_request
+{
+    struct request_header __header;
+    obj_handle_t   handle;
+};
+struct get_fd_completion_reply
+{
+    struct reply_header __header;
+    int            bound;
+    char __pad_12[4];
+};
+
+
+
 struct set_fd_disp_info_request
 {
     struct request_header __header;
@@ -5394,6 +5596,7 @@ enum request
     REQ_get_startup_info,
     REQ_init_process_done,
     REQ_init_thread,
+    REQ_init_request_shm,
     REQ_terminate_process,
     REQ_terminate_thread,
     REQ_get_process_info,
@@ -5428,6 +5631,9 @@ enum request
     REQ_release_semaphore,
     REQ_query_semaphore,
     REQ_open_semaphore,
+    REQ_init_inproc_sync,
+    REQ_get_inproc_sync,
+    REQ_set_inproc_event,
     REQ_create_file,
     REQ_open_file_object,
     REQ_alloc_file_handle,
@@ -5471,6 +5677,7 @@ enum request
     REQ_create_mapping,
     REQ_open_mapping,
     REQ_get_mapping_info,
+    REQ_get_mapping_reloc_file,
     REQ_get_mapping_committed_range,
     REQ_add_mapping_committed_range,
     REQ_create_snapshot,
@@ -5485,6 +5692,7 @@ enum request
     REQ_set_debugger_kill_on_exit,
     REQ_read_process_memory,
     REQ_write_process_memory,
+    REQ_get_process_vm_pid,
     REQ_create_key,
     REQ_open_key,
     REQ_delete_key,
@@ -5514,6 +5722,7 @@ enum request
     REQ_empty_atom_table,
     REQ_init_atom_table,
     REQ_get_msg_queue,
+    REQ_get_queue_shm,
     REQ_set_queue_fd,
     REQ_set_queue_mask,
     REQ_get_queue_status,
@@ -5546,6 +5755,7 @@ enum request
     REQ_set_window_owner,
     REQ_get_window_info,
     REQ_set_window_info,
+    REQ_get_window_shm,
     REQ_set_parent,
     REQ_get_window_parents,
     REQ_get_window_children,
@@ -5644,6 +5854,7 @@ enum request
     REQ_query_completion,
     REQ_set_completion_info,
     REQ_add_fd_completion,
+    REQ_get_fd_completion,
     REQ_set_fd_disp_info,
     REQ_set_fd_name_info,
     REQ_get_window_layered_info,
@@ -5674,6 +5885,7 @@ union generic_request
     struct get_startup_info_request get_startup_info_request;
     struct init_process_done_request init_process_done_request;
     struct init_thread_request init_thread_request;
+    struct init_request_shm_request init_request_shm_request;
     struct terminate_process_request terminate_process_request;
     struct terminate_thread_request terminate_thread_request;
     struct get_process_info_request get_process_info_request;
@@ -5708,6 +5920,9 @@ union generic_request
     struct release_semaphore_request release_semaphore_request;
     struct query_semaphore_request query_semaphore_request;
     struct open_semaphore_request open_semaphore_request;
+    struct init_inproc_sync_request init_inproc_sync_request;
+    struct get_inproc_sync_request get_inproc_sync_request;
+    struct set_inproc_event_request set_inproc_event_request;
     struct create_file_request create_file_request;
     struct open_file_object_request open_file_object_request;
     struct alloc_file_handle_request alloc_file_handle_request;
@@ -5751,6 +5966,7 @@ union generic_request
     struct create_mapping_request create_mapping_request;
     struct open_mapping_request open_mapping_request;
     struct get_mapping_info_request get_mapping_info_request;
+    struct get_mapping_reloc_file_request get_mapping_reloc_file_request;
     struct get_mapping_committed_range_request get_mapping_committed_range_request;
     struct add_mapping_committed_range_request add_mapping_committed_range_request;
     struct create_snapshot_request create_snapshot_request;
@@ -5765,6 +5981,7 @@ union generic_request
     struct set_debugger_kill_on_exit_request set_debugger_kill_on_exit_request;
     struct read_process_memory_request read_process_memory_request;
     struct write_process_memory_request write_process_memory_request;
+    struct get_process_vm_pid_request get_process_vm_pid_request;
     struct create_key_request create_key_request;
     struct open_key_request open_key_request;
     struct delete_key_request delete_key_request;
@@ -5794,6 +6011,7 @@ union generic_request
     struct empty_atom_table_request empty_atom_table_request;
     struct init_atom_table_request init_atom_table_request;
     struct get_msg_queue_request get_msg_queue_request;
+    struct get_queue_shm_request get_queue_shm_request;
     struct set_queue_fd_request set_queue_fd_request;
     struct set_queue_mask_request set_queue_mask_request;
     struct get_queue_status_request get_queue_status_request;
@@ -5826,6 +6044,7 @@ union generic_request
     struct set_window_owner_request set_window_owner_request;
     struct get_window_info_request get_window_info_request;
     struct set_window_info_request set_window_info_request;
+    struct get_window_shm_request get_window_shm_request;
     struct set_parent_request set_parent_request;
     struct get_window_parents_request get_window_parents_request;
     struct get_window_children_request get_window_children_request;
@@ -5924,6 +6143,7 @@ union generic_request
     struct query_completion_request query_completion_request;
     struct set_completion_info_request set_completion_info_request;
     struct add_fd_completion_request add_fd_completion_request;
+    struct get_fd_completion_request get_fd_completion_request;
     struct set_fd_disp_info_request set_fd_disp_info_request;
     struct set_fd_name_info_request set_fd_name_info_request;
     struct get_window_layered_info_request get_window_layered_info_request;
@@ -5952,6 +6172,7 @@ union generic_reply
     struct get_startup_info_reply get_startup_info_reply;
     struct init_process_done_reply init_process_done_reply;
     struct init_thread_reply init_thread_reply;
+    struct init_request_shm_reply init_request_shm_reply;
     struct terminate_process_reply terminate_process_reply;
     struct terminate_thread_reply terminate_thread_reply;
     struct get_process_info_reply get_process_info_reply;
@@ -5986,6 +6207,9 @@ union generic_reply
     struct release_semaphore_reply release_semaphore_reply;
     struct query_semaphore_reply query_semaphore_reply;
     struct open_semaphore_reply open_semaphore_reply;
+    struct init_inproc_sync_reply init_inproc_sync_reply;
+    struct get_inproc_sync_reply get_inproc_sync_reply;
+    struct set_inproc_event_reply set_inproc_event_reply;
     struct create_file_reply create_file_reply;
     struct open_file_object_reply open_file_object_reply;
     struct alloc_file_handle_reply alloc_file_handle_reply;
@@ -6029,6 +6253,7 @@ union generic_reply
     struct create_mapping_reply create_mapping_reply;
     struct open_mapping_reply open_mapping_reply;
     struct get_mapping_info_reply get_mapping_info_reply;
+    struct get_mapping_reloc_file_reply get_mapping_reloc_file_reply;
     struct get_mapping_committed_range_reply get_mapping_committed_range_reply;
     struct add_mapping_committed_range_reply add_mapping_committed_range_reply;
     struct create_snapshot_reply create_snapshot_reply;
@@ -6043,6 +6268,7 @@ union generic_reply
     struct set_debugger_kill_on_exit_reply set_debugger_kill_on_exit_reply;
     struct read_process_memory_reply read_process_memory_reply;
     struct write_process_memory_reply write_process_memory_reply;
+    struct get_process_vm_pid_reply get_process_vm_pid_reply;
     struct create_key_reply create_key_reply;
     struct open_key_reply open_key_reply;
     struct delete_key_reply delete_key_reply;
@@ -6072,6 +6298,7 @@ union generic_reply
     struct empty_atom_table_reply empty_atom_table_reply;
     struct init_atom_table_reply init_atom_table_reply;
     struct get_msg_queue_reply get_msg_queue_reply;
+    struct get_queue_shm_reply get_queue_shm_reply;
     struct set_queue_fd_reply set_queue_fd_reply;
     struct set_queue_mask_reply set_queue_mask_reply;
     struct get_queue_status_reply get_queue_status_reply;
@@ -6104,6 +6331,7 @@ union generic_reply
     struct set_window_owner_reply set_window_owner_reply;
     struct get_window_info_reply get_window_info_reply;
     struct set_window_info_reply set_window_info_reply;
+    struct get_window_shm_reply get_window_shm_reply;
     struct set_parent_reply set_parent_reply;
     struct get_window_parents_reply get_window_parents_reply;
     struct get_window_children_reply get_window_children_reply;
@@ -6202,6 +6430,7 @@ union generic_reply
     struct query_completion_reply query_completion_reply;
     struct set_completion_info_reply set_completion_info_reply;
     struct add_fd_completion_reply add_fd_completion_reply;
+    struct get_fd_completion_reply get_fd_completion_reply;
     struct set_fd_disp_info_reply set_fd_disp_info_reply;
     struct set_fd_name_info_reply set_fd_name_info_reply;
     struct get_window_layered_info_reply get_window_layered_info_reply;
@@ -6221,6 +6450,6 @@ union generic_reply
     struct terminate_job_reply terminate_job_reply;
 };
 
-#define SERVER_PROTOCOL_VERSION 504
+#define SERVER_PROTOCOL_VERSION 511
 
 #endif /* __WINE_WINE_SERVER_PROTOCOL_H */
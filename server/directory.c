@@ -124,7 +124,16 @@ static struct object_type *object_type_get_type( struct object *obj )
 
 static void directory_dump( struct object *obj, int verbose )
 {
-    fputs( "Directory\n", stderr );
+    struct directory *dir = (struct directory *)obj;
+    assert( obj->ops == &directory_ops );
+
+    fputs( "Directory", stderr );
+    if (verbose && dir->entries)
+    {
+        fputs( " ", stderr );
+        dump_namespace( dir->entries );
+    }
+    fputc( '\n', stderr );
 }
 
 static struct object_type *directory_get_type( struct object *obj )
@@ -195,7 +204,7 @@ static void directory_destroy( struct object *obj )
 {
     struct directory *dir = (struct directory *)obj;
     assert( obj->ops == &directory_ops );
-    free( dir->entries );
+    free_namespace( dir->entries );
 }
 
 static struct directory *create_directory( struct object *root, const struct unicode_str *name,
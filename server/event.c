@@ -22,6 +22,7 @@
 #include "wine/port.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -32,6 +33,7 @@
 #include "winternl.h"
 
 #include "handle.h"
+#include "process.h"
 #include "thread.h"
 #include "request.h"
 #include "security.h"
@@ -41,22 +43,27 @@ struct event
     struct object  obj;             /* object header */
     int            manual_reset;    /* is it a manual reset event? */
     int            signaled;        /* event has been signaled */
+    struct inproc_sync_ref sync;    /* state shared with the creator process */
+    struct list    shared_entry;    /* entry in the list of events of the shared area */
 };
 
 static void event_dump( struct object *obj, int verbose );
 static struct object_type *event_get_type( struct object *obj );
+static int event_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static void event_remove_queue( struct object *obj, struct wait_queue_entry *entry );
 static int event_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void event_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static unsigned int event_map_access( struct object *obj, unsigned int access );
 static int event_signal( struct object *obj, unsigned int access);
+static void event_destroy( struct object *obj );
 
 static const struct object_ops event_ops =
 {
     sizeof(struct event),      /* size */
     event_dump,                /* dump */
     event_get_type,            /* get_type */
-    add_queue,                 /* add_queue */
-    remove_queue,              /* remove_queue */
+    event_add_queue,           /* add_queue */
+    event_remove_queue,        /* remove_queue */
     event_signaled,            /* signaled */
     event_satisfied,           /* satisfied */
     event_signal,              /* signal */
@@ -69,7 +76,7 @@ static const struct object_ops event_ops =
     default_unlink_name,       /* unlink_name */
     no_open_file,              /* open_file */
     no_close_handle,           /* close_handle */
-    no_destroy                 /* destroy */
+    event_destroy              /* destroy */
 };
 
 
@@ -119,6 +126,7 @@ struct event *create_event( struct object *root, const struct unicode_str *name,
             /* initialize it if it didn't already exist */
             event->manual_reset = manual_reset;
             event->signaled     = initial_state;
+            event->sync.shm     = NULL;
         }
     }
     return event;
@@ -129,8 +137,50 @@ struct event *get_event_obj( struct process *process, obj_handle_t handle, unsig
     return (struct event *)get_handle_obj( process, handle, access, &event_ops );
 }
 
+struct inproc_sync_ref *get_event_inproc_sync( struct object *obj )
+{
+    if (obj->ops != &event_ops) return NULL;
+    return &((struct event *)obj)->sync;
+}
+
+static inline int is_event_signaled( struct event *event )
+{
+    if (event->sync.shm) return (event->sync.shm->state & INPROC_SYNC_EVENT_SIGNALED) != 0;
+    return event->signaled;
+}
+
+/* update the shared state, returning the previous one */
+static int update_shared_event( struct event *event, int set, int clear, int pulse )
+{
+    int state, new_state;
+
+    do
+    {
+        state = event->sync.shm->state;
+        new_state = (state | set) & ~clear;
+        if (pulse)  /* bump the pulse generation, leaving the flags alone */
+            new_state = (new_state & (INPROC_SYNC_SERVER_WAIT | INPROC_SYNC_EVENT_SIGNALED)) |
+                        ((new_state + INPROC_SYNC_EVENT_PULSE) &
+                         ~(INPROC_SYNC_SERVER_WAIT | INPROC_SYNC_EVENT_SIGNALED));
+    } while (update_inproc_sync( &event->sync, new_state, state ) != state);
+    return state;
+}
+
 void pulse_event( struct event *event )
 {
+    if (event->sync.shm)
+    {
+        update_shared_event( event, INPROC_SYNC_EVENT_SIGNALED, 0, 0 );
+        wake_up( &event->obj, !event->manual_reset );
+        if ((update_shared_event( event, 0, INPROC_SYNC_EVENT_SIGNALED, 0 ) & INPROC_SYNC_EVENT_SIGNALED) ||
+            event->manual_reset)
+        {
+            /* no server waiter consumed it, bump the generation to release the client waiters */
+            update_shared_event( event, 0, 0, 1 );
+            wake_inproc_sync( &event->sync, event->manual_reset ? INT_MAX : 1 );
+        }
+        return;
+    }
     event->signaled = 1;
     /* wake up all waiters if manual reset, a single one otherwise */
     wake_up( &event->obj, !event->manual_reset );
@@ -139,6 +189,14 @@ void pulse_event( struct event *event )
 
 void set_event( struct event *event )
 {
+    if (event->sync.shm)
+    {
+        update_shared_event( event, INPROC_SYNC_EVENT_SIGNALED, 0, 0 );
+        wake_up( &event->obj, !event->manual_reset );
+        if (is_event_signaled( event ))
+            wake_inproc_sync( &event->sync, event->manual_reset ? INT_MAX : 1 );
+        return;
+    }
     event->signaled = 1;
     /* wake up all waiters if manual reset, a single one otherwise */
     wake_up( &event->obj, !event->manual_reset );
@@ -146,15 +204,26 @@ void set_event( struct event *event )
 
 void reset_event( struct event *event )
 {
-    event->signaled = 0;
+    if (event->sync.shm) update_shared_event( event, 0, INPROC_SYNC_EVENT_SIGNALED, 0 );
+    else event->signaled = 0;
+}
+
+/* move the event state to the memory shared with the process */
+static void share_event( struct event *event, struct process *process )
+{
+    int state = event->signaled ? INPROC_SYNC_EVENT_SIGNALED : 0;
+
+    alloc_inproc_sync( &event->sync, process,
+                       event->manual_reset ? INPROC_SYNC_MANUAL_EVENT : INPROC_SYNC_AUTO_EVENT, state, 0 );
+    if (event->sync.shm) list_add_tail( get_inproc_sync_events( event->sync.area ), &event->shared_entry );
 }
 
 static void event_dump( struct object *obj, int verbose )
 {
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
-    fprintf( stderr, "Event manual=%d signaled=%d\n",
-             event->manual_reset, event->signaled );
+    fprintf( stderr, "Event manual=%d signaled=%d%s\n",
+             event->manual_reset, is_event_signaled( event ), event->sync.shm ? " shared" : "" );
 }
 
 static struct object_type *event_get_type( struct object *obj )
@@ -164,11 +233,27 @@ static struct object_type *event_get_type( struct object *obj )
     return get_object_type( &str );
 }
 
+static int event_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    if (event->sync.shm) set_inproc_sync_server_wait( &event->sync, 1 );
+    return add_queue( obj, entry );
+}
+
+static void event_remove_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    remove_queue( obj, entry );
+    if (event->sync.shm && list_empty( &obj->wait_queue )) set_inproc_sync_server_wait( &event->sync, 0 );
+}
+
 static int event_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
-    return event->signaled;
+    return is_event_signaled( event );
 }
 
 static void event_satisfied( struct object *obj, struct wait_queue_entry *entry )
@@ -176,7 +261,7 @@ static void event_satisfied( struct object *obj, struct wait_queue_entry *entry
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
     /* Reset if it's an auto-reset event */
-    if (!event->manual_reset) event->signaled = 0;
+    if (!event->manual_reset) reset_event( event );
 }
 
 static unsigned int event_map_access( struct object *obj, unsigned int access )
@@ -202,6 +287,14 @@ static int event_signal( struct object *obj, unsigned int access )
     return 1;
 }
 
+static void event_destroy( struct object *obj )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    if (event->sync.shm) list_remove( &event->shared_entry );
+    free_inproc_sync( &event->sync );
+}
+
 struct keyed_event *create_keyed_event( struct object *root, const struct unicode_str *name,
                                         unsigned int attr, const struct security_descriptor *sd )
 {
@@ -288,8 +381,11 @@ DECL_HANDLER(create_event)
         if (get_error() == STATUS_OBJECT_NAME_EXISTS)
             reply->handle = alloc_handle( current->process, event, req->access, objattr->attributes );
         else
+        {
+            share_event( event, current->process );
             reply->handle = alloc_handle_no_access_check( current->process, event,
                                                           req->access, objattr->attributes );
+        }
         release_object( event );
     }
 
@@ -329,6 +425,22 @@ DECL_HANDLER(event_op)
     release_object( event );
 }
 
+/* signal an event of the process shared area, for I/O completed in the client */
+DECL_HANDLER(set_inproc_event)
+{
+    struct event *event;
+
+    if (!current->process->inproc_sync) return;
+    LIST_FOR_EACH_ENTRY( event, get_inproc_sync_events( current->process->inproc_sync ),
+                         struct event, shared_entry )
+    {
+        if (event->sync.index != req->index) continue;
+        set_event( event );
+        return;
+    }
+    /* the event has been destroyed, nobody can be waiting on it */
+}
+
 /* return details about the event */
 DECL_HANDLER(query_event)
 {
@@ -337,7 +449,7 @@ DECL_HANDLER(query_event)
     if (!(event = get_event_obj( current->process, req->handle, EVENT_QUERY_STATE ))) return;
 
     reply->manual_reset = event->manual_reset;
-    reply->state = event->signaled;
+    reply->state = is_event_signaled( event );
 
     release_object( event );
 }
@@ -188,6 +188,7 @@ struct fd
     unsigned int         cacheable :1;/* can the fd be cached on the client side? */
     unsigned int         signaled :1; /* is the fd signaled? */
     unsigned int         fs_locks :1; /* can we use filesystem locks for this fd? */
+    unsigned int         poll_last :1;/* handle events after those of the other fds? */
     int                  poll_index;  /* index of fd in poll array */
     struct async_queue  *read_q;      /* async readers of this fd */
     struct async_queue  *write_q;     /* async writers of this fd */
@@ -358,13 +359,19 @@ static file_pos_t max_unix_offset = OFF_T_MAX;
 
 struct timeout_user
 {
-    struct list           entry;      /* entry in sorted timeout list */
+    unsigned int          index;      /* index in timeout heap, or TIMEOUT_EXPIRED */
+    struct list           entry;      /* entry in expired list while the callbacks are run */
     timeout_t             when;       /* timeout expiry (absolute time) */
     timeout_callback      callback;   /* callback function */
     void                 *private;    /* callback private data */
 };
 
-static struct list timeout_list = LIST_INIT(timeout_list);   /* sorted timeouts list */
+#define TIMEOUT_EXPIRED (~0u)
+
+/* binary min-heap of pending timeouts, ordered by expiry time */
+static struct timeout_user **timeout_heap;
+static unsigned int timeout_count;
+static unsigned int timeout_size;
 timeout_t current_time;
 
 static inline void set_current_time(void)
@@ -375,32 +382,87 @@ static inline void set_current_time(void)
     current_time = (timeout_t)now.tv_sec * TICKS_PER_SEC + now.tv_usec * 10 + ticks_1601_to_1970;
 }
 
+/* store a timeout at a given heap position */
+static inline void set_heap_timeout( unsigned int index, struct timeout_user *user )
+{
+    timeout_heap[index] = user;
+    user->index = index;
+}
+
+/* move a timeout towards the top of the heap until its parent expires earlier */
+static void heap_sift_up( unsigned int index, struct timeout_user *user )
+{
+    while (index)
+    {
+        unsigned int parent = (index - 1) / 2;
+        if (timeout_heap[parent]->when <= user->when) break;
+        set_heap_timeout( index, timeout_heap[parent] );
+        index = parent;
+    }
+    set_heap_timeout( index, user );
+}
+
+/* move a timeout towards the bottom of the heap until its children expire later */
+static void heap_sift_down( unsigned int index, struct timeout_user *user )
+{
+    for (;;)
+    {
+        unsigned int child = 2 * index + 1;
+        if (child >= timeout_count) break;
+        if (child + 1 < timeout_count && timeout_heap[child + 1]->when < timeout_heap[child]->when)
+            child++;
+        if (user->when <= timeout_heap[child]->when) break;
+        set_heap_timeout( index, timeout_heap[child] );
+        index = child;
+    }
+    set_heap_timeout( index, user );
+}
+
+/* remove the timeout at a given heap position */
+static void heap_remove( unsigned int index )
+{
+    struct timeout_user *last;
+
+    timeout_heap[index]->index = TIMEOUT_EXPIRED;
+    if (index == --timeout_count) return;
+    last = timeout_heap[timeout_count];
+    if (index && timeout_heap[(index - 1) / 2]->when > last->when) heap_sift_up( index, last );
+    else heap_sift_down( index, last );
+}
+
 /* add a timeout user */
 struct timeout_user *add_timeout_user( timeout_t when, timeout_callback func, void *private )
 {
     struct timeout_user *user;
-    struct list *ptr;
+
+    if (timeout_count == timeout_size)
+    {
+        unsigned int new_size = max( 64, timeout_size * 2 );
+        struct timeout_user **new_heap = realloc( timeout_heap, new_size * sizeof(*new_heap) );
+
+        if (!new_heap)
+        {
+            set_error( STATUS_NO_MEMORY );
+            return NULL;
+        }
+        timeout_heap = new_heap;
+        timeout_size = new_size;
+    }
 
     if (!(user = mem_alloc( sizeof(*user) ))) return NULL;
     user->when     = (when > 0) ? when : current_time - when;
     user->callback = func;
     user->private  = private;
 
-    /* Now insert it in the linked list */
-
-    LIST_FOR_EACH( ptr, &timeout_list )
-    {
-        struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-        if (timeout->when >= user->when) break;
-    }
-    list_add_before( ptr, &user->entry );
+    heap_sift_up( timeout_count++, user );
     return user;
 }
 
 /* remove a timeout user */
 void remove_timeout_user( struct timeout_user *user )
 {
-    list_remove( &user->entry );
+    if (user->index == TIMEOUT_EXPIRED) list_remove( &user->entry );
+    else heap_remove( user->index );
     free( user );
 }
 
@@ -549,7 +611,14 @@ static inline void main_loop_epoll(void)
         for (i = 0; i < ret; i++)
         {
             int user = events[i].data.u32;
-            if (pollfd[user].revents) fd_poll_event( poll_users[user], pollfd[user].revents );
+            if (pollfd[user].revents && !poll_users[user]->poll_last)
+                fd_poll_event( poll_users[user], pollfd[user].revents );
+        }
+        for (i = 0; i < ret; i++)
+        {
+            int user = events[i].data.u32;
+            if (pollfd[user].revents && poll_users[user]->poll_last)
+                fd_poll_event( poll_users[user], pollfd[user].revents );
         }
     }
 }
@@ -846,23 +915,19 @@ static void remove_poll_user( struct fd *fd, int user )
 /* process pending timeouts and return the time until the next timeout, in milliseconds */
 static int get_next_timeout(void)
 {
-    if (!list_empty( &timeout_list ))
+    if (timeout_count)
     {
         struct list expired_list, *ptr;
 
-        /* first remove all expired timers from the list */
+        /* first remove all expired timers from the heap */
 
         list_init( &expired_list );
-        while ((ptr = list_head( &timeout_list )) != NULL)
+        while (timeout_count && timeout_heap[0]->when <= current_time)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            struct timeout_user *timeout = timeout_heap[0];
 
-            if (timeout->when <= current_time)
-            {
-                list_remove( &timeout->entry );
-                list_add_tail( &expired_list, &timeout->entry );
-            }
-            else break;
+            heap_remove( 0 );
+            list_add_tail( &expired_list, &timeout->entry );
         }
 
         /* now call the callback for all the removed timers */
@@ -875,9 +940,9 @@ static int get_next_timeout(void)
             free( timeout );
         }
 
-        if ((ptr = list_head( &timeout_list )) != NULL)
+        if (timeout_count)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            struct timeout_user *timeout = timeout_heap[0];
             int diff = (timeout->when - current_time + 9999) / 10000;
             if (diff < 0) diff = 0;
             return diff;
@@ -908,14 +973,25 @@ void main_loop(void)
 
         if (ret > 0)
         {
+            int last = 0;
+
             for (i = 0; i < nb_users; i++)
             {
                 if (pollfd[i].revents)
                 {
-                    fd_poll_event( poll_users[i], pollfd[i].revents );
+                    if (poll_users[i]->poll_last) last++;
+                    else fd_poll_event( poll_users[i], pollfd[i].revents );
                     if (!--ret) break;
                 }
             }
+            for (i = 0; last && i < nb_users; i++)
+            {
+                if (pollfd[i].revents && poll_users[i]->poll_last)
+                {
+                    fd_poll_event( poll_users[i], pollfd[i].revents );
+                    last--;
+                }
+            }
         }
     }
 }
@@ -1562,6 +1638,12 @@ void set_fd_events( struct fd *fd, int events )
     }
 }
 
+/* handle the events of this fd after those of the other fds returned by the same poll */
+void set_fd_poll_last( struct fd *fd )
+{
+    fd->poll_last = 1;
+}
+
 /* prepare an fd for unmounting its corresponding device */
 static inline void unmount_fd( struct fd *fd )
 {
@@ -1602,6 +1684,7 @@ static struct fd *alloc_fd_object(void)
     fd->cacheable  = 0;
     fd->signaled   = 1;
     fd->fs_locks   = 1;
+    fd->poll_last  = 0;
     fd->poll_index = -1;
     fd->read_q     = NULL;
     fd->write_q    = NULL;
@@ -1637,6 +1720,7 @@ struct fd *alloc_pseudo_fd( const struct fd_ops *fd_user_ops, struct object *use
     fd->cacheable  = 0;
     fd->signaled   = 0;
     fd->fs_locks   = 0;
+    fd->poll_last  = 0;
     fd->poll_index = -1;
     fd->read_q     = NULL;
     fd->write_q    = NULL;
@@ -2562,6 +2646,17 @@ DECL_HANDLER(add_fd_completion)
     }
 }
 
+/* check whether a file is associated with a completion port */
+DECL_HANDLER(get_fd_completion)
+{
+    struct fd *fd = get_handle_fd_obj( current->process, req->handle, 0 );
+    if (fd)
+    {
+        reply->bound = (fd->completion != NULL);
+        release_object( fd );
+    }
+}
+
 /* set fd disposition information */
 DECL_HANDLER(set_fd_disp_info)
 {
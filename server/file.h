@@ -76,6 +76,7 @@ extern int is_fd_removable( struct fd *fd );
 extern int fd_close_handle( struct object *obj, struct process *process, obj_handle_t handle );
 extern int check_fd_events( struct fd *fd, int events );
 extern void set_fd_events( struct fd *fd, int events );
+extern void set_fd_poll_last( struct fd *fd );
 extern obj_handle_t lock_fd( struct fd *fd, file_pos_t offset, file_pos_t count, int shared, int wait );
 extern void unlock_fd( struct fd *fd, file_pos_t offset, file_pos_t count );
 extern void allow_fd_caching( struct fd *fd );
@@ -138,6 +139,8 @@ extern obj_handle_t open_mapping_file( struct process *process, struct mapping *
                                        unsigned int access, unsigned int sharing );
 extern struct mapping *grab_mapping_unless_removable( struct mapping *mapping );
 extern int get_page_size(void);
+extern int create_temp_file( file_pos_t size );
+extern struct object *create_shared_mapping( mem_size_t size, void **ptr );
 
 /* device functions */
 
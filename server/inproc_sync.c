@@ -0,0 +1,277 @@
+/*
+ * Server-side state of synchronization objects shared with client processes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * Events, semaphores and mutexes created by a process that requested it
+ * keep their state in an area of shared memory mapped in that process.
+ * The client can then wait on them with futexes and signal them with
+ * atomic operations without a server round trip.
+ *
+ * The server stays in charge of everything else: waits on several objects,
+ * alertable waits, and waits or signals coming from other processes.
+ * While any thread waits on an object in the server, the INPROC_SYNC_SERVER_WAIT
+ * bit is set in its state, and the client then sends every operation that
+ * could acquire or signal the object to the server, so that the server wait
+ * queues are processed correctly.
+ */
+
+#include "config.h"
+#include "wine/port.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+#include <unistd.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+
+#include "file.h"
+#include "handle.h"
+#include "process.h"
+#include "thread.h"
+#include "request.h"
+
+#define INPROC_SYNC_COUNT (INPROC_SYNC_AREA_SIZE / sizeof(struct inproc_sync))
+
+struct inproc_sync_area
+{
+    unsigned int        refcount;   /* references from the process and the objects */
+    struct inproc_sync *states;     /* states shared with the process */
+    unsigned int        hint;       /* where to start looking for a free entry */
+    struct list         mutexes;    /* mutexes allocated in the area */
+    struct list         events;     /* events allocated in the area */
+    unsigned int        orphans;    /* entries of destroyed events still referenced by the client */
+    unsigned int        used[INPROC_SYNC_COUNT / 32];  /* bitmap of allocated entries */
+};
+
+#ifdef __linux__
+static inline void futex_wake( int *addr, int count )
+{
+    syscall( __NR_futex, addr, 1 /* FUTEX_WAKE */, count, NULL, 0, 0 );
+}
+#else
+static inline void futex_wake( int *addr, int count ) { }
+#endif
+
+static struct inproc_sync_area *grab_area( struct inproc_sync_area *area )
+{
+    area->refcount++;
+    return area;
+}
+
+void release_inproc_sync_area( struct inproc_sync_area *area )
+{
+    if (--area->refcount) return;
+    munmap( area->states, INPROC_SYNC_AREA_SIZE );
+    free( area );
+}
+
+/* free the entries of destroyed events once the client has released them */
+static void reclaim_orphans( struct inproc_sync_area *area )
+{
+    unsigned int i;
+
+    for (i = 0; i < INPROC_SYNC_COUNT && area->orphans; i++)
+    {
+        if (!(area->used[i / 32] & (1u << (i % 32)))) continue;
+        if (area->states[i].type != INPROC_SYNC_NONE || area->states[i].count) continue;
+        area->used[i / 32] &= ~(1u << (i % 32));
+        area->orphans--;
+    }
+}
+
+/* mark a free entry as used, return -1 if the area is full */
+static int alloc_entry( struct inproc_sync_area *area )
+{
+    unsigned int i, bit, word;
+
+    for (i = 0; i < INPROC_SYNC_COUNT / 32; i++)
+    {
+        word = (area->hint + i) % (INPROC_SYNC_COUNT / 32);
+        if (area->used[word] == ~0u) continue;
+        for (bit = 0; bit < 32; bit++) if (!(area->used[word] & (1u << bit))) break;
+        area->used[word] |= 1u << bit;
+        area->hint = word;
+        return word * 32 + bit;
+    }
+    return -1;
+}
+
+/* allocate the shared state of a new object, if the process uses in-process synchronization */
+void alloc_inproc_sync( struct inproc_sync_ref *ref, struct process *process,
+                        unsigned int type, int state, unsigned int count )
+{
+    struct inproc_sync_area *area = process->inproc_sync;
+    int index;
+
+    ref->area = NULL;
+    ref->shm = NULL;
+    ref->index = 0;
+    if (!area) return;
+
+    if ((index = alloc_entry( area )) == -1 && area->orphans)
+    {
+        reclaim_orphans( area );
+        index = alloc_entry( area );
+    }
+    if (index == -1) return;  /* area is full, keep the object private to the server */
+
+    ref->area  = grab_area( area );
+    ref->index = index;
+    ref->shm   = &area->states[index];
+    ref->shm->type      = type;
+    ref->shm->count     = count;
+    ref->shm->abandoned = 0;
+    ref->shm->state     = state;
+}
+
+void free_inproc_sync( struct inproc_sync_ref *ref )
+{
+    if (!ref->shm) return;
+    if ((ref->shm->type == INPROC_SYNC_AUTO_EVENT || ref->shm->type == INPROC_SYNC_MANUAL_EVENT) &&
+        ref->shm->count)
+    {
+        /* pending I/O in the client will still signal it, keep the entry until then */
+        ref->shm->type = INPROC_SYNC_NONE;
+        ref->area->orphans++;
+    }
+    else
+    {
+        memset( ref->shm, 0, sizeof(*ref->shm) );
+        ref->area->used[ref->index / 32] &= ~(1u << (ref->index % 32));
+    }
+    release_inproc_sync_area( ref->area );
+    ref->area = NULL;
+    ref->shm = NULL;
+}
+
+/* list of the mutexes keeping their state in the area, their owner can only be found there */
+struct list *get_inproc_sync_mutexes( struct inproc_sync_area *area )
+{
+    return &area->mutexes;
+}
+
+/* list of the events keeping their state in the area */
+struct list *get_inproc_sync_events( struct inproc_sync_area *area )
+{
+    return &area->events;
+}
+
+/* atomically replace the state if it still has the old value; return the previous value */
+int update_inproc_sync( struct inproc_sync_ref *ref, int new_state, int old_state )
+{
+    return interlocked_cmpxchg( &ref->shm->state, new_state, old_state );
+}
+
+/* set or clear the server wait flag, called when the first waiter is queued or the last one removed */
+void set_inproc_sync_server_wait( struct inproc_sync_ref *ref, int set )
+{
+    int state, new_state;
+
+    do
+    {
+        state = ref->shm->state;
+        new_state = set ? (state | INPROC_SYNC_SERVER_WAIT) : (state & ~INPROC_SYNC_SERVER_WAIT);
+    } while (update_inproc_sync( ref, new_state, state ) != state);
+
+    /* client waiters may have given up on the object while the flag was set */
+    if (!set && new_state) wake_inproc_sync( ref, INT_MAX );
+}
+
+/* wake threads waiting on the state in the client */
+void wake_inproc_sync( struct inproc_sync_ref *ref, int count )
+{
+    futex_wake( &ref->shm->state, count );
+}
+
+/* map the shared state area of the current process */
+DECL_HANDLER(init_inproc_sync)
+{
+#ifdef __linux__
+    struct process *process = current->process;
+    struct inproc_sync_area *area;
+    void *ptr;
+    int fd;
+
+    if (process->inproc_sync)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        return;
+    }
+    if ((fd = create_temp_file( INPROC_SYNC_AREA_SIZE )) == -1) return;
+
+    if ((ptr = mmap( NULL, INPROC_SYNC_AREA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) == MAP_FAILED)
+    {
+        file_set_error();
+        close( fd );
+        return;
+    }
+    if (!(area = mem_alloc( sizeof(*area) )))
+    {
+        munmap( ptr, INPROC_SYNC_AREA_SIZE );
+        close( fd );
+        return;
+    }
+    memset( area, 0, sizeof(*area) );
+    area->refcount = 1;
+    area->states = ptr;
+    list_init( &area->mutexes );
+    list_init( &area->events );
+
+    if (send_client_fd( process, fd, 0 ) != -1) process->inproc_sync = area;
+    else release_inproc_sync_area( area );
+    close( fd );
+#else
+    set_error( STATUS_NOT_IMPLEMENTED );
+#endif
+}
+
+/* retrieve the shared state of a synchronization object */
+DECL_HANDLER(get_inproc_sync)
+{
+    struct inproc_sync_ref *ref;
+    struct object *obj;
+
+    if (!(obj = get_handle_obj( current->process, req->handle, 0, NULL ))) return;
+
+    if (!(ref = get_event_inproc_sync( obj )) &&
+        !(ref = get_semaphore_inproc_sync( obj )))
+        ref = get_mutex_inproc_sync( obj );
+
+    reply->type = INPROC_SYNC_NONE;
+    if (ref && ref->shm && ref->area == current->process->inproc_sync)
+    {
+        reply->type   = ref->shm->type;
+        reply->index  = ref->index;
+        reply->access = get_handle_access( current->process, req->handle );
+    }
+    release_object( obj );
+}
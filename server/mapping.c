@@ -67,6 +67,9 @@ struct mapping
     struct ranges  *committed;       /* list of committed ranges in this mapping */
     struct file    *shared_file;     /* temp file for shared PE mapping */
     struct list     shared_entry;    /* entry in global shared PE mappings list */
+    client_ptr_t    reloc_base;      /* address the PE image is relocated to when not at its base */
+    struct file    *reloc_file;      /* temp file for the relocated PE image */
+    struct list     reloc_entry;     /* entry in global relocated PE mappings list */
 };
 
 static void mapping_dump( struct object *obj, int verbose );
@@ -113,6 +116,7 @@ static const struct fd_ops mapping_fd_ops =
 };
 
 static struct list shared_list = LIST_INIT(shared_list);
+static struct list reloc_list = LIST_INIT(reloc_list);
 
 static size_t page_mask;
 
@@ -161,7 +165,7 @@ static int check_current_dir_for_exec(void)
 }
 
 /* create a temp file for anonymous mappings */
-static int create_temp_file( file_pos_t size )
+int create_temp_file( file_pos_t size )
 {
     static int temp_dir_fd = -1;
     char tmpfn[] = "anonmap.XXXXXX";
@@ -371,6 +375,148 @@ static int build_shared_mapping( struct mapping *mapping, int fd,
     return 0;
 }
 
+/* find the mapping holding the relocated copy of a given PE image */
+static struct mapping *find_reloc_mapping( struct mapping *mapping )
+{
+    struct mapping *ptr;
+
+    LIST_FOR_EACH_ENTRY( ptr, &reloc_list, struct mapping, reloc_entry )
+        if (ptr->cpu == mapping->cpu && is_same_file_fd( ptr->fd, mapping->fd ))
+            return ptr;
+    return NULL;
+}
+
+/* apply a block of base relocations to a page of the image */
+static int relocate_block( char *page, mem_size_t max_size, const USHORT *relocs,
+                           unsigned int count, client_ptr_t delta )
+{
+    while (count--)
+    {
+        unsigned int offset = *relocs & 0xfff;
+
+        switch (*relocs++ >> 12)
+        {
+        case IMAGE_REL_BASED_ABSOLUTE:
+            break;
+        case IMAGE_REL_BASED_HIGH:
+            if (offset + sizeof(short) > max_size) return 0;
+            *(short *)(page + offset) += HIWORD(delta);
+            break;
+        case IMAGE_REL_BASED_LOW:
+            if (offset + sizeof(short) > max_size) return 0;
+            *(short *)(page + offset) += LOWORD(delta);
+            break;
+        case IMAGE_REL_BASED_HIGHLOW:
+            if (offset + sizeof(int) > max_size) return 0;
+            *(int *)(page + offset) += delta;
+            break;
+        case IMAGE_REL_BASED_DIR64:
+            if (offset + sizeof(client_ptr_t) > max_size) return 0;
+            *(client_ptr_t *)(page + offset) += delta;
+            break;
+        default:  /* leave the other types to the client */
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* build a temp file containing the image of a PE dll relocated to a given address */
+/* the file has the memory layout of the image, so that it can be mapped in one piece */
+static struct file *build_reloc_image( struct mapping *mapping, int unix_fd, client_ptr_t base )
+{
+    IMAGE_NT_HEADERS32 *nt32;
+    IMAGE_NT_HEADERS64 *nt64;
+    IMAGE_DATA_DIRECTORY *relocs;
+    IMAGE_SECTION_HEADER *sec;
+    IMAGE_BASE_RELOCATION *rel;
+    mem_size_t header_size, pos, end;
+    size_t map_size, file_size;
+    off_t file_start;
+    client_ptr_t delta;
+    unsigned int i, section_align;
+    int fd, ok = 0;
+    char *ptr;
+
+    /* shared sections are mapped from their own file and relocated by the client */
+    if (mapping->shared_file) return NULL;
+
+    if ((fd = create_temp_file( mapping->size )) == -1) return NULL;
+    if ((ptr = mmap( NULL, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) == MAP_FAILED)
+    {
+        close( fd );
+        return NULL;
+    }
+
+    header_size = min( mapping->header_size, mapping->size );
+    if (pread( unix_fd, ptr, header_size, 0 ) == -1) goto done;
+
+    nt32 = (IMAGE_NT_HEADERS32 *)(ptr + ((IMAGE_DOS_HEADER *)ptr)->e_lfanew);
+    nt64 = (IMAGE_NT_HEADERS64 *)nt32;
+    if (!(nt32->FileHeader.Characteristics & IMAGE_FILE_DLL)) goto done;
+    if (nt32->FileHeader.Characteristics & IMAGE_FILE_RELOCS_STRIPPED) goto done;
+
+    switch (nt32->OptionalHeader.Magic)
+    {
+    case IMAGE_NT_OPTIONAL_HDR32_MAGIC:
+        delta         = base - nt32->OptionalHeader.ImageBase;
+        section_align = nt32->OptionalHeader.SectionAlignment;
+        relocs        = &nt32->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+        nt32->OptionalHeader.ImageBase = base;
+        break;
+    case IMAGE_NT_OPTIONAL_HDR64_MAGIC:
+        delta         = base - nt64->OptionalHeader.ImageBase;
+        section_align = nt64->OptionalHeader.SectionAlignment;
+        relocs        = &nt64->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+        nt64->OptionalHeader.ImageBase = base;
+        break;
+    default:
+        goto done;
+    }
+    if (section_align <= page_mask) goto done;  /* not relocated by the client either */
+    if (!relocs->Size || !relocs->VirtualAddress) goto done;
+
+    /* copy the sections data */
+
+    sec = (IMAGE_SECTION_HEADER *)((char *)&nt32->OptionalHeader + nt32->FileHeader.SizeOfOptionalHeader);
+    if ((char *)(sec + nt32->FileHeader.NumberOfSections) > ptr + header_size) goto done;
+    for (i = 0; i < nt32->FileHeader.NumberOfSections; i++)
+    {
+        get_section_sizes( &sec[i], &map_size, &file_start, &file_size );
+        if (sec[i].VirtualAddress > mapping->size || map_size > mapping->size - sec[i].VirtualAddress)
+            goto done;
+        if (!sec[i].PointerToRawData || !file_size) continue;
+        if (pread( unix_fd, ptr + sec[i].VirtualAddress, file_size, file_start ) == -1) goto done;
+    }
+
+    /* apply the relocations */
+
+    pos = relocs->VirtualAddress;
+    end = pos + relocs->Size;
+    if (end > mapping->size || end < pos) goto done;
+    while (pos + sizeof(*rel) <= end)
+    {
+        rel = (IMAGE_BASE_RELOCATION *)(ptr + pos);
+        if (!rel->SizeOfBlock) break;
+        if (rel->SizeOfBlock < sizeof(*rel) || rel->SizeOfBlock > end - pos) goto done;
+        if (rel->VirtualAddress >= mapping->size) goto done;
+        if (!relocate_block( ptr + rel->VirtualAddress, mapping->size - rel->VirtualAddress,
+                             (const USHORT *)(rel + 1), (rel->SizeOfBlock - sizeof(*rel)) / sizeof(USHORT),
+                             delta )) goto done;
+        pos += rel->SizeOfBlock;
+    }
+    ok = 1;
+
+ done:
+    munmap( ptr, mapping->size );
+    if (!ok)
+    {
+        close( fd );
+        return NULL;
+    }
+    return create_file_for_fd( fd, FILE_GENERIC_READ, 0 );
+}
+
 /* retrieve the mapping parameters for an executable (PE) image */
 static unsigned int get_image_params( struct mapping *mapping, int unix_fd, int protect )
 {
@@ -492,6 +638,8 @@ static struct object *create_mapping( struct object *root, const struct unicode_
     mapping->base        = 0;
     mapping->fd          = NULL;
     mapping->shared_file = NULL;
+    mapping->reloc_base  = 0;
+    mapping->reloc_file  = NULL;
     mapping->committed   = NULL;
 
     if (protect & VPROT_READ) access |= FILE_READ_DATA;
@@ -573,6 +721,30 @@ static struct object *create_mapping( struct object *root, const struct unicode_
     return NULL;
 }
 
+/* create an anonymous mapping that is also mapped in the server, to share data with the clients */
+struct object *create_shared_mapping( mem_size_t size, void **ptr )
+{
+    static const struct unicode_str empty_str;
+    struct mapping *mapping;
+    int unix_fd;
+
+    if (!(mapping = (struct mapping *)create_mapping( NULL, &empty_str, 0, size,
+                                                      VPROT_READ | VPROT_WRITE | VPROT_COMMITTED, 0, NULL )))
+        return NULL;
+
+    if ((unix_fd = get_unix_fd( mapping->fd )) == -1) goto error;
+    if ((*ptr = mmap( NULL, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED, unix_fd, 0 )) == MAP_FAILED)
+    {
+        file_set_error();
+        goto error;
+    }
+    return &mapping->obj;
+
+ error:
+    release_object( mapping );
+    return NULL;
+}
+
 struct mapping *get_mapping_obj( struct process *process, obj_handle_t handle, unsigned int access )
 {
     return (struct mapping *)get_handle_obj( process, handle, access, &mapping_ops );
@@ -602,10 +774,11 @@ static void mapping_dump( struct object *obj, int verbose )
     struct mapping *mapping = (struct mapping *)obj;
     assert( obj->ops == &mapping_ops );
     fprintf( stderr, "Mapping size=%08x%08x prot=%08x fd=%p header_size=%08x base=%08lx "
-             "shared_file=%p\n",
+             "shared_file=%p reloc_base=%08lx reloc_file=%p\n",
              (unsigned int)(mapping->size >> 32), (unsigned int)mapping->size,
              mapping->protect, mapping->fd, mapping->header_size,
-             (unsigned long)mapping->base, mapping->shared_file );
+             (unsigned long)mapping->base, mapping->shared_file,
+             (unsigned long)mapping->reloc_base, mapping->reloc_file );
 }
 
 static struct object_type *mapping_get_type( struct object *obj )
@@ -640,6 +813,11 @@ static void mapping_destroy( struct object *obj )
         release_object( mapping->shared_file );
         list_remove( &mapping->shared_entry );
     }
+    if (mapping->reloc_base)
+    {
+        if (mapping->reloc_file) release_object( mapping->reloc_file );
+        list_remove( &mapping->reloc_entry );
+    }
     free( mapping->committed );
 }
 
@@ -690,7 +868,7 @@ DECL_HANDLER(open_mapping)
 /* get a mapping information */
 DECL_HANDLER(get_mapping_info)
 {
-    struct mapping *mapping;
+    struct mapping *mapping, *reloc;
     struct fd *fd;
 
     if (!(mapping = get_mapping_obj( current->process, req->handle, req->access ))) return;
@@ -706,7 +884,10 @@ DECL_HANDLER(get_mapping_info)
     reply->protect     = mapping->protect;
     reply->header_size = mapping->header_size;
     reply->base        = mapping->base;
+    reply->reloc_base  = 0;
     reply->shared_file = 0;
+    if ((mapping->protect & VPROT_IMAGE) && (reloc = find_reloc_mapping( mapping )))
+        reply->reloc_base = reloc->reloc_base;
     if ((fd = get_obj_fd( &mapping->obj )))
     {
         if (!is_fd_removable(fd)) reply->mapping = alloc_handle( current->process, mapping, 0, 0 );
@@ -758,3 +939,39 @@ DECL_HANDLER(add_mapping_committed_range)
         release_object( mapping );
     }
 }
+
+/* get the relocated copy of a PE image mapped at an address other than its base */
+DECL_HANDLER(get_mapping_reloc_file)
+{
+    struct mapping *mapping, *reloc;
+    int unix_fd;
+
+    if (!(mapping = get_mapping_obj( current->process, req->handle, 0 ))) return;
+
+    if (!(mapping->protect & VPROT_IMAGE) || !req->base || req->base == mapping->base)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        release_object( mapping );
+        return;
+    }
+
+    if (!(reloc = find_reloc_mapping( mapping )))
+    {
+        /* first process to relocate the image, its address becomes the shared one */
+        if ((unix_fd = get_unix_fd( mapping->fd )) == -1)
+        {
+            release_object( mapping );
+            return;
+        }
+        mapping->reloc_file = build_reloc_image( mapping, unix_fd, req->base );
+        mapping->reloc_base = req->base;
+        list_add_head( &reloc_list, &mapping->reloc_entry );
+        clear_error();  /* if the image can't be relocated, the client does it */
+        reloc = mapping;
+    }
+
+    reply->reloc_base = reloc->reloc_base;
+    if (reloc->reloc_base == req->base && reloc->reloc_file)
+        reply->handle = alloc_handle( current->process, reloc->reloc_file, GENERIC_READ, 0 );
+    release_object( mapping );
+}
@@ -32,6 +32,7 @@
 #include "winternl.h"
 
 #include "handle.h"
+#include "process.h"
 #include "thread.h"
 #include "request.h"
 #include "security.h"
@@ -39,14 +40,18 @@
 struct mutex
 {
     struct object  obj;             /* object header */
-    struct thread *owner;           /* mutex owner */
+    struct thread *owner;           /* mutex owner, for shared mutexes only if outside the creator process */
     unsigned int   count;           /* recursion count */
     int            abandoned;       /* has it been abandoned? */
     struct list    entry;           /* entry in owner thread mutex list */
+    struct list    shared_entry;    /* entry in the creator process shared mutexes list */
+    struct inproc_sync_ref sync;    /* state shared with the creator process */
 };
 
 static void mutex_dump( struct object *obj, int verbose );
 static struct object_type *mutex_get_type( struct object *obj );
+static int mutex_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static void mutex_remove_queue( struct object *obj, struct wait_queue_entry *entry );
 static int mutex_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void mutex_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static unsigned int mutex_map_access( struct object *obj, unsigned int access );
@@ -58,8 +63,8 @@ static const struct object_ops mutex_ops =
     sizeof(struct mutex),      /* size */
     mutex_dump,                /* dump */
     mutex_get_type,            /* get_type */
-    add_queue,                 /* add_queue */
-    remove_queue,              /* remove_queue */
+    mutex_add_queue,           /* add_queue */
+    mutex_remove_queue,        /* remove_queue */
     mutex_signaled,            /* signaled */
     mutex_satisfied,           /* satisfied */
     mutex_signal,              /* signal */
@@ -76,12 +81,56 @@ static const struct object_ops mutex_ops =
 };
 
 
+static inline thread_id_t get_shared_owner( struct mutex *mutex )
+{
+    return mutex->sync.shm->state & ~INPROC_SYNC_SERVER_WAIT;
+}
+
+/* set the owner of a shared mutex, keeping the server wait flag */
+static void set_shared_owner( struct mutex *mutex, thread_id_t owner )
+{
+    int state;
+
+    do state = mutex->sync.shm->state;
+    while (update_inproc_sync( &mutex->sync, (state & INPROC_SYNC_SERVER_WAIT) | owner, state ) != state);
+}
+
+/* release a shared mutex once the recursion count is 0 */
+static void do_release_shared( struct mutex *mutex )
+{
+    if (mutex->owner)
+    {
+        list_remove( &mutex->entry );
+        mutex->owner = NULL;
+    }
+    set_shared_owner( mutex, 0 );
+    wake_up( &mutex->obj, 0 );
+    if (!get_shared_owner( mutex )) wake_inproc_sync( &mutex->sync, 1 );
+}
+
 /* grab a mutex for a given thread */
 static void do_grab( struct mutex *mutex, struct thread *thread )
 {
+    if (mutex->sync.shm)
+    {
+        if (get_shared_owner( mutex ) != thread->id)
+        {
+            set_shared_owner( mutex, thread->id );
+            mutex->sync.shm->count = 0;
+            /* owners in the creator process are found through its shared mutexes list */
+            if (thread->process->inproc_sync != mutex->sync.area)
+            {
+                mutex->owner = thread;
+                list_add_head( &thread->mutex_list, &mutex->entry );
+            }
+        }
+        mutex->sync.shm->count++;
+        return;
+    }
+
     assert( !mutex->count || (mutex->owner == thread) );
 
-    if (!mutex->count++)  /* FIXME: avoid wrap-around */
+    if (!mutex->count++)
     {
         assert( !mutex->owner );
         mutex->owner = thread;
@@ -112,20 +161,65 @@ static struct mutex *create_mutex( struct object *root, const struct unicode_str
             mutex->count = 0;
             mutex->owner = NULL;
             mutex->abandoned = 0;
+            alloc_inproc_sync( &mutex->sync, current->process, INPROC_SYNC_MUTEX, 0, 0 );
+            if (mutex->sync.shm)
+                list_add_tail( get_inproc_sync_mutexes( mutex->sync.area ), &mutex->shared_entry );
             if (owned) do_grab( mutex, current );
         }
     }
     return mutex;
 }
 
+struct inproc_sync_ref *get_mutex_inproc_sync( struct object *obj )
+{
+    if (obj->ops != &mutex_ops) return NULL;
+    return &((struct mutex *)obj)->sync;
+}
+
+/* check if the mutex is owned by the thread, and return the recursion count */
+static unsigned int get_mutex_count( struct mutex *mutex, struct thread *thread, int *owned )
+{
+    if (mutex->sync.shm)
+    {
+        thread_id_t owner = get_shared_owner( mutex );
+        *owned = owner && owner == thread->id;
+        return owner ? mutex->sync.shm->count : 0;
+    }
+    *owned = mutex->count && mutex->owner == thread;
+    return mutex->count;
+}
+
+static void abandon_shared_mutex( struct mutex *mutex )
+{
+    mutex->sync.shm->count = 0;
+    mutex->sync.shm->abandoned = 1;
+    do_release_shared( mutex );
+}
+
 void abandon_mutexes( struct thread *thread )
 {
+    struct mutex *mutex, *next;
     struct list *ptr;
 
+    /* mutexes acquired in the client are only known from their shared state */
+    if (thread->process->inproc_sync)
+    {
+        LIST_FOR_EACH_ENTRY_SAFE( mutex, next, get_inproc_sync_mutexes( thread->process->inproc_sync ),
+                                  struct mutex, shared_entry )
+        {
+            if (get_shared_owner( mutex ) == thread->id) abandon_shared_mutex( mutex );
+        }
+    }
+
     while ((ptr = list_head( &thread->mutex_list )) != NULL)
     {
         struct mutex *mutex = LIST_ENTRY( ptr, struct mutex, entry );
         assert( mutex->owner == thread );
+        if (mutex->sync.shm)
+        {
+            abandon_shared_mutex( mutex );
+            continue;
+        }
         mutex->count = 0;
         mutex->abandoned = 1;
         do_release( mutex );
@@ -136,7 +230,11 @@ static void mutex_dump( struct object *obj, int verbose )
 {
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
-    fprintf( stderr, "Mutex count=%u owner=%p\n", mutex->count, mutex->owner );
+    if (mutex->sync.shm)
+        fprintf( stderr, "Mutex count=%u owner=%04x shared\n",
+                 mutex->sync.shm->count, get_shared_owner( mutex ) );
+    else
+        fprintf( stderr, "Mutex count=%u owner=%p\n", mutex->count, mutex->owner );
 }
 
 static struct object_type *mutex_get_type( struct object *obj )
@@ -146,23 +244,73 @@ static struct object_type *mutex_get_type( struct object *obj )
     return get_object_type( &str );
 }
 
+static int mutex_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct mutex *mutex = (struct mutex *)obj;
+    assert( obj->ops == &mutex_ops );
+    if (mutex->sync.shm) set_inproc_sync_server_wait( &mutex->sync, 1 );
+    return add_queue( obj, entry );
+}
+
+static void mutex_remove_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct mutex *mutex = (struct mutex *)obj;
+    assert( obj->ops == &mutex_ops );
+    remove_queue( obj, entry );
+    if (mutex->sync.shm && list_empty( &obj->wait_queue )) set_inproc_sync_server_wait( &mutex->sync, 0 );
+}
+
 static int mutex_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct mutex *mutex = (struct mutex *)obj;
+    unsigned int count;
+    int owned;
+
     assert( obj->ops == &mutex_ops );
-    return (!mutex->count || (mutex->owner == get_wait_queue_thread( entry )));
+    count = get_mutex_count( mutex, get_wait_queue_thread( entry ), &owned );
+    /* the wait completes with an error, before any object of it is acquired */
+    if (owned && count == INPROC_SYNC_MUTEX_MAX_COUNT) make_wait_failed( entry, STATUS_MUTANT_LIMIT_EXCEEDED );
+    return (!count || owned);
 }
 
 static void mutex_satisfied( struct object *obj, struct wait_queue_entry *entry )
 {
     struct mutex *mutex = (struct mutex *)obj;
+    struct thread *thread = get_wait_queue_thread( entry );
+
     assert( obj->ops == &mutex_ops );
 
-    do_grab( mutex, get_wait_queue_thread( entry ));
+    do_grab( mutex, thread );
+    if (mutex->sync.shm)
+    {
+        if (mutex->sync.shm->abandoned) make_wait_abandoned( entry );
+        mutex->sync.shm->abandoned = 0;
+        return;
+    }
     if (mutex->abandoned) make_wait_abandoned( entry );
     mutex->abandoned = 0;
 }
 
+/* release the mutex if owned by the current thread, return the previous recursion count */
+static unsigned int release_mutex( struct mutex *mutex )
+{
+    unsigned int count;
+    int owned;
+
+    count = get_mutex_count( mutex, current, &owned );
+    if (!count || !owned)
+    {
+        set_error( STATUS_MUTANT_NOT_OWNED );
+        return 0;
+    }
+    if (mutex->sync.shm)
+    {
+        if (!--mutex->sync.shm->count) do_release_shared( mutex );
+    }
+    else if (!--mutex->count) do_release( mutex );
+    return count;
+}
+
 static unsigned int mutex_map_access( struct object *obj, unsigned int access )
 {
     if (access & GENERIC_READ)    access |= STANDARD_RIGHTS_READ | MUTANT_QUERY_STATE;
@@ -182,13 +330,7 @@ static int mutex_signal( struct object *obj, unsigned int access )
         set_error( STATUS_ACCESS_DENIED );
         return 0;
     }
-    if (!mutex->count || (mutex->owner != current))
-    {
-        set_error( STATUS_MUTANT_NOT_OWNED );
-        return 0;
-    }
-    if (!--mutex->count) do_release( mutex );
-    return 1;
+    return release_mutex( mutex ) != 0;
 }
 
 static void mutex_destroy( struct object *obj )
@@ -196,6 +338,13 @@ static void mutex_destroy( struct object *obj )
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
 
+    if (mutex->sync.shm)
+    {
+        list_remove( &mutex->shared_entry );
+        if (mutex->owner) list_remove( &mutex->entry );
+        free_inproc_sync( &mutex->sync );
+        return;
+    }
     if (!mutex->count) return;
     mutex->count = 0;
     do_release( mutex );
@@ -242,12 +391,7 @@ DECL_HANDLER(release_mutex)
     if ((mutex = (struct mutex *)get_handle_obj( current->process, req->handle,
                                                  0, &mutex_ops )))
     {
-        if (!mutex->count || (mutex->owner != current)) set_error( STATUS_MUTANT_NOT_OWNED );
-        else
-        {
-            reply->prev_count = mutex->count;
-            if (!--mutex->count) do_release( mutex );
-        }
+        reply->prev_count = release_mutex( mutex );
         release_object( mutex );
     }
 }
@@ -260,9 +404,8 @@ DECL_HANDLER(query_mutex)
     if ((mutex = (struct mutex *)get_handle_obj( current->process, req->handle,
                                                  MUTANT_QUERY_STATE, &mutex_ops )))
     {
-        reply->count = mutex->count;
-        reply->owned = (mutex->owner == current);
-        reply->abandoned = mutex->abandoned;
+        reply->count = get_mutex_count( mutex, current, &reply->owned );
+        reply->abandoned = mutex->sync.shm ? mutex->sync.shm->abandoned : mutex->abandoned;
 
         release_object( mutex );
     }
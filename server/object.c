@@ -43,9 +43,16 @@
 struct namespace
 {
     unsigned int        hash_size;       /* size of hash table */
-    struct list         names[1];        /* array of hash entry lists */
+    unsigned int        count;           /* number of names in the table */
+    struct list        *names;           /* array of hash entry lists */
+    unsigned int        lookups;         /* number of lookups */
+    unsigned int        probes;          /* number of names compared during lookups */
+    unsigned int        max_chain;       /* longest hash chain walked by a lookup */
+    unsigned int        resizes;         /* number of times the table has been grown */
 };
 
+#define NAMESPACE_MAX_LOAD 2             /* average chain length that triggers a resize */
+
 
 #ifdef DEBUG_OBJECTS
 static struct list object_list = LIST_INIT(object_list);
@@ -113,19 +120,73 @@ void *memdup( const void *data, size_t len )
 
 /*****************************************************************/
 
-static int get_name_hash( const struct namespace *namespace, const WCHAR *name, data_size_t len )
+/* FNV-1a hash of the lower-case name, so that it can be used for case-insensitive lookups too */
+unsigned int get_name_hash( const WCHAR *name, data_size_t len )
 {
-    WCHAR hash = 0;
+    unsigned int hash = 2166136261u;
     len /= sizeof(WCHAR);
-    while (len--) hash ^= tolowerW(*name++);
-    return hash % namespace->hash_size;
+    while (len--)
+    {
+        WCHAR ch = tolowerW(*name++);
+        hash = (hash ^ (ch & 0xff)) * 16777619;
+        hash = (hash ^ (ch >> 8)) * 16777619;
+    }
+    return hash;
+}
+
+/* grow the hash table when the chains become too long; failure is not fatal */
+static void grow_namespace( struct namespace *namespace )
+{
+    unsigned int i, new_size = namespace->hash_size * 2 + 1;
+    struct object_name *ptr, *next;
+    struct list *names;
+
+    if (!(names = malloc( new_size * sizeof(*names) ))) return;
+    for (i = 0; i < new_size; i++) list_init( &names[i] );
+
+    for (i = 0; i < namespace->hash_size; i++)
+    {
+        LIST_FOR_EACH_ENTRY_SAFE( ptr, next, &namespace->names[i], struct object_name, entry )
+        {
+            list_remove( &ptr->entry );
+            list_add_tail( &names[ptr->hash % new_size], &ptr->entry );
+        }
+    }
+    free( namespace->names );
+    namespace->names = names;
+    namespace->hash_size = new_size;
+    namespace->resizes++;
 }
 
 void namespace_add( struct namespace *namespace, struct object_name *ptr )
 {
-    int hash = get_name_hash( namespace, ptr->name, ptr->len );
+    ptr->hash = get_name_hash( ptr->name, ptr->len );
+    ptr->namespace = namespace;
+    list_add_head( &namespace->names[ptr->hash % namespace->hash_size], &ptr->entry );
+    if (++namespace->count > namespace->hash_size * NAMESPACE_MAX_LOAD) grow_namespace( namespace );
+}
+
+/* remove a name from the namespace it was added to */
+static void namespace_remove( struct object_name *ptr )
+{
+    list_remove( &ptr->entry );
+    ptr->namespace->count--;
+}
 
-    list_add_head( &namespace->names[hash], &ptr->entry );
+/* dump the hash table statistics of a namespace */
+void dump_namespace( const struct namespace *namespace )
+{
+    unsigned int i, used = 0, longest = 0;
+
+    for (i = 0; i < namespace->hash_size; i++)
+    {
+        unsigned int len = list_count( &namespace->names[i] );
+        if (len) used++;
+        if (len > longest) longest = len;
+    }
+    fprintf( stderr, "names=%u buckets=%u used=%u longest=%u lookups=%u probes=%u max_chain=%u resizes=%u",
+             namespace->count, namespace->hash_size, used, longest, namespace->lookups,
+             namespace->probes, namespace->max_chain, namespace->resizes );
 }
 
 /* allocate a name for an object */
@@ -137,6 +198,7 @@ static struct object_name *alloc_name( const struct unicode_str *name )
     {
         ptr->len = name->len;
         ptr->parent = NULL;
+        ptr->namespace = NULL;
         memcpy( ptr->name, name->str, name->len );
     }
     return ptr;
@@ -418,31 +480,35 @@ void release_object( void *ptr )
 }
 
 /* find an object by its name; the refcount is incremented */
-struct object *find_object( const struct namespace *namespace, const struct unicode_str *name,
+struct object *find_object( struct namespace *namespace, const struct unicode_str *name,
                             unsigned int attributes )
 {
-    const struct list *list;
-    struct list *p;
+    const struct object_name *ptr, *found = NULL;
+    unsigned int hash, chain = 0;
 
     if (!name || !name->len) return NULL;
 
-    list = &namespace->names[ get_name_hash( namespace, name->str, name->len ) ];
-    LIST_FOR_EACH( p, list )
+    hash = get_name_hash( name->str, name->len );
+    LIST_FOR_EACH_ENTRY( ptr, &namespace->names[hash % namespace->hash_size],
+                         const struct object_name, entry )
     {
-        const struct object_name *ptr = LIST_ENTRY( p, struct object_name, entry );
-        if (ptr->len != name->len) continue;
+        chain++;
+        if (ptr->hash != hash || ptr->len != name->len) continue;
         if (attributes & OBJ_CASE_INSENSITIVE)
         {
-            if (!strncmpiW( ptr->name, name->str, name->len/sizeof(WCHAR) ))
-                return grab_object( ptr->obj );
+            if (strncmpiW( ptr->name, name->str, name->len/sizeof(WCHAR) )) continue;
         }
         else
         {
-            if (!memcmp( ptr->name, name->str, name->len ))
-                return grab_object( ptr->obj );
+            if (memcmp( ptr->name, name->str, name->len )) continue;
         }
+        found = ptr;
+        break;
     }
-    return NULL;
+    namespace->lookups++;
+    namespace->probes += chain;
+    if (chain > namespace->max_chain) namespace->max_chain = chain;
+    return found ? grab_object( found->obj ) : NULL;
 }
 
 /* find an object by its index; the refcount is incremented */
@@ -469,15 +535,31 @@ struct namespace *create_namespace( unsigned int hash_size )
     struct namespace *namespace;
     unsigned int i;
 
-    namespace = mem_alloc( sizeof(*namespace) + (hash_size - 1) * sizeof(namespace->names[0]) );
-    if (namespace)
+    if (!hash_size) hash_size = 1;
+    if (!(namespace = mem_alloc( sizeof(*namespace) ))) return NULL;
+    if (!(namespace->names = mem_alloc( hash_size * sizeof(namespace->names[0]) )))
     {
-        namespace->hash_size      = hash_size;
-        for (i = 0; i < hash_size; i++) list_init( &namespace->names[i] );
+        free( namespace );
+        return NULL;
     }
+    namespace->hash_size = hash_size;
+    namespace->count     = 0;
+    namespace->lookups   = 0;
+    namespace->probes    = 0;
+    namespace->max_chain = 0;
+    namespace->resizes   = 0;
+    for (i = 0; i < hash_size; i++) list_init( &namespace->names[i] );
     return namespace;
 }
 
+/* free a namespace */
+void free_namespace( struct namespace *namespace )
+{
+    if (!namespace) return;
+    free( namespace->names );
+    free( namespace );
+}
+
 /* functions for unimplemented/default object operations */
 
 struct object_type *no_get_type( struct object *obj )
@@ -642,7 +724,7 @@ int no_link_name( struct object *obj, struct object_name *name, struct object *p
 
 void default_unlink_name( struct object *obj, struct object_name *name )
 {
-    list_remove( &name->entry );
+    namespace_remove( name );
 }
 
 struct object *no_open_file( struct object *obj, unsigned int access, unsigned int sharing,
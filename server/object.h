@@ -113,6 +113,8 @@ struct object_name
     struct list         entry;           /* entry in the hash list */
     struct object      *obj;             /* object owning this name */
     struct object      *parent;          /* parent object */
+    struct namespace   *namespace;       /* namespace containing the name */
+    unsigned int        hash;            /* hash value of the lower-case name */
     data_size_t         len;             /* name length in bytes */
     WCHAR               name[1];
 };
@@ -140,12 +142,15 @@ extern void *open_named_object( struct object *parent, const struct object_ops *
                                 const struct unicode_str *name, unsigned int attributes );
 extern void unlink_named_object( struct object *obj );
 extern void make_object_static( struct object *obj );
+extern unsigned int get_name_hash( const WCHAR *name, data_size_t len );
 extern struct namespace *create_namespace( unsigned int hash_size );
+extern void free_namespace( struct namespace *namespace );
+extern void dump_namespace( const struct namespace *namespace );
 /* grab/release_object can take any pointer, but you better make sure */
 /* that the thing pointed to starts with a struct object... */
 extern struct object *grab_object( void *obj );
 extern void release_object( void *obj );
-extern struct object *find_object( const struct namespace *namespace, const struct unicode_str *name,
+extern struct object *find_object( struct namespace *namespace, const struct unicode_str *name,
                                    unsigned int attributes );
 extern struct object *find_object_index( const struct namespace *namespace, unsigned int index );
 extern struct object_type *no_get_type( struct object *obj );
@@ -190,6 +195,31 @@ extern void reset_event( struct event *event );
 
 extern void abandon_mutexes( struct thread *thread );
 
+/* in-process synchronization functions */
+
+struct inproc_sync_area;
+
+/* reference to the state of an object shared with the process that created it */
+struct inproc_sync_ref
+{
+    struct inproc_sync_area *area;   /* area of the creator process */
+    struct inproc_sync      *shm;    /* shared state, NULL if the object is private to the server */
+    unsigned int             index;  /* index of the state in the area */
+};
+
+extern void alloc_inproc_sync( struct inproc_sync_ref *ref, struct process *process,
+                               unsigned int type, int state, unsigned int count );
+extern void free_inproc_sync( struct inproc_sync_ref *ref );
+extern void release_inproc_sync_area( struct inproc_sync_area *area );
+extern struct list *get_inproc_sync_mutexes( struct inproc_sync_area *area );
+extern struct list *get_inproc_sync_events( struct inproc_sync_area *area );
+extern int update_inproc_sync( struct inproc_sync_ref *ref, int new_state, int old_state );
+extern void set_inproc_sync_server_wait( struct inproc_sync_ref *ref, int set );
+extern void wake_inproc_sync( struct inproc_sync_ref *ref, int count );
+extern struct inproc_sync_ref *get_event_inproc_sync( struct object *obj );
+extern struct inproc_sync_ref *get_mutex_inproc_sync( struct object *obj );
+extern struct inproc_sync_ref *get_semaphore_inproc_sync( struct object *obj );
+
 /* serial functions */
 
 int get_serial_async_timeout(struct object *obj, int type, int count);
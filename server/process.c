@@ -527,6 +527,7 @@ struct thread *create_process( int fd, struct thread *parent_thread, int inherit
     process->peb             = 0;
     process->ldt_copy        = 0;
     process->dir_cache       = NULL;
+    process->inproc_sync     = NULL;
     process->winstation      = 0;
     process->desktop         = 0;
     process->token           = NULL;
@@ -632,6 +633,7 @@ static void process_destroy( struct object *obj )
     if (process->id) free_ptid( process->id );
     if (process->token) release_object( process->token );
     free( process->dir_cache );
+    if (process->inproc_sync) release_inproc_sync_area( process->inproc_sync );
 }
 
 /* dump a process on stdout for debugging purposes */
@@ -1436,6 +1438,24 @@ DECL_HANDLER(write_process_memory)
     }
 }
 
+/* get the Unix pid of a process for direct access to its address space */
+DECL_HANDLER(get_process_vm_pid)
+{
+    struct process *process;
+
+    if (req->access != PROCESS_VM_READ && req->access != PROCESS_VM_WRITE)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        return;
+    }
+    if ((process = get_process_from_handle( req->handle, req->access )))
+    {
+        if (process->unix_pid != -1) reply->unix_pid = process->unix_pid;
+        else set_error( STATUS_ACCESS_DENIED );
+        release_object( process );
+    }
+}
+
 /* notify the server that a dll has been loaded */
 DECL_HANDLER(load_dll)
 {
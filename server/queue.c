@@ -25,6 +25,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef HAVE_POLL_H
 # include <poll.h>
 #endif
@@ -140,6 +141,7 @@ struct msg_queue
     struct thread_input   *input;           /* thread input descriptor */
     struct hook_table     *hooks;           /* hook table */
     timeout_t              last_get_msg;    /* time of last get message call */
+    struct queue_shm      *shm;             /* state shared with the clients, if any */
 };
 
 struct hotkey
@@ -152,6 +154,14 @@ struct hotkey
     unsigned int        flags;        /* key modifiers */
 };
 
+#define QUEUE_SHM_COUNT (QUEUE_SHM_AREA_SIZE / sizeof(struct queue_shm))
+
+/* shared queue states, allocated when a client asks for them */
+static struct object *queue_shm_mapping;
+static struct queue_shm *queue_shm_states;
+static unsigned int queue_shm_hint;
+static unsigned int queue_shm_used[QUEUE_SHM_COUNT / 32];
+
 static void msg_queue_dump( struct object *obj, int verbose );
 static int msg_queue_add_queue( struct object *obj, struct wait_queue_entry *entry );
 static void msg_queue_remove_queue( struct object *obj, struct wait_queue_entry *entry );
@@ -298,6 +308,7 @@ static struct msg_queue *create_msg_queue( struct thread *thread, struct thread_
         queue->input           = (struct thread_input *)grab_object( input );
         queue->hooks           = NULL;
         queue->last_get_msg    = current_time;
+        queue->shm             = NULL;
         list_init( &queue->send_result );
         list_init( &queue->callback_result );
         list_init( &queue->pending_timers );
@@ -429,6 +440,55 @@ void set_queue_hooks( struct thread *thread, struct hook_table *hooks )
     queue->hooks = hooks;
 }
 
+/* allocate the shared state of a queue */
+static struct queue_shm *alloc_queue_shm( struct msg_queue *queue )
+{
+    unsigned int i, bit, word;
+    void *ptr;
+
+    if (!queue_shm_mapping)
+    {
+        if (!(queue_shm_mapping = create_shared_mapping( QUEUE_SHM_AREA_SIZE, &ptr ))) return NULL;
+        make_object_static( queue_shm_mapping );
+        queue_shm_states = ptr;
+    }
+
+    for (i = 0; i < QUEUE_SHM_COUNT / 32; i++)
+    {
+        word = (queue_shm_hint + i) % (QUEUE_SHM_COUNT / 32);
+        if (queue_shm_used[word] == ~0u) continue;
+        for (bit = 0; bit < 32; bit++) if (!(queue_shm_used[word] & (1u << bit))) break;
+        queue_shm_used[word] |= 1u << bit;
+        queue_shm_hint = word;
+
+        queue->shm = &queue_shm_states[word * 32 + bit];
+        queue->shm->wake_bits    = queue->wake_bits;
+        queue->shm->changed_bits = queue->changed_bits;
+        return queue->shm;
+    }
+    set_error( STATUS_NO_MEMORY );
+    return NULL;
+}
+
+static void free_queue_shm( struct msg_queue *queue )
+{
+    unsigned int index;
+
+    if (!queue->shm) return;
+    index = queue->shm - queue_shm_states;
+    memset( queue->shm, 0, sizeof(*queue->shm) );
+    queue_shm_used[index / 32] &= ~(1u << (index % 32));
+    queue->shm = NULL;
+}
+
+/* update the queue state shared with the client after the bits have changed */
+static inline void update_queue_shm( struct msg_queue *queue )
+{
+    if (!queue->shm) return;
+    queue->shm->wake_bits    = queue->wake_bits;
+    queue->shm->changed_bits = queue->changed_bits;
+}
+
 /* check the queue status */
 static inline int is_signaled( struct msg_queue *queue )
 {
@@ -440,6 +500,7 @@ static inline void set_queue_bits( struct msg_queue *queue, unsigned int bits )
 {
     queue->wake_bits |= bits;
     queue->changed_bits |= bits;
+    update_queue_shm( queue );
     if (is_signaled( queue )) wake_up( &queue->obj, 0 );
 }
 
@@ -448,6 +509,7 @@ static inline void clear_queue_bits( struct msg_queue *queue, unsigned int bits
 {
     queue->wake_bits &= ~bits;
     queue->changed_bits &= ~bits;
+    update_queue_shm( queue );
 }
 
 /* check whether msg is a keyboard message */
@@ -995,6 +1057,7 @@ static void msg_queue_destroy( struct object *obj )
     release_object( queue->input );
     if (queue->hooks) release_object( queue->hooks );
     if (queue->fd) release_object( queue->fd );
+    free_queue_shm( queue );
 }
 
 static void msg_queue_poll_event( struct fd *fd, int event )
@@ -2250,11 +2313,26 @@ DECL_HANDLER(get_queue_status)
         reply->wake_bits    = queue->wake_bits;
         reply->changed_bits = queue->changed_bits;
         queue->changed_bits &= ~req->clear_bits;
+        update_queue_shm( queue );
     }
     else reply->wake_bits = reply->changed_bits = 0;
 }
 
 
+/* get the location of the current queue state in the shared area */
+DECL_HANDLER(get_queue_shm)
+{
+    struct msg_queue *queue = get_current_queue();
+
+    if (!queue) return;
+    if (!queue->shm && !alloc_queue_shm( queue )) return;
+
+    reply->index = queue->shm - queue_shm_states;
+    if (req->map)
+        reply->handle = alloc_handle( current->process, queue_shm_mapping, SECTION_MAP_READ | SECTION_QUERY, 0 );
+}
+
+
 /* send a message to a thread queue */
 DECL_HANDLER(send_message)
 {
@@ -2425,6 +2503,7 @@ DECL_HANDLER(get_message)
     }
     if (filter & QS_INPUT) queue->changed_bits &= ~QS_INPUT;
     if (filter & QS_PAINT) queue->changed_bits &= ~QS_PAINT;
+    update_queue_shm( queue );
 
     /* then check for posted messages */
     if ((filter & QS_POSTMESSAGE) &&
@@ -35,6 +35,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#ifdef HAVE_SYS_WAIT_H
+# include <sys/wait.h>
+#endif
 #include <unistd.h>
 
 #include "ntstatus.h"
@@ -72,6 +75,10 @@ struct key
     int               last_subkey; /* last in use subkey */
     int               nb_subkeys;  /* count of allocated subkeys */
     struct key      **subkeys;     /* subkeys array */
+    unsigned int      hash;        /* hash value of the name */
+    struct list       hash_entry;  /* entry in the parent subkey hash table */
+    unsigned int      hash_size;   /* size of the subkey hash table */
+    struct list      *hash_table;  /* subkey hash table, only used for keys with many subkeys */
     int               last_value;  /* last in use value */
     int               nb_values;   /* count of allocated values in array */
     struct key_value *values;      /* values array */
@@ -87,6 +94,7 @@ struct key
 #define KEY_SYMLINK  0x0008  /* key is a symbolic link */
 #define KEY_WOW64    0x0010  /* key contains a Wow6432Node subkey */
 #define KEY_WOWSHARE 0x0020  /* key is a Wow64 shared key (used for Software\Classes) */
+#define KEY_CHANGED  0x0040  /* key contents have been modified since last saved */
 
 /* a key value */
 struct key_value
@@ -99,6 +107,7 @@ struct key_value
 };
 
 #define MIN_SUBKEYS  8   /* min. number of allocated subkeys per key */
+#define MIN_HASHED_SUBKEYS 64  /* min. number of subkeys to use a hash table */
 #define MIN_VALUES   8   /* min. number of allocated values per key */
 
 #define MAX_NAME_LEN  256    /* max. length of a key name */
@@ -125,12 +134,32 @@ struct save_branch_info
 {
     struct key  *key;
     const char  *path;
+    char        *log_path;      /* log of the changes since the file was saved */
+    char        *old_log_path;  /* log being merged into the file */
+    off_t        log_size;      /* size of the change log */
+    off_t        old_log_size;  /* size of the log being merged */
+    pid_t        save_pid;      /* process saving the file in the background */
+    int          need_save;     /* the change log is incomplete, the whole file must be saved */
 };
 
 #define MAX_SAVE_BRANCH_INFO 3
 static int save_branch_count;
 static struct save_branch_info save_branch_info[MAX_SAVE_BRANCH_INFO];
 
+#define MIN_MERGE_LOG_SIZE (256 * 1024)  /* min. size of the change log before merging it */
+
+/* a key deleted since the change log was last written */
+struct deleted_key
+{
+    struct list  entry;    /* entry in the deleted keys list */
+    struct key  *parent;   /* parent of the deleted key */
+    WCHAR       *name;     /* name of the deleted key */
+    data_size_t  namelen;  /* length of the name */
+};
+
+static struct list deleted_keys = LIST_INIT( deleted_keys );
+static int deleted_keys_lost;  /* failed to record a deleted key, the change log is not usable */
+
 
 /* information about a file being loaded */
 struct file_load_info
@@ -142,6 +171,7 @@ struct file_load_info
     int         line;     /* current input line */
     WCHAR      *tmp;      /* temp buffer to use while parsing input */
     size_t      tmplen;   /* length of temp buffer */
+    int         log;      /* loading a change log */
 };
 
 
@@ -188,6 +218,13 @@ static inline int is_wow6432node( const WCHAR *name, unsigned int len )
  * - key names use escapes too in order to support Unicode
  * - the modification time optionally follows the key name
  * - REG_EXPAND_SZ and REG_MULTI_SZ are saved as strings instead of hex
+ *
+ * Between full saves, the modified keys are appended to a change log in the
+ * same format, next to the registry file. Every key saved to the log has
+ * a #clear option that removes its previous values first, and deleted
+ * keys are recorded as !delete [name] lines. The log is replayed on top of
+ * the file at startup, and merged into the file once it has grown large
+ * enough.
  */
 
 /* dump the full path of a key */
@@ -255,6 +292,26 @@ static void dump_value( const struct key_value *value, FILE *f )
     fputc( '\n', f );
 }
 
+/* save a key and its values to a text file */
+static void save_key( const struct key *key, const struct key *base, FILE *f, int log )
+{
+    int i;
+
+    fprintf( f, "\n[" );
+    if (key != base) dump_path( key, base, f );
+    fprintf( f, "] %u\n", (unsigned int)((key->modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
+    fprintf( f, "#time=%x%08x\n", (unsigned int)(key->modif >> 32), (unsigned int)key->modif );
+    if (key->class)
+    {
+        fprintf( f, "#class=\"" );
+        dump_strW( key->class, key->classlen / sizeof(WCHAR), f, "\"\"" );
+        fprintf( f, "\"\n" );
+    }
+    if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
+    if (log) fputs( "#clear\n", f );
+    for (i = 0; i <= key->last_value; i++) dump_value( &key->values[i], f );
+}
+
 /* save a registry and all its subkeys to a text file */
 static void save_subkeys( const struct key *key, const struct key *base, FILE *f )
 {
@@ -264,23 +321,21 @@ static void save_subkeys( const struct key *key, const struct key *base, FILE *f
     /* save key if it has either some values or no subkeys, or needs special options */
     /* keys with no values but subkeys are saved implicitly by saving the subkeys */
     if ((key->last_value >= 0) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
-    {
-        fprintf( f, "\n[" );
-        if (key != base) dump_path( key, base, f );
-        fprintf( f, "] %u\n", (unsigned int)((key->modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
-        fprintf( f, "#time=%x%08x\n", (unsigned int)(key->modif >> 32), (unsigned int)key->modif );
-        if (key->class)
-        {
-            fprintf( f, "#class=\"" );
-            dump_strW( key->class, key->classlen / sizeof(WCHAR), f, "\"\"" );
-            fprintf( f, "\"\n" );
-        }
-        if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
-        for (i = 0; i <= key->last_value; i++) dump_value( &key->values[i], f );
-    }
+        save_key( key, base, f, 0 );
     for (i = 0; i <= key->last_subkey; i++) save_subkeys( key->subkeys[i], base, f );
 }
 
+/* save the keys modified since the last save to a change log */
+static void save_changed_keys( const struct key *key, const struct key *base, FILE *f )
+{
+    int i;
+
+    if (key->flags & KEY_VOLATILE) return;
+    if (!(key->flags & KEY_DIRTY)) return;
+    if (key->flags & KEY_CHANGED) save_key( key, base, f, 1 );
+    for (i = 0; i <= key->last_subkey; i++) save_changed_keys( key->subkeys[i], base, f );
+}
+
 static void dump_operation( const struct key *key, const struct key_value *value, const char *op )
 {
     fprintf( stderr, "%s key ", op );
@@ -424,6 +479,7 @@ static void key_destroy( struct object *obj )
         release_object( key->subkeys[i] );
     }
     free( key->subkeys );
+    free( key->hash_table );
     /* unconditionally notify everything waiting on this key */
     while ((ptr = list_head( &key->notify_list )))
     {
@@ -487,6 +543,9 @@ static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
         key->last_subkey = -1;
         key->nb_subkeys  = 0;
         key->subkeys     = NULL;
+        key->hash        = get_name_hash( name->str, name->len );
+        key->hash_size   = 0;
+        key->hash_table  = NULL;
         key->nb_values   = 0;
         key->last_value  = -1;
         key->values      = NULL;
@@ -520,7 +579,7 @@ static void make_clean( struct key *key )
 
     if (key->flags & KEY_VOLATILE) return;
     if (!(key->flags & KEY_DIRTY)) return;
-    key->flags &= ~KEY_DIRTY;
+    key->flags &= ~(KEY_DIRTY | KEY_CHANGED);
     for (i = 0; i <= key->last_subkey; i++) make_clean( key->subkeys[i] );
 }
 
@@ -543,6 +602,7 @@ static void touch_key( struct key *key, unsigned int change )
     struct key *k;
 
     key->modif = current_time;
+    key->flags |= KEY_CHANGED;
     make_dirty( key );
 
     /* do notifications */
@@ -576,6 +636,37 @@ static int grow_subkeys( struct key *key )
     return 1;
 }
 
+/* (re)build the subkey hash table of a key; failure is not fatal, lookups fall back to the array */
+static int rehash_subkeys( struct key *key, unsigned int size )
+{
+    struct list *table;
+    unsigned int i;
+
+    if (!(table = malloc( size * sizeof(*table) ))) return 0;
+    for (i = 0; i < size; i++) list_init( &table[i] );
+    for (i = 0; i <= key->last_subkey; i++)
+        list_add_tail( &table[key->subkeys[i]->hash % size], &key->subkeys[i]->hash_entry );
+    free( key->hash_table );
+    key->hash_table = table;
+    key->hash_size  = size;
+    return 1;
+}
+
+/* add a new subkey to the hash table of its parent, creating or growing it as needed */
+static void hash_subkey( struct key *parent, struct key *key )
+{
+    unsigned int count = parent->last_subkey + 1;
+
+    if (!parent->hash_table)
+    {
+        if (count >= MIN_HASHED_SUBKEYS) rehash_subkeys( parent, count * 2 - 1 );
+        return;
+    }
+    /* if growing fails, keep using the current table */
+    if (count > parent->hash_size * 2 && rehash_subkeys( parent, parent->hash_size * 4 + 1 )) return;
+    list_add_head( &parent->hash_table[key->hash % parent->hash_size], &key->hash_entry );
+}
+
 /* allocate a subkey for a given key, and return its index */
 static struct key *alloc_subkey( struct key *parent, const struct unicode_str *name,
                                  int index, timeout_t modif )
@@ -599,6 +690,7 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
         for (i = ++parent->last_subkey; i > index; i--)
             parent->subkeys[i] = parent->subkeys[i-1];
         parent->subkeys[index] = key;
+        hash_subkey( parent, key );
         if (is_wow6432node( key->name, key->namelen ) && !is_wow6432node( parent->name, parent->namelen ))
             parent->flags |= KEY_WOW64;
     }
@@ -617,6 +709,7 @@ static void free_subkey( struct key *parent, int index )
     key = parent->subkeys[index];
     for (i = index; i < parent->last_subkey; i++) parent->subkeys[i] = parent->subkeys[i + 1];
     parent->last_subkey--;
+    if (parent->hash_table) list_remove( &key->hash_entry );
     key->flags |= KEY_DELETED;
     key->parent = NULL;
     if (is_wow6432node( key->name, key->namelen )) parent->flags &= ~KEY_WOW64;
@@ -635,12 +728,26 @@ static void free_subkey( struct key *parent, int index )
     }
 }
 
-/* find the named child of a given key and return its index */
+/* find the named child of a given key */
+/* if not found, index is set to the position where it should be inserted */
 static struct key *find_subkey( const struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
     data_size_t len;
 
+    if (key->hash_table)
+    {
+        unsigned int hash = get_name_hash( name->str, name->len );
+        struct key *subkey;
+
+        LIST_FOR_EACH_ENTRY( subkey, &key->hash_table[hash % key->hash_size], struct key, hash_entry )
+        {
+            if (subkey->hash != hash || subkey->namelen != name->len) continue;
+            if (!memicmpW( subkey->name, name->str, name->len / sizeof(WCHAR) )) return subkey;
+        }
+        /* not found, we still need the insertion point */
+    }
+
     min = 0;
     max = key->last_subkey;
     while (min <= max)
@@ -661,6 +768,28 @@ static struct key *find_subkey( const struct key *key, const struct unicode_str
     return NULL;
 }
 
+/* return the index of a subkey in the array of its parent */
+static int get_subkey_index( const struct key *parent, const struct key *key )
+{
+    int i, min, max, res;
+    data_size_t len;
+
+    min = 0;
+    max = parent->last_subkey;
+    while (min <= max)
+    {
+        i = (min + max) / 2;
+        if (parent->subkeys[i] == key) return i;
+        len = min( parent->subkeys[i]->namelen, key->namelen );
+        res = memicmpW( parent->subkeys[i]->name, key->name, len / sizeof(WCHAR) );
+        if (!res) res = parent->subkeys[i]->namelen - key->namelen;
+        if (res > 0) max = i - 1;
+        else min = i + 1;
+    }
+    assert( 0 );  /* the key must be in its parent array */
+    return -1;
+}
+
 /* return the wow64 variant of the key, or the key itself if none */
 static struct key *find_wow64_subkey( struct key *key, const struct unicode_str *name )
 {
@@ -816,7 +945,7 @@ static struct key *create_key( struct key *key, const struct unicode_str *name,
 
     if (options & REG_OPTION_CREATE_LINK) key->flags |= KEY_SYMLINK;
     if (options & REG_OPTION_VOLATILE) key->flags |= KEY_VOLATILE;
-    else key->flags |= KEY_DIRTY;
+    else key->flags |= KEY_DIRTY | KEY_CHANGED;
 
     if (sd) default_set_sd( &key->obj, sd, OWNER_SECURITY_INFORMATION | GROUP_SECURITY_INFORMATION |
                             DACL_SECURITY_INFORMATION | SACL_SECURITY_INFORMATION );
@@ -982,6 +1111,42 @@ static void enum_key( const struct key *key, int index, int info_class,
     if (debug_level > 1) dump_operation( key, NULL, "Enum" );
 }
 
+/* remember a deleted key until the change log is written */
+static void log_deleted_key( struct key *parent, const struct key *key )
+{
+    struct deleted_key *deleted;
+
+    if (!(deleted = mem_alloc( sizeof(*deleted) )) ||
+        !(deleted->name = memdup( key->name, key->namelen )))
+    {
+        free( deleted );
+        clear_error();
+        deleted_keys_lost = 1;
+        return;
+    }
+    deleted->parent  = (struct key *)grab_object( parent );
+    deleted->namelen = key->namelen;
+    list_add_tail( &deleted_keys, &deleted->entry );
+}
+
+static void free_deleted_key( struct deleted_key *deleted )
+{
+    list_remove( &deleted->entry );
+    release_object( deleted->parent );
+    free( deleted->name );
+    free( deleted );
+}
+
+/* forget about all the deleted keys, once the branches have been saved */
+static void free_deleted_keys(void)
+{
+    struct deleted_key *deleted, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE( deleted, next, &deleted_keys, struct deleted_key, entry )
+        free_deleted_key( deleted );
+    deleted_keys_lost = 0;
+}
+
 /* delete a key and its values */
 static int delete_key( struct key *key, int recurse )
 {
@@ -1000,10 +1165,6 @@ static int delete_key( struct key *key, int recurse )
         if (0 > delete_key(key->subkeys[key->last_subkey], 1))
             return -1;
 
-    for (index = 0; index <= parent->last_subkey; index++)
-        if (parent->subkeys[index] == key) break;
-    assert( index <= parent->last_subkey );
-
     /* we can only delete a key that has no subkeys */
     if (key->last_subkey >= 0)
     {
@@ -1011,7 +1172,10 @@ static int delete_key( struct key *key, int recurse )
         return -1;
     }
 
+    index = get_subkey_index( parent, key );
+
     if (debug_level > 1) dump_operation( key, NULL, "Delete" );
+    if (!(key->flags & KEY_VOLATILE)) log_deleted_key( parent, key );
     free_subkey( parent, index );
     touch_key( parent, REG_NOTIFY_CHANGE_NAME );
     return 0;
@@ -1356,22 +1520,22 @@ static int get_data_type( const char *buffer, int *type, int *parse_type )
 }
 
 /* load and create a key from the input file */
-static struct key *load_key( struct key *base, const char *buffer, int prefix_len,
-                             struct file_load_info *info, timeout_t *modif )
+/* parse a key name line; an empty name stands for the base key */
+static int parse_key_name( const char *buffer, int prefix_len, struct file_load_info *info,
+                           struct unicode_str *name, timeout_t *modif )
 {
     WCHAR *p;
-    struct unicode_str name;
     int res;
     unsigned int mod;
     data_size_t len;
 
-    if (!get_file_tmp_space( info, strlen(buffer) * sizeof(WCHAR) )) return NULL;
+    if (!get_file_tmp_space( info, strlen(buffer) * sizeof(WCHAR) )) return 0;
 
     len = info->tmplen;
     if ((res = parse_strW( info->tmp, &len, buffer, ']' )) == -1)
     {
         file_read_error( "Malformed key", info );
-        return NULL;
+        return 0;
     }
     if (sscanf( buffer + res, " %u", &mod ) == 1)
         *modif = (timeout_t)mod * TICKS_PER_SEC + ticks_1601_to_1970;
@@ -1386,16 +1550,62 @@ static struct key *load_key( struct key *base, const char *buffer, int prefix_le
         if (prefix_len > 1)
         {
             file_read_error( "Malformed key", info );
-            return NULL;
+            return 0;
         }
-        /* empty key name, return base key */
-        return (struct key *)grab_object( base );
+        name->str = NULL;
+        name->len = 0;
+        return 1;
     }
-    name.str = p;
-    name.len = len - (p - info->tmp + 1) * sizeof(WCHAR);
+    name->str = p;
+    name->len = len - (p - info->tmp + 1) * sizeof(WCHAR);
+    return 1;
+}
+
+static struct key *load_key( struct key *base, const char *buffer, int prefix_len,
+                             struct file_load_info *info, timeout_t *modif )
+{
+    struct unicode_str name;
+
+    if (!parse_key_name( buffer, prefix_len, info, &name, modif )) return NULL;
+    /* empty key name, return base key */
+    if (!name.len) return (struct key *)grab_object( base );
     return create_key_recursive( base, &name, 0 );
 }
 
+/* delete a key recorded as deleted in a change log */
+static void load_deleted_key( struct key *base, const char *buffer, int prefix_len,
+                              struct file_load_info *info )
+{
+    struct unicode_str name, token;
+    struct key *key = base;
+    timeout_t modif;
+    int index;
+
+    if (!parse_key_name( buffer, prefix_len, info, &name, &modif ) || !name.len) return;
+
+    token.str = NULL;
+    if (!get_path_token( &name, &token )) return;
+    while (token.len)
+    {
+        if (!(key = find_subkey( key, &token, &index ))) return;
+        get_path_token( &name, &token );
+    }
+    free_subkey( key->parent, get_subkey_index( key->parent, key ) );
+}
+
+/* remove all the values of a key */
+static void clear_values( struct key *key )
+{
+    int i;
+
+    for (i = 0; i <= key->last_value; i++)
+    {
+        free( key->values[i].name );
+        free( key->values[i].data );
+    }
+    key->last_value = -1;
+}
+
 /* update the modification time of a key (and its parents) after it has been loaded from a file */
 static void update_key_time( struct key *key, timeout_t modif )
 {
@@ -1451,7 +1661,8 @@ static int load_key_option( struct key *key, const char *buffer, struct file_loa
             else if (*p >= 'a' && *p <= 'f') modif = (modif << 4) | (*p - 'a' + 10);
             else break;
         }
-        update_key_time( key, modif );
+        if (info->log) key->modif = modif;
+        else update_key_time( key, modif );
     }
     if (!strncmp( buffer, "#class=", 7 ))
     {
@@ -1465,6 +1676,7 @@ static int load_key_option( struct key *key, const char *buffer, struct file_loa
         key->classlen = len;
     }
     if (!strncmp( buffer, "#link", 5 )) key->flags |= KEY_SYMLINK;
+    if (info->log && !strncmp( buffer, "#clear", 6 )) clear_values( key );
     /* ignore unknown options */
     return 1;
 }
@@ -1623,7 +1835,7 @@ static int get_prefix_len( struct key *key, const char *name, struct file_load_i
 
 /* load all the keys from the input file */
 /* prefix_len is the number of key name prefixes to skip, or -1 for autodetection */
-static void load_keys( struct key *key, const char *filename, FILE *f, int prefix_len )
+static void load_keys( struct key *key, const char *filename, FILE *f, int prefix_len, int log )
 {
     struct key *subkey = NULL;
     struct file_load_info info;
@@ -1635,6 +1847,7 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
     info.len    = 4;
     info.tmplen = 4;
     info.line   = 0;
+    info.log    = log;
     if (!(info.buffer = mem_alloc( info.len ))) return;
     if (!(info.tmp = mem_alloc( info.tmplen )))
     {
@@ -1660,6 +1873,7 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
             {
                 update_key_time( subkey, modif );
                 release_object( subkey );
+                subkey = NULL;
             }
             if (prefix_len == -1) prefix_len = get_prefix_len( key, p + 1, &info );
             if (!(subkey = load_key( key, p + 1, prefix_len, &info, &modif )))
@@ -1674,6 +1888,16 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
             if (subkey) load_key_option( subkey, p, &info );
             else if (!load_global_option( p, &info )) goto done;
             break;
+        case '!':   /* deleted key */
+            if (subkey)
+            {
+                update_key_time( subkey, modif );
+                release_object( subkey );
+                subkey = NULL;
+            }
+            if (log && !strncmp( p, "!delete [", 9 )) load_deleted_key( key, p + 9, prefix_len, &info );
+            else file_read_error( "Unrecognized input", &info );
+            break;
         case ';':   /* comment */
         case 0:     /* empty line */
             break;
@@ -1707,21 +1931,39 @@ static void load_registry( struct key *key, obj_handle_t handle )
         FILE *f = fdopen( fd, "r" );
         if (f)
         {
-            load_keys( key, NULL, f, -1 );
+            load_keys( key, NULL, f, -1, 0 );
             fclose( f );
         }
         else file_set_error();
     }
 }
 
+/* replay a change log on top of a registry branch, and return its size */
+static off_t load_change_log( const char *filename, struct key *key )
+{
+    struct stat st;
+    off_t size = 0;
+    FILE *f;
+
+    if (!(f = fopen( filename, "r" ))) return 0;
+    if (!fstat( fileno( f ), &st )) size = st.st_size;
+    load_keys( key, filename, f, 0, 1 );
+    fclose( f );
+    if (get_error() == STATUS_NOT_REGISTRY_FILE)
+        fprintf( stderr, "%s is not a valid registry change log\n", filename );
+    clear_error();
+    return size;
+}
+
 /* load one of the initial registry files */
 static int load_init_registry_from_file( const char *filename, struct key *key )
 {
+    struct save_branch_info *info;
     FILE *f;
 
     if ((f = fopen( filename, "r" )))
     {
-        load_keys( key, filename, f, 0 );
+        load_keys( key, filename, f, 0, 0 );
         fclose( f );
         if (get_error() == STATUS_NOT_REGISTRY_FILE)
         {
@@ -1732,9 +1974,21 @@ static int load_init_registry_from_file( const char *filename, struct key *key )
 
     assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
 
-    save_branch_info[save_branch_count].path = filename;
-    save_branch_info[save_branch_count++].key = (struct key *)grab_object( key );
+    info = &save_branch_info[save_branch_count++];
+    info->path = filename;
+    info->key = (struct key *)grab_object( key );
+    info->save_pid = 0;
+    info->need_save = 0;
+    if (!(info->log_path = malloc( strlen( filename ) + sizeof(".log") )) ||
+        !(info->old_log_path = malloc( strlen( filename ) + sizeof(".log.old") )))
+        fatal_error( "out of memory\n" );
+    sprintf( info->log_path, "%s.log", filename );
+    sprintf( info->old_log_path, "%s.log.old", filename );
     make_object_static( &key->obj );
+
+    /* apply the changes that were not merged into the file yet */
+    info->old_log_size = load_change_log( info->old_log_path, key );
+    info->log_size = load_change_log( info->log_path, key );
     return (f != NULL);
 }
 
@@ -1918,12 +2172,6 @@ static int save_branch( struct key *key, const char *path )
     int fd, count = 0, ret = 0;
     FILE *f;
 
-    if (!(key->flags & KEY_DIRTY))
-    {
-        if (debug_level > 1) dump_operation( key, NULL, "Not saving clean" );
-        return 1;
-    }
-
     /* test the file type */
 
     if ((fd = open( path, O_WRONLY )) != -1)
@@ -1984,6 +2232,144 @@ done:
     return ret;
 }
 
+/* check whether a key belongs to a registry branch */
+static int is_key_in_branch( const struct key *key, const struct key *base )
+{
+    for ( ; key; key = key->parent) if (key == base) return 1;
+    return 0;
+}
+
+/* append the changes made to a registry branch to its change log */
+static int save_branch_log( struct save_branch_info *info )
+{
+    static const char header[] = "WINE REGISTRY Version 2\n";
+    struct deleted_key *deleted, *next;
+    struct key *key = info->key;
+    long size;
+    FILE *f;
+    int ret;
+
+    if (!(key->flags & KEY_DIRTY)) return 1;
+    if (!(f = fopen( info->log_path, "a" ))) return 0;
+
+    if (debug_level > 1)
+    {
+        fprintf( stderr, "%s: ", info->log_path );
+        dump_operation( key, NULL, "logging" );
+    }
+
+    fseek( f, 0, SEEK_END );
+    if (!ftell( f )) fputs( header, f );
+
+    LIST_FOR_EACH_ENTRY_SAFE( deleted, next, &deleted_keys, struct deleted_key, entry )
+    {
+        if (!is_key_in_branch( deleted->parent, key )) continue;
+        fprintf( f, "\n!delete [" );
+        if (deleted->parent != key)
+        {
+            dump_path( deleted->parent, key, f );
+            fprintf( f, "\\\\" );
+        }
+        dump_strW( deleted->name, deleted->namelen / sizeof(WCHAR), f, "[]" );
+        fprintf( f, "]\n" );
+        free_deleted_key( deleted );
+    }
+    save_changed_keys( key, key, f );
+
+    size = ftell( f );
+    ret = !fclose( f ) && size != -1;
+    if (ret)
+    {
+        info->log_size = size;
+        make_clean( key );
+    }
+    return ret;
+}
+
+/* append a change log to the one being merged, skipping its header */
+static int append_change_log( struct save_branch_info *info )
+{
+    static const char header[] = "WINE REGISTRY Version 2\n";
+    char buffer[8192];
+    int src, dst, ret = 0;
+    ssize_t size;
+
+    if ((src = open( info->log_path, O_RDONLY )) == -1) return 0;
+    if ((dst = open( info->old_log_path, O_WRONLY | O_APPEND )) == -1)
+    {
+        close( src );
+        return 0;
+    }
+    if (lseek( src, sizeof(header) - 1, SEEK_SET ) != -1)
+    {
+        while ((size = read( src, buffer, sizeof(buffer) )) > 0)
+            if (write( dst, buffer, size ) != size) break;
+        ret = !size;
+    }
+    if (close( dst )) ret = 0;
+    close( src );
+    return ret && !unlink( info->log_path );
+}
+
+/* check whether the background save of a branch is finished */
+static int is_branch_save_running( struct save_branch_info *info )
+{
+    struct stat st;
+
+    if (!info->save_pid) return 0;
+    /* the process may already have been reaped by the SIGCHLD handler */
+    if (!waitpid( info->save_pid, NULL, WNOHANG )) return 1;
+    info->save_pid = 0;
+    /* the old log is removed once the file has been successfully saved */
+    info->old_log_size = stat( info->old_log_path, &st ) ? 0 : st.st_size;
+    return 0;
+}
+
+/* merge the change log of a branch into its file, in the background if possible */
+static void merge_branch_log( struct save_branch_info *info )
+{
+    struct stat st;
+#ifdef USE_PTRACE
+    pid_t pid;
+#endif
+
+    if (is_branch_save_running( info )) return;
+    if (info->log_size + info->old_log_size < MIN_MERGE_LOG_SIZE) return;
+    if (!stat( info->path, &st ) && info->log_size + info->old_log_size < st.st_size / 2) return;
+
+    /* the file being saved includes all the logged changes, start a new log */
+    if (info->log_size)
+    {
+        if (info->old_log_size)
+        {
+            if (!append_change_log( info )) return;
+        }
+        else if (rename( info->log_path, info->old_log_path )) return;
+        info->old_log_size += info->log_size;
+        info->log_size = 0;
+    }
+
+#ifdef USE_PTRACE  /* the SIGCHLD handler can't cope with unknown children otherwise */
+    if (!(pid = fork()))
+    {
+        int ret = save_branch( info->key, info->path );
+        if (ret) unlink( info->old_log_path );
+        _exit( !ret );
+    }
+    if (pid != -1)
+    {
+        if (debug_level > 1) fprintf( stderr, "%s: saving in process %d\n", info->path, pid );
+        info->save_pid = pid;
+        return;
+    }
+#endif
+    if (save_branch( info->key, info->path ))
+    {
+        unlink( info->old_log_path );
+        info->old_log_size = 0;
+    }
+}
+
 /* periodic saving of the registry */
 static void periodic_save( void *arg )
 {
@@ -1992,7 +2378,29 @@ static void periodic_save( void *arg )
     if (fchdir( config_dir_fd ) == -1) return;
     save_timeout_user = NULL;
     for (i = 0; i < save_branch_count; i++)
-        save_branch( save_branch_info[i].key, save_branch_info[i].path );
+    {
+        struct save_branch_info *info = &save_branch_info[i];
+
+        if (info->key->flags & KEY_DIRTY)
+        {
+            if (deleted_keys_lost || !save_branch_log( info )) info->need_save = 1;
+        }
+        if (info->need_save)
+        {
+            /* the log is incomplete, save the whole branch */
+            if (is_branch_save_running( info )) continue;
+            if (save_branch( info->key, info->path ))
+            {
+                unlink( info->log_path );
+                unlink( info->old_log_path );
+                info->log_size = info->old_log_size = 0;
+                info->need_save = 0;
+            }
+        }
+        else merge_branch_log( info );
+    }
+    /* forget about deleted keys that are not part of a saved branch */
+    free_deleted_keys();
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
     set_periodic_save_timer();
 }
@@ -2012,13 +2420,31 @@ void flush_registry(void)
     if (fchdir( config_dir_fd ) == -1) return;
     for (i = 0; i < save_branch_count; i++)
     {
-        if (!save_branch( save_branch_info[i].key, save_branch_info[i].path ))
+        struct save_branch_info *info = &save_branch_info[i];
+
+        if (info->save_pid)
+        {
+            waitpid( info->save_pid, NULL, 0 );
+            is_branch_save_running( info );
+        }
+        if (!(info->key->flags & KEY_DIRTY) && !info->need_save && !info->log_size && !info->old_log_size)
+        {
+            if (debug_level > 1) dump_operation( info->key, NULL, "Not saving clean" );
+            continue;
+        }
+        if (!save_branch( info->key, info->path ))
         {
             fprintf( stderr, "wineserver: could not save registry branch to %s",
-                     save_branch_info[i].path );
+                     info->path );
             perror( " " );
+            continue;
         }
+        unlink( info->log_path );
+        unlink( info->old_log_path );
+        info->log_size = info->old_log_size = 0;
+        info->need_save = 0;
     }
+    free_deleted_keys();
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
 }
 
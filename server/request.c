@@ -35,9 +35,15 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 #ifdef HAVE_SYS_SOCKET_H
 # include <sys/socket.h>
 #endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 #ifdef HAVE_SYS_WAIT_H
 # include <sys/wait.h>
 #endif
@@ -245,11 +251,41 @@ void write_reply( struct thread *thread )
         fatal_protocol_error( thread, "reply write: %s\n", strerror( errno ));
 }
 
+#ifdef __linux__
+static inline void futex_wake( int *addr, int count )
+{
+    syscall( __NR_futex, addr, 1 /* FUTEX_WAKE */, count, NULL, 0, 0 );
+}
+#else
+static inline void futex_wake( int *addr, int count ) { }
+#endif
+
+/* send the reply to a request received in the shared buffer, and wake the client */
+static void send_shm_reply( union generic_reply *reply )
+{
+    struct request_shm *shm = current->request_shm;
+
+    memcpy( &shm->header, reply, sizeof(*reply) );
+    if (current->reply_size) memcpy( shm + 1, current->reply_data, current->reply_size );
+    free( current->reply_data );
+    current->reply_data = NULL;
+    current->shm_request = 0;
+    __sync_synchronize();
+    shm->state = REQUEST_SHM_REPLY;
+    futex_wake( &shm->state, 1 );
+}
+
 /* send a reply to the current thread */
 static void send_reply( union generic_reply *reply )
 {
     int ret;
 
+    if (current->shm_request)
+    {
+        send_shm_reply( reply );
+        return;
+    }
+
     if (!current->reply_size)
     {
         if ((ret = write( get_unix_fd( current->reply_fd ),
@@ -372,6 +408,49 @@ error:
         fatal_protocol_error( thread, "read: %s\n", strerror( errno ));
 }
 
+/* read a request posted in the shared buffer of a thread */
+void read_shm_request( struct thread *thread )
+{
+    struct request_shm *shm = thread->request_shm;
+    unsigned int size;
+    ULONG64 count;
+
+    /* reset the eventfd counter, the client has at most one request in flight */
+    if (read( get_unix_fd( thread->doorbell_fd ), &count, sizeof(count) ) != sizeof(count)) return;
+    if (shm->state != REQUEST_SHM_REQUEST) return;
+
+    /* copy everything out so that the client cannot change it while it is being handled */
+    memcpy( &thread->req, &shm->header, sizeof(thread->req) );
+    size = thread->req.request_header.request_size;
+    if (size > REQUEST_SHM_DATA_SIZE || thread->req.request_header.reply_size > REQUEST_SHM_DATA_SIZE)
+    {
+        fatal_protocol_error( thread, "shared request %d too large\n", thread->req.request_header.req );
+        return;
+    }
+    if (size)
+    {
+        if (!(thread->req_data = malloc( size )))
+        {
+            fatal_protocol_error( thread, "no memory for %u bytes request %d\n",
+                                  size, thread->req.request_header.req );
+            return;
+        }
+        memcpy( thread->req_data, shm + 1, size );
+    }
+    thread->shm_request = 1;
+    call_req_handler( thread );
+    free( thread->req_data );
+    thread->req_data = NULL;
+}
+
+/* unmap the shared buffer of a dead thread, releasing the client if it is waiting for a reply */
+void close_request_shm( struct thread *thread )
+{
+    thread->request_shm->state = REQUEST_SHM_DEAD;
+    futex_wake( &thread->request_shm->state, 1 );
+    munmap( thread->request_shm, REQUEST_SHM_SIZE );
+}
+
 /* receive a file descriptor on the process socket */
 int receive_fd( struct process *process )
 {
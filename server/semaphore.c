@@ -41,22 +41,26 @@ struct semaphore
     struct object  obj;    /* object header */
     unsigned int   count;  /* current count */
     unsigned int   max;    /* maximum possible count */
+    struct inproc_sync_ref sync; /* state shared with the creator process */
 };
 
 static void semaphore_dump( struct object *obj, int verbose );
 static struct object_type *semaphore_get_type( struct object *obj );
+static int semaphore_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static void semaphore_remove_queue( struct object *obj, struct wait_queue_entry *entry );
 static int semaphore_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void semaphore_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static unsigned int semaphore_map_access( struct object *obj, unsigned int access );
 static int semaphore_signal( struct object *obj, unsigned int access );
+static void semaphore_destroy( struct object *obj );
 
 static const struct object_ops semaphore_ops =
 {
     sizeof(struct semaphore),      /* size */
     semaphore_dump,                /* dump */
     semaphore_get_type,            /* get_type */
-    add_queue,                     /* add_queue */
-    remove_queue,                  /* remove_queue */
+    semaphore_add_queue,           /* add_queue */
+    semaphore_remove_queue,        /* remove_queue */
     semaphore_signaled,            /* signaled */
     semaphore_satisfied,           /* satisfied */
     semaphore_signal,              /* signal */
@@ -69,7 +73,7 @@ static const struct object_ops semaphore_ops =
     default_unlink_name,           /* unlink_name */
     no_open_file,                  /* open_file */
     no_close_handle,               /* close_handle */
-    no_destroy                     /* destroy */
+    semaphore_destroy              /* destroy */
 };
 
 
@@ -91,14 +95,52 @@ static struct semaphore *create_semaphore( struct object *root, const struct uni
             /* initialize it if it didn't already exist */
             sem->count = initial;
             sem->max   = max;
+            alloc_inproc_sync( &sem->sync, current->process, INPROC_SYNC_SEMAPHORE, initial, max );
         }
     }
     return sem;
 }
 
+struct inproc_sync_ref *get_semaphore_inproc_sync( struct object *obj )
+{
+    if (obj->ops != &semaphore_ops) return NULL;
+    return &((struct semaphore *)obj)->sync;
+}
+
+static inline unsigned int get_semaphore_count( struct semaphore *sem )
+{
+    if (sem->sync.shm) return sem->sync.shm->state & ~INPROC_SYNC_SERVER_WAIT;
+    return sem->count;
+}
+
+static int release_shared_semaphore( struct semaphore *sem, unsigned int count, unsigned int *prev )
+{
+    unsigned int current_count;
+    int state;
+
+    do
+    {
+        state = sem->sync.shm->state;
+        current_count = state & ~INPROC_SYNC_SERVER_WAIT;
+        if (prev) *prev = current_count;
+        if (current_count + count < current_count || current_count + count > sem->max)
+        {
+            set_error( STATUS_SEMAPHORE_LIMIT_EXCEEDED );
+            return 0;
+        }
+    } while (update_inproc_sync( &sem->sync, (state & INPROC_SYNC_SERVER_WAIT) | (current_count + count),
+                                 state ) != state);
+
+    wake_up( &sem->obj, count );
+    if (get_semaphore_count( sem )) wake_inproc_sync( &sem->sync, count );
+    return 1;
+}
+
 static int release_semaphore( struct semaphore *sem, unsigned int count,
                               unsigned int *prev )
 {
+    if (sem->sync.shm) return release_shared_semaphore( sem, count, prev );
+
     if (prev) *prev = sem->count;
     if (sem->count + count < sem->count || sem->count + count > sem->max)
     {
@@ -122,7 +164,8 @@ static void semaphore_dump( struct object *obj, int verbose )
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
-    fprintf( stderr, "Semaphore count=%d max=%d\n", sem->count, sem->max );
+    fprintf( stderr, "Semaphore count=%d max=%d%s\n", get_semaphore_count( sem ), sem->max,
+             sem->sync.shm ? " shared" : "" );
 }
 
 static struct object_type *semaphore_get_type( struct object *obj )
@@ -132,17 +175,46 @@ static struct object_type *semaphore_get_type( struct object *obj )
     return get_object_type( &str );
 }
 
+static int semaphore_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    if (sem->sync.shm) set_inproc_sync_server_wait( &sem->sync, 1 );
+    return add_queue( obj, entry );
+}
+
+static void semaphore_remove_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    remove_queue( obj, entry );
+    if (sem->sync.shm && list_empty( &obj->wait_queue )) set_inproc_sync_server_wait( &sem->sync, 0 );
+}
+
 static int semaphore_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
-    return (sem->count > 0);
+    return (get_semaphore_count( sem ) > 0);
 }
 
 static void semaphore_satisfied( struct object *obj, struct wait_queue_entry *entry )
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
+
+    if (sem->sync.shm)
+    {
+        int state;
+
+        /* don't trust the client to have left the count alone */
+        do
+        {
+            state = sem->sync.shm->state;
+            if (!(state & ~INPROC_SYNC_SERVER_WAIT)) return;
+        } while (update_inproc_sync( &sem->sync, state - 1, state ) != state);
+        return;
+    }
     assert( sem->count );
     sem->count--;
 }
@@ -169,6 +241,13 @@ static int semaphore_signal( struct object *obj, unsigned int access )
     return release_semaphore( sem, 1, NULL );
 }
 
+static void semaphore_destroy( struct object *obj )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    free_inproc_sync( &sem->sync );
+}
+
 /* create a semaphore */
 DECL_HANDLER(create_semaphore)
 {
@@ -223,7 +302,7 @@ DECL_HANDLER(query_semaphore)
     if ((sem = (struct semaphore *)get_handle_obj( current->process, req->handle,
                                                    SEMAPHORE_QUERY_STATE, &semaphore_ops )))
     {
-        reply->current = sem->count;
+        reply->current = get_semaphore_count( sem );
         reply->max = sem->max;
         release_object( sem );
     }
@@ -30,6 +30,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 #include <unistd.h>
 #include <time.h>
 #ifdef HAVE_POLL_H
@@ -76,6 +82,7 @@ struct thread_wait
     int                     count;      /* count of objects */
     int                     flags;
     int                     abandoned;
+    unsigned int            status;     /* failure status set by a satisfied object */
     enum select_op          select;
     client_ptr_t            key;        /* wait key for keyed events */
     client_ptr_t            cookie;     /* magic cookie to return to client */
@@ -190,7 +197,10 @@ static inline void init_thread_structure( struct thread *thread )
     thread->req_toread      = 0;
     thread->reply_data      = NULL;
     thread->reply_towrite   = 0;
+    thread->request_shm     = NULL;
+    thread->shm_request     = 0;
     thread->request_fd      = NULL;
+    thread->doorbell_fd     = NULL;
     thread->reply_fd        = NULL;
     thread->wait_fd         = NULL;
     thread->state           = RUNNING;
@@ -268,7 +278,8 @@ static void thread_poll_event( struct fd *fd, int event )
     assert( thread->obj.ops == &thread_ops );
 
     grab_object( thread );
-    if (event & (POLLERR | POLLHUP)) kill_thread( thread, 0 );
+    if (fd == thread->doorbell_fd) read_shm_request( thread );
+    else if (event & (POLLERR | POLLHUP)) kill_thread( thread, 0 );
     else if (event & POLLIN) read_request( thread );
     else if (event & POLLOUT) write_reply( thread );
     release_object( thread );
@@ -284,6 +295,8 @@ static void cleanup_thread( struct thread *thread )
     clear_apc_queue( &thread->user_apc );
     free( thread->req_data );
     free( thread->reply_data );
+    if (thread->request_shm) close_request_shm( thread );
+    if (thread->doorbell_fd) release_object( thread->doorbell_fd );
     if (thread->request_fd) release_object( thread->request_fd );
     if (thread->reply_fd) release_object( thread->reply_fd );
     if (thread->wait_fd) release_object( thread->wait_fd );
@@ -302,6 +315,9 @@ static void cleanup_thread( struct thread *thread )
     }
     thread->req_data = NULL;
     thread->reply_data = NULL;
+    thread->request_shm = NULL;
+    thread->shm_request = 0;
+    thread->doorbell_fd = NULL;
     thread->request_fd = NULL;
     thread->reply_fd = NULL;
     thread->wait_fd = NULL;
@@ -583,6 +599,12 @@ void make_wait_abandoned( struct wait_queue_entry *entry )
     entry->wait->abandoned = 1;
 }
 
+/* make the wait fail with the given status, when the object could not be acquired */
+void make_wait_failed( struct wait_queue_entry *entry, unsigned int status )
+{
+    entry->wait->status = status;
+}
+
 /* finish waiting */
 static void end_wait( struct thread *thread )
 {
@@ -616,6 +638,7 @@ static int wait_on( const select_op_t *select_op, unsigned int count, struct obj
     wait->user    = NULL;
     wait->timeout = timeout;
     wait->abandoned = 0;
+    wait->status  = 0;
     current->wait = wait;
 
     for (i = 0, entry = wait->queues; i < count; i++, entry++)
@@ -666,6 +689,8 @@ static int check_wait( struct thread *thread )
     /* Suspended threads may not acquire locks, but they can run system APCs */
     if (thread->process->suspend + thread->suspend > 0) return -1;
 
+    /* objects that can't be acquired set the status from their signaled() function */
+    wait->status = 0;
     if (wait->select == SELECT_WAIT_ALL)
     {
         int not_ok = 0;
@@ -674,6 +699,7 @@ static int check_wait( struct thread *thread )
         for (i = 0, entry = wait->queues; i < wait->count; i++, entry++)
             not_ok |= !entry->obj->ops->signaled( entry->obj, entry );
         if (not_ok) goto other_checks;
+        if (wait->status) return wait->status;
         /* Wait satisfied: tell it to all objects */
         for (i = 0, entry = wait->queues; i < wait->count; i++, entry++)
             entry->obj->ops->satisfied( entry->obj, entry );
@@ -684,6 +710,7 @@ static int check_wait( struct thread *thread )
         for (i = 0, entry = wait->queues; i < wait->count; i++, entry++)
         {
             if (!entry->obj->ops->signaled( entry->obj, entry )) continue;
+            if (wait->status) return wait->status;
             /* Wait satisfied: tell it to the object */
             entry->obj->ops->satisfied( entry->obj, entry );
             if (wait->abandoned) i += STATUS_ABANDONED_WAIT_0;
@@ -756,6 +783,7 @@ int wake_thread_queue_entry( struct wait_queue_entry *entry )
     signaled = entry - wait->queues;
     entry->obj->ops->satisfied( entry->obj, entry );
     if (wait->abandoned) signaled += STATUS_ABANDONED_WAIT_0;
+    if (wait->status) signaled = wait->status;
 
     cookie = wait->cookie;
     if (debug_level) fprintf( stderr, "%04x: *wakeup* signaled=%d\n", thread->id, signaled );
@@ -1336,6 +1364,54 @@ DECL_HANDLER(init_thread)
     if (wait_fd != -1) close( wait_fd );
 }
 
+/* create the buffer used to pass requests and replies through shared memory */
+DECL_HANDLER(init_request_shm)
+{
+#if defined(__linux__) && defined(HAVE_SYS_EVENTFD_H)
+    void *ptr;
+    int fd, doorbell;
+
+    if (current->request_shm)  /* already initialised */
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        return;
+    }
+    if ((doorbell = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC )) == -1)
+    {
+        file_set_error();
+        return;
+    }
+    if ((fd = create_temp_file( REQUEST_SHM_SIZE )) == -1)
+    {
+        close( doorbell );
+        return;
+    }
+
+    if ((ptr = mmap( NULL, REQUEST_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) == MAP_FAILED)
+        file_set_error();
+    else if (send_client_fd( current->process, fd, current->id ) == -1 ||
+             send_client_fd( current->process, doorbell, current->id ) == -1)
+        munmap( ptr, REQUEST_SHM_SIZE );
+    else
+    {
+        /* the fd object owns the eventfd from now on, even on failure */
+        if ((current->doorbell_fd = create_anonymous_fd( &thread_fd_ops, doorbell, &current->obj, 0 )))
+        {
+            current->request_shm = ptr;
+            /* let the fds written before the request was posted be seen first */
+            set_fd_poll_last( current->doorbell_fd );
+            set_fd_events( current->doorbell_fd, POLLIN );
+        }
+        else munmap( ptr, REQUEST_SHM_SIZE );
+        doorbell = -1;
+    }
+    close( fd );
+    if (doorbell != -1) close( doorbell );
+#else
+    set_error( STATUS_NOT_IMPLEMENTED );
+#endif
+}
+
 /* terminate a thread */
 DECL_HANDLER(terminate_thread)
 {
@@ -69,7 +69,10 @@ struct thread
     void                  *reply_data;    /* variable-size data for reply */
     unsigned int           reply_size;    /* size of reply data */
     unsigned int           reply_towrite; /* amount of data still to write in reply */
+    struct request_shm    *request_shm;   /* buffer shared with the client for requests and replies */
+    int                    shm_request;   /* current request came through the shared buffer */
     struct fd             *request_fd;    /* fd for receiving client requests */
+    struct fd             *doorbell_fd;   /* eventfd signaled when a request is in the shared buffer */
     struct fd             *reply_fd;      /* fd to send a reply to a client */
     struct fd             *wait_fd;       /* fd to use to wake a sleeping client */
     enum run_state         state;         /* running state */
@@ -110,6 +113,7 @@ extern struct thread *get_wait_queue_thread( struct wait_queue_entry *entry );
 extern enum select_op get_wait_queue_select_op( struct wait_queue_entry *entry );
 extern client_ptr_t get_wait_queue_key( struct wait_queue_entry *entry );
 extern void make_wait_abandoned( struct wait_queue_entry *entry );
+extern void make_wait_failed( struct wait_queue_entry *entry, unsigned int status );
 extern void stop_thread( struct thread *thread );
 extern void stop_thread_if_suspended( struct thread *thread );
 extern int wake_thread( struct thread *thread );
@@ -33,6 +33,8 @@
 #include "winternl.h"
 
 #include "object.h"
+#include "file.h"
+#include "handle.h"
 #include "request.h"
 #include "thread.h"
 #include "process.h"
@@ -118,6 +120,10 @@ static struct window *shell_listview;
 static struct window *progman_window;
 static struct window *taskman_window;
 
+/* window states shared with the clients, mapped once a client asks for them */
+static struct object *window_shm_mapping;
+static struct window_shm *window_shm_states;
+
 /* magic HWND_TOP etc. pointers */
 #define WINPTR_TOP       ((struct window *)1L)
 #define WINPTR_BOTTOM    ((struct window *)2L)
@@ -138,6 +144,50 @@ static inline int is_desktop_window( const struct window *win )
     return !win->parent;  /* only desktop windows have no parent */
 }
 
+static inline struct window_shm *get_window_shm( user_handle_t handle )
+{
+    return &window_shm_states[((handle & 0xffff) - FIRST_USER_HANDLE) >> 1];
+}
+
+/* update the window state shared with the clients, after it has been changed */
+static void update_window_shm( struct window *win )
+{
+    struct window_shm *shm;
+
+    if (!window_shm_states) return;
+    shm = get_window_shm( win->handle );
+    shm->seq++;
+    __sync_synchronize();
+    shm->handle      = win->handle;
+    shm->parent      = win->parent ? win->parent->handle : 0;
+    shm->owner       = win->owner;
+    shm->tid         = win->thread ? get_thread_id( win->thread ) : 0;
+    shm->pid         = win->thread ? get_process_id( win->thread->process ) : 0;
+    shm->style       = win->style;
+    shm->ex_style    = win->ex_style;
+    shm->id          = win->id;
+    shm->instance    = win->instance;
+    shm->user_data   = win->user_data;
+    shm->window_rect = win->window_rect;
+    shm->client_rect = win->client_rect;
+    __sync_synchronize();
+    shm->seq++;
+}
+
+/* mark the shared state entry as no longer being a window */
+static void clear_window_shm( struct window *win )
+{
+    struct window_shm *shm;
+
+    if (!window_shm_states) return;
+    shm = get_window_shm( win->handle );
+    shm->seq++;
+    __sync_synchronize();
+    shm->handle = 0;
+    __sync_synchronize();
+    shm->seq++;
+}
+
 /* get next window in Z-order list */
 static inline struct window *get_next_window( struct window *win )
 {
@@ -227,6 +277,7 @@ static void link_window( struct window *win, struct window *previous )
     }
 
     win->is_linked = 1;
+    update_window_shm( win );
 }
 
 /* change the parent of a window (or unlink the window if the new parent is NULL) */
@@ -263,6 +314,7 @@ static int set_parent_window( struct window *win, struct window *parent )
         list_add_head( &win->parent->unlinked, &win->entry );
         win->is_linked = 0;
     }
+    update_window_shm( win );
     return 1;
 }
 
@@ -401,6 +453,7 @@ static void detach_window_thread( struct window *win )
     /* destroyed when the desktop ref count reaches zero */
     release_object( win->desktop );
     win->thread = NULL;
+    update_window_shm( win );
 }
 
 /* get the process owning the top window of a given desktop */
@@ -527,6 +580,7 @@ static struct window *create_window( struct window *parent, struct window *owner
     }
 
     current->desktop_users++;
+    update_window_shm( win );
     return win;
 
 failed:
@@ -1670,8 +1724,10 @@ static void set_window_pos( struct window *win, struct window *previous,
             offset_rect( &child->window_rect, new_size - old_size, 0 );
             offset_rect( &child->visible_rect, new_size - old_size, 0 );
             offset_rect( &child->client_rect, new_size - old_size, 0 );
+            update_window_shm( child );
         }
     }
+    update_window_shm( win );
 
     /* reset cursor clip rectangle when the desktop changes size */
     if (win == win->desktop->top_window) win->desktop->cursor.clip = *window_rect;
@@ -1855,6 +1911,7 @@ void destroy_window( struct window *win )
     if (win == progman_window) progman_window = NULL;
     if (win == taskman_window) taskman_window = NULL;
     free_hotkeys( win->desktop, win->handle );
+    clear_window_shm( win );
     free_user_handle( win->handle );
     destroy_properties( win );
     list_remove( &win->entry );
@@ -1966,6 +2023,7 @@ DECL_HANDLER(get_desktop_window)
         {
             detach_window_thread( desktop->top_window );
             desktop->top_window->style  = WS_POPUP | WS_VISIBLE | WS_CLIPSIBLINGS | WS_CLIPCHILDREN;
+            update_window_shm( desktop->top_window );
         }
     }
 
@@ -1978,6 +2036,7 @@ DECL_HANDLER(get_desktop_window)
         {
             detach_window_thread( desktop->msg_window );
             desktop->msg_window->style = WS_POPUP | WS_CLIPSIBLINGS | WS_CLIPCHILDREN;
+            update_window_shm( desktop->msg_window );
         }
     }
 
@@ -2013,6 +2072,26 @@ DECL_HANDLER(set_window_owner)
 
     reply->prev_owner = win->owner;
     reply->full_owner = win->owner = owner ? owner->handle : 0;
+    update_window_shm( win );
+}
+
+
+/* get a handle to the mapping of the shared window states */
+DECL_HANDLER(get_window_shm)
+{
+    user_handle_t handle = 0;
+    struct window *win;
+    void *ptr;
+
+    if (!window_shm_mapping)
+    {
+        if (!(window_shm_mapping = create_shared_mapping( WINDOW_SHM_COUNT * sizeof(struct window_shm), &ptr )))
+            return;
+        make_object_static( window_shm_mapping );
+        window_shm_states = ptr;
+        while ((win = next_user_handle( &handle, USER_WINDOW ))) update_window_shm( win );
+    }
+    reply->handle = alloc_handle( current->process, window_shm_mapping, SECTION_MAP_READ | SECTION_QUERY, 0 );
 }
 
 
@@ -2086,6 +2165,8 @@ DECL_HANDLER(set_window_info)
     if (req->flags & SET_WIN_EXTRA) memcpy( win->extra_bytes + req->extra_offset,
                                             &req->extra_value, req->extra_size );
 
+    if (req->flags) update_window_shm( win );
+
     /* changing window style triggers a non-client paint */
     if (req->flags & SET_WIN_STYLE) win->paint_flags |= PAINT_NONCLIENT;
 }